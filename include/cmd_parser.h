@@ -2,17 +2,21 @@
 #define CMD_PARSER_H
 
 #include "ltf_log_level.h"
+#include "ltf_shard.h"
 #include "ltf_test_scenarios.h"
 
 #include "util/da.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     CMD_INIT,
     CMD_TEST,
     CMD_EVAL,
     CMD_LOGS_INFO,
+    CMD_LOGS_MERGE,
     CMD_HELP,
     CMD_TARGET_ADD,
     CMD_TARGET_REMOVE,
@@ -53,6 +57,29 @@ typedef struct {
 
     bool headless;
 
+    size_t jobs;
+
+    unsigned int tui_fps;
+
+    size_t test_mem_budget; // bytes of outputs kept in memory, 0 = unlimited
+    size_t run_mem_budget;  // bytes of outputs kept in memory, 0 = unlimited
+
+    bool profile;
+    unsigned int profile_hz;
+
+    uint64_t timeout_ms; // of tests without their own, 0 = none
+
+    bool no_cache; // do not use the bytecode cache and test index
+    bool no_index; // do not use the test index, load every test file
+
+    size_t shard_index; // 0-based
+    size_t shard_count; // 0 = not sharded
+    ltf_shard_by_t shard_by;
+    char *shard_timings; // raw log to balance durations with, NULL = none
+
+    bool rerun_failed;
+    char *rerun_log; // raw log of the failed tests, NULL = latest
+
     ltf_test_scenario_parsed_t scenario;
     bool scenario_parsed;
 } cmd_test_options;
@@ -66,6 +93,13 @@ typedef struct {
     bool internal_logging;
 } cmd_logs_info_options;
 
+typedef struct {
+    da_t *inputs; // raw log paths
+    char *output;
+
+    bool internal_logging;
+} cmd_logs_merge_options;
+
 typedef struct {
     char *target;
     bool internal_logging;
@@ -88,6 +122,7 @@ cmd_init_options *cmd_parser_get_init_options();
 cmd_config_options *cmd_parser_get_config_options();
 cmd_test_options *cmd_parser_get_test_options();
 cmd_logs_info_options *cmd_parser_get_logs_info_options();
+cmd_logs_merge_options *cmd_parser_get_logs_merge_options();
 cmd_target_add_options *cmd_parser_get_target_add_options();
 cmd_target_remove_options *cmd_parser_get_target_remove_options();
 cmd_eval_options *cmd_parser_get_eval_options();
@@ -95,5 +130,6 @@ cmd_eval_options *cmd_parser_get_eval_options();
 void cmd_parser_free_init_options();
 void cmd_parser_free_test_options();
 void cmd_parser_free_eval_options();
+void cmd_parser_free_logs_merge_options();
 
 #endif // CMD_PARSER_H
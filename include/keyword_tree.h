@@ -0,0 +1,39 @@
+#ifndef KEYWORD_TREE_H
+#define KEYWORD_TREE_H
+
+#include <stdint.h>
+
+typedef struct keyword_status keyword_status_t;
+
+struct keyword_status {
+    keyword_status_t *children;   // first child
+    keyword_status_t *last_child; // for appending in order
+    keyword_status_t *next;       // next sibling
+
+    const char *name; // interned in the owning tree
+    const char *file; // interned in the owning tree
+    int line;
+
+    uint64_t started_ns;  // monotonic_nanos()
+    uint64_t finished_ns; // 0 while still running
+};
+
+// Keywords of a single test. Nodes and strings live in one arena and are
+// released together with the tree.
+typedef struct keyword_tree keyword_tree_t;
+
+keyword_tree_t *keyword_tree_new(void);
+
+void keyword_tree_free(keyword_tree_t *tree);
+
+// Append a keyword under 'parent', NULL adds a top level keyword.
+// Returns NULL on OOM.
+keyword_status_t *keyword_tree_add(keyword_tree_t *tree,
+                                   keyword_status_t *parent, const char *name,
+                                   const char *file, int line,
+                                   uint64_t started_ns);
+
+// First top level keyword, the others follow through 'next'
+keyword_status_t *keyword_tree_roots(const keyword_tree_t *tree);
+
+#endif // KEYWORD_TREE_H
@@ -3,4 +3,7 @@
 
 int ltf_logs_info();
 
+// Combine the raw logs of the shards of a test run into one
+int ltf_logs_merge();
+
 #endif // LTF_LOGS_H
@@ -0,0 +1,29 @@
+#ifndef LTF_PROFILER_H
+#define LTF_PROFILER_H
+
+#include "ltf_state.h"
+
+#include <stdbool.h>
+
+// Sampling profiler for test bodies (ltf test --profile).
+//
+// The Lua stack is sampled from an instruction count hook and from returns
+// of C functions, so that time spent in C modules and sleeps is charged to
+// the C function instead of the next Lua line. Every test gets a collapsed
+// stacks file '<dir>/tests/<test>.folded' and the whole run '<dir>/all.folded'.
+
+// Create 'dir' and remember the sampling rate. Returns 0 on success.
+int ltf_profiler_init(const char *dir, unsigned int hz);
+
+bool ltf_profiler_enabled(void);
+
+// Profile the tests of 'state'. Must be called in every process that runs
+// tests, after lua_hooks_init().
+void ltf_profiler_attach(ltf_state_t *state);
+
+// Write the aggregate profile and print a summary with the overhead
+void ltf_profiler_finish(ltf_state_t *state);
+
+void ltf_profiler_free(void);
+
+#endif // LTF_PROFILER_H
@@ -0,0 +1,34 @@
+#ifndef LTF_SHARD_H
+#define LTF_SHARD_H
+
+#include "ltf_timings.h"
+
+#include "util/da.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Split of the tests of a run between several invocations of 'ltf test'.
+// Every test lands in exactly one shard. The split only depends on the test
+// names, their order and the timings, so every shard computes the same one.
+
+typedef enum {
+    LTF_SHARD_BY_HASH = 0,    // hash of the test name
+    LTF_SHARD_BY_ROUND_ROBIN, // position of the test in the run order
+    LTF_SHARD_BY_DURATION,    // balanced durations of a previous run
+} ltf_shard_by_t;
+
+// Parse "i/N" with 1 <= i <= N into a 0-based 'index'. Returns 0 on success.
+int ltf_shard_parse(const char *spec, size_t *index, size_t *count);
+
+// Returns -1 if 'str' is not one of "hash", "round-robin" or "duration"
+int ltf_shard_by_from_str(const char *str);
+
+// Set 'keep' (one entry per test_case_t of 'tests') for the tests of shard
+// 'index' of 'count'. 'timings' is only used to balance durations; tests it
+// does not know are given its mean duration.
+void ltf_shard_partition(da_t *tests, size_t index, size_t count,
+                         ltf_shard_by_t by, const ltf_timings_t *timings,
+                         bool *keep);
+
+#endif // LTF_SHARD_H
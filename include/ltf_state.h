@@ -1,6 +1,7 @@
 #ifndef RAW_LOG_H
 #define RAW_LOG_H
 
+#include "keyword_tree.h"
 #include "ltf_log_level.h"
 #include "test_case.h"
 
@@ -8,7 +9,10 @@
 
 #include <json.h>
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 typedef struct {
     char *file;
@@ -33,9 +37,26 @@ typedef enum {
     TEARDOWN_STAGE = 2U,
 } ltf_state_stage_t;
 
+// Filled by the sampling profiler (ltf test --profile) for the test body.
+// Samples are taken at the profiling rate and split by where they landed.
+typedef struct {
+    uint64_t samples;
+    uint64_t samples_c;     // inside C functions other than sleeps
+    uint64_t samples_sleep; // inside ltf.sleep()
+    uint64_t duration_ns;   // profiled time
+    uint64_t overhead_ns;   // time spent in the profiler itself
+} ltf_state_test_profile_t;
+
+// Run of outputs moved from memory to the spill file
+typedef struct {
+    long offset;  // position of the first record in the spill file
+    size_t count; // amount of records
+} ltf_state_spill_segment_t;
+
 typedef struct {
     char *name;
     char *description;
+    char *file; // that registered the test, relative to the project
     char *started;
     char *finished;
     char *teardown_start;
@@ -51,13 +72,30 @@ typedef struct {
     da_t *teardown_outputs;
     da_t *teardown_errors;
 
-    da_t *keyword_statuses;
+    keyword_tree_t *keywords;
+
+    // Oldest entries of 'outputs' end up here once an output memory budget
+    // is exceeded. Use ltf_state_test_foreach_output() to go over all of
+    // them.
+    FILE *spill_file;      // shared, owned by ltf_state_t
+    da_t *spilled_outputs; // ltf_state_spill_segment_t
+    size_t spilled_count;
+    size_t outputs_mem; // bytes held in memory by 'outputs'
+
+    ltf_state_test_profile_t profile; // all zero unless profiled
+
+    // From the start of the test until it completed (body, defer queue and
+    // hooks). Logs without it get the second resolution difference of
+    // 'started' and 'teardown_end' or 'finished', 0 if even that is unknown.
+    uint64_t started_ns;
+    uint64_t duration_ns;
 
 } ltf_state_test_t;
 
 typedef void (*test_run_cb)();
 typedef void (*test_cb)(ltf_state_test_t *);
 typedef void (*test_log_cb)(ltf_state_test_t *, ltf_state_test_output_t *);
+typedef void (*ltf_state_output_fn)(ltf_state_test_output_t *, void *ud);
 
 typedef struct {
     char *project_name;
@@ -86,6 +124,15 @@ typedef struct {
 
     ltf_state_stage_t current_stage;
 
+    size_t test_output_budget; // bytes, 0 = unlimited
+    size_t run_output_budget;  // bytes, 0 = unlimited
+    size_t outputs_mem;        // bytes of test outputs held in memory
+    size_t outputs_mem_peak;
+    size_t outputs_spilled; // bytes of test outputs moved to disk
+    FILE *spill_file;       // temporary, created on first spill
+    size_t spilled_tests;   // tests with outputs in 'spill_file'
+    bool spill_failed;
+
     da_t *hook_started_cbs;  // hook_cb
     da_t *hook_finished_cbs; // hook_cb
     da_t *hook_failed_cbs;   // hook_err_cb
@@ -102,12 +149,27 @@ typedef struct {
     da_t *test_teardown_finished_cbs; // test_cb
     da_t *test_defer_failed_cbs;      // test_log_cb
 
+    da_t *test_completed_cbs; // test_cb
+
 } ltf_state_t;
 
 json_object *ltf_state_to_json(ltf_state_t *log);
 
 ltf_state_t *ltf_state_from_json(json_object *obj);
 
+// Load a raw log file. Besides complete logs this also reads logs of runs
+// that were interrupted before the raw log was finalized.
+ltf_state_t *ltf_state_from_file(const char *path);
+
+// Run metadata only: everything ltf_state_to_json() outputs except "tests",
+// "finished" and the amounts
+json_object *ltf_state_header_to_json(ltf_state_t *state);
+
+// "finished" and the amounts, i.e. what ltf_state_header_to_json() leaves out
+json_object *ltf_state_footer_to_json(ltf_state_t *state);
+
+json_object *ltf_state_test_to_json(const ltf_state_test_t *test);
+
 ltf_state_t *ltf_state_new();
 
 void ltf_state_test_run_started(ltf_state_t *state);
@@ -119,7 +181,7 @@ void ltf_state_test_failed(ltf_state_t *state, const char *file, int line,
 
 void ltf_state_test_passed(ltf_state_t *state);
 
-void ltf_state_test_set_keyword_statuses(ltf_state_t *state, da_t *statuses);
+void ltf_state_test_set_keywords(ltf_state_t *state, keyword_tree_t *keywords);
 
 void ltf_state_test_defer_queue_finished(ltf_state_t *state);
 
@@ -133,8 +195,40 @@ void ltf_state_log(ltf_state_t *state, ltf_log_level level, const char *file,
 
 void ltf_state_test_started(ltf_state_t *state, test_case_t *test_case);
 
+// The test is fully done: body, defer queue and test finished hooks
+void ltf_state_test_completed(ltf_state_t *state);
+
+// Free outputs and keywords of a test that were already persisted elsewhere
+void ltf_state_test_release_outputs(ltf_state_t *state, ltf_state_test_t *test);
+
+// Like ltf_state_test_release_outputs(), failure reasons included, for tests
+// that live on elsewhere (e.g. sent by a worker to its parent)
+void ltf_state_test_release(ltf_state_t *state, ltf_state_test_t *test);
+
+// Call 'fn' for every output of the test in order, paging spilled ones back
+// from disk one at a time. Outputs passed to 'fn' are only valid during the
+// call.
+void ltf_state_test_foreach_output(const ltf_state_test_t *test,
+                                   ltf_state_output_fn fn, void *ud);
+
+size_t ltf_state_test_outputs_count(const ltf_state_test_t *test);
+
+// Write the test as a single line of JSON without building the whole
+// object in memory
+void ltf_state_test_write_json(const ltf_state_test_t *test, FILE *f);
+
 void ltf_state_free(ltf_state_t *state);
 
+// Serialize the test that is currently being executed (the last one added)
+json_object *ltf_state_current_test_to_json(ltf_state_t *state);
+
+// Append a finished test serialized with ltf_state_current_test_to_json()
+// (e.g. by a worker process) and replay its lifecycle callbacks
+void ltf_state_test_merge(ltf_state_t *state, json_object *obj);
+
+// Drop all registered test and hook callbacks
+void ltf_state_clear_cbs(ltf_state_t *state);
+
 void ltf_state_register_vars(ltf_state_t *ltf_state);
 
 void ltf_state_register_test_run_started_cb(ltf_state_t *state, test_run_cb cb);
@@ -149,5 +243,6 @@ void ltf_state_register_test_teardown_finished_cb(ltf_state_t *state,
                                                   test_cb cb);
 void ltf_state_register_test_defer_failed_cb(ltf_state_t *state,
                                              test_log_cb cb);
+void ltf_state_register_test_completed_cb(ltf_state_t *state, test_cb cb);
 
 #endif // RAW_LOG_H
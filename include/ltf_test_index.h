@@ -0,0 +1,42 @@
+#ifndef LTF_TEST_INDEX_H
+#define LTF_TEST_INDEX_H
+
+#include "util/da.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Names and tags of the tests every test file registers, kept across runs so
+// that runs selecting some of the tests only load the files that have them.
+// The entry of a file is only used while the file keeps the same modification
+// time and size, and while the run has the same 'context' (see
+// ltf_test_index_init()) as the run that indexed it.
+
+// Tells whether a test with 'name' and 'tags' (char *) would be run
+typedef bool (*ltf_test_index_filter_t)(const char *name, da_t *tags);
+
+// Read the index kept in 'path'. Files are given relative to 'project_path'.
+// An index of another 'context', e.g. a hash of the variables of the run and
+// of the project 'lib/' tree, is ignored. Returns 0 on success, the index starts empty otherwise.
+int ltf_test_index_init(const char *path, const char *project_path,
+                        uint64_t context);
+
+// Whether test file 'file' has to be loaded to get the tests 'wanted' accepts.
+// Files that are not indexed, or changed since, always have to.
+bool ltf_test_index_needs_file(const char *file,
+                               ltf_test_index_filter_t wanted);
+
+// Tests recorded from now on are registered by test file 'file', which gets
+// a new entry. NULL once it is loaded.
+void ltf_test_index_set_loading_file(const char *file);
+
+// Record a test registered by the file being loaded, if any
+void ltf_test_index_record(const char *name, da_t *tags);
+
+// Write the index back if it changed. Entries of files that no longer exist
+// are dropped. Returns 0 on success.
+int ltf_test_index_save(void);
+
+void ltf_test_index_free(void);
+
+#endif // LTF_TEST_INDEX_H
@@ -0,0 +1,54 @@
+#ifndef LTF_TIMINGS_H
+#define LTF_TIMINGS_H
+
+#include "ltf_state.h"
+
+#include "util/da.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Durations of the tests of previous runs, looked up by test name. They are
+// read from a raw log or from a timings file, which keeps the latest known
+// duration of every test across runs.
+
+typedef struct {
+    char *name;
+    uint64_t duration_ns;
+} ltf_timing_t;
+
+typedef struct {
+    ltf_timing_t *items; // sorted by name
+    size_t count;
+    uint64_t mean_ns; // of all known durations, 0 if there are none
+} ltf_timings_t;
+
+// Read the durations of a raw log or a timings file. Returns 0 on success,
+// 'timings' is left empty otherwise.
+int ltf_timings_load(ltf_timings_t *timings, const char *path);
+
+// Write 'timings' as a timings file. Returns 0 on success.
+int ltf_timings_save(const ltf_timings_t *timings, const char *path);
+
+// Take the durations of the tests that completed in 'state'. A failed test
+// only replaces a shorter duration, it usually stopped early.
+void ltf_timings_update(ltf_timings_t *timings, ltf_state_t *state);
+
+// Duration of test 'name', false if it is unknown
+bool ltf_timings_find(const ltf_timings_t *timings, const char *name,
+                      uint64_t *duration_ns);
+
+// Duration of test 'name', the mean duration if it is unknown, or 1 ns if
+// no duration is known at all so that every test counts the same
+uint64_t ltf_timings_estimate(const ltf_timings_t *timings, const char *name);
+
+// Fill 'order' with the indexes of 'tests' (test_case_t), longest estimated
+// duration first. Tests of the same duration are ordered by name, then by
+// index.
+void ltf_timings_longest_first(const ltf_timings_t *timings, da_t *tests,
+                               size_t *order);
+
+void ltf_timings_free(ltf_timings_t *timings);
+
+#endif // LTF_TIMINGS_H
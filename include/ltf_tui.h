@@ -3,6 +3,10 @@
 
 #include "ltf_state.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // UI initialization
 int ltf_tui_init(ltf_state_t *state);
 
@@ -16,6 +20,18 @@ void tui_render_result(void *ud);
 
 void ltf_tui_set_test_progress(double progress);
 
-void ltf_tui_set_current_line(const char *file, int line, const char *line_str);
+// Estimated durations of the tests in run order, shown as the ETA of the
+// run. 'jobs' tests run at the same time. Not shown if never set.
+void ltf_tui_set_estimates(const uint64_t *estimates_ns, size_t count,
+                           size_t jobs);
+
+// Whether the panel wants the next executed line, at most once per frame (see
+// --tui-fps). Line hooks return early otherwise, before looking at the line.
+bool ltf_tui_line_wanted(void);
+
+// Report the currently executed line; the panel picks it up at most once per
+// frame (see --tui-fps)
+void ltf_tui_set_current_line(const char *file, int line, const char *line_str,
+                              size_t line_len);
 
 #endif // LTF_TUI_H
@@ -0,0 +1,36 @@
+#ifndef LTF_WATCHDOG_H
+#define LTF_WATCHDOG_H
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deadline of the running test. Once it passes, a watchdog thread flags the
+// test as timed out and a count hook raises a timeout error in its Lua code.
+// Blocking calls of the C modules wait no longer than the deadline, see
+// ltf_watchdog_clamp_ms(), and raise the same error with
+// ltf_watchdog_check().
+
+// Give the running test 'timeout_ms' from now, 0 for no deadline. The count
+// hook needs lua_hooks_init(). Returns 0 on success.
+int ltf_watchdog_arm(uint64_t timeout_ms);
+
+// Remove the deadline, e.g. before the defer queue runs
+void ltf_watchdog_disarm(void);
+
+// Whether the deadline of the running test passed
+bool ltf_watchdog_expired(void);
+
+// Timeout for a wait of 'timeout_ms' (negative: no limit) that ends at the
+// deadline, 1 ms at least so that it never turns into a wait without limit.
+// Non-blocking waits (0) stay non-blocking.
+int ltf_watchdog_clamp_ms(int timeout_ms);
+
+// Raise the timeout error if the deadline passed, return otherwise
+void ltf_watchdog_check(lua_State *L);
+
+// Stop the watchdog thread
+void ltf_watchdog_free(void);
+
+#endif // LTF_WATCHDOG_H
@@ -0,0 +1,30 @@
+#ifndef LTF_WORKERS_H
+#define LTF_WORKERS_H
+
+#include "ltf_state.h"
+#include "test_case.h"
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Called once inside every freshly forked worker before it takes any tests
+typedef void (*ltf_worker_init_fn)(lua_State *L, ltf_state_t *state);
+
+// Runs a single test (hooks, body and defer queue) inside a worker
+typedef void (*ltf_worker_test_fn)(lua_State *L, ltf_state_t *state,
+                                   test_case_t *tc);
+
+// Fork 'jobs' workers sharing the already loaded Lua state 'L', hand them
+// tests from test_case_get_all() one at a time and merge the results back
+// into 'state' in the original test order.
+// Tests are handed out in 'order' (indexes into test_case_get_all()), or in
+// the test order if it is NULL.
+// Stops handing out new tests once '*interrupted' becomes true.
+// Returns 0 on success, -1 if worker processes could not be started.
+int ltf_workers_run(lua_State *L, ltf_state_t *state, size_t jobs,
+                    const size_t *order, ltf_worker_init_fn init,
+                    ltf_worker_test_fn run_test, volatile bool *interrupted);
+
+#endif // LTF_WORKERS_H
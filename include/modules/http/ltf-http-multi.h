@@ -0,0 +1,63 @@
+#ifndef MODULE_HTTP_MULTI_H
+#define MODULE_HTTP_MULTI_H
+
+#include "modules/http/ltf-http.h"
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include <curl/curl.h>
+
+#include <stddef.h>
+
+// Runs many easy handles concurrently on one curl multi handle. Transfers
+// progress only while the batch is waited on (next/perform), the existing
+// Lua callbacks of every handle are called from there.
+
+struct l_module_http_multi {
+    CURLM *m;
+    l_module_http_t **handles; // attached easy handles
+    size_t handles_count;
+    size_t handles_cap;
+    size_t added; // handles submitted so far, gives their index
+    int running;  // transfers curl still works on
+};
+
+#define HTTP_MULTI_MT "ltf-http-multi"
+
+/******************* API START ***********************/
+
+// http.multi(opts?) -> multi
+// opts:
+// - max_connections: integer?, limit of simultaneously open connections
+int l_module_http_multi_new(lua_State *L);
+
+// multi:add(handle, fetch_opts?) -> multi
+// With fetch_opts the response is collected as by handle:fetch()
+int l_module_http_multi_add(lua_State *L);
+
+// multi:next(timeout_ms?) -> result?
+// result: {handle, index, ok, error?, status, headers?, body?}
+// Waits for the next transfer to complete, nil when none is left or the
+// timeout expired. timeout_ms < 0 or nil waits forever.
+int l_module_http_multi_next(lua_State *L);
+
+// multi:perform() -> [result]
+// Completes every remaining transfer, results are in submission order.
+int l_module_http_multi_perform(lua_State *L);
+
+// multi:pending() -> integer
+int l_module_http_multi_pending(lua_State *L);
+
+// multi:close()
+int l_module_http_multi_close(lua_State *L);
+
+/******************* API END *************************/
+
+// Detach an easy handle from its batch, e.g. before it is cleaned up
+void http_multi_detach(l_module_http_t *ud);
+
+int l_module_register_http_multi(lua_State *L);
+
+#endif // MODULE_HTTP_MULTI_H
@@ -0,0 +1,21 @@
+#ifndef MODULE_HTTP_POOL_H
+#define MODULE_HTTP_POOL_H
+
+#include <curl/curl.h>
+
+// Process-wide pool of easy handles attached to one share object holding the
+// DNS cache, the connection cache and TLS sessions, so that keep-alive works
+// across handles, commands and tests. Handles are reset with curl_easy_reset()
+// when returned. State inherited through fork() is abandoned, the parent
+// still owns the connections.
+
+// Take an idle handle or create one, attached to the share. NULL on error.
+CURL *http_pool_checkout(void);
+
+// Reset a handle and keep it for later use, or free it if the pool is full
+void http_pool_checkin(CURL *h);
+
+// Free every idle handle and the share, once no handle is checked out
+void http_pool_clear(void);
+
+#endif // MODULE_HTTP_POOL_H
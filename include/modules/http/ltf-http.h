@@ -5,14 +5,38 @@
 #include <lua.h>
 #include <lualib.h>
 
+#include "util/byte_buf.h"
+
 #include <curl/curl.h>
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define HTTP_HANDLE_MT "ltf-http"
+
+typedef struct l_module_http_multi l_module_http_multi_t;
+
+// Response collected in C by fetch(), instead of per-chunk Lua callbacks
+typedef struct {
+    bool active;
+    byte_buf_t body;
+    byte_buf_t headers; // raw header lines of every response received
+    FILE *file;         // the body goes here instead, if set
+    bool write_failed;
+} http_collect_t;
+
 typedef struct {
     CURL *h;
     struct curl_slist *headers; // current header list (nullable)
     int write_ref;              // Lua registry ref for write callback
     int read_ref;               // idem for read callback
     lua_State *mainL;           // the "main" Lua state
+
+    l_module_http_multi_t *multi; // batch running the transfer (nullable)
+    size_t multi_index;           // submission order within 'multi'
+
+    http_collect_t collect;
 } l_module_http_t;
 
 /******************* API START ***********************/
@@ -27,8 +51,25 @@ int l_module_http_setopt(lua_State *L);
 // handle:perform(self:handle)
 int l_module_http_perform(lua_State *L);
 
+// handle:fetch(self:handle, opts:fetch_opts?) -> response
+// fetch_opts:
+// - file: string?, write the body to this file instead of returning it
+// response: {status, headers:{[lowercase name]=value}, body:string?}
+int l_module_http_fetch(lua_State *L);
+
 /******************* API END *************************/
 
+// Collect the response of the next transfer, opts at 'opts_idx' (may be
+// none). Raises a Lua error on failure.
+void http_collect_begin(lua_State *L, l_module_http_t *ud, int opts_idx);
+
+// Set "status", "headers" and "body" on the table at 'idx' and stop
+// collecting. Returns false if the body could not be written to the file.
+bool http_collect_finish(lua_State *L, l_module_http_t *ud, int idx);
+
+// Stop collecting, drop what was collected
+void http_collect_abort(l_module_http_t *ud);
+
 // Register "ltf-http" module
 int l_module_http_register_module(lua_State *L);
 
@@ -0,0 +1,64 @@
+#ifndef MODULE_JSON_CODEC_H
+#define MODULE_JSON_CODEC_H
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Single pass JSON codec working directly on Lua values, without building a
+// json-c object tree. Output and accepted input match json-c: the compact
+// format of json_object_to_json_string_ext() and the non-strict syntax of
+// json_tokener_parse() (trailing commas, comments, single quoted strings,
+// NaN and Infinity).
+
+#define JSON_CODEC_MT "ltf-json-codec-buffer"
+
+#define JSON_MAX_DEPTH 1000
+
+// Push the compact JSON encoding of the value at 'idx'. Slashes are escaped
+// only if 'escape_slash'. Raises a Lua error on cycles or too deep nesting.
+void json_codec_encode(lua_State *L, int idx, bool escape_slash);
+
+// Push the Lua value of the JSON document 's'. Raises a Lua error if it is
+// invalid.
+void json_codec_decode(lua_State *L, const char *s, size_t len);
+
+/*----------- decoder internals, shared with ltf-json-query ----------*/
+
+typedef struct {
+    lua_State *L;
+    const char *start;
+    const char *p;
+    const char *end;
+    int depth;
+} json_dec_t;
+
+// Raise "json-deserialize: <what> at offset N", N being the current offset
+void json_dec_error(json_dec_t *d, const char *what);
+
+// Skip whitespace and comments
+void json_dec_skip_ws(json_dec_t *d);
+
+// Decode the next value and push it
+void json_dec_value(json_dec_t *d);
+
+// Decode the string after its opening 'quote' and push it
+void json_dec_string(json_dec_t *d, char quote);
+
+// Move past the string after its opening 'quote'
+void json_dec_skip_string(json_dec_t *d, char quote);
+
+// Move past the string key after its opening 'quote', true if it is 'name'
+bool json_dec_key_equals(json_dec_t *d, char quote, const char *name,
+                         size_t len);
+
+// Move past the next value without decoding it. Only strings and the
+// nesting of brackets are checked.
+void json_dec_skip_value(json_dec_t *d);
+
+int l_module_register_json_codec(lua_State *L);
+
+#endif // MODULE_JSON_CODEC_H
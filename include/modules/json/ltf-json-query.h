@@ -0,0 +1,27 @@
+#ifndef MODULE_JSON_QUERY_H
+#define MODULE_JSON_QUERY_H
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include <stddef.h>
+
+// Selection of values in a JSON document without decoding all of it. The
+// text is scanned once: subtrees that cannot match are skipped without
+// creating any Lua value, only the selected values are decoded.
+
+// Push the value at JSON pointer 'ptr' (RFC 6901, e.g. "/data/items/3/id",
+// array indices start at 0) and whether it exists. The scan stops at the
+// first match.
+void json_query_pointer(lua_State *L, const char *s, size_t len,
+                        const char *ptr, size_t ptr_len);
+
+// Push the array of values matched by the JSONPath 'path', in document
+// order, and the number of matches (matched 'null's leave nil holes in the
+// array). Supported: '$', '.name', '['name']', '[n]', '[start:end]', '*' and
+// '..' (recursive descent).
+void json_query_path(lua_State *L, const char *s, size_t len,
+                     const char *path, size_t path_len);
+
+#endif // MODULE_JSON_QUERY_H
@@ -13,6 +13,12 @@ int l_module_json_serialize(lua_State *L);
 // json:deserialize(str:string) -> table
 int l_module_json_deserialize(lua_State *L);
 
+// json:query(str:string, pointer:string) -> any, boolean
+int l_module_json_query(lua_State *L);
+
+// json:query_path(str:string, path:string) -> table
+int l_module_json_query_path(lua_State *L);
+
 /******************* API END *************************/
 
 // Register "ltf-json" module
@@ -5,6 +5,10 @@
 #include <lua.h>
 #include <lualib.h>
 
+#include "util/byte_buf.h"
+
+#include <stdbool.h>
+
 #if defined(_WIN32) || defined(_WIN64)
 #define NOMINMAX
 #include <windows.h>
@@ -16,16 +20,20 @@ typedef pid_t ltf_pid_t;
 #endif
 
 typedef struct {
-    pid_t pid;
+    pid_t pid; // 0 once the child has been reaped
+    int pidfd; // readable when the child exits, -1 if not supported
 
-    FILE *in;
-    FILE *out;
-    FILE *err;
+    bool exited;
+    int exitcode;
 
     int pin[2];
     int pout[2];
     int perr[2];
 
+    // Output drained by the reactor, not yet returned by read()
+    byte_buf_t out;
+    byte_buf_t err;
+
 } l_module_proc_t;
 
 /******************* API START ***********************/
@@ -33,13 +41,14 @@ typedef struct {
 // proc:spawn(argc:[string]) -> proc_handle
 int l_module_proc_spawn(lua_State *L);
 
-// proc_handle:read(self: proc_handle, want:integer=4096) -> string
+// proc_handle:read(self: proc_handle, stream:string="stdout",
+//                  want:integer=4096) -> string
 int l_module_proc_read(lua_State *L);
 
 // proc_handle:write(self: proc_handle, buf:string) -> integer
 int l_module_proc_write(lua_State *L);
 
-// proc_handle:wait(self: proc_handle) -> integer
+// proc_handle:wait(self: proc_handle, timeout_ms:integer=0) -> integer?
 int l_module_proc_wait(lua_State *L);
 
 // proc_handle:kill(self: proc_handle)
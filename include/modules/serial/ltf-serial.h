@@ -7,8 +7,14 @@
 
 #include <libserialport.h>
 
+#include "util/byte_buf.h"
+
 typedef struct {
     struct sp_port *port;
+
+    // Input received but not yet returned to Lua, e.g. what followed the
+    // pattern of read_until()
+    byte_buf_t rx;
 } l_module_serial_t;
 
 /******************* API START ***********************/
@@ -66,6 +72,17 @@ int l_module_serial_read_blocking(lua_State *L);
 // ) -> string read
 int l_module_serial_read_nonblocking(lua_State *L);
 
+// read_until_opts:
+// - pattern: string="\n"
+// - timeout: integer=200 (ms)
+// - chunk_size: integer=4096
+
+// port:read_until(
+//     self:port,
+//     opts:read_until_opts?
+// ) -> boolean found, string read
+int l_module_serial_read_until(lua_State *L);
+
 // port:set_baudrate(self:port, baudrate:integer)
 int l_module_serial_set_baudrate(lua_State *L);
 
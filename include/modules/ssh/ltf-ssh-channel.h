@@ -6,10 +6,15 @@
 #include <lua.h>
 #include <lualib.h>
 #include <modules/ssh/ltf-ssh-session.h>
+#include <util/byte_buf.h>
 
 typedef struct {
     LIBSSH2_CHANNEL *channel;
     l_ssh_session_t *session;
+
+    // Data read past the pattern of read_until(), returned by the next reads
+    byte_buf_t out;
+    byte_buf_t err;
 } l_ssh_channel_t;
 
 #define SSH_CHANNEL_MT "ltf-ssh-channel"
@@ -33,6 +38,13 @@ int l_module_ssh_channel_process_startup(lua_State *L);
 int l_module_ssh_channel_read(lua_State *L);
 int l_module_ssh_channel_read_ex(lua_State *L);
 int l_module_ssh_channel_read_stderr(lua_State *L);
+
+// channel:read_until(
+//     pattern:string="\n",
+//     timeout:integer=200,
+//     stream:string="stdout"
+// ) -> boolean found, string read
+int l_module_ssh_channel_read_until(lua_State *L);
 int l_module_ssh_channel_receive_window_adjust(lua_State *L);
 int l_module_ssh_channel_request_auth_agent(lua_State *L);
 
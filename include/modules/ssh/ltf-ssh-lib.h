@@ -8,6 +8,8 @@
 #define SSH_LIBMOD_MT "ltf-ssh-libmod"
 #define SSH_LIB_MT "ltf-ssh"
 
+#define SSH_SESSION_TIMEOUT_MS 60000
+
 static const struct {
     int code;
     const char *name;
@@ -86,6 +88,18 @@ int l_module_ssh_trace_sethandler(lua_State *L); // Do not use
 
 const char *ssh_err_to_str(int code);
 
+// Wait at most 'timeout_ms' (-1: no limit) for the session socket to become
+// ready in the direction a non-blocking libssh2 call is blocked on. Never
+// waits past the deadline of the running test. Returns -1 on error.
+int ssh_wait_socket(LIBSSH2_SESSION *session, libssh2_socket_t sock,
+                    int timeout_ms);
+
+// Blocking libssh2 calls wait up to the session timeout. Between these two
+// it ends at the deadline of the running test at the latest; failed calls
+// raise the timeout error with ltf_watchdog_check() once it passed.
+void ssh_session_begin_call(LIBSSH2_SESSION *session);
+void ssh_session_end_call(LIBSSH2_SESSION *session);
+
 int l_module_ssh_socket_connect(lua_State *L);
 
 int l_module_ssh_register_module(lua_State *L);
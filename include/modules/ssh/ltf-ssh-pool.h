@@ -0,0 +1,30 @@
+#ifndef MODULE_SSH2_POOL_H
+#define MODULE_SSH2_POOL_H
+
+#include <libssh2.h>
+
+#include <stdbool.h>
+
+// Process-wide pool of idle, authenticated sessions keyed by host, port and
+// credentials, so that the handshake is paid once per run instead of once
+// per test. Sessions are returned by session:close() and handed out again by
+// session:connect(). Entries inherited through fork() are dropped without
+// talking to the server, the parent still owns the connection.
+
+#define SSH_POOL_KEEPALIVE_INTERVAL 30 // seconds
+
+// Take a healthy idle session matching the key, false if there is none
+bool ssh_pool_checkout(const char *ip, int port, const char *user,
+                       const char *password, LIBSSH2_SESSION **session,
+                       libssh2_socket_t *sock);
+
+// Keep a connected session for later use. Returns false if the pool does not
+// take it (full or the connection looks dead): the caller still owns it.
+bool ssh_pool_checkin(const char *ip, int port, const char *user,
+                      const char *password, LIBSSH2_SESSION *session,
+                      libssh2_socket_t sock);
+
+// Disconnect and free every idle session, before libssh2_exit()
+void ssh_pool_clear(void);
+
+#endif // MODULE_SSH2_POOL_H
@@ -7,6 +7,8 @@
 #include <lualib.h>
 #include <util/da.h>
 
+#include <stdbool.h>
+
 typedef enum {
     SSH_AUTH_USERPASS,
 } l_ssh_session_auth_method;
@@ -28,6 +30,9 @@ typedef struct {
         l_ssh_session_auth_userpass_t userpass;
     };
     da_t *active_channels;
+    da_t *active_sftp; // l_sftp_session_t *, shut down before close/checkin
+
+    bool pooled; // connect() and close() go through the session pool
 } l_ssh_session_t;
 
 #define SSH_SESSION_MT "ltf-ssh-session"
@@ -38,7 +43,8 @@ typedef struct {
 //      ip:string,
 //      port:integer,
 //      user:string,
-//      password:string
+//      password:string,
+//      pooled:boolean=false
 // )
 int l_module_ssh_session_init_userpass(lua_State *L);
 
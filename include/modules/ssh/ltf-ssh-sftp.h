@@ -2,6 +2,8 @@
 #ifndef MODULE_SSH2_SFTP_H
 #define MODULE_SSH2_SFTP_H
 
+#include "modules/ssh/ltf-ssh-session.h"
+
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
@@ -12,10 +14,24 @@ typedef struct {
     LIBSSH2_SFTP *sftp_session;
     LIBSSH2_SFTP_HANDLE *sftp_handle;
     LIBSSH2_SESSION *session;
+    libssh2_socket_t sock_fd;
+    l_ssh_session_t *owner; // listed in owner->active_sftp while alive
 } l_sftp_session_t;
 
 #define SFTP_SESSION_MT "ltf-sftp-session"
 
+// transfer_opts:
+// - flags: integer=WRITE|CREAT|TRUNC (upload only)
+// - permissions: integer=0644
+// - window: integer=1MiB, bytes kept in flight
+// - progress: fun(done:integer, total:integer)?
+
+// sftp:upload(local:string, remote:string, opts:transfer_opts?) -> integer
+int l_module_ssh_sftp_upload(lua_State *L);
+
+// sftp:download(remote:string, local:string, opts:transfer_opts?) -> integer
+int l_module_ssh_sftp_download(lua_State *L);
+
 int l_module_ssh_sftp_close(lua_State *L);
 int l_module_ssh_sftp_close_handle(lua_State *L);
 int l_module_ssh_sftp_closedir(lua_State *L);
@@ -58,4 +74,9 @@ int l_module_ssh_sftp_unlink(lua_State *L);
 int l_module_ssh_sftp_unlink_ex(lua_State *L);
 int l_module_ssh_sftp_write(lua_State *L);
 int l_module_register_ssh_sftp(lua_State *L);
+
+// Shut down every SFTP session still open on 's', so that the SSH session can
+// be freed or handed to the pool without SFTP state pointing into it
+void ssh_sftp_shutdown_all(l_ssh_session_t *s);
+
 #endif // MODULE_SSH2_SFTP_H
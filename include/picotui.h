@@ -25,6 +25,8 @@ void pico_install_sigint_handler(pico_t *ui);
    Clamped to [1, rows-1]. Reapplies scroll region and redraws UI. */
 void pico_set_ui_rows(pico_t *ui, int ui_rows);
 
+/* Stream output is buffered until the next pico_flush()/pico_present(). */
+
 /* Print text above UI without automatic newline */
 void pico_print(pico_t *ui, const char *text);
 
@@ -42,9 +44,17 @@ void pico_printfln(pico_t *ui, const char *fmt, ...)
 /* Print a block (may contain '\n'); split & print per line. */
 void pico_print_block(pico_t *ui, const char *block);
 
-/* Force UI redraw (calls render callback). */
+/* Force UI redraw: clears the back-buffer, calls the render callback and
+   presents the result. */
 void pico_redraw_ui(pico_t *ui);
 
+/* Present the back-buffer: emit only the UI cells that changed since the
+   previous frame, together with any pending stream output, in one write. */
+void pico_present(pico_t *ui);
+
+/* Write out pending stream output without touching the UI region. */
+void pico_flush(pico_t *ui);
+
 /* Remove and Restore cursor in UI. */
 void pico_remove_cursor();
 void pico_restore_cursor();
@@ -57,7 +67,8 @@ void pico_free(pico_t *ui);
 int pico_ui_rows(const pico_t *ui);
 int pico_cols(const pico_t *ui);
 
-/* UI-region writes */
+/* UI-region writes; they draw into the back-buffer and reach the terminal
+   on the next pico_present()/pico_redraw_ui() */
 void pico_ui_puts_yx(pico_t *ui, int rel_row, int col, const char *s);
 void pico_ui_puts(pico_t *ui, const char *s);
 void pico_ui_printf_yx(pico_t *ui, int rel_row, int col, const char *fmt, ...)
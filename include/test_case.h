@@ -7,20 +7,38 @@
 
 #include <lauxlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct {
     const char *name; /* test name           */
     const char *desc; /* test description    */
     da_t *tags;       /* test tags           */
     int ref;          /* reference to Lua fn */
+    const char *file; /* registering file    */
+    int64_t timeout;  /* ms, 0: none, -1: default of the run */
 } test_case_t;
 
 int test_case_enqueue(lua_State *L, test_case_t *tc);
 
+// Tests enqueued from now on were registered by 'file' (relative to the
+// project), NULL once it is loaded
+void test_case_set_loading_file(const char *file);
+
+// Only enqueue the tests named in 'names' (char *, kept by the caller),
+// NULL to enqueue all of them again
+void test_case_set_only(da_t *names);
+
+// Whether a test with 'name' and 'tags' (char *) would be run: it is
+// selected, has one of the tags of the run and is part of the scenario order
+bool test_case_is_wanted(const char *name, da_t *tags);
+
 void test_case_order_tests();
 
 da_t *test_case_get_all();
 
+// Drop the tests whose entry of 'keep' (one per test, in order) is false
+void test_case_retain(lua_State *L, const bool *keep);
+
 void test_case_free_all(lua_State *L);
 
 #endif // TESTS_H
@@ -0,0 +1,17 @@
+#ifndef UTIL_ARENA_H
+#define UTIL_ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: allocations are only released all at once by arena_free()
+typedef struct arena_t arena_t;
+
+arena_t *arena_init(size_t block_size); // 0 = default block size
+void arena_free(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size); // zeroed, NULL on OOM
+char *arena_strndup(arena_t *arena, const char *s, size_t len);
+
+size_t arena_used(const arena_t *arena);
+
+#endif // UTIL_ARENA_H
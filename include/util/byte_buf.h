@@ -0,0 +1,37 @@
+#ifndef UTIL_BYTE_BUF_H
+#define UTIL_BYTE_BUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Growable byte queue: appended at the end, consumed from the front. Space
+// freed at the front is reclaimed when the buffer would otherwise grow.
+typedef struct {
+    char *data;
+    size_t start;
+    size_t len;
+    size_t cap;
+} byte_buf_t;
+
+#define BYTE_BUF_INIT {0}
+
+size_t byte_buf_size(const byte_buf_t *b);
+const char *byte_buf_data(const byte_buf_t *b); // never NULL
+
+// Make room for 'extra' bytes at byte_buf_tail(), false on OOM
+bool byte_buf_reserve(byte_buf_t *b, size_t extra);
+char *byte_buf_tail(byte_buf_t *b);
+void byte_buf_commit(byte_buf_t *b, size_t n); // n bytes written at tail
+
+bool byte_buf_append(byte_buf_t *b, const void *data, size_t n);
+void byte_buf_consume(byte_buf_t *b, size_t n);
+void byte_buf_truncate(byte_buf_t *b, size_t n); // keep the first n bytes
+void byte_buf_free(byte_buf_t *b);
+
+// Incremental search for 'pat'. '*scanned' holds how many leading bytes are
+// known not to start a match, start with 0 and keep it while only appending.
+// Returns the length up to the end of the match, 0 if not found yet.
+size_t byte_buf_find(const byte_buf_t *b, const char *pat, size_t pat_len,
+                     size_t *scanned);
+
+#endif // UTIL_BYTE_BUF_H
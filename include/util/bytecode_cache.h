@@ -0,0 +1,25 @@
+#ifndef UTIL_BYTECODE_CACHE_H
+#define UTIL_BYTECODE_CACHE_H
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+// Cache of compiled Lua chunks (lua_dump() output, debug info included).
+// Entries are keyed by the source path and only used while the source still
+// has the same mtime and size, otherwise the source is compiled again and
+// the entry replaced.
+
+// Keep the cache in 'dir', created if needed. Returns 0 on success, the
+// cache stays disabled otherwise.
+int bytecode_cache_init(const char *dir);
+
+// Same as luaL_loadfile(), through the cache if it is enabled
+int bytecode_cache_loadfile(lua_State *L, const char *path);
+
+// Make require() load Lua modules found in package.path through the cache
+void bytecode_cache_install_searcher(lua_State *L);
+
+void bytecode_cache_free(void);
+
+#endif // UTIL_BYTECODE_CACHE_H
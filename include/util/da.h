@@ -19,6 +19,7 @@ void *da_get(da_t *da, size_t index);              // NULL if OOB
 const void *da_cget(const da_t *da, size_t index); // const view, NULL if OOB
 bool da_set(da_t *da, size_t index, const void *elem);
 bool da_remove(da_t *da, size_t index);
+bool da_remove_range(da_t *da, size_t index, size_t count);
 bool da_pop(da_t *da, size_t index, void *out);
 
 size_t da_size(const da_t *da);
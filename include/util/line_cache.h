@@ -1,14 +1,21 @@
 #ifndef LINE_CACHE_H
 #define LINE_CACHE_H
 
-#include <stdlib.h>
+#include <stddef.h>
 
-typedef struct line_cache {
-    char *path;
-    char **lines;
-    struct line_cache *next;
-} line_cache_t;
+// Source lines for the line hook. Files are read once and indexed by line
+// offsets, lookups do not allocate. A file that changed on disk (inode, size
+// or modification time) is read again, checked at most every 100 ms.
+// The returned text points into the cached copy: it is not NUL terminated,
+// excludes the line ending and stays valid until the next lookup.
+// Returns NULL if the file cannot be read or 'lineno' (1-based) is out of
+// range.
+const char *get_line_text(const char *path, int lineno, size_t *len);
 
-char *get_line_text(const char *path, int lineno);
+// Drop the cached copy of a file, e.g. because it is about to be loaded
+// again, the next lookup reads it without waiting for the periodic check
+void line_cache_invalidate(const char *path);
+
+void line_cache_free(void);
 
 #endif // LINE_CACHE_H
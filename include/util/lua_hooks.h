@@ -9,8 +9,25 @@
 
 typedef void (*lua_hook_fn)(lua_State *L, lua_Debug *ar, const char *src);
 
+// Register a hook for a LUA_HOOK* event. The matching LUA_MASK* bit is only
+// enabled while at least one hook of that type is registered.
 void lua_hooks_add(int type, lua_hook_fn fn);
 
+void lua_hooks_remove(int type, lua_hook_fn fn);
+
+// Same as lua_hooks_add(), but the hook also fires for C functions and
+// sources outside of the whitelist, e.g. for profiling. LUA_HOOKCOUNT is
+// only available here and gets a NULL 'src'.
+void lua_hooks_add_unfiltered(int type, lua_hook_fn fn);
+
+void lua_hooks_remove_unfiltered(int type, lua_hook_fn fn);
+
+// Amount of VM instructions between LUA_HOOKCOUNT events
+void lua_hooks_set_count(int count);
+
+// Hooks only fire for sources starting with one of 'file_whitelist'
+// entries. The decision is cached per source, so the whitelist must not
+// change until the next lua_hooks_init().
 void lua_hooks_init(lua_State *L, da_t *file_whitelist);
 
 void lua_hooks_deinit();
@@ -13,6 +13,13 @@ char *string_join(char *items[], size_t count);
 
 char *string_strip(const char *s);
 
+// Same as string_strip() for the first 's_len' bytes of 's', which does not
+// need to be NUL terminated
+char *string_strip_len(const char *s, size_t s_len);
+
 bool string_has_prefix(const char *str, const char *prefix);
 
+// Human readable size, e.g. "512 B", "3.2 KiB", "1.5 GiB"
+void string_format_bytes(size_t bytes, char *buf, size_t buf_len);
+
 #endif // UTIL_STRING_H
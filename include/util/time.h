@@ -1,13 +1,38 @@
 #ifndef UTIL_TIME_H
 #define UTIL_TIME_H
 
+#include <stdint.h>
+
 void reset_millis(void);
 unsigned long millis_since_start(void);
 void reset_ltf_start_millis(void);
 unsigned long millis_since_ltf_start(void);
 
+// Monotonic clock reading in nanoseconds, only meaningful as a difference
+uint64_t monotonic_nanos(void);
+
+// Milliseconds left until a monotonic_nanos() deadline, rounded up and at
+// most INT_MAX, 0 once it has passed
+unsigned int millis_until(uint64_t deadline_ns);
+
 #define TS_LEN 18 // "MM.DD.YY-HH:mm:ss" + '\0'
 
 void get_date_time_now(char buf[TS_LEN]);
 
+// Wall clock date of a monotonic_nanos() reading, same format as
+// get_date_time_now()
+void monotonic_to_date_time(uint64_t ns, char buf[TS_LEN]);
+
+// Nanoseconds since the Unix epoch of a monotonic_nanos() reading. Wrapping
+// arithmetic: dates before boot map to "negative" readings. Unlike monotonic
+// readings, these stay valid across reboots and machines.
+int64_t monotonic_to_epoch_nanos(uint64_t ns);
+
+// Inverse of monotonic_to_epoch_nanos(), never 0
+uint64_t epoch_nanos_to_monotonic(int64_t epoch_ns);
+
+// Inverse of monotonic_to_date_time() with second resolution, 0 if 'str'
+// cannot be parsed
+uint64_t date_time_to_monotonic(const char *str);
+
 #endif // UTIL_TIME_H
@@ -7,10 +7,20 @@ M.low = http
 --- @alias setoptfunc fun(self: http_handle, curlopt: integer, value: boolean|integer|string|[string]|function): http_handle
 --- @alias performfunc fun(self:http_handle)
 --- @alias cleanupfunc fun(self:http_handle)
+--- @alias fetchfunc fun(self:http_handle, opts: http_fetch_opts?): http_response
+
+--- @class http_fetch_opts
+--- @field file string? write the body to this file instead of returning it
+
+--- @class http_response
+--- @field status integer HTTP response code
+--- @field headers table<string, string> headers of the final response, names in lowercase
+--- @field body string? response body, nil if written to a file
 
 --- @class http_handle
 --- @field setopt setoptfunc pretty much cURL easy setopt (chainable)
 --- @field perform performfunc pretty much cURL easy perform
+--- @field fetch fetchfunc perform and collect status, headers and body in C
 --- @field cleanup cleanupfunc cleanup after done using (also invoked by GC)
 
 --- @return http_handle
@@ -18,6 +28,60 @@ M.new = function()
 	return http:new()
 end
 
+--- @class http_multi_result
+--- @field handle http_handle
+--- @field index integer position in which the handle was added, starting at 1
+--- @field ok boolean whether the transfer completed
+--- @field error string? curl error message if not ok
+--- @field status integer HTTP response code, 0 if no response was received
+--- @field headers table<string, string>? collected headers if added with fetch opts
+--- @field body string? collected body if added with fetch opts
+
+--- @class http_multi_opts
+--- @field max_connections integer? limit of simultaneously open connections
+
+--- @class http_multi
+--- @field add fun(self: http_multi, handle: http_handle, fetch_opts: http_fetch_opts?): http_multi add a configured handle to the batch (chainable), with fetch_opts its response is collected as by fetch()
+--- @field next fun(self: http_multi, timeout_ms: integer?): http_multi_result? wait for the next transfer to complete, nil if none is left or on timeout
+--- @field perform fun(self: http_multi): http_multi_result[] complete all remaining transfers, results are in the order handles were added
+--- @field pending fun(self: http_multi): integer number of transfers not yet returned
+--- @field close fun(self: http_multi) abort remaining transfers (also invoked by GC)
+
+--- Run many requests concurrently on a single event loop
+--- @param opts http_multi_opts?
+--- @return http_multi
+M.multi = function(opts)
+	return http.multi(opts)
+end
+
+--- Perform all handles concurrently and wait for every one of them
+--- @param handles http_handle[]
+--- @param opts http_multi_opts?
+--- @return http_multi_result[]
+M.perform_all = function(handles, opts)
+	local multi = http.multi(opts)
+	for _, handle in ipairs(handles) do
+		multi:add(handle)
+	end
+	local results = multi:perform()
+	multi:close()
+	return results
+end
+
+--- Fetch all handles concurrently, results carry status, headers and body
+--- @param handles http_handle[]
+--- @param opts http_multi_opts?
+--- @return http_multi_result[]
+M.fetch_all = function(handles, opts)
+	local multi = http.multi(opts)
+	for _, handle in ipairs(handles) do
+		multi:add(handle, {})
+	end
+	local results = multi:perform()
+	multi:close()
+	return results
+end
+
 local OPTTYPE_LONG = 0
 local OPTTYPE_OBJECTPOINT = 10000
 local OPTTYPE_FUNCTIONPOINT = 20000
@@ -28,15 +28,48 @@ local M = {}
 --- | '"trace"'
 --- | '"TRACE"'
 
--- Expose submodules of 'ltf'
-M.serial = require("ltf.serial")
-M.webdriver = require("ltf.webdriver")
-M.proc = require("ltf.proc")
-M.json = require("ltf.json")
-M.http = require("ltf.http")
-M.hooks = require("ltf.hooks")
-M.ssh = require("ltf.ssh")
-M.util = require("ltf.util")
+-- Expose submodules of 'ltf'. They are required on first access, so a test
+-- file only pays for the ones it uses.
+local submodules = {
+	serial = "ltf.serial",
+	webdriver = "ltf.webdriver",
+	proc = "ltf.proc",
+	json = "ltf.json",
+	http = "ltf.http",
+	hooks = "ltf.hooks",
+	ssh = "ltf.ssh",
+	util = "ltf.util",
+}
+
+setmetatable(M, {
+	__index = function(self, key)
+		local name = submodules[key]
+		if name == nil then
+			return nil
+		end
+		local submodule = require(name)
+		rawset(self, key, submodule)
+		return submodule
+	end,
+})
+
+-- Declarations for the language server only, the fields stay unset
+--- @module "ltf.serial"
+M.serial = nil
+--- @module "ltf.webdriver"
+M.webdriver = nil
+--- @module "ltf.proc"
+M.proc = nil
+--- @module "ltf.json"
+M.json = nil
+--- @module "ltf.http"
+M.http = nil
+--- @module "ltf.hooks"
+M.hooks = nil
+--- @module "ltf.ssh"
+M.ssh = nil
+--- @module "ltf.util"
+M.util = nil
 
 --- Get amount of milliseconds since test started
 ---
@@ -49,6 +82,7 @@ end
 --- @field name string name of the test
 --- @field description string? description of the test, optional
 --- @field tags [string]? array of test tags, optional
+--- @field timeout integer? time limit of the body in ms, 0 for none, optional
 --- @field body fun() body of the test
 
 --- Register new test
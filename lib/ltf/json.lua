@@ -57,6 +57,29 @@ M.deserialize = function(str)
 	return json:deserialize(str)
 end
 
+--- Select one value of a JSON string by JSON pointer (RFC 6901), without
+--- deserializing the rest of the document
+--- @param str string
+--- @param pointer string e.g. "/data/items/3/id", array indices start at 0
+---
+--- @return any value `nil` if not found (or JSON `null`)
+--- @return boolean found
+M.query = function(str, pointer)
+	return json:query(str, pointer)
+end
+
+--- Select values of a JSON string by JSONPath, without deserializing the
+--- rest of the document. Supported: `$`, `.name`, `['name']`, `[n]`,
+--- `[start:end]`, `*` and `..`
+--- @param str string
+--- @param path string e.g. "$.data.items[*].id"
+---
+--- @return any[] values matches in document order (`null` matches are nil)
+--- @return integer count number of matches
+M.query_path = function(str, path)
+	return json:query_path(str, path)
+end
+
 --- Explicitly mark Lua object as a JSON array
 --- @param obj table?
 ---
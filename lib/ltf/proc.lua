@@ -1,5 +1,4 @@
 local proc = require("ltf-proc")
-local tm = require("ltf-main")
 
 local M = {}
 
@@ -15,14 +14,14 @@ M.low = proc
 
 --- @alias proc_read_func fun(self:proc_handle, stream:proc_output_stream?, want: integer?):string
 --- @alias proc_write_func fun(self:proc_handle, buf:string):integer
---- @alias proc_wait_func fun(self:proc_handle):integer?
+--- @alias proc_wait_func fun(self:proc_handle, timeout: integer?):integer?
 --- @alias proc_kill_func fun(self:proc_handle)
 
 --- @class proc_handle
---- @field read proc_read_func read stdout/stderr from the spawned process. must not be called after `kill` (`stream`: which stream to read (stdout default), `want`: amount of bytes expected (4096 default))
+--- @field read proc_read_func read stdout/stderr from the spawned process, blocks until some output is available. once the process has exited, returns all of its remaining output. must not be called after `kill` (`stream`: which stream to read (stdout default), `want`: maximum amount of bytes to return (4096 default))
 --- @field write proc_write_func write buffer to stdin to the spawned process if it is still alive (`buf`: buffer to write, returns amount of bytes written)
---- @field wait proc_wait_func nonblocking function to check on current status of process (nil if still running)
---- @field kill proc_kill_func send SIGINT signal to process if it's still running
+--- @field wait proc_wait_func returns the exit code of the process, or nil if it is still running after `timeout` milliseconds (0 default: do not block, negative: wait indefinitely)
+--- @field kill proc_kill_func send SIGTERM to the process if it's still running, SIGKILL if it has not exited after 1 s
 
 --- @param opts run_opts
 ---
@@ -40,27 +39,15 @@ end
 
 --- @param opts run_opts
 --- @param timeout integer? timeout in milliseconds. keep nil for indefinite waiting
---- @param sleepinterval integer? interval in milliseconds between checking for timeout. Default: 20
+--- @param sleepinterval integer? unused, kept for compatibility: the process is waited for without polling
 ---
 --- @return run_result result
 M.run = function(opts, timeout, sleepinterval)
 	local handle = M.spawn(opts)
-	local status = nil
-	if timeout then
-		local start = tm:millis()
-		local deadline = start + timeout
-		local interval = sleepinterval or 20
-		while status == nil do
-			if tm:millis() >= deadline then
-				error("timeout")
-			end
-			tm:sleep(interval)
-			status = handle:wait()
-		end
-	else
-		while status == nil do
-			status = handle:wait()
-		end
+	local status = handle:wait(timeout or -1)
+	if status == nil then
+		handle:kill()
+		error("timeout")
 	end
 	local stdout = handle:read("stdout", nil)
 	local stderr = handle:read("stderr", nil)
@@ -1,4 +1,3 @@
-local ltf = require("ltf-main")
 local ts = require("ltf-serial")
 
 local M = {}
@@ -114,7 +113,12 @@ M.low = ts
 --- @alias open_func fun(self:serial_port, mode: serial_mode)
 --- @alias read_blocking_func fun(self:serial_port, chunk_size:integer, timeout:integer?): string
 --- @alias read_nonblocking_func fun(self:serial_port, chunk_size:integer): string
---- @alias read_until_func fun(self:serial_port, opts: serial_read_until_opts): found: boolean, read: string
+--- Reads from serial port until it encounters the matching pattern, sleeping while no input arrives.
+--- `found` will be true if pattern appeared within timeout, false otherwise.
+--- `read` is everything read up to and including the pattern; input received after it is kept for the next read.
+--- On timeout `read` is everything that was read.
+---
+--- @alias read_until_func fun(self:serial_port, opts: serial_read_until_opts?): found: boolean, read: string
 --- @alias set_baudrate_func fun(self:serial_port, baudrate:integer)
 --- @alias set_bits_func fun(self:serial_port, bits:serial_data_bits)
 --- @alias set_cts_func fun(self:serial_port, cts:serial_cts)
@@ -159,46 +163,7 @@ M.low = ts
 --- @class serial_read_until_opts
 --- @field pattern string? pattern to look for using `string:find(pattern, 1, true)`. Default: "\n"
 --- @field timeout integer? timeout in milliseconds for how long we should wait for the pattern to appear. Default: 200
---- @field chunk_size integer? size of the "chunk" for single read operation
-
---- Reads from serial port until it encounters the matching pattern
---- `found` will be true if pattern appeared within timeout, false otherwise
---- `read` will be always present and represents everything that was read
----
---- @param port serial_port
---- @param opts serial_read_until_opts
----
---- @return boolean found, string read
-local read_until = function(port, opts)
-	local now_ms = function()
-		return ltf:millis()
-	end
-
-	opts.pattern = opts.pattern or "\n"
-	opts.timeout = opts.timeout or 200
-	opts.chunk_size = opts.chunk_size or 64
-
-	local buftable = {}
-	local deadline = now_ms() + opts.timeout
-
-	while true do
-		local remaining = math.max(0, math.ceil(deadline - now_ms()))
-		if remaining == 0 then
-			return false, table.concat(buftable)
-		end
-
-		local chunk = port:read(opts.chunk_size)
-
-		if chunk and #chunk > 0 then
-			table.insert(buftable, chunk)
-
-			local full_buff = table.concat(buftable)
-			if full_buff:find(opts.pattern, 1, true) then
-				return true, full_buff
-			end
-		end
-	end
-end
+--- @field chunk_size integer? maximum size of a single read operation. Default: 4096
 
 --- Get port by it's path or name (but not open it)
 ---
@@ -206,13 +171,7 @@ end
 ---
 --- @return serial_port
 M.get_port = function(path)
-	local port = ts:get_port(path)
-	local mt = getmetatable(port)
-	--- @param opts serial_read_until_opts
-	function mt.__index:read_until(opts)
-		return read_until(self, opts)
-	end
-	return port
+	return ts:get_port(path)
 end
 
 --- List info about all connected serial devices in the system
@@ -26,6 +26,9 @@ local low = require("ltf-ssh")
 --- Read from "stderr"
 --- @field read_stderr fun(self: ssh_channel, chunk_size: integer): string
 ---
+--- Read from "stdout" or "stderr" until the pattern appears or the timeout (ms) expires
+--- @field read_until fun(self: ssh_channel, pattern: string?, timeout: integer?, stream: ssh_channel_stream?): found: boolean, read: string
+---
 --- Set environment variable
 --- @field setenv fun(self: ssh_channel, var: string, value: string)
 ---
@@ -30,6 +30,7 @@ local M = {}
 --- @field ip string IP of the remote host
 --- @field port integer? SSH port. Default: 22
 --- @field userpass ssh_auth_method_userpass? Authenticate with user and password
+--- @field pool boolean? Reuse an idle connection to the same host, port and user, and keep this one for reuse on `close`. Default: true
 
 --- Create new SSH connection
 ---
@@ -54,8 +55,13 @@ M.new_session = function(params)
 	end
 
 	if params.userpass then
-		local session =
-			low.session_init_userpass(params.ip, params.port or 22, params.userpass.user, params.userpass.password)
+		local session = low.session_init_userpass(
+			params.ip,
+			params.port or 22,
+			params.userpass.user,
+			params.userpass.password,
+			params.pool ~= false
+		)
 		prepare_session(session)
 		return session
 	end
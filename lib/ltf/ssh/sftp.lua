@@ -9,6 +9,8 @@ local M = {}
 --- @field read fun(self: sftp_channel_low, chunk_size: integer)
 --- @field file_info fun(self: sftp_channel_low, remote_file: string): file_info?
 --- @field resolve_symlink fun(self: sftp_channel_low, path: string): string? resolved_path
+--- @field upload fun(self: sftp_channel_low, local_file: string, remote_file: string, opts: table?): integer
+--- @field download fun(self: sftp_channel_low, remote_file: string, local_file: string, opts: table?): integer
 --- @field close fun()
 --- @field shutdown fun()
 
@@ -22,7 +24,8 @@ local M = {}
 --- @field resolve_symlinks boolean?
 --- @field mode sftp_channel_send_flag?
 --- @field file_permissions integer?
---- @field chunk_size integer?
+--- @field window integer? bytes kept in flight, 1 MiB by default
+--- @field progress fun(done: integer, total: integer)? called at most 10 times per second
 
 --- @class sftp_file_exists_result
 --- @field exists boolean
@@ -33,15 +36,15 @@ local M = {}
 --- @field low sftp_channel_low
 --- @field ssh_session ssh_session
 ---
---- @field send fun(self: sftp_channel, opts: sftp_file_transfer_opts)
---- @field receive fun(self: sftp_channel, opts: sftp_file_transfer_opts)
+--- @field send fun(self: sftp_channel, opts: sftp_file_transfer_opts): integer
+--- @field receive fun(self: sftp_channel, opts: sftp_file_transfer_opts): integer
 --- @field file_info fun(self: sftp_channel, path: string): file_info?
 --- @field close fun(self: sftp_channel)
 
 --- @param channel sftp_channel
 --- @param opts sftp_file_transfer_opts
+--- @return integer bytes sent
 local function send(channel, opts)
-	opts.chunk_size = opts.chunk_size or 1024
 	opts.resolve_symlinks = opts.resolve_symlinks or true
 	opts.mode = opts.mode or "create"
 	opts.file_permissions = opts.file_permissions or 420 -- think of a better way
@@ -75,11 +78,6 @@ local function send(channel, opts)
 		error("File " .. opts.local_file .. " is of size 0")
 	end
 
-	local f, ferr = io.open(path, "rb")
-	if not f then
-		error("fopen: " .. path .. "failed with code: " .. tostring(ferr))
-	end
-
 	local flags = 0
 	if opts.mode == "create" then
 		flags = 10
@@ -97,62 +95,23 @@ local function send(channel, opts)
 		error("Unknown mode " .. opts.mode)
 	end
 
-	local open_type = 0 -- 0 for file, 1 - directory
-	channel.low:open(opts.remote_file, flags, opts.file_permissions, open_type)
-
-	-- write loop
-	local total_sent = 0
-	local buf_len = opts.chunk_size
-	while true do
-		local chunk = f:read(buf_len)
-		if not chunk then
-			-- EOF
-			break
-		end
-
-		local offset = 1
-		local remaining = #chunk
-		while remaining > 0 do
-			local piece = chunk:sub(offset, offset + remaining - 1)
-			local written = channel.low:write(piece, #piece)
-
-			-- advance by number of bytes written
-			offset = offset + written
-			remaining = remaining - written
-			total_sent = total_sent + written
-		end
-	end
-
-	channel.low:close()
-	f:close()
+	return channel.low:upload(path, opts.remote_file, {
+		flags = flags,
+		permissions = opts.file_permissions,
+		window = opts.window,
+		progress = opts.progress,
+	})
 end
 
 --- @param session sftp_channel
 --- @param opts sftp_file_transfer_opts
+--- @return integer bytes received
 local function receive(session, opts)
-	opts.chunk_size = opts.chunk_size or 1024
-	local out, oerr = io.open(opts.local_file, "wb")
-	if not out then
-		return nil, ("fopen failed: %s (%s)"):format(tostring(opts.local_file), tostring(oerr))
-	end
-
-	session.low:open(opts.remote_file, 1, 0, 0)
-
-	local total_received = 0
-	while true do
-		local chunk = session.low:read(opts.chunk_size)
-
-		if #chunk == 0 then
-			break
-		end
-
-		-- write to local file
-		out:write(chunk)
-		total_received = total_received + #chunk
-	end
-
-	session.low:close()
-	out:close()
+	return session.low:download(opts.remote_file, opts.local_file, {
+		permissions = opts.file_permissions,
+		window = opts.window,
+		progress = opts.progress,
+	})
 end
 
 --- @param ssh_session ssh_session
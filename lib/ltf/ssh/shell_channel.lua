@@ -11,14 +11,14 @@
 ---
 --- Read from the remote shell until encounter some pattern.
 --- `found` will be true if pattern appeared within timeout, false otherwise
---- `read` will be always present and represents everything that was read
+--- `read` is everything up to and including the pattern, or everything that was read on timeout.
+--- Data received after the pattern is kept for the next read.
 --- @field read_until fun(self: ssh_shell_channel, opts: ssh_read_until_opts): found: boolean, read: string
 ---
 --- Close SSH shell channel
 --- @field close fun(self: ssh_shell_channel)
 
 local channel = require("ltf.ssh.channel")
-local ltf = require("ltf-main")
 
 local M = {}
 
@@ -46,7 +46,7 @@ end
 --- @class ssh_read_until_opts
 --- @field pattern string? pattern to look for using `string:find(pattern, 1, true)`. Default: "\n"
 --- @field timeout integer? timeout in milliseconds for how long we should wait for the pattern to appear. Default: 200
---- @field read_opts ssh_channel_read_opts?
+--- @field read_opts ssh_channel_read_opts? only `stream` is used
 
 --- @type ssh_read_until_opts
 local default_ssh_read_until_opts = {
@@ -60,42 +60,11 @@ local default_ssh_read_until_opts = {
 ---
 --- @return boolean found, string read
 local function read_until(chan, opts)
-	local now_ms = function()
-		return ltf:millis()
-	end
-
 	local def = default_ssh_read_until_opts
 	opts = opts or def
-	opts.timeout = opts.timeout or def.timeout
-	opts.read_opts = opts.read_opts or def.read_opts
-	opts.read_opts.stream = opts.read_opts.stream or def.read_opts.stream
-	opts.read_opts.chunk_size = opts.read_opts.chunk_size or def.read_opts.chunk_size
-
-	local buftable = {}
-	local deadline = now_ms() + opts.timeout
-
-	while true do
-		local remaining = math.max(0, math.ceil(deadline - now_ms()))
-		if remaining == 0 then
-			return false, table.concat(buftable)
-		end
-
-		local chunk
-		if opts.read_opts.stream == "stdout" then
-			chunk = chan:read(opts.read_opts.chunk_size)
-		else
-			chunk = chan:read_stderr(opts.read_opts.chunk_size)
-		end
-
-		if chunk and #chunk > 0 then
-			table.insert(buftable, chunk)
-
-			local full_buff = table.concat(buftable)
-			if full_buff:find(opts.pattern, 1, true) then
-				return true, full_buff
-			end
-		end
-	end
+	local read_opts = opts.read_opts or def.read_opts
+
+	return chan:read_until(opts.pattern or def.pattern, opts.timeout or def.timeout, read_opts.stream or def.read_opts.stream)
 end
 
 --- @class ssh_shell_channel_opts
@@ -156,13 +156,22 @@ M.spawn_webdriver = function(opts)
 	return handle
 end
 
+--- The body is collected in C in one piece. The handle goes back to the pool
+--- as soon as the response is in, so that the next command reuses it and its
+--- connection. The deferred cleanup only matters if fetch() raised.
+--- @param handle http_handle
+--- @return string body
+local wd_fetch = function(handle)
+	local response = handle:fetch()
+	handle:cleanup()
+	return response.body
+end
+
 --- @param url string
 --- @param body string
 ---
 --- @return string result
 local wd_post_json = function(url, body)
-	local result = ""
-
 	local handle = http.new()
 	tm:defer(function()
 		handle:cleanup()
@@ -178,21 +187,14 @@ local wd_post_json = function(url, body)
 			"Accept: application/json",
 			"Expect:", -- disable 100-continue
 		})
-		:setopt(http.OPT_WRITEFUNCTION, function(chunk, n)
-			result = result .. chunk
-			return n
-		end)
 
-	handle:perform()
-	return result
+	return wd_fetch(handle)
 end
 
 --- @param url string
 --- @param body string -- JSON string
 --- @return string result
 local wd_put_json = function(url, body)
-	local result = ""
-
 	local handle = http.new()
 	tm:defer(function()
 		handle:cleanup()
@@ -208,20 +210,13 @@ local wd_put_json = function(url, body)
 			"Accept: application/json",
 			"Expect:",
 		})
-		:setopt(http.OPT_WRITEFUNCTION, function(chunk, n)
-			result = result .. chunk
-			return n
-		end)
 
-	handle:perform()
-	return result
+	return wd_fetch(handle)
 end
 
 --- @param url string
 --- @return string result
 local wd_get_json = function(url)
-	local result = ""
-
 	local handle = http.new()
 	tm:defer(function()
 		handle:cleanup()
@@ -233,20 +228,13 @@ local wd_get_json = function(url)
 			"Accept: application/json",
 			"Expect:",
 		})
-		:setopt(http.OPT_WRITEFUNCTION, function(chunk, n)
-			result = result .. chunk
-			return n
-		end)
 
-	handle:perform()
-	return result
+	return wd_fetch(handle)
 end
 
 --- @param url string
 --- @return string result
 local wd_delete_json = function(url)
-	local result = ""
-
 	local handle = http.new()
 	tm:defer(function()
 		handle:cleanup()
@@ -259,13 +247,8 @@ local wd_delete_json = function(url)
 			"Accept: application/json",
 			"Expect:",
 		})
-		:setopt(http.OPT_WRITEFUNCTION, function(chunk, n)
-			result = result .. chunk
-			return n
-		end)
 
-	handle:perform()
-	return result
+	return wd_fetch(handle)
 end
 
 --- @param session wd_session
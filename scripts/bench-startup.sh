@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+# Measures how long 'ltf test' needs before the first test could run: every
+# lib, tests and hooks file of the project is loaded, then a tag that no test
+# has leaves nothing to execute. The test index is bypassed when the binary
+# has one, it would skip every test file for that tag.
+#
+# Every run must end with "No tests to execute.", anything else (a usage
+# error, a failing hook...) aborts the benchmark with the output of the run.
+#
+# Usage (from a project directory):
+#   bench-startup.sh [runs] [ltf binary] [extra ltf test options...]
+#
+# e.g. compare with and without the bytecode cache:
+#   bench-startup.sh 20 ltf
+#   bench-startup.sh 20 ltf --no-cache
+set -euo pipefail
+
+RUNS="${1:-20}"
+LTF="${2:-ltf}"
+shift $(($# > 2 ? 2 : $#))
+
+TAG="__ltf_startup_bench__"
+EXPECTED="No tests to execute."
+
+ARGS=(--headless --no-logs --tags "$TAG")
+if "$LTF" test --help 2>&1 | grep -q -- "--no-index"; then
+  ARGS+=(--no-index)
+fi
+
+OUT="$(mktemp)"
+trap 'rm -f "$OUT"' EXIT
+
+run_once() {
+  local status=0
+  "$LTF" test "${ARGS[@]}" "$@" >"$OUT" 2>&1 || status=$?
+  # Nothing matches the tag, so a healthy run exits with a failure status
+  if ! grep -qF "$EXPECTED" "$OUT"; then
+    echo "bench-startup.sh: '$LTF test' exited with $status," \
+      "expected \"$EXPECTED\":" >&2
+    cat "$OUT" >&2
+    exit 1
+  fi
+}
+
+# Warm up the page cache (and the bytecode cache, if enabled)
+run_once "$@"
+
+start="$(date +%s%N)"
+for _ in $(seq "$RUNS"); do
+  run_once "$@"
+done
+end="$(date +%s%N)"
+
+total_ms=$(((end - start) / 1000000))
+printf 'runs: %s, total: %s ms, mean: %s.%02d ms\n' "$RUNS" "$total_ms" \
+  $((total_ms / RUNS)) $(((total_ms * 100 / RUNS) % 100))
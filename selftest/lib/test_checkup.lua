@@ -105,19 +105,48 @@ end
 --- @field tags [string]
 --- @field tests [test_t]
 
+--- Run LTF in the selftest project and wait for it to exit
 --- @param args [string]
---- @return log_obj_t
-M.load_log = function(args)
+--- @return integer exitcode
+M.run_ltf = function(args)
 	local proc_handle = proc.spawn({
 		exe = "../build/ltf",
 		args = args,
 	})
-	while proc_handle:wait() == nil do
+	local exitcode = proc_handle:wait()
+	while exitcode == nil do
 		proc_handle:read() -- flush stdout to not hang on large buffers
+		exitcode = proc_handle:wait()
 	end
 	proc_handle:kill()
+	return exitcode
+end
+
+--- @param args [string]
+--- @return log_obj_t
+M.load_log = function(args)
+	M.run_ltf(args)
+	return M.read_log("logs/bootstrap/test_run_latest_raw.json")
+end
 
-	local log_file = io.open("logs/bootstrap/test_run_latest_raw.json", "r")
+--- Copy the latest raw log of a bootstrap run, the next run replaces it
+--- @param path string
+M.copy_latest_log = function(path)
+	local src = io.open("logs/bootstrap/test_run_latest_raw.json", "r")
+	assert(src)
+	local str = src:read("a")
+	src:close()
+
+	local dst = io.open(path, "w")
+	assert(dst)
+	dst:write(str)
+	dst:close()
+end
+
+--- @param path string raw JSON log of a bootstrap run
+--- @return log_obj_t
+M.read_log = function(path)
+	local log_file = io.open(path, "r")
 
 	assert(log_file)
 
@@ -245,4 +274,64 @@ M.check_output = function(test, output, expected_message, expected_level, contai
 	return nil, output
 end
 
+--- @param test test_t
+--- @param what string
+--- @param outputs [output_t]
+--- @param expected [output_t]
+local function check_same_outputs(test, what, outputs, expected)
+	outputs = outputs or {}
+	expected = expected or {}
+	M.error_if(
+		#outputs ~= #expected,
+		test,
+		("%d %s, expected %d"):format(#outputs, what, #expected)
+	)
+	for i = 1, math.min(#outputs, #expected) do
+		local o, e = outputs[i], expected[i]
+		M.error_if(
+			o.msg ~= e.msg or o.level ~= e.level or o.file ~= e.file or o.line ~= e.line,
+			test,
+			("%s[%d] is '%s' (%s), expected '%s' (%s)"):format(what, i, o.msg, o.level, e.msg, e.level)
+		)
+	end
+end
+
+--- Check that a test has the same result and outputs as in another run.
+--- Dates are not compared.
+--- @param test test_t?
+--- @param expected test_t
+M.check_same_test = function(test, expected)
+	if test == nil then
+		ltf.log_error(("Test '%s': %s"):format(expected.name, "test is nil"))
+		return
+	end
+
+	M.error_if(
+		test.name ~= expected.name,
+		test,
+		("test.name is '%s', expected '%s'"):format(test.name, expected.name)
+	)
+	M.error_if(
+		test.status ~= expected.status,
+		test,
+		("test.status is '%s', expected '%s'"):format(test.status, expected.status)
+	)
+	M.test_tags(test, expected.tags)
+	check_same_outputs(test, "output", test.output, expected.output)
+	check_same_outputs(test, "failure_reasons", test.failure_reasons, expected.failure_reasons)
+	check_same_outputs(test, "teardown_output", test.teardown_output, expected.teardown_output)
+	check_same_outputs(test, "teardown_errors", test.teardown_errors, expected.teardown_errors)
+end
+
+--- Tests of the log by name
+--- @param log_obj log_obj_t
+--- @return table<string, test_t>
+M.tests_by_name = function(log_obj)
+	local tests = {}
+	for _, test in ipairs(log_obj.tests) do
+		tests[test.name] = test
+	end
+	return tests
+end
+
 return M
@@ -71,3 +71,32 @@ ltf.test({
 		ltf.log_info(test_object)
 	end,
 })
+
+ltf.test({
+	name = "Test JSON escaping and round trip",
+	tags = { "module-json" },
+	body = function()
+		ltf.log_info(json.serialize({ 'say "hi"', "a/b", "tab\tnew\n", 0.5, true }))
+
+		local test_object = json.deserialize('{"s": "caf\\u00e9 \\ud83d\\ude00", /* note */ "list": [1, [2, 3],],}')
+		ltf.log_info(test_object.s)
+		ltf.log_info(json.serialize(test_object.list))
+	end,
+})
+
+ltf.test({
+	name = "Test JSON queries",
+	tags = { "module-json" },
+	body = function()
+		local str = '{"data": {"items": [{"id": 1}, {"id": 2, "a/b": "x"}, {"id": 3}], "total": 3}}'
+
+		local value, found = json.query(str, "/data/items/1/a~1b")
+		ltf.log_info(value, found)
+		value, found = json.query(str, "/data/items/5/id")
+		ltf.log_info(value, found)
+		ltf.log_info(json.serialize((json.query_path(str, "$.data.items[*].id"))))
+		ltf.log_info(json.serialize((json.query_path(str, "$..items[1:].id"))))
+		local values, count = json.query_path('[1, null, 3]', "$[*]")
+		ltf.log_info(count, values[1], values[2], values[3])
+	end,
+})
@@ -0,0 +1,17 @@
+local ltf = require("ltf")
+
+-- Records every load of this file, so that the test index selftest can tell
+-- which runs skipped it
+local loads = io.open("logs/bootstrap/index_fixture_loads.txt", "a")
+if loads then
+	loads:write(ltf.get_var("enum") .. "\n")
+	loads:close()
+end
+
+ltf.test({
+	name = "Test index fixture",
+	tags = { "module-ltf", "index" },
+	body = function()
+		ltf.log_info("indexed")
+	end,
+})
@@ -314,3 +314,51 @@ ltf.test({
 		end
 	end,
 })
+
+-- About 1 MiB of outputs each, spilled to disk with a small --test-mem-budget
+for i = 1, 8 do
+	ltf.test({
+		name = ("Test output-heavy test %d"):format(i),
+		tags = { "module-ltf", "output-heavy" },
+		body = function()
+			local line = tostring(i):rep(1024)
+			for j = 1, 1000 do
+				ltf.log_info(j .. ":" .. line)
+			end
+		end,
+	})
+end
+
+-- Each must fail within its 100 ms timeout instead of hanging the run
+ltf.test({
+	name = "Test timeout (busy loop)",
+	tags = { "module-ltf", "timeout" },
+	timeout = 100,
+	body = function()
+		while true do
+		end
+	end,
+})
+
+ltf.test({
+	name = "Test timeout (ltf.sleep)",
+	tags = { "module-ltf", "timeout" },
+	timeout = 100,
+	body = function()
+		ltf.sleep(60000)
+	end,
+})
+
+ltf.test({
+	name = "Test timeout (caught with pcall)",
+	tags = { "module-ltf", "timeout" },
+	timeout = 100,
+	body = function()
+		while true do
+			pcall(function()
+				while true do
+				end
+			end)
+		end
+	end,
+})
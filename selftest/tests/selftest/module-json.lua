@@ -20,7 +20,7 @@ ltf.test({
 		assert(log_obj.tags[1] == "module-json")
 
 		assert(log_obj.tests ~= nil)
-		assert(#log_obj.tests == 3, "Expected 3 tests, got " .. #log_obj.tests)
+		assert(#log_obj.tests == 5, "Expected 5 tests, got " .. #log_obj.tests)
 
 		local test = log_obj.tests[1]
 		check.check_test(test, "Test JSON serialization", "PASSED")
@@ -48,5 +48,23 @@ ltf.test({
 		check.test_tags(test, { "module-json" })
 		check.error_if(#test.output ~= 0, test, "Outputs not match")
 		check.check_output(test, test.failure_reasons[1], "stack traceback:", "CRITICAL", true)
+
+		test = log_obj.tests[4]
+		check.check_test(test, "Test JSON escaping and round trip", "PASSED")
+		check.test_tags(test, { "module-json" })
+		check.error_if(#test.output ~= 3, test, "Outputs not match")
+		check.check_output(test, test.output[1], '["say \\"hi\\"","a/b","tab\\tnew\\n",0.5,true]', "INFO")
+		check.check_output(test, test.output[2], "café 😀", "INFO")
+		check.check_output(test, test.output[3], "[1.0,[2.0,3.0]]", "INFO")
+
+		test = log_obj.tests[5]
+		check.check_test(test, "Test JSON queries", "PASSED")
+		check.test_tags(test, { "module-json" })
+		check.error_if(#test.output ~= 5, test, "Outputs not match")
+		check.check_output(test, test.output[1], "x\ttrue", "INFO")
+		check.check_output(test, test.output[2], "nil\tfalse", "INFO")
+		check.check_output(test, test.output[3], "[1.0,2.0,3.0]", "INFO")
+		check.check_output(test, test.output[4], "[2.0,3.0]", "INFO")
+		check.check_output(test, test.output[5], "3\t1.0\tnil\t3.0", "INFO")
 	end,
 })
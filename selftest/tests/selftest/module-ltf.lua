@@ -270,3 +270,295 @@ ltf.test({
 		check.check_output(test, test.output[6], "number:3.14", "INFO")
 	end,
 })
+
+ltf.test({
+	name = "Test module-ltf (parallel jobs)",
+	tags = { "module-ltf", "jobs" },
+	body = function()
+		local args = {
+			"test",
+			"bootstrap",
+			"-t",
+			"logging",
+			"-v",
+			"any=anyval,enum=value2",
+		}
+		local serial_log = check.load_log(args)
+
+		table.insert(args, "-j")
+		table.insert(args, "2")
+		local log_obj = check.load_log(args)
+
+		-- Workers must not change anything but the timing of the tests
+		assert(#serial_log.tests == 13, "Expected 13 tests, got " .. #serial_log.tests)
+		assert(#log_obj.tests == #serial_log.tests, "Expected 13 tests, got " .. #log_obj.tests)
+		for i, expected in ipairs(serial_log.tests) do
+			check.check_same_test(log_obj.tests[i], expected)
+		end
+	end,
+})
+
+ltf.test({
+	name = "Test module-ltf (output-heavy parallel jobs)",
+	tags = { "module-ltf", "jobs" },
+	body = function()
+		-- Workers spill the outputs and free them once sent to the parent
+		local log_obj = check.load_log({
+			"test",
+			"bootstrap",
+			"-t",
+			"output-heavy",
+			"-v",
+			"any=anyval,enum=value2",
+			"-j",
+			"2",
+			"--test-mem-budget",
+			"1",
+			"--run-mem-budget",
+			"2",
+		})
+
+		assert(#log_obj.tests == 8, "Expected 8 tests, got " .. #log_obj.tests)
+		for i, test in ipairs(log_obj.tests) do
+			check.check_test(test, ("Test output-heavy test %d"):format(i), "PASSED")
+			check.test_tags(test, { "module-ltf", "output-heavy" })
+			check.error_if(#test.output ~= 1000, test, "Outputs not match")
+
+			local line = tostring(i):rep(1024)
+			for j, output in ipairs(test.output) do
+				local expected = j .. ":" .. line
+				if output.msg ~= expected or output.level ~= "INFO" then
+					check.check_output(test, output, expected, "INFO")
+					break
+				end
+			end
+		end
+	end,
+})
+
+ltf.test({
+	name = "Test module-ltf (shards)",
+	tags = { "module-ltf", "shard" },
+	body = function()
+		local args = {
+			"test",
+			"bootstrap",
+			"-t",
+			"logging",
+			"-v",
+			"any=anyval,enum=value2",
+		}
+		local full_log = check.load_log(args)
+		assert(#full_log.tests == 13, "Expected 13 tests, got " .. #full_log.tests)
+		local full_tests = check.tests_by_name(full_log)
+		local timings_path = "logs/bootstrap/shard_timings_raw.json"
+		check.copy_latest_log(timings_path)
+
+		-- Durations of previous runs differ between machines, so would shards
+		local duration_args = { table.unpack(args) }
+		table.insert(duration_args, "--shard")
+		table.insert(duration_args, "1/2")
+		table.insert(duration_args, "--shard-by")
+		table.insert(duration_args, "duration")
+		local exitcode = check.run_ltf(duration_args)
+		assert(exitcode ~= 0, "--shard-by duration without --shard-timings succeeded")
+
+		for _, shard_by in ipairs({ "hash", "round-robin", "duration" }) do
+			local shard_logs = {}
+			local runs = {}
+			for i = 1, 2 do
+				local shard_args = { table.unpack(args) }
+				table.insert(shard_args, "--shard")
+				table.insert(shard_args, ("%d/2"):format(i))
+				table.insert(shard_args, "--shard-by")
+				table.insert(shard_args, shard_by)
+				if shard_by == "duration" then
+					table.insert(shard_args, "--shard-timings")
+					table.insert(shard_args, timings_path)
+				end
+				check.run_ltf(shard_args)
+
+				shard_logs[i] = ("logs/bootstrap/shard_%d_of_2_raw.json"):format(i)
+				check.copy_latest_log(shard_logs[i])
+				runs[i] = check.read_log(shard_logs[i])
+			end
+
+			-- Every test runs in exactly one of the shards
+			local shard_of = {}
+			for i, shard_log in ipairs(runs) do
+				for _, test in ipairs(shard_log.tests) do
+					check.error_if(
+						shard_of[test.name] ~= nil,
+						test,
+						("runs in shard %d and %d (%s)"):format(shard_of[test.name] or 0, i, shard_by)
+					)
+					shard_of[test.name] = i
+					check.check_same_test(test, full_tests[test.name])
+				end
+			end
+			for name, _ in pairs(full_tests) do
+				if shard_of[name] == nil then
+					ltf.log_error(("Test '%s': runs in no shard (%s)"):format(name, shard_by))
+				end
+			end
+
+			local merged_path = "logs/bootstrap/shards_merged_raw.json"
+			exitcode = check.run_ltf({ "logs", "merge", shard_logs[1], shard_logs[2], "-o", merged_path })
+			assert(exitcode == 0, "ltf logs merge exited with " .. tostring(exitcode))
+
+			local merged_log = check.read_log(merged_path)
+			assert(#merged_log.tests == 13, "Expected 13 merged tests, got " .. #merged_log.tests)
+			local merged_tests = check.tests_by_name(merged_log)
+			for name, expected in pairs(full_tests) do
+				check.check_same_test(merged_tests[name], expected)
+			end
+		end
+	end,
+})
+
+ltf.test({
+	name = "Test module-ltf (rerun failed)",
+	tags = { "module-ltf", "rerun-failed" },
+	body = function()
+		local full_log = check.load_log({
+			"test",
+			"bootstrap",
+			"-t",
+			"logging",
+			"-v",
+			"any=anyval,enum=value2",
+		})
+		assert(#full_log.tests == 13, "Expected 13 tests, got " .. #full_log.tests)
+
+		local failed = {}
+		for _, test in ipairs(full_log.tests) do
+			if test.status == "FAILED" then
+				table.insert(failed, test)
+			end
+		end
+		assert(#failed == 7, "Expected 7 failed tests, got " .. #failed)
+
+		-- Reruns read the latest log of the bootstrap target by default
+		local rerun_log = check.load_log({
+			"test",
+			"bootstrap",
+			"--rerun-failed",
+			"-v",
+			"any=anyval,enum=value2",
+		})
+		assert(#rerun_log.tests == #failed, ("Expected %d tests, got %d"):format(#failed, #rerun_log.tests))
+		for i, expected in ipairs(failed) do
+			check.check_same_test(rerun_log.tests[i], expected)
+		end
+	end,
+})
+
+ltf.test({
+	name = "Test module-ltf (test index)",
+	tags = { "module-ltf", "index" },
+	body = function()
+		local fixture_path = "tests/bootstrap/module-ltf-index.lua"
+		local loads_path = "logs/bootstrap/index_fixture_loads.txt"
+
+		local f = io.open(fixture_path, "r")
+		assert(f)
+		local fixture = f:read("a")
+		f:close()
+
+		--- @param content string
+		local function write_fixture(content)
+			local out = io.open(fixture_path, "w")
+			assert(out)
+			out:write(content)
+			out:close()
+		end
+		ltf.defer(write_fixture, fixture)
+
+		--- Run the bootstrap project and tell whether the fixture was loaded
+		--- @param tags string
+		--- @param enum string
+		--- @param expected_tests integer
+		--- @return string? loads one line per load, with the 'enum' variable
+		local function run(tags, enum, expected_tests)
+			os.remove(loads_path)
+			local log_obj = check.load_log({
+				"test",
+				"bootstrap",
+				"-t",
+				tags,
+				"-v",
+				"any=anyval,enum=" .. enum,
+			})
+			assert(
+				#log_obj.tests == expected_tests,
+				("Expected %d tests, got %d"):format(expected_tests, #log_obj.tests)
+			)
+
+			local loads_file = io.open(loads_path, "r")
+			if not loads_file then
+				return nil
+			end
+			local loads = loads_file:read("a")
+			loads_file:close()
+			return loads
+		end
+
+		-- Indexed by any run that loads it
+		local loads = run("index", "value2", 1)
+		assert(loads == "value2\n", "Fixture not loaded for its own tag")
+
+		-- Skipped while it registers no wanted test
+		loads = run("logging", "value2", 13)
+		assert(loads == nil, "Fixture loaded although it has no 'logging' test")
+
+		-- A changed size or modification time makes it load again
+		write_fixture(fixture .. "\n-- Changed by the test index selftest\n")
+		loads = run("logging", "value2", 13)
+		assert(loads == "value2\n", "Changed fixture not loaded")
+
+		write_fixture(fixture)
+		loads = run("logging", "value2", 13)
+		assert(loads == "value2\n", "Restored fixture not loaded")
+		loads = run("logging", "value2", 13)
+		assert(loads == nil, "Fixture loaded although it was indexed again")
+
+		-- Other variables can register other tests, the whole index is rebuilt
+		loads = run("logging", "value1", 13)
+		assert(loads == "value1\n", "Fixture not loaded with other variables")
+		loads = run("logging", "value1", 13)
+		assert(loads == nil, "Fixture loaded although it was indexed with these variables")
+	end,
+})
+
+ltf.test({
+	name = "Test module-ltf (timeout)",
+	tags = { "module-ltf", "timeout" },
+	body = function()
+		local started = ltf.millis()
+		local log_obj = check.load_log({
+			"test",
+			"bootstrap",
+			"-t",
+			"timeout",
+			"-v",
+			"any=anyval,enum=value2",
+		})
+		local elapsed = ltf.millis() - started
+
+		assert(#log_obj.tests == 3, "Expected 3 tests, got " .. #log_obj.tests)
+		local names = {
+			"Test timeout (busy loop)",
+			"Test timeout (ltf.sleep)",
+			"Test timeout (caught with pcall)",
+		}
+		for i, test in ipairs(log_obj.tests) do
+			check.check_test(test, names[i], "FAILED")
+			check.test_tags(test, { "module-ltf", "timeout" })
+			check.error_if(#test.failure_reasons ~= 1, test, "Outputs not match")
+			check.check_output(test, test.failure_reasons[1], "Test timed out after 100 ms", "CRITICAL", true)
+		end
+
+		-- ltf.sleep(60000) must not run to its end
+		assert(elapsed < 30000, ("Timed out tests took %d ms"):format(elapsed))
+	end,
+})
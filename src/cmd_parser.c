@@ -7,6 +7,7 @@
 
 #include "util/string.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,17 +55,44 @@ static void print_test_help(FILE *file) {
             "Dump internal logging file\n"
             "  -e, --headless                                              "
             "Run in headless mode (no TUI)\n"
+            "  -j, --jobs <N>                                              "
+            "Run tests in N parallel worker processes\n"
+            "  --tui-fps <N>                                               "
+            "Limit TUI refresh rate to N frames per second (default 30)\n"
+            "  --test-mem-budget <MiB>                                     "
+            "Keep at most MiB of outputs per test in memory (default 64)\n"
+            "  --run-mem-budget <MiB>                                      "
+            "Keep at most MiB of outputs per run in memory (default 512)\n"
+            "  --profile                                                   "
+            "Sample test bodies and write flamegraph stacks to the logs\n"
+            "  --profile-hz <N>                                            "
+            "Profiler sampling rate in samples per second (default 1000)\n"
+            "  --timeout <ms>                                              "
+            "Fail tests that run longer than ms (default none)\n"
+            "  --no-cache                                                  "
+            "Do not use or update the bytecode cache and test index\n"
+            "  --no-index                                                  "
+            "Load every test file, do not use or update the test index\n"
+            "  --rerun-failed [<test_run_raw_json_file>]                   "
+            "Run only the tests that failed in the log (default latest)\n"
+            "  --shard <i/N>                                               "
+            "Run only the i-th of N parts of the tests\n"
+            "  --shard-by <hash|round-robin|duration>                      "
+            "How tests are split between shards (default hash)\n"
+            "  --shard-timings <test_run_raw_json_file>                    "
+            "Durations to balance shards with (required by duration)\n"
             "  -h, --help                                                  "
             "Display help\n");
 }
 
 static void print_logs_help(FILE *file) {
-    fprintf(file, "Usage: ltf logs [<info>] [<options>]\n"
+    fprintf(file, "Usage: ltf logs [<info|merge>] [<options>]\n"
                   "\n"
                   "Perform actions on LTF logs.\n"
                   "\n"
                   "Categories:\n"
                   "  info               Get information about the test run\n"
+                  "  merge              Combine raw logs of sharded test runs\n"
                   "  help               Display help\n"
                   "\n"
                   "Options:\n"
@@ -84,6 +112,19 @@ static void print_logs_info_help(FILE *file) {
                   "  -h, --help               Display help\n");
 }
 
+static void print_logs_merge_help(FILE *file) {
+    fprintf(file, "Usage: ltf logs merge <test_run_raw_json_file>... "
+                  "[<options>]\n"
+                  "\n"
+                  "Combine raw logs of shards of a test run into one.\n"
+                  "\n"
+                  "Options:\n"
+                  "  -o, --output <file>      Merged raw log file "
+                  "(default test_run_merged_raw.json)\n"
+                  "  -i, --internal-log       Dump internal logging file\n"
+                  "  -h, --help               Display help\n");
+}
+
 static void print_target_help(FILE *file) {
     fprintf(file,
             "Usage: ltf target [<add|remove>]\n"
@@ -186,6 +227,12 @@ cmd_logs_info_options *cmd_parser_get_logs_info_options() {
     return &logs_info_opts;
 }
 
+static cmd_logs_merge_options logs_merge_opts;
+cmd_logs_merge_options *cmd_parser_get_logs_merge_options() {
+    //
+    return &logs_merge_opts;
+}
+
 static cmd_eval_options eval_opts;
 cmd_eval_options *cmd_parser_get_eval_options() {
     //
@@ -280,6 +327,7 @@ static void set_internal_logging(const char *) {
     target_remove_opts.internal_logging = true;
     test_opts.internal_logging = true;
     logs_info_opts.internal_logging = true;
+    logs_merge_opts.internal_logging = true;
     eval_opts.internal_logging = true;
 }
 
@@ -467,6 +515,115 @@ static void set_test_scenario(const char *arg) {
     }
 }
 
+static void set_test_jobs(const char *arg) {
+    char *end = NULL;
+    long jobs = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || jobs < 1) {
+        fprintf(stderr, "Invalid amount of jobs '%s', must be >= 1\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    test_opts.jobs = (size_t)jobs;
+}
+
+static void set_test_tui_fps(const char *arg) {
+    char *end = NULL;
+    long fps = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || fps < 1 || fps > 1000) {
+        fprintf(stderr, "Invalid TUI refresh rate '%s', must be 1..1000\n",
+                arg);
+        exit(EXIT_FAILURE);
+    }
+    test_opts.tui_fps = (unsigned int)fps;
+}
+
+// Budgets are given in MiB, 0 disables the limit
+static size_t parse_mem_budget(const char *arg, const char *what) {
+    char *end = NULL;
+    long long mib = strtoll(arg, &end, 10);
+    if (!end || *end != '\0' || mib < 0 ||
+        (unsigned long long)mib > SIZE_MAX / (1024 * 1024)) {
+        fprintf(stderr, "Invalid %s memory budget '%s', must be >= 0 MiB\n",
+                what, arg);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)mib * 1024 * 1024;
+}
+
+static void set_test_mem_budget(const char *arg) {
+    test_opts.test_mem_budget = parse_mem_budget(arg, "test");
+}
+
+static void set_run_mem_budget(const char *arg) {
+    test_opts.run_mem_budget = parse_mem_budget(arg, "run");
+}
+
+static void set_test_profile(const char *) {
+    //
+    test_opts.profile = true;
+}
+
+static void set_test_profile_hz(const char *arg) {
+    char *end = NULL;
+    long hz = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || hz < 1 || hz > 100000) {
+        fprintf(stderr, "Invalid profiler rate '%s', must be 1..100000\n",
+                arg);
+        exit(EXIT_FAILURE);
+    }
+    test_opts.profile_hz = (unsigned int)hz;
+}
+
+static void set_test_timeout(const char *arg) {
+    char *end = NULL;
+    long long ms = strtoll(arg, &end, 10);
+    if (!end || end == arg || *end != '\0' || ms < 0) {
+        fprintf(stderr, "Invalid timeout '%s', must be >= 0 ms\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    test_opts.timeout_ms = (uint64_t)ms;
+}
+
+static void set_test_no_cache(const char *) {
+    //
+    test_opts.no_cache = true;
+}
+
+static void set_test_no_index(const char *) {
+    //
+    test_opts.no_index = true;
+}
+
+static void set_test_shard(const char *arg) {
+    if (ltf_shard_parse(arg, &test_opts.shard_index, &test_opts.shard_count)) {
+        fprintf(stderr, "Invalid shard '%s', must be i/N with 1 <= i <= N\n",
+                arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void set_test_shard_by(const char *arg) {
+    int by = ltf_shard_by_from_str(arg);
+    if (by < 0) {
+        fprintf(stderr,
+                "Unknown shard mode '%s', must be hash, round-robin or "
+                "duration\n",
+                arg);
+        exit(EXIT_FAILURE);
+    }
+    test_opts.shard_by = (ltf_shard_by_t)by;
+}
+
+static void set_test_shard_timings(const char *arg) {
+    free(test_opts.shard_timings);
+    test_opts.shard_timings = strdup(arg);
+}
+
+// The log path is optional, see parse_test_options()
+static void set_test_rerun_failed(const char *) {
+    //
+    test_opts.rerun_failed = true;
+}
+
 static void set_skip_hooks(const char *) {
     //
     test_opts.skip_hooks = true;
@@ -482,6 +639,19 @@ static cmd_option all_test_options[] = {
     {"--scenario", "-s", true, set_test_scenario},
     {"--internal-log", "-i", false, set_internal_logging},
     {"--headless", "-e", false, set_test_headless},
+    {"--jobs", "-j", true, set_test_jobs},
+    {"--tui-fps", NULL, true, set_test_tui_fps},
+    {"--test-mem-budget", NULL, true, set_test_mem_budget},
+    {"--run-mem-budget", NULL, true, set_run_mem_budget},
+    {"--profile", NULL, false, set_test_profile},
+    {"--profile-hz", NULL, true, set_test_profile_hz},
+    {"--timeout", NULL, true, set_test_timeout},
+    {"--no-cache", NULL, false, set_test_no_cache},
+    {"--no-index", NULL, false, set_test_no_index},
+    {"--rerun-failed", NULL, false, set_test_rerun_failed},
+    {"--shard", NULL, true, set_test_shard},
+    {"--shard-by", NULL, true, set_test_shard_by},
+    {"--shard-timings", NULL, true, set_test_shard_timings},
     {"--help", "-h", false, get_test_help},
     {NULL, NULL, false, NULL},
 };
@@ -497,6 +667,21 @@ static cmd_category parse_test_options(int argc, char **argv) {
     test_opts.custom_ltf_lib_path = NULL;
     test_opts.headless = NULL;
     test_opts.skip_hooks = false;
+    test_opts.jobs = 1;
+    test_opts.tui_fps = 30;
+    test_opts.test_mem_budget = (size_t)64 * 1024 * 1024;
+    test_opts.run_mem_budget = (size_t)512 * 1024 * 1024;
+    test_opts.profile = false;
+    test_opts.profile_hz = 1000;
+    test_opts.timeout_ms = 0;
+    test_opts.no_cache = false;
+    test_opts.no_index = false;
+    test_opts.shard_index = 0;
+    test_opts.shard_count = 0;
+    test_opts.shard_by = LTF_SHARD_BY_HASH;
+    test_opts.shard_timings = NULL;
+    test_opts.rerun_failed = false;
+    test_opts.rerun_log = NULL;
     test_opts.vars = da_init(1, sizeof(kv_pair_t));
     memset(&test_opts.scenario, 0, sizeof(test_opts.scenario));
     test_opts.scenario_parsed = false;
@@ -515,6 +700,23 @@ static cmd_category parse_test_options(int argc, char **argv) {
     }
     parse_additional_options(all_test_options, index, argc, argv);
 
+    // Arguments that are not options are skipped by the parser, so the log
+    // path of '--rerun-failed' is picked up here
+    for (int i = index; i + 1 < argc; ++i) {
+        if (STR_EQ(argv[i], "--rerun-failed") && argv[i + 1][0] != '-') {
+            test_opts.rerun_log = strdup(argv[i + 1]);
+            break;
+        }
+    }
+
+    // Local durations differ between machines, so would the shards
+    if (test_opts.shard_by == LTF_SHARD_BY_DURATION &&
+        !test_opts.shard_timings) {
+        fprintf(stderr, "'--shard-by duration' requires '--shard-timings'\n");
+        print_test_help(stderr);
+        return CMD_UNKNOWN;
+    }
+
     return CMD_TEST;
 }
 
@@ -539,10 +741,57 @@ static cmd_option all_logs_info_options[] = {
     {NULL, NULL, false, NULL},
 };
 
+static void get_logs_merge_help(const char *) {
+    print_logs_merge_help(stdout);
+    exit(EXIT_SUCCESS);
+}
+
+static void set_logs_merge_output(const char *arg) {
+    free(logs_merge_opts.output);
+    logs_merge_opts.output = strdup(arg);
+}
+
+static cmd_option all_logs_merge_options[] = {
+    {"--internal-log", "-i", false, set_internal_logging},
+    {"--output", "-o", true, set_logs_merge_output},
+    {"--help", "-h", false, get_logs_merge_help},
+    {NULL, NULL, false, NULL},
+};
+
+static cmd_category parse_logs_merge_options(int argc, char **argv) {
+    logs_merge_opts.inputs = da_init(1, sizeof(char *));
+    logs_merge_opts.output = NULL;
+    logs_merge_opts.internal_logging = false;
+
+    parse_additional_options(all_logs_merge_options, 3, argc, argv);
+
+    // Everything that is neither an option nor its argument is an input
+    for (int i = 3; i < argc; ++i) {
+        if (STR_EQ(argv[i], "--output") || STR_EQ(argv[i], "-o")) {
+            i++;
+            continue;
+        }
+        if (argv[i][0] == '-')
+            continue;
+        char *input = strdup(argv[i]);
+        da_append(logs_merge_opts.inputs, &input);
+    }
+
+    if (da_size(logs_merge_opts.inputs) == 0) {
+        fprintf(stderr, "'ltf logs merge' requires at least one raw log\n");
+        print_logs_merge_help(stderr);
+        return CMD_UNKNOWN;
+    }
+    if (!logs_merge_opts.output)
+        logs_merge_opts.output = strdup("test_run_merged_raw.json");
+
+    return CMD_LOGS_MERGE;
+}
+
 static cmd_category parse_logs_options(int argc, char **argv) {
 
     if (argc < 3) {
-        fprintf(stderr, "'ltf logs' requires category [info]\n");
+        fprintf(stderr, "'ltf logs' requires category [info|merge]\n");
         print_logs_help(stderr);
         return CMD_UNKNOWN;
     }
@@ -558,6 +807,8 @@ static cmd_category parse_logs_options(int argc, char **argv) {
         logs_info_opts.keyword_tree = false;
         parse_additional_options(all_logs_info_options, 3, argc, argv);
         return CMD_LOGS_INFO;
+    } else if (STR_EQ(argv[2], "merge")) {
+        return parse_logs_merge_options(argc, argv);
     } else if (STR_EQ(argv[2], "help") || STR_EQ(argv[2], "-h") ||
                STR_EQ(argv[2], "--help")) {
         print_logs_help(stdout);
@@ -736,6 +987,8 @@ void cmd_parser_free_test_options() {
     free_kv_pair_da(test_opts.vars);
     free(test_opts.target);
     free(test_opts.custom_ltf_lib_path);
+    free(test_opts.shard_timings);
+    free(test_opts.rerun_log);
 
     free(test_opts.scenario.target);
     free_str_da(test_opts.scenario.tags);
@@ -748,3 +1001,8 @@ void cmd_parser_free_eval_options() {
     //
     free_str_da(eval_opts.args);
 }
+
+void cmd_parser_free_logs_merge_options() {
+    free_str_da(logs_merge_opts.inputs);
+    free(logs_merge_opts.output);
+}
@@ -3,6 +3,7 @@
 #include "cmd_parser.h"
 #include "ltf_hooks.h"
 #include "ltf_state.h"
+#include "util/string.h"
 #include "util/time.h"
 #include "version.h"
 
@@ -145,6 +146,12 @@ static void ltf_headless_run_finished() {
     puts("\nLTF Test Run Finished.\n");
     printf("Total: %zu, Passed: %zu, Failed: %zu\n", ltf_state->total_amount,
            ltf_state->passed_amount, ltf_state->failed_amount);
+
+    char peak[32];
+    char spilled[32];
+    string_format_bytes(ltf_state->outputs_mem_peak, peak, sizeof peak);
+    string_format_bytes(ltf_state->outputs_spilled, spilled, sizeof spilled);
+    printf("Output memory: peak %s, %s spilled to disk\n", peak, spilled);
 }
 
 void ltf_headless_init(ltf_state_t *state) {
@@ -5,7 +5,7 @@
 
 #include <string.h>
 
-static da_t *keyword_statuses = NULL;
+static keyword_tree_t *keywords = NULL;
 typedef struct {
     keyword_status_t *kw;
     bool ignored;
@@ -19,7 +19,7 @@ static bool test_running = false;
 
 static void keyword_status_test_started(ltf_state_test_t *) {
     test_running = true;
-    keyword_statuses = da_init(10, sizeof(keyword_status_t));
+    keywords = keyword_tree_new();
     if (keyword_stack) {
         da_clear(keyword_stack);
     }
@@ -27,10 +27,10 @@ static void keyword_status_test_started(ltf_state_test_t *) {
 
 static void keyword_status_test_finished(ltf_state_test_t *) {
     test_running = false;
-    ltf_state_test_set_keyword_statuses(ltf_state, keyword_statuses);
+    ltf_state_test_set_keywords(ltf_state, keywords);
     // Freeing keywords is handled in ltf_state.c,
     // so here we just NULLify them just in case
-    keyword_statuses = NULL;
+    keywords = NULL;
 }
 
 static void call_hook(lua_State *L, lua_Debug *ar, const char *src) {
@@ -60,29 +60,13 @@ static void call_hook(lua_State *L, lua_Debug *ar, const char *src) {
     if (parent_entry && parent_entry->in_blacklist && in_blacklist)
         ignored = true;
 
-    char time[TS_LEN];
-    get_date_time_now(time);
-
-    keyword_status_t ks = {.children = da_init(10, sizeof(keyword_status_t)),
-                           .name = strdup(ar->name ? ar->name : "(undefined)"),
-                           .started = strdup(time),
-                           .file = strdup(src),
-                           .line = ar->linedefined,
-                           .finished = NULL,
-                           .ignored = ignored};
-
     keyword_status_t *added = NULL;
 
-    if (!ignored) {
-
-        if (parent && !parent->ignored) {
-            da_append(parent->children, &ks);
-            added = da_get(parent->children, da_size(parent->children) - 1);
-        } else {
-            da_append(keyword_statuses, &ks);
-            added = da_get(keyword_statuses, da_size(keyword_statuses) - 1);
-        }
-
+    if (!ignored && keywords) {
+        // Ignored keywords are never stored, so 'parent' is either a stored
+        // keyword or NULL for a top level one
+        added = keyword_tree_add(keywords, parent, ar->name, src,
+                                 ar->linedefined, monotonic_nanos());
     }
 
     keyword_stack_entry_t entry = {
@@ -119,9 +103,7 @@ static void ret_hook(lua_State *L, lua_Debug *ar, const char *src) {
         return;
 
     if (!entry.ignored && entry.kw) {
-        char time[TS_LEN];
-        get_date_time_now(time);
-        entry.kw->finished = strdup(time);
+        entry.kw->finished_ns = monotonic_nanos();
     }
 }
 
@@ -0,0 +1,128 @@
+#include "keyword_tree.h"
+
+#include "util/arena.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_MIN_CAPACITY 64
+
+struct keyword_tree {
+    arena_t *arena;
+
+    keyword_status_t *roots;
+    keyword_status_t *last_root;
+
+    // Open addressing set of the names and files stored in the arena: a
+    // test calls the same few functions over and over
+    const char **interned;
+    size_t interned_capacity; // power of two
+    size_t interned_count;
+};
+
+static uint64_t string_hash(const char *s) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static bool intern_grow(keyword_tree_t *tree) {
+    size_t capacity = tree->interned_capacity ? tree->interned_capacity * 2
+                                              : INTERN_MIN_CAPACITY;
+    const char **grown = calloc(capacity, sizeof *grown);
+    if (!grown)
+        return false;
+
+    for (size_t i = 0; i < tree->interned_capacity; ++i) {
+        const char *s = tree->interned[i];
+        if (!s)
+            continue;
+        size_t slot = string_hash(s) & (capacity - 1);
+        while (grown[slot])
+            slot = (slot + 1) & (capacity - 1);
+        grown[slot] = s;
+    }
+
+    free(tree->interned);
+    tree->interned = grown;
+    tree->interned_capacity = capacity;
+    return true;
+}
+
+static const char *intern(keyword_tree_t *tree, const char *s) {
+    if (!s)
+        return NULL;
+
+    // Keep the load factor under 3/4
+    if ((tree->interned_count + 1) * 4 > tree->interned_capacity * 3 &&
+        !intern_grow(tree))
+        return NULL;
+
+    size_t mask = tree->interned_capacity - 1;
+    size_t slot = string_hash(s) & mask;
+    while (tree->interned[slot]) {
+        if (strcmp(tree->interned[slot], s) == 0)
+            return tree->interned[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    char *copy = arena_strndup(tree->arena, s, strlen(s));
+    if (!copy)
+        return NULL;
+    tree->interned[slot] = copy;
+    tree->interned_count++;
+    return copy;
+}
+
+keyword_tree_t *keyword_tree_new(void) {
+    keyword_tree_t *tree = calloc(1, sizeof *tree);
+    if (!tree)
+        return NULL;
+    tree->arena = arena_init(0);
+    if (!tree->arena) {
+        free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+void keyword_tree_free(keyword_tree_t *tree) {
+    if (!tree)
+        return;
+    arena_free(tree->arena);
+    free(tree->interned);
+    free(tree);
+}
+
+keyword_status_t *keyword_tree_add(keyword_tree_t *tree,
+                                   keyword_status_t *parent, const char *name,
+                                   const char *file, int line,
+                                   uint64_t started_ns) {
+    keyword_status_t *kw = arena_alloc(tree->arena, sizeof *kw);
+    if (!kw)
+        return NULL;
+
+    kw->name = intern(tree, name);
+    kw->file = intern(tree, file);
+    kw->line = line;
+    kw->started_ns = started_ns;
+
+    keyword_status_t **first = parent ? &parent->children : &tree->roots;
+    keyword_status_t **last = parent ? &parent->last_child : &tree->last_root;
+    if (*last)
+        (*last)->next = kw;
+    else
+        *first = kw;
+    *last = kw;
+
+    return kw;
+}
+
+keyword_status_t *keyword_tree_roots(const keyword_tree_t *tree) {
+    return tree ? tree->roots : NULL;
+}
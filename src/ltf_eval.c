@@ -4,6 +4,7 @@
 #include "internal_logging.h"
 #include "libgen.h"
 #include "ltf_test.h"
+#include "modules/http/ltf-http-pool.h"
 #include "project_parser.h"
 #include "util/files.h"
 #include "util/time.h"
@@ -90,10 +91,9 @@ int ltf_eval() {
         exitcode = EXIT_SUCCESS;
     }
 
-deinit:
-
     LOG("Tidying up...");
     lua_close(L);
+    http_pool_clear();
     cmd_parser_free_eval_options();
     free(project_lib_dir_path);
     internal_logging_deinit();
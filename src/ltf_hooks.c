@@ -9,6 +9,7 @@
 #include "ltf_vars.h"
 #include "test_logs.h"
 #include "util/kv.h"
+#include "util/time.h"
 
 #include <lua.h>
 #include <stdlib.h>
@@ -91,23 +92,43 @@ static inline void push_output(lua_State *L, const ltf_state_test_output_t *o) {
     lua_setfield(L, -2, "line");
 }
 
+typedef struct {
+    lua_State *L;
+    lua_Integer index;
+} push_outputs_ctx_t;
+
+static void push_output_cb(ltf_state_test_output_t *o, void *ud) {
+    push_outputs_ctx_t *ctx = ud;
+    push_output(ctx->L, o);
+    lua_seti(ctx->L, -2, ++ctx->index);
+}
+
 static inline void push_keyword(lua_State *L, const keyword_status_t *s) {
+    char time[TS_LEN];
+
     lua_newtable(L);
 
     push_string(L, "name", s->name);
-    push_string(L, "started", s->started);
-    push_string(L, "finished", s->finished);
+    monotonic_to_date_time(s->started_ns, time);
+    push_string(L, "started", time);
+    if (s->finished_ns) {
+        monotonic_to_date_time(s->finished_ns, time);
+        push_string(L, "finished", time);
+
+        lua_pushinteger(L, (lua_Integer)(s->finished_ns - s->started_ns));
+        lua_setfield(L, -2, "duration_ns");
+    }
     push_string(L, "file", s->file);
 
     lua_pushinteger(L, (lua_Integer)s->line);
     lua_setfield(L, -2, "line");
 
     lua_newtable(L);
-    size_t children_count = da_size(s->children);
-    for (size_t i = 0; i < children_count; ++i) {
-        keyword_status_t *child = da_get(s->children, i);
+    lua_Integer index = 0;
+    for (const keyword_status_t *child = s->children; child;
+         child = child->next) {
         push_keyword(L, child);
-        lua_seti(L, -2, (lua_Integer)(i + 1));
+        lua_seti(L, -2, ++index);
     }
     lua_setfield(L, -2, "children");
 }
@@ -184,12 +205,8 @@ static int hooks_context_push(lua_State *L) {
 
         // test.outputs
         lua_newtable(L);
-        size_t outputs_count = da_size(t->outputs);
-        for (size_t i = 0; i < outputs_count; i++) {
-            ltf_state_test_output_t *o = da_get(t->outputs, i);
-            push_output(L, o);
-            lua_seti(L, -2, (lua_Integer)(i + 1));
-        }
+        push_outputs_ctx_t outputs_ctx = {.L = L, .index = 0};
+        ltf_state_test_foreach_output(t, push_output_cb, &outputs_ctx);
         lua_setfield(L, -2, "outputs");
 
         // test.failure_reasons
@@ -224,11 +241,11 @@ static int hooks_context_push(lua_State *L) {
 
         // test.keywords
         lua_newtable(L);
-        size_t keywords_count = da_size(t->keyword_statuses);
-        for (size_t i = 0; i < keywords_count; i++) {
-            keyword_status_t *s = da_get(t->keyword_statuses, i);
+        lua_Integer keyword_index = 0;
+        for (const keyword_status_t *s = keyword_tree_roots(t->keywords); s;
+             s = s->next) {
             push_keyword(L, s);
-            lua_seti(L, -2, (lua_Integer)(i + 1));
+            lua_seti(L, -2, ++keyword_index);
         }
         lua_setfield(L, -2, "keywords");
 
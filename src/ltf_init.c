@@ -19,6 +19,7 @@
 
 static const char *gitignore_contents = //
     "logs/\n"                           //
+    ".ltf/\n"                           //
     ".secrets\n"                        //
     "\n"                                //
     "\n"                                //
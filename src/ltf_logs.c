@@ -9,6 +9,7 @@
 
 #include "ltf_vars.h"
 #include "util/files.h"
+#include "util/time.h"
 
 #include <json.h>
 
@@ -62,9 +63,8 @@ static ltf_state_t *ltf_logs_info_load_log(cmd_logs_info_options *opts) {
 
     LOG("Log path: %s", log_file_path);
 
-    LOG("Getting JSON object...");
-    json_object *root = json_object_from_file(log_file_path);
-    ltf_state_t *ltf_state = ltf_state_from_json(root);
+    LOG("Loading log file...");
+    ltf_state_t *ltf_state = ltf_state_from_file(log_file_path);
     if (!ltf_state || !ltf_state->os || !ltf_state->os_version) {
         LOG("Log file is incorrect or corrupt");
         fprintf(stderr, "Log file %s is either incorrect or corrupt.\n",
@@ -82,7 +82,8 @@ static void ltf_logs_info_print_header(ltf_state_t *ltf_state) {
     printf("├── LTF version: %s\n", ltf_state->ltf_version);
     printf("├── Host OS: %s\n", ltf_state->os_version);
     printf("├── Started: %s\n", ltf_state->started);
-    printf("├── Finished: %s\n", ltf_state->finished);
+    printf("├── Finished: %s\n",
+           ltf_state->finished ? ltf_state->finished : "(interrupted)");
 
     if (ltf_state->target && *ltf_state->target)
         printf("├── Target: %s\n", ltf_state->target);
@@ -164,6 +165,15 @@ static void ltf_logs_info_print_prop(da_t *has_more_at_level, size_t level,
     fputc('\n', stdout);
 }
 
+static void format_duration(uint64_t ns, char *buf, size_t buf_len) {
+    if (ns < 1000000ULL)
+        snprintf(buf, buf_len, "%.3f us", (double)ns / 1e3);
+    else if (ns < 1000000000ULL)
+        snprintf(buf, buf_len, "%.3f ms", (double)ns / 1e6);
+    else
+        snprintf(buf, buf_len, "%.3f s", (double)ns / 1e9);
+}
+
 static void ltf_logs_info_print_keyword_rec(keyword_status_t *keyword,
                                             da_t *has_more_at_level,
                                             size_t level,
@@ -181,25 +191,34 @@ static void ltf_logs_info_print_keyword_rec(keyword_status_t *keyword,
     printf("[%s]\n", keyword->name);
 
     /* Facts */
-    size_t children_count = da_size(keyword->children);
-    bool have_children = (children_count != 0);
-    bool finished = (keyword->finished && *keyword->finished);
+    bool have_children = (keyword->children != NULL);
+    bool finished = (keyword->finished_ns != 0);
 
-    /* Properties: Started, (Finished), Declaration, (Children:) */
-    int prop_total = 2 + (finished ? 1 : 0) + (have_children ? 1 : 0);
+    /* Properties: Started, (Finished, Duration), Declaration, (Children:) */
+    int prop_total = 2 + (finished ? 2 : 0) + (have_children ? 1 : 0);
     int idx = 0;
     bool last_prop;
+    char time[TS_LEN];
 
     /* Started */
+    monotonic_to_date_time(keyword->started_ns, time);
     last_prop = (++idx == prop_total);
     ltf_logs_info_print_prop(has_more_at_level, level, !is_last_sibling,
-                             last_prop, "Started: ", keyword->started);
+                             last_prop, "Started: ", time);
 
     /* Finished */
     if (finished) {
+        monotonic_to_date_time(keyword->finished_ns, time);
         last_prop = (++idx == prop_total);
         ltf_logs_info_print_prop(has_more_at_level, level, !is_last_sibling,
-                                 last_prop, "Finished: ", keyword->finished);
+                                 last_prop, "Finished: ", time);
+
+        char duration[32];
+        format_duration(keyword->finished_ns - keyword->started_ns, duration,
+                        sizeof duration);
+        last_prop = (++idx == prop_total);
+        ltf_logs_info_print_prop(has_more_at_level, level, !is_last_sibling,
+                                 last_prop, "Duration: ", duration);
     }
 
     /* Declaration */
@@ -217,9 +236,9 @@ static void ltf_logs_info_print_keyword_rec(keyword_status_t *keyword,
                                  last_prop, "Children:", NULL);
 
         /* Recurse */
-        for (size_t i = 0; i < children_count; ++i) {
-            keyword_status_t *child = da_get(keyword->children, i);
-            bool child_is_last = (i == children_count - 1);
+        for (keyword_status_t *child = keyword->children; child;
+             child = child->next) {
+            bool child_is_last = (child->next == NULL);
             ltf_logs_info_print_keyword_rec(child, has_more_at_level, level + 1,
                                             child_is_last);
         }
@@ -227,16 +246,15 @@ static void ltf_logs_info_print_keyword_rec(keyword_status_t *keyword,
 }
 
 static void ltf_logs_info_print_test_keyword_tree(ltf_state_test_t *test) {
-    size_t count = da_size(test->keyword_statuses);
-    if (count == 0) {
+    keyword_status_t *roots = keyword_tree_roots(test->keywords);
+    if (!roots) {
         return;
     }
 
     da_t *has_more_at_level = da_init(4, sizeof(bool)); /* grows as needed */
 
-    for (size_t i = 0; i < count; ++i) {
-        keyword_status_t *kw = da_get(test->keyword_statuses, i);
-        bool is_last = (i == count - 1);
+    for (keyword_status_t *kw = roots; kw; kw = kw->next) {
+        bool is_last = (kw->next == NULL);
         ltf_logs_info_print_keyword_rec(kw, has_more_at_level, 0, is_last);
     }
 
@@ -267,7 +285,7 @@ static void ltf_logs_info_print_test(ltf_state_test_t *test,
     bool has_teardown_errors = da_size(test->teardown_errors) != 0;
 
     bool has_keywords =
-        opts->keyword_tree && da_size(test->keyword_statuses) != 0;
+        opts->keyword_tree && keyword_tree_roots(test->keywords) != NULL;
 
     ch = (opts->include_outputs &&
           (has_failure_reasons || has_outputs || has_teardown_outputs ||
@@ -322,3 +340,170 @@ int ltf_logs_info() {
 
     return EXIT_SUCCESS;
 }
+
+// Keep the earliest 'started' and the latest 'finished' of both runs. A run
+// that never finished leaves the merged one unfinished as well.
+static void ltf_logs_merge_times(ltf_state_t *merged, ltf_state_t *shard) {
+    uint64_t started = date_time_to_monotonic(merged->started);
+    uint64_t shard_started = date_time_to_monotonic(shard->started);
+    if (shard_started && (!started || shard_started < started)) {
+        free(merged->started);
+        merged->started = shard->started;
+        shard->started = NULL;
+    }
+
+    if (!merged->finished)
+        return;
+    if (!shard->finished) {
+        free(merged->finished);
+        merged->finished = NULL;
+        return;
+    }
+    if (date_time_to_monotonic(shard->finished) >
+        date_time_to_monotonic(merged->finished)) {
+        free(merged->finished);
+        merged->finished = shard->finished;
+        shard->finished = NULL;
+    }
+}
+
+static ltf_state_test_t *ltf_logs_merge_find(ltf_state_t *merged,
+                                             size_t count, const char *name) {
+    for (size_t i = 0; i < count; ++i) {
+        ltf_state_test_t *test = da_get(merged->tests, i);
+        if (test->name && name && !strcmp(test->name, name))
+            return test;
+    }
+    return NULL;
+}
+
+// Move the tests of 'shard' into 'merged'. A test that is already in one of
+// the previous logs is replaced, so the last log given wins.
+static void ltf_logs_merge_tests(ltf_state_t *merged, ltf_state_t *shard,
+                                 const char *path) {
+    size_t merged_count = da_size(merged->tests);
+    da_foreach(shard->tests, ltf_state_test_t, test) {
+        ltf_state_test_t *prev =
+            ltf_logs_merge_find(merged, merged_count, test->name);
+        if (prev) {
+            fprintf(stderr,
+                    YELLOW_COLOR "WARNING:" END_COLOR
+                                 " Test '%s' is in several logs, using the "
+                                 "one of %s\n",
+                    test->name, path);
+            // The replaced test is freed along with 'shard'
+            ltf_state_test_t tmp = *prev;
+            *prev = *test;
+            *test = tmp;
+            continue;
+        }
+        da_append(merged->tests, test);
+        memset(test, 0, sizeof *test);
+    }
+}
+
+static void ltf_logs_merge_count(ltf_state_t *merged) {
+    merged->total_amount = da_size(merged->tests);
+    merged->passed_amount = 0;
+    merged->failed_amount = 0;
+    da_foreach(merged->tests, ltf_state_test_t, test) {
+        if (!test->status_str)
+            continue;
+        if (!strcmp(test->status_str, "PASSED"))
+            merged->passed_amount++;
+        else if (!strcmp(test->status_str, "FAILED"))
+            merged->failed_amount++;
+    }
+    merged->finished_amount = merged->passed_amount + merged->failed_amount;
+}
+
+static ltf_state_t *ltf_logs_merge_load(const char *path) {
+    LOG("Loading log file %s...", path);
+    ltf_state_t *state = NULL;
+    if (file_exists(path))
+        state = ltf_state_from_file(path);
+
+    if (!state || !state->os || !state->os_version) {
+        LOG("Log file %s is incorrect or corrupt", path);
+        fprintf(stderr,
+                "Log file %s is either missing, incorrect or corrupt.\n",
+                path);
+        ltf_state_free(state);
+        return NULL;
+    }
+    if (!state->tests)
+        state->tests = da_init(1, sizeof(ltf_state_test_t));
+    return state;
+}
+
+static bool str_differs(const char *a, const char *b) {
+    return (a || b) && (!a || !b || strcmp(a, b));
+}
+
+int ltf_logs_merge() {
+
+    cmd_logs_merge_options *opts = cmd_parser_get_logs_merge_options();
+
+    if (opts->internal_logging && internal_logging_init()) {
+        fprintf(stderr, "Unable to init internal_logging.\n");
+        cmd_parser_free_logs_merge_options();
+        return EXIT_FAILURE;
+    }
+
+    LOG("Starting ltf logs merge...");
+
+    int exitcode = EXIT_FAILURE;
+    ltf_state_t *merged = NULL;
+
+    // The header (project, versions, variables, tags) is the one of the
+    // first log, the shards of a run share it
+    da_foreach(opts->inputs, char *, path) {
+        ltf_state_t *shard = ltf_logs_merge_load(*path);
+        if (!shard)
+            goto deinit;
+
+        if (!merged) {
+            merged = shard;
+            continue;
+        }
+
+        if (str_differs(merged->project_name, shard->project_name) ||
+            str_differs(merged->target, shard->target)) {
+            fprintf(stderr,
+                    "Log file %s is of another project or target, unable to "
+                    "merge it.\n",
+                    *path);
+            ltf_state_free(shard);
+            goto deinit;
+        }
+
+        ltf_logs_merge_times(merged, shard);
+        ltf_logs_merge_tests(merged, shard, *path);
+        ltf_state_free(shard);
+    }
+
+    ltf_logs_merge_count(merged);
+
+    json_object *root = ltf_state_to_json(merged);
+    if (json_object_to_file_ext(opts->output, root,
+                                JSON_C_TO_STRING_PLAIN |
+                                    JSON_C_TO_STRING_NOSLASHESCAPE)) {
+        const char *err = json_util_get_last_err();
+        LOG("Unable to write merged log: %s", err);
+        fprintf(stderr, "Unable to write merged log %s: %s\n", opts->output,
+                err);
+    } else {
+        printf("Merged %zu logs into %s: %zu tests, %zu passed, %zu failed\n",
+               da_size(opts->inputs), opts->output, merged->total_amount,
+               merged->passed_amount, merged->failed_amount);
+        exitcode = EXIT_SUCCESS;
+    }
+    json_object_put(root);
+
+deinit:
+    ltf_state_free(merged);
+    cmd_parser_free_logs_merge_options();
+    internal_logging_deinit();
+
+    return exitcode;
+}
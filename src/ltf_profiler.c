@@ -0,0 +1,386 @@
+#include "ltf_profiler.h"
+
+#include "internal_logging.h"
+#include "modules/ltf/ltf.h"
+
+#include "util/files.h"
+#include "util/lua_hooks.h"
+#include "util/time.h"
+
+#include <lauxlib.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILER_HOOK_COUNT 1000 // VM instructions between clock checks
+#define PROFILER_MAX_DEPTH 64
+#define PROFILER_FRAME_LEN 256
+#define PROFILER_STACK_LEN 8192
+
+/* ----- collapsed stacks ----------------------------------------------- */
+
+typedef struct {
+    char *stack;
+    uint64_t count;
+} folded_entry_t;
+
+// Open addressing map of "root;...;leaf" -> samples
+typedef struct {
+    folded_entry_t *entries;
+    size_t capacity; // power of two
+    size_t count;
+} folded_t;
+
+static uint64_t stack_hash(const char *s, size_t len) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static bool folded_grow(folded_t *f) {
+    size_t capacity = f->capacity ? f->capacity * 2 : 256;
+    folded_entry_t *grown = calloc(capacity, sizeof *grown);
+    if (!grown)
+        return false;
+
+    for (size_t i = 0; i < f->capacity; ++i) {
+        folded_entry_t *e = &f->entries[i];
+        if (!e->stack)
+            continue;
+        size_t slot = stack_hash(e->stack, strlen(e->stack)) & (capacity - 1);
+        while (grown[slot].stack)
+            slot = (slot + 1) & (capacity - 1);
+        grown[slot] = *e;
+    }
+
+    free(f->entries);
+    f->entries = grown;
+    f->capacity = capacity;
+    return true;
+}
+
+static void folded_add(folded_t *f, const char *stack, size_t len,
+                       uint64_t count) {
+    if ((f->count + 1) * 4 > f->capacity * 3 && !folded_grow(f))
+        return;
+
+    size_t mask = f->capacity - 1;
+    size_t slot = stack_hash(stack, len) & mask;
+    while (f->entries[slot].stack) {
+        folded_entry_t *e = &f->entries[slot];
+        if (strncmp(e->stack, stack, len) == 0 && e->stack[len] == '\0') {
+            e->count += count;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    char *copy = strndup(stack, len);
+    if (!copy)
+        return;
+    f->entries[slot] = (folded_entry_t){.stack = copy, .count = count};
+    f->count++;
+}
+
+static void folded_clear(folded_t *f) {
+    for (size_t i = 0; i < f->capacity; ++i) {
+        free(f->entries[i].stack);
+    }
+    free(f->entries);
+    *f = (folded_t){0};
+}
+
+static int folded_write(const folded_t *f, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+    for (size_t i = 0; i < f->capacity; ++i) {
+        const folded_entry_t *e = &f->entries[i];
+        if (e->stack)
+            fprintf(file, "%s %" PRIu64 "\n", e->stack, e->count);
+    }
+    return fclose(file) ? -1 : 0;
+}
+
+static void folded_read(folded_t *f, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, file)) > 0) {
+        // "stack count\n", the stack itself may contain spaces
+        char *space = strrchr(line, ' ');
+        if (!space)
+            continue;
+        uint64_t count = strtoull(space + 1, NULL, 10);
+        folded_add(f, line, (size_t)(space - line), count);
+    }
+    free(line);
+    fclose(file);
+}
+
+/* ----- sampling ------------------------------------------------------- */
+
+static char *profile_dir = NULL;
+static uint64_t interval_ns = 0;
+static unsigned int profile_hz = 0;
+
+static folded_t test_folded;
+static ltf_state_test_profile_t test_profile;
+static uint64_t test_started_ns = 0;
+static uint64_t last_sample_ns = 0;
+
+static void frame_label(const lua_Debug *ar, char out[PROFILER_FRAME_LEN]) {
+    const char *name = ar->name ? ar->name : NULL;
+
+    if (ar->what[0] == 'C')
+        snprintf(out, PROFILER_FRAME_LEN, "%s [C]", name ? name : "?");
+    else if (ar->what[0] == 'm')
+        snprintf(out, PROFILER_FRAME_LEN, "main (%s)", ar->short_src);
+    else
+        snprintf(out, PROFILER_FRAME_LEN, "%s (%s:%d)",
+                 name ? name : "anonymous", ar->short_src, ar->linedefined);
+
+    // ';' separates frames and a newline ends the record
+    for (char *p = out; *p; ++p) {
+        if (*p == ';' || *p == '\n')
+            *p = ':';
+    }
+}
+
+static void take_sample(lua_State *L, uint64_t ticks) {
+    lua_Debug ar;
+
+    int depth = 0;
+    while (depth < PROFILER_MAX_DEPTH && lua_getstack(L, depth, &ar))
+        depth++;
+
+    char stack[PROFILER_STACK_LEN];
+    size_t len = 0;
+
+    // Deeper stacks keep their leaf-most frames
+    if (depth == PROFILER_MAX_DEPTH && lua_getstack(L, depth, &ar))
+        len = (size_t)snprintf(stack, sizeof stack, "...");
+
+    for (int level = depth - 1; level >= 0; --level) {
+        if (!lua_getstack(L, level, &ar) || !lua_getinfo(L, "Sn", &ar))
+            continue;
+
+        char frame[PROFILER_FRAME_LEN];
+        frame_label(&ar, frame);
+
+        int n = snprintf(stack + len, sizeof stack - len, "%s%s",
+                         len ? ";" : "", frame);
+        if (n < 0 || (size_t)n >= sizeof stack - len)
+            break;
+        len += (size_t)n;
+    }
+
+    if (len)
+        folded_add(&test_folded, stack, len, ticks);
+    test_profile.samples += ticks;
+}
+
+static void profiler_tick(lua_State *L, lua_Debug *ar, bool in_c) {
+    uint64_t now = monotonic_nanos();
+
+    if (now - last_sample_ns >= interval_ns) {
+        uint64_t ticks = (now - last_sample_ns) / interval_ns;
+        last_sample_ns += ticks * interval_ns;
+
+        if (in_c) {
+            lua_getinfo(L, "f", ar);
+            bool sleeping = lua_tocfunction(L, -1) == l_module_ltf_sleep;
+            lua_pop(L, 1);
+
+            if (sleeping)
+                test_profile.samples_sleep += ticks;
+            else
+                test_profile.samples_c += ticks;
+        }
+        take_sample(L, ticks);
+    }
+
+    test_profile.overhead_ns += monotonic_nanos() - now;
+}
+
+static void profiler_count_hook(lua_State *L, lua_Debug *ar, const char *) {
+    profiler_tick(L, ar, false);
+}
+
+// Lua code is not running while a C function (module call, sleep, ...) is,
+// so its time is charged when it returns, with the C frame on the stack
+static void profiler_ret_hook(lua_State *L, lua_Debug *ar, const char *) {
+    if (ar->what && ar->what[0] == 'C')
+        profiler_tick(L, ar, true);
+}
+
+static char *test_profile_path(const char *test_name) {
+    char *name = strdup(test_name ? test_name : "unnamed");
+    if (!name)
+        return NULL;
+    for (char *p = name; *p; ++p) {
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_' && *p != '.')
+            *p = '_';
+    }
+
+    char *path = NULL;
+    asprintf(&path, "%s/tests/%s.folded", profile_dir, name);
+    for (size_t i = 2; path && file_exists(path); i++) {
+        free(path);
+        path = NULL;
+        asprintf(&path, "%s/tests/%s(%zu).folded", profile_dir, name, i);
+    }
+
+    free(name);
+    return path;
+}
+
+static void profiler_test_started(ltf_state_test_t *) {
+    folded_clear(&test_folded);
+    test_profile = (ltf_state_test_profile_t){0};
+
+    lua_hooks_set_count(PROFILER_HOOK_COUNT);
+    lua_hooks_add_unfiltered(LUA_HOOKCOUNT, profiler_count_hook);
+    lua_hooks_add_unfiltered(LUA_HOOKRET, profiler_ret_hook);
+
+    test_started_ns = monotonic_nanos();
+    last_sample_ns = test_started_ns;
+}
+
+static void profiler_test_finished(ltf_state_test_t *test) {
+    uint64_t now = monotonic_nanos();
+
+    lua_hooks_remove_unfiltered(LUA_HOOKCOUNT, profiler_count_hook);
+    lua_hooks_remove_unfiltered(LUA_HOOKRET, profiler_ret_hook);
+
+    test_profile.duration_ns = now - test_started_ns;
+    test->profile = test_profile;
+
+    char *path = test_profile_path(test->name);
+    if (!path || folded_write(&test_folded, path)) {
+        LOG("Unable to write profile of test '%s'.", test->name);
+    } else {
+        LOG("Wrote profile of test '%s' (%" PRIu64 " samples) to '%s'.",
+            test->name, test_profile.samples, path);
+    }
+    free(path);
+    folded_clear(&test_folded);
+}
+
+/* ----- public API ----------------------------------------------------- */
+
+int ltf_profiler_init(const char *dir, unsigned int hz) {
+    if (!dir || hz == 0)
+        return -1;
+
+    char *tests_dir = NULL;
+    asprintf(&tests_dir, "%s/tests", dir);
+    if (!tests_dir || create_directory(tests_dir, MKDIR_MODE)) {
+        LOG("Unable to create profile directory '%s'.", dir);
+        free(tests_dir);
+        return -1;
+    }
+    free(tests_dir);
+
+    free(profile_dir);
+    profile_dir = strdup(dir);
+    profile_hz = hz;
+    interval_ns = 1000000000ULL / hz;
+
+    LOG("Profiling test bodies at %u Hz into '%s'.", hz, dir);
+    return 0;
+}
+
+bool ltf_profiler_enabled(void) { return profile_dir != NULL; }
+
+void ltf_profiler_attach(ltf_state_t *state) {
+    if (!profile_dir)
+        return;
+    ltf_state_register_test_started_cb(state, profiler_test_started);
+    ltf_state_register_test_finished_cb(state, profiler_test_finished);
+}
+
+void ltf_profiler_finish(ltf_state_t *state) {
+    if (!profile_dir)
+        return;
+
+    // Per test files come from this process or from the workers
+    folded_t all = {0};
+    char *tests_dir = NULL;
+    asprintf(&tests_dir, "%s/tests", profile_dir);
+    DIR *d = tests_dir ? opendir(tests_dir) : NULL;
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d))) {
+            const char *ext = strrchr(entry->d_name, '.');
+            if (!ext || strcmp(ext, ".folded") != 0)
+                continue;
+            char *path = NULL;
+            asprintf(&path, "%s/%s", tests_dir, entry->d_name);
+            if (path)
+                folded_read(&all, path);
+            free(path);
+        }
+        closedir(d);
+    }
+    free(tests_dir);
+
+    char *all_path = NULL;
+    asprintf(&all_path, "%s/all.folded", profile_dir);
+    if (!all_path || folded_write(&all, all_path))
+        LOG("Unable to write aggregate profile.");
+    folded_clear(&all);
+
+    ltf_state_test_profile_t total = {0};
+    size_t tests_count = da_size(state->tests);
+    for (size_t i = 0; i < tests_count; ++i) {
+        const ltf_state_test_t *t = da_cget(state->tests, i);
+        total.samples += t->profile.samples;
+        total.samples_c += t->profile.samples_c;
+        total.samples_sleep += t->profile.samples_sleep;
+        total.duration_ns += t->profile.duration_ns;
+        total.overhead_ns += t->profile.overhead_ns;
+    }
+
+    uint64_t samples_lua =
+        total.samples - total.samples_c - total.samples_sleep;
+    double per_sample = total.samples ? 100.0 / (double)total.samples : 0;
+    double overhead_pct =
+        total.duration_ns
+            ? 100.0 * (double)total.overhead_ns / (double)total.duration_ns
+            : 0;
+
+    printf("\nProfile: %" PRIu64 " samples at %u Hz "
+           "(Lua %.1f%%, C %.1f%%, sleep %.1f%%)\n",
+           total.samples, profile_hz, (double)samples_lua * per_sample,
+           (double)total.samples_c * per_sample,
+           (double)total.samples_sleep * per_sample);
+    printf("Profiler overhead: %.1f ms (%.2f%% of %.1f ms profiled)\n",
+           (double)total.overhead_ns / 1e6, overhead_pct,
+           (double)total.duration_ns / 1e6);
+    printf("Flamegraph stacks: %s\n", all_path ? all_path : profile_dir);
+
+    LOG("Profile: %" PRIu64 " samples, overhead %" PRIu64 " ns of %" PRIu64
+        " ns.",
+        total.samples, total.overhead_ns, total.duration_ns);
+    free(all_path);
+}
+
+void ltf_profiler_free(void) {
+    folded_clear(&test_folded);
+    free(profile_dir);
+    profile_dir = NULL;
+}
@@ -0,0 +1,103 @@
+#include "ltf_shard.h"
+
+#include "internal_logging.h"
+#include "test_case.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int ltf_shard_parse(const char *spec, size_t *index, size_t *count) {
+    char *end = NULL;
+    unsigned long long i = strtoull(spec, &end, 10);
+    if (end == spec || *end != '/')
+        return -1;
+
+    const char *n_str = end + 1;
+    unsigned long long n = strtoull(n_str, &end, 10);
+    if (end == n_str || *end != '\0')
+        return -1;
+
+    if (spec[0] == '-' || n_str[0] == '-' || i < 1 || n < 1 || i > n ||
+        n > SIZE_MAX)
+        return -1;
+
+    *index = (size_t)(i - 1);
+    *count = (size_t)n;
+    return 0;
+}
+
+int ltf_shard_by_from_str(const char *str) {
+    if (!strcmp(str, "hash"))
+        return LTF_SHARD_BY_HASH;
+    if (!strcmp(str, "round-robin"))
+        return LTF_SHARD_BY_ROUND_ROBIN;
+    if (!strcmp(str, "duration"))
+        return LTF_SHARD_BY_DURATION;
+    return -1;
+}
+
+static uint64_t name_hash(const char *name) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (const char *p = name; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Longest processing time first: each test goes to the least loaded shard,
+// which stays within 4/3 of the best possible split
+static void partition_by_duration(da_t *tests, size_t index, size_t count,
+                                  const ltf_timings_t *timings, bool *keep) {
+    size_t tests_count = da_size(tests);
+    size_t *order = calloc(tests_count ? tests_count : 1, sizeof(size_t));
+    uint64_t *loads = calloc(count, sizeof(uint64_t));
+    if (!order || !loads) {
+        free(order);
+        free(loads);
+        LOG("Out of memory, sharding by round-robin instead");
+        for (size_t i = 0; i < tests_count; ++i)
+            keep[i] = i % count == index;
+        return;
+    }
+
+    ltf_timings_longest_first(timings, tests, order);
+    for (size_t i = 0; i < tests_count; ++i) {
+        test_case_t *tc = da_get(tests, order[i]);
+        size_t least = 0;
+        for (size_t s = 1; s < count; ++s) {
+            if (loads[s] < loads[least])
+                least = s;
+        }
+        loads[least] += ltf_timings_estimate(timings, tc->name);
+        keep[order[i]] = least == index;
+    }
+
+    LOG("Shard %zu of %zu: estimated %llu ms", index + 1, count,
+        (unsigned long long)(loads[index] / 1000000));
+    free(order);
+    free(loads);
+}
+
+void ltf_shard_partition(da_t *tests, size_t index, size_t count,
+                         ltf_shard_by_t by, const ltf_timings_t *timings,
+                         bool *keep) {
+    size_t tests_count = da_size(tests);
+
+    switch (by) {
+    case LTF_SHARD_BY_DURATION:
+        partition_by_duration(tests, index, count, timings, keep);
+        break;
+    case LTF_SHARD_BY_ROUND_ROBIN:
+        for (size_t i = 0; i < tests_count; ++i)
+            keep[i] = i % count == index;
+        break;
+    default:
+        for (size_t i = 0; i < tests_count; ++i) {
+            test_case_t *tc = da_get(tests, i);
+            keep[i] = name_hash(tc->name) % count == index;
+        }
+        break;
+    }
+}
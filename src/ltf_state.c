@@ -6,13 +6,17 @@
 #include "ltf_test.h"
 #include "ltf_vars.h"
 #include "project_parser.h"
+#include "internal_logging.h"
 #include "version.h"
 
 #include "util/os.h"
 #include "util/time.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 static inline char *jdup_string(struct json_object *o) {
     return o ? strdup(json_object_get_string(o)) : NULL;
@@ -160,101 +164,206 @@ static da_t *json_array_to_da_outputs(json_object *a) {
     return out;
 }
 
-static json_object *da_keywords_to_json_array(const da_t *arr);
+static json_object *keywords_to_json_array(const keyword_status_t *first);
 
-static da_t *json_array_to_da_keywords(json_object *a);
+static void json_array_to_keywords(json_object *a, keyword_tree_t *tree,
+                                   keyword_status_t *parent);
 
+// Timestamps are taken from the monotonic clock while tracing and only
+// turned into wall clock dates here, monotonic readings mean nothing after a
+// reboot or on another machine
 static json_object *
 ltf_state_test_keyword_to_json(const keyword_status_t *keyword) {
+    char time[TS_LEN];
     json_object *o = json_object_new_object();
     add_string_if(o, "name", keyword->name);
-    add_string_if(o, "started", keyword->started);
-    add_string_if(o, "finished", keyword->finished);
+    monotonic_to_date_time(keyword->started_ns, time);
+    add_string_if(o, "started", time);
+    if (keyword->finished_ns) {
+        monotonic_to_date_time(keyword->finished_ns, time);
+        add_string_if(o, "finished", time);
+    }
+    json_object_object_add(
+        o, "started_epoch_ns",
+        json_object_new_int64(monotonic_to_epoch_nanos(keyword->started_ns)));
+    if (keyword->finished_ns) {
+        json_object_object_add(
+            o, "duration_ns",
+            json_object_new_int64(
+                (int64_t)(keyword->finished_ns - keyword->started_ns)));
+    }
     add_string_if(o, "file", keyword->file);
     json_object_object_add(o, "line", json_object_new_int(keyword->line));
     json_object_object_add(o, "children",
-                           da_keywords_to_json_array(keyword->children));
+                           keywords_to_json_array(keyword->children));
     return o;
 }
 
 static void ltf_state_test_keyword_from_json(json_object *jk,
-                                             keyword_status_t *out) {
-    memset(out, 0, sizeof *out);
-    JGET_STR_DUP(jk, "name", out->name);
-    JGET_STR_DUP(jk, "started", out->started);
-    JGET_STR_DUP(jk, "finished", out->finished);
-    JGET_STR_DUP(jk, "file", out->file);
-
-    JGET_INT(jk, "line", out->line);
-
+                                             keyword_tree_t *tree,
+                                             keyword_status_t *parent) {
     json_object *tmp;
+    const char *name = NULL;
+    const char *file = NULL;
+    int line = 0;
+    uint64_t started_ns = 0;
+    uint64_t finished_ns = 0;
+
+    if (json_object_object_get_ex(jk, "name", &tmp))
+        name = json_object_get_string(tmp);
+    if (json_object_object_get_ex(jk, "file", &tmp))
+        file = json_object_get_string(tmp);
+    JGET_INT(jk, "line", line);
+
+    // Logs written before the nanosecond fields only carry the dates
+    if (json_object_object_get_ex(jk, "started_epoch_ns", &tmp))
+        started_ns = epoch_nanos_to_monotonic(json_object_get_int64(tmp));
+    else if (json_object_object_get_ex(jk, "started", &tmp))
+        started_ns = date_time_to_monotonic(json_object_get_string(tmp));
+
+    if (json_object_object_get_ex(jk, "duration_ns", &tmp))
+        finished_ns = started_ns + (uint64_t)json_object_get_int64(tmp);
+    else if (json_object_object_get_ex(jk, "finished", &tmp))
+        finished_ns = date_time_to_monotonic(json_object_get_string(tmp));
+
+    keyword_status_t *kw =
+        keyword_tree_add(tree, parent, name, file, line, started_ns);
+    if (!kw)
+        return;
+    kw->finished_ns = finished_ns;
 
     if (json_object_object_get_ex(jk, "children", &tmp))
-        out->children = json_array_to_da_keywords(tmp);
+        json_array_to_keywords(tmp, tree, kw);
 }
 
-static json_object *da_keywords_to_json_array(const da_t *arr) {
+static json_object *keywords_to_json_array(const keyword_status_t *first) {
     json_object *a = json_object_new_array();
-    size_t n = da_size((da_t *)arr);
-    for (size_t i = 0; i < n; ++i) {
-        const keyword_status_t *s =
-            (const keyword_status_t *)da_get((da_t *)arr, i);
-        json_object_array_add(a, ltf_state_test_keyword_to_json(s));
+    for (const keyword_status_t *kw = first; kw; kw = kw->next) {
+        json_object_array_add(a, ltf_state_test_keyword_to_json(kw));
     }
     return a;
 }
 
-static da_t *json_array_to_da_keywords(json_object *a) {
+static void json_array_to_keywords(json_object *a, keyword_tree_t *tree,
+                                   keyword_status_t *parent) {
     if (!a || !json_object_is_type(a, json_type_array))
-        return NULL;
+        return;
     size_t n = (size_t)json_object_array_length(a);
-    da_t *out = da_init(n, sizeof(keyword_status_t));
     for (size_t i = 0; i < n; ++i) {
         json_object *jk = json_object_array_get_idx(a, (int)i);
-        keyword_status_t item;
-        ltf_state_test_keyword_from_json(jk, &item);
-        if (!da_append(out, &item)) {
-            da_free(out);
-            return NULL;
-        }
+        ltf_state_test_keyword_from_json(jk, tree, parent);
     }
+}
 
-    return out;
+static void output_to_json_array_cb(ltf_state_test_output_t *output,
+                                    void *ud) {
+    json_object_array_add((json_object *)ud,
+                          ltf_state_test_output_to_json(output));
 }
 
-static json_object *ltf_state_test_to_json(const ltf_state_test_t *t) {
+static json_object *test_to_json(const ltf_state_test_t *t, bool outputs) {
     json_object *o = json_object_new_object();
 
     add_string_if(o, "name", t->name);
     add_string_if(o, "description", t->description);
+    add_string_if(o, "file", t->file);
     add_string_if(o, "started", t->started);
     add_string_if(o, "finished", t->finished);
     add_string_if(o, "teardown_start", t->teardown_start);
+    add_string_if(o, "teardown_end", t->teardown_end);
     add_string_if(o, "status", t->status_str);
 
     json_object_object_add(o, "tags", da_strings_to_json_array(t->tags));
     json_object_object_add(o, "failure_reasons",
                            da_outputs_to_json_array(t->failure_reasons));
-    json_object_object_add(o, "output", da_outputs_to_json_array(t->outputs));
+    if (outputs) {
+        json_object *arr = json_object_new_array();
+        ltf_state_test_foreach_output(t, output_to_json_array_cb, arr);
+        json_object_object_add(o, "output", arr);
+    }
     json_object_object_add(o, "teardown_output",
                            da_outputs_to_json_array(t->teardown_outputs));
     json_object_object_add(o, "teardown_errors",
                            da_outputs_to_json_array(t->teardown_errors));
-    json_object_object_add(o, "keywords",
-                           da_keywords_to_json_array(t->keyword_statuses));
+    json_object_object_add(
+        o, "keywords", keywords_to_json_array(keyword_tree_roots(t->keywords)));
+
+    if (t->duration_ns) {
+        json_object_object_add(o, "duration_ns",
+                               json_object_new_int64((int64_t)t->duration_ns));
+    }
+
+    if (t->profile.duration_ns) {
+        const ltf_state_test_profile_t *p = &t->profile;
+        json_object *jp = json_object_new_object();
+        json_object_object_add(jp, "samples",
+                               json_object_new_int64((int64_t)p->samples));
+        json_object_object_add(jp, "samples_c",
+                               json_object_new_int64((int64_t)p->samples_c));
+        json_object_object_add(
+            jp, "samples_sleep",
+            json_object_new_int64((int64_t)p->samples_sleep));
+        json_object_object_add(jp, "duration_ns",
+                               json_object_new_int64((int64_t)p->duration_ns));
+        json_object_object_add(jp, "overhead_ns",
+                               json_object_new_int64((int64_t)p->overhead_ns));
+        json_object_object_add(o, "profile", jp);
+    }
 
     return o;
 }
 
+json_object *ltf_state_test_to_json(const ltf_state_test_t *t) {
+    return test_to_json(t, true);
+}
+
+typedef struct {
+    FILE *f;
+    bool first;
+} write_output_ctx_t;
+
+static void write_output_cb(ltf_state_test_output_t *output, void *ud) {
+    write_output_ctx_t *ctx = ud;
+
+    json_object *o = ltf_state_test_output_to_json(output);
+    if (!ctx->first)
+        fputc(',', ctx->f);
+    fputs(json_object_to_json_string_ext(o, JSON_C_TO_STRING_PLAIN |
+                                                JSON_C_TO_STRING_NOSLASHESCAPE),
+          ctx->f);
+    json_object_put(o);
+    ctx->first = false;
+}
+
+void ltf_state_test_write_json(const ltf_state_test_t *t, FILE *f) {
+    json_object *o = test_to_json(t, false);
+
+    size_t len = 0;
+    const char *str = json_object_to_json_string_length(
+        o, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &len);
+
+    // Reopen the object and stream the outputs into it: '{...}' ->
+    // '{...,"output":[...]}'
+    fwrite(str, 1, len - 1, f);
+    fputs(len > 2 ? ",\"output\":[" : "\"output\":[", f);
+    write_output_ctx_t ctx = {.f = f, .first = true};
+    ltf_state_test_foreach_output(t, write_output_cb, &ctx);
+    fputs("]}", f);
+
+    json_object_put(o);
+}
+
 static void ltf_state_test_from_json(json_object *jt, da_t *tests) {
 
     ltf_state_test_t t = {0};
 
     JGET_STR_DUP(jt, "name", t.name);
     JGET_STR_DUP(jt, "description", t.description);
+    JGET_STR_DUP(jt, "file", t.file);
     JGET_STR_DUP(jt, "started", t.started);
     JGET_STR_DUP(jt, "finished", t.finished);
     JGET_STR_DUP(jt, "teardown_start", t.teardown_start);
+    JGET_STR_DUP(jt, "teardown_end", t.teardown_end);
     JGET_STR_DUP(jt, "status", t.status_str);
 
     json_object *tmp;
@@ -274,15 +383,42 @@ static void ltf_state_test_from_json(json_object *jt, da_t *tests) {
     if (json_object_object_get_ex(jt, "teardown_errors", &tmp))
         t.teardown_errors = json_array_to_da_outputs(tmp);
 
-    if (json_object_object_get_ex(jt, "keywords", &tmp))
-        t.keyword_statuses = json_array_to_da_keywords(tmp);
+    if (json_object_object_get_ex(jt, "keywords", &tmp)) {
+        t.keywords = keyword_tree_new();
+        if (t.keywords)
+            json_array_to_keywords(tmp, t.keywords, NULL);
+    }
+
+    if (json_object_object_get_ex(jt, "duration_ns", &tmp)) {
+        t.duration_ns = (uint64_t)json_object_get_int64(tmp);
+    } else {
+        const char *end = t.teardown_end ? t.teardown_end : t.finished;
+        uint64_t started_ns = date_time_to_monotonic(t.started);
+        uint64_t finished_ns = date_time_to_monotonic(end);
+        if (started_ns && finished_ns > started_ns)
+            t.duration_ns = finished_ns - started_ns;
+    }
+
+    if (json_object_object_get_ex(jt, "profile", &tmp)) {
+        json_object *v;
+        if (json_object_object_get_ex(tmp, "samples", &v))
+            t.profile.samples = (uint64_t)json_object_get_int64(v);
+        if (json_object_object_get_ex(tmp, "samples_c", &v))
+            t.profile.samples_c = (uint64_t)json_object_get_int64(v);
+        if (json_object_object_get_ex(tmp, "samples_sleep", &v))
+            t.profile.samples_sleep = (uint64_t)json_object_get_int64(v);
+        if (json_object_object_get_ex(tmp, "duration_ns", &v))
+            t.profile.duration_ns = (uint64_t)json_object_get_int64(v);
+        if (json_object_object_get_ex(tmp, "overhead_ns", &v))
+            t.profile.overhead_ns = (uint64_t)json_object_get_int64(v);
+    }
 
     da_append(tests, &t);
 }
 
 /* ----- state <-> json (public API) ------------------------------------- */
 
-json_object *ltf_state_to_json(ltf_state_t *state) {
+json_object *ltf_state_header_to_json(ltf_state_t *state) {
     if (!state)
         return NULL;
 
@@ -293,7 +429,6 @@ json_object *ltf_state_to_json(ltf_state_t *state) {
     add_string_if(root, "os", state->os);
     add_string_if(root, "os_version", state->os_version);
     add_string_if(root, "started", state->started);
-    add_string_if(root, "finished", state->finished);
     add_string_if(root, "target", state->target);
 
     json_object_object_add(root, "variables",
@@ -303,13 +438,16 @@ json_object *ltf_state_to_json(ltf_state_t *state) {
                            state->tags ? da_strings_to_json_array(state->tags)
                                        : json_object_new_array());
 
-    json_object *tests_arr = json_object_new_array();
-    size_t tests_count = da_size(state->tests);
-    for (size_t i = 0; i < tests_count; ++i) {
-        ltf_state_test_t *test = da_get(state->tests, i);
-        json_object_array_add(tests_arr, ltf_state_test_to_json(test));
-    }
-    json_object_object_add(root, "tests", tests_arr);
+    return root;
+}
+
+json_object *ltf_state_footer_to_json(ltf_state_t *state) {
+    if (!state)
+        return NULL;
+
+    json_object *root = json_object_new_object();
+
+    add_string_if(root, "finished", state->finished);
 
     json_object_object_add(root, "total_amount",
                            json_object_new_int((int)state->total_amount));
@@ -323,6 +461,29 @@ json_object *ltf_state_to_json(ltf_state_t *state) {
     return root;
 }
 
+json_object *ltf_state_to_json(ltf_state_t *state) {
+    if (!state)
+        return NULL;
+
+    json_object *root = ltf_state_header_to_json(state);
+
+    json_object *tests_arr = json_object_new_array();
+    size_t tests_count = da_size(state->tests);
+    for (size_t i = 0; i < tests_count; ++i) {
+        ltf_state_test_t *test = da_get(state->tests, i);
+        json_object_array_add(tests_arr, ltf_state_test_to_json(test));
+    }
+    json_object_object_add(root, "tests", tests_arr);
+
+    json_object *footer = ltf_state_footer_to_json(state);
+    json_object_object_foreach(footer, key, val) {
+        json_object_object_add(root, key, json_object_get(val));
+    }
+    json_object_put(footer);
+
+    return root;
+}
+
 ltf_state_t *ltf_state_from_json(json_object *root) {
     if (!root || !json_object_is_type(root, json_type_object))
         return NULL;
@@ -364,17 +525,314 @@ ltf_state_t *ltf_state_from_json(json_object *root) {
     JGET_INT(root, "failed_amount", state->failed_amount);
     JGET_INT(root, "finished_amount", state->finished_amount);
 
+    // Log of an interrupted run has no amounts, count what made it in
+    if (!json_object_object_get_ex(root, "finished_amount", &tmp)) {
+        size_t tests_count = da_size(state->tests);
+        for (size_t i = 0; i < tests_count; ++i) {
+            ltf_state_test_t *test = da_get(state->tests, i);
+            if (!test->status_str)
+                continue;
+            if (!strcmp(test->status_str, "PASSED"))
+                state->passed_amount++;
+            else if (!strcmp(test->status_str, "FAILED"))
+                state->failed_amount++;
+        }
+        state->finished_amount = state->passed_amount + state->failed_amount;
+    }
+
     return state;
 }
 
+// Rebuild the root object of a raw log that was never finalized (e.g. the
+// run crashed). The log is streamed as a header line ending with
+// '"tests":[', one line per test and a footer line starting with ']'.
+static json_object *raw_log_recover(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    json_object *root = NULL;
+    json_object *tests = NULL;
+
+    if ((len = getline(&line, &cap, f)) > 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        char *header = NULL;
+        if (asprintf(&header, "%s]}", line) != -1) {
+            root = json_tokener_parse(header);
+            free(header);
+        }
+    }
+
+    if (!root || !json_object_object_get_ex(root, "tests", &tests) ||
+        !json_object_is_type(tests, json_type_array)) {
+        json_object_put(root);
+        free(line);
+        fclose(f);
+        return NULL;
+    }
+
+    while ((len = getline(&line, &cap, f)) > 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        char *p = line;
+        if (*p == ',')
+            p++;
+
+        if (*p == ']') {
+            // Footer: '],"finished":...}' -> '{"finished":...}'
+            p++;
+            if (*p == ',')
+                p++;
+            char *footer_str = NULL;
+            if (asprintf(&footer_str, "{%s", p) == -1)
+                break;
+            json_object *footer = json_tokener_parse(footer_str);
+            free(footer_str);
+            if (footer) {
+                json_object_object_foreach(footer, key, val) {
+                    json_object_object_add(root, key, json_object_get(val));
+                }
+                json_object_put(footer);
+            }
+            break;
+        }
+
+        json_object *test = json_tokener_parse(p);
+        if (!test) {
+            // The run ended while this test was being written
+            LOG("Raw log '%s' is truncated.", path);
+            break;
+        }
+        json_object_array_add(tests, test);
+    }
+
+    free(line);
+    fclose(f);
+
+    return root;
+}
+
+ltf_state_t *ltf_state_from_file(const char *path) {
+    json_object *root = json_object_from_file(path);
+    if (!root) {
+        LOG("Unable to parse '%s' as a whole, trying to recover it...", path);
+        root = raw_log_recover(path);
+    }
+
+    ltf_state_t *state = ltf_state_from_json(root);
+    json_object_put(root);
+
+    return state;
+}
+
+/* ----- output spilling ------------------------------------------------ */
+
+// Record header in the spill file, followed by file, date_time and msg
+typedef struct {
+    int line;
+    int level;
+    size_t file_len;
+    size_t date_time_len;
+    size_t msg_len;
+} spill_record_t;
+
+static void ltf_state_test_output_free(ltf_state_test_output_t *o);
+
+static size_t output_mem_size(const ltf_state_test_output_t *o) {
+    return sizeof(*o) + (o->file ? strlen(o->file) + 1 : 0) +
+           (o->date_time ? strlen(o->date_time) + 1 : 0) + o->msg_len + 1;
+}
+
+static void track_output_mem(ltf_state_t *state, ltf_state_test_t *test,
+                             size_t size) {
+    test->outputs_mem += size;
+    state->outputs_mem += size;
+    if (state->outputs_mem > state->outputs_mem_peak)
+        state->outputs_mem_peak = state->outputs_mem;
+}
+
+static bool spill_write_output(FILE *f, const ltf_state_test_output_t *o) {
+    spill_record_t r = {
+        .line = o->line,
+        .level = (int)o->level,
+        .file_len = o->file ? strlen(o->file) : 0,
+        .date_time_len = o->date_time ? strlen(o->date_time) : 0,
+        .msg_len = o->msg ? o->msg_len : 0,
+    };
+    return fwrite(&r, sizeof r, 1, f) == 1 &&
+           fwrite(o->file ? o->file : "", 1, r.file_len, f) == r.file_len &&
+           fwrite(o->date_time ? o->date_time : "", 1, r.date_time_len, f) ==
+               r.date_time_len &&
+           fwrite(o->msg ? o->msg : "", 1, r.msg_len, f) == r.msg_len;
+}
+
+static char *spill_read_string(FILE *f, size_t len) {
+    char *str = malloc(len + 1);
+    if (!str)
+        return NULL;
+    if (fread(str, 1, len, f) != len) {
+        free(str);
+        return NULL;
+    }
+    str[len] = '\0';
+    return str;
+}
+
+static bool spill_read_output(FILE *f, ltf_state_test_output_t *o) {
+    spill_record_t r;
+    memset(o, 0, sizeof *o);
+    if (fread(&r, sizeof r, 1, f) != 1)
+        return false;
+
+    o->line = r.line;
+    o->level = (ltf_log_level)r.level;
+    o->msg_len = r.msg_len;
+    o->file = spill_read_string(f, r.file_len);
+    o->date_time = o->file ? spill_read_string(f, r.date_time_len) : NULL;
+    o->msg = o->date_time ? spill_read_string(f, r.msg_len) : NULL;
+    if (!o->msg) {
+        ltf_state_test_output_free(o);
+        return false;
+    }
+    return true;
+}
+
+// Move the oldest in-memory outputs of 'test' to the spill file until at
+// most 'keep_bytes' of them stay in memory
+static void spill_test_outputs(ltf_state_t *state, ltf_state_test_t *test,
+                               size_t keep_bytes) {
+    size_t outputs_count = da_size(test->outputs);
+    if (outputs_count == 0 || test->outputs_mem <= keep_bytes ||
+        state->spill_failed)
+        return;
+
+    if (!state->spill_file) {
+        state->spill_file = tmpfile();
+        if (!state->spill_file) {
+            LOG("Unable to create output spill file: %s", strerror(errno));
+            state->spill_failed = true;
+            return;
+        }
+    }
+
+    FILE *f = state->spill_file;
+    if (fseek(f, 0, SEEK_END)) {
+        LOG("Unable to seek output spill file: %s", strerror(errno));
+        return;
+    }
+    long offset = ftell(f);
+
+    size_t count = 0;
+    size_t freed = 0;
+    while (count < outputs_count && test->outputs_mem - freed > keep_bytes) {
+        ltf_state_test_output_t *o = da_get(test->outputs, count);
+        if (!spill_write_output(f, o))
+            break;
+        freed += output_mem_size(o);
+        count++;
+    }
+
+    // Nothing is dropped from memory unless it really made it to disk
+    if (count == 0 || fflush(f)) {
+        LOG("Unable to write output spill file: %s", strerror(errno));
+        state->spill_failed = true;
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        ltf_state_test_output_free(da_get(test->outputs, i));
+    }
+    da_remove_range(test->outputs, 0, count);
+
+    if (!test->spilled_outputs)
+        test->spilled_outputs = da_init(1, sizeof(ltf_state_spill_segment_t));
+    ltf_state_spill_segment_t segment = {.offset = offset, .count = count};
+    da_append(test->spilled_outputs, &segment);
+
+    test->spill_file = f;
+    if (!test->spilled_count)
+        state->spilled_tests++;
+    test->spilled_count += count;
+    test->outputs_mem -= freed;
+    state->outputs_mem -= freed;
+    state->outputs_spilled += freed;
+
+    LOG("Spilled %zu outputs (%zu bytes) of test '%s' to disk.", count, freed,
+        test->name);
+}
+
+static void enforce_output_budgets(ltf_state_t *state,
+                                   ltf_state_test_t *test) {
+    // Spill down to half of the budget, so that a test logging steadily
+    // does not hit the disk on every single line
+    if (state->test_output_budget &&
+        test->outputs_mem > state->test_output_budget) {
+        spill_test_outputs(state, test, state->test_output_budget / 2);
+    }
+
+    if (state->run_output_budget &&
+        state->outputs_mem > state->run_output_budget) {
+        // Oldest tests go first, the running one last
+        size_t tests_count = da_size(state->tests);
+        for (size_t i = 0; i < tests_count &&
+                           state->outputs_mem > state->run_output_budget / 2;
+             ++i) {
+            spill_test_outputs(state, da_get(state->tests, i), 0);
+        }
+    }
+}
+
+void ltf_state_test_foreach_output(const ltf_state_test_t *test,
+                                   ltf_state_output_fn fn, void *ud) {
+    size_t segments_count = da_size(test->spilled_outputs);
+    for (size_t i = 0; i < segments_count; ++i) {
+        const ltf_state_spill_segment_t *segment =
+            da_cget(test->spilled_outputs, i);
+
+        if (!test->spill_file ||
+            fseek(test->spill_file, segment->offset, SEEK_SET)) {
+            LOG("Unable to seek output spill file: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t j = 0; j < segment->count; ++j) {
+            ltf_state_test_output_t o;
+            if (!spill_read_output(test->spill_file, &o)) {
+                LOG("Unable to read spilled output of test '%s'.",
+                    test->name);
+                break;
+            }
+            fn(&o, ud);
+            ltf_state_test_output_free(&o);
+        }
+    }
+
+    size_t outputs_count = da_size(test->outputs);
+    for (size_t i = 0; i < outputs_count; ++i) {
+        fn(da_get(test->outputs, i), ud);
+    }
+}
+
+size_t ltf_state_test_outputs_count(const ltf_state_test_t *test) {
+    return test->spilled_count + da_size(test->outputs);
+}
+
 void ltf_state_test_started(ltf_state_t *state, test_case_t *test_case) {
     char time[TS_LEN];
     get_date_time_now(time);
 
     ltf_state_test_t test = {0};
     test.started = strdup(time);
+    test.started_ns = monotonic_nanos();
     test.name = strdup(test_case->name);
     test.description = test_case->desc ? strdup(test_case->desc) : NULL;
+    test.file = test_case->file ? strdup(test_case->file) : NULL;
     test.status = TEST_STATUS_RUNNING;
     size_t tags_size = da_size(test_case->tags);
     test.tags = da_init(tags_size, sizeof(char *));
@@ -422,10 +880,12 @@ void ltf_state_log(ltf_state_t *state, ltf_log_level level, const char *file,
 
     if (state->current_stage == TEST_STAGE) {
         ltf_state_test_t *test = ltf_state_get_current_test(state);
+        bool in_outputs = false;
 
         switch (test->status) {
         case TEST_STATUS_RUNNING:
             da_append(test->outputs, &o);
+            in_outputs = true;
             if (level == LTF_LOG_LEVEL_ERROR) {
                 ltf_state_test_output_t o = {
                     .file = file ? strdup(file) : strdup("unknown"),
@@ -454,6 +914,12 @@ void ltf_state_log(ltf_state_t *state, ltf_log_level level, const char *file,
                 (*cb)(test, &o);
             }
         }
+
+        // Only after the callbacks: spilling frees what 'o' points to
+        if (in_outputs) {
+            track_output_mem(state, test, output_mem_size(&o));
+            enforce_output_budgets(state, test);
+        }
     } else if (state->current_stage == HOOK_STAGE) {
         size_t count = da_size(state->hook_log_cbs);
         for (size_t i = 0; i < count; ++i) {
@@ -465,9 +931,9 @@ void ltf_state_log(ltf_state_t *state, ltf_log_level level, const char *file,
     }
 }
 
-void ltf_state_test_set_keyword_statuses(ltf_state_t *state, da_t *statuses) {
+void ltf_state_test_set_keywords(ltf_state_t *state, keyword_tree_t *keywords) {
     ltf_state_test_t *test = ltf_state_get_current_test(state);
-    test->keyword_statuses = statuses;
+    test->keywords = keywords;
 }
 
 void ltf_state_test_defer_queue_started(ltf_state_t *state) {
@@ -625,6 +1091,133 @@ void ltf_state_test_run_finished(ltf_state_t *state) {
     }
 }
 
+void ltf_state_test_completed(ltf_state_t *state) {
+    ltf_state_test_t *test = ltf_state_get_current_test(state);
+    test->duration_ns = monotonic_nanos() - test->started_ns;
+
+    size_t count = da_size(state->test_completed_cbs);
+    for (size_t i = 0; i < count; ++i) {
+        test_cb *cb = da_get(state->test_completed_cbs, i);
+        if (cb && *cb) {
+            (*cb)(test);
+        }
+    }
+}
+
+json_object *ltf_state_current_test_to_json(ltf_state_t *state) {
+    ltf_state_test_t *test = ltf_state_get_current_test(state);
+    return ltf_state_test_to_json(test);
+}
+
+static void run_test_log_cbs(ltf_state_t *state, ltf_state_test_t *test,
+                             da_t *outputs) {
+    size_t outputs_count = da_size(outputs);
+    size_t count = da_size(state->test_log_cbs);
+    for (size_t i = 0; i < outputs_count; ++i) {
+        ltf_state_test_output_t *o = da_get(outputs, i);
+        for (size_t j = 0; j < count; ++j) {
+            test_log_cb *cb = da_get(state->test_log_cbs, j);
+            if (cb && *cb) {
+                (*cb)(test, o);
+            }
+        }
+    }
+}
+
+static void run_test_cbs(da_t *cbs, ltf_state_test_t *test) {
+    size_t count = da_size(cbs);
+    for (size_t i = 0; i < count; ++i) {
+        test_cb *cb = da_get(cbs, i);
+        if (cb && *cb) {
+            (*cb)(test);
+        }
+    }
+}
+
+void ltf_state_test_merge(ltf_state_t *state, json_object *obj) {
+    ltf_state_test_from_json(obj, state->tests);
+
+    ltf_state_test_t *test = ltf_state_get_current_test(state);
+
+    if (!test->tags)
+        test->tags = da_init(1, sizeof(char *));
+    if (!test->outputs)
+        test->outputs = da_init(1, sizeof(ltf_state_test_output_t));
+    if (!test->failure_reasons)
+        test->failure_reasons = da_init(1, sizeof(ltf_state_test_output_t));
+    if (!test->teardown_outputs)
+        test->teardown_outputs = da_init(1, sizeof(ltf_state_test_output_t));
+    if (!test->teardown_errors)
+        test->teardown_errors = da_init(1, sizeof(ltf_state_test_output_t));
+
+    bool passed = test->status_str && !strcmp(test->status_str, "PASSED");
+
+    // Replay the test lifecycle so that every registered consumer (TUI,
+    // output log, headless printer) sees the same sequence of events as
+    // during a serial run.
+    test->status = TEST_STATUS_RUNNING;
+    run_test_cbs(state->test_started_cbs, test);
+    run_test_log_cbs(state, test, test->outputs);
+
+    size_t outputs_count = da_size(test->outputs);
+    for (size_t i = 0; i < outputs_count; ++i) {
+        track_output_mem(state, test,
+                         output_mem_size(da_get(test->outputs, i)));
+    }
+    enforce_output_budgets(state, test);
+
+    if (test->teardown_start) {
+        test->status = passed ? TEST_STATUS_TEARDOWN_AFTER_PASSED
+                              : TEST_STATUS_TEARDOWN_AFTER_FAILED;
+        run_test_cbs(state->test_teardown_started_cbs, test);
+        run_test_log_cbs(state, test, test->teardown_outputs);
+
+        size_t errors_count = da_size(test->teardown_errors);
+        size_t count = da_size(state->test_defer_failed_cbs);
+        for (size_t i = 0; i < errors_count; ++i) {
+            ltf_state_test_output_t *o = da_get(test->teardown_errors, i);
+            for (size_t j = 0; j < count; ++j) {
+                test_log_cb *cb = da_get(state->test_defer_failed_cbs, j);
+                if (cb && *cb) {
+                    (*cb)(test, o);
+                }
+            }
+        }
+        run_test_cbs(state->test_teardown_finished_cbs, test);
+    }
+
+    test->status = passed ? TEST_STATUS_PASSED : TEST_STATUS_FAILED;
+    if (passed)
+        state->passed_amount++;
+    else
+        state->failed_amount++;
+    state->finished_amount++;
+
+    run_test_cbs(state->test_finished_cbs, test);
+    run_test_cbs(state->test_completed_cbs, test);
+}
+
+void ltf_state_clear_cbs(ltf_state_t *state) {
+    da_clear(state->test_run_started_cbs);
+    da_clear(state->test_run_finished_cbs);
+    da_clear(state->test_started_cbs);
+    da_clear(state->test_finished_cbs);
+    da_clear(state->test_teardown_started_cbs);
+    da_clear(state->test_teardown_finished_cbs);
+    da_clear(state->test_defer_failed_cbs);
+    da_clear(state->test_log_cbs);
+    da_clear(state->test_completed_cbs);
+
+    if (state->hook_started_cbs)
+        da_clear(state->hook_started_cbs);
+    if (state->hook_finished_cbs)
+        da_clear(state->hook_finished_cbs);
+    if (state->hook_failed_cbs)
+        da_clear(state->hook_failed_cbs);
+    if (state->hook_log_cbs)
+        da_clear(state->hook_log_cbs);
+}
+
 ltf_state_t *ltf_state_new() {
     cmd_test_options *opts = cmd_parser_get_test_options();
     project_parsed_t *proj = get_parsed_project();
@@ -652,6 +1245,10 @@ ltf_state_t *ltf_state_new() {
     ltf_state->test_teardown_started_cbs = da_init(1, sizeof(test_cb));
     ltf_state->test_defer_failed_cbs = da_init(1, sizeof(test_log_cb));
     ltf_state->test_log_cbs = da_init(1, sizeof(test_log_cb));
+    ltf_state->test_completed_cbs = da_init(1, sizeof(test_cb));
+
+    ltf_state->test_output_budget = opts->test_mem_budget;
+    ltf_state->run_output_budget = opts->run_mem_budget;
 
     ltf_state->ltf_version = strdup(LTF_VERSION);
     if (opts->target) {
@@ -737,6 +1334,10 @@ void ltf_state_register_test_defer_failed_cb(ltf_state_t *state,
     da_append(state->test_defer_failed_cbs, (void *)&cb);
 }
 
+void ltf_state_register_test_completed_cb(ltf_state_t *state, test_cb cb) {
+    da_append(state->test_completed_cbs, (void *)&cb);
+}
+
 static void ltf_state_test_output_free(ltf_state_test_output_t *o) {
     if (!o)
         return;
@@ -792,41 +1393,59 @@ static void da_free_outputs(da_t *arr) {
     da_free(arr);
 }
 
-static void free_keyword_status(keyword_status_t *status) {
-    size_t children_count = da_size(status->children);
-    for (size_t i = 0; i < children_count; ++i) {
-        keyword_status_t *child = da_get(status->children, i);
-        free_keyword_status(child);
-    }
-    da_free(status->children);
-    free(status->name);
-    free(status->started);
-    free(status->finished);
-    free(status->file);
-}
-
 static void ltf_state_test_free(ltf_state_test_t *t) {
     if (!t)
         return;
 
     free(t->name);
     free(t->description);
+    free(t->file);
     free(t->started);
     free(t->finished);
     free(t->teardown_start);
+    free(t->teardown_end);
     free(t->status_str);
 
-    size_t keyword_statuses_count = da_size(t->keyword_statuses);
-    for (size_t i = 0; i < keyword_statuses_count; ++i) {
-        keyword_status_t *status = da_get(t->keyword_statuses, i);
-        free_keyword_status(status);
-    }
+    keyword_tree_free(t->keywords);
 
     da_free_strings(t->tags);
     da_free_outputs(t->failure_reasons);
     da_free_outputs(t->outputs);
     da_free_outputs(t->teardown_outputs);
     da_free_outputs(t->teardown_errors);
+    da_free(t->spilled_outputs);
+}
+
+void ltf_state_test_release_outputs(ltf_state_t *state,
+                                    ltf_state_test_t *test) {
+    keyword_tree_free(test->keywords);
+    test->keywords = NULL;
+
+    da_free_outputs(test->outputs);
+    da_free_outputs(test->teardown_outputs);
+    da_free_outputs(test->teardown_errors);
+    state->outputs_mem -= test->outputs_mem;
+    test->outputs_mem = 0;
+
+    // Spilled records are left in the file, it gets emptied once no test
+    // refers to it anymore
+    if (test->spilled_count && !--state->spilled_tests && state->spill_file &&
+        ftruncate(fileno(state->spill_file), 0) == 0)
+        rewind(state->spill_file);
+    da_free(test->spilled_outputs);
+    test->spilled_outputs = NULL;
+    test->spilled_count = 0;
+    test->spill_file = NULL;
+
+    test->outputs = da_init(1, sizeof(ltf_state_test_output_t));
+    test->teardown_outputs = da_init(1, sizeof(ltf_state_test_output_t));
+    test->teardown_errors = da_init(1, sizeof(ltf_state_test_output_t));
+}
+
+void ltf_state_test_release(ltf_state_t *state, ltf_state_test_t *test) {
+    ltf_state_test_release_outputs(state, test);
+    da_free_outputs(test->failure_reasons);
+    test->failure_reasons = da_init(1, sizeof(ltf_state_test_output_t));
 }
 
 static void ltf_state_tests_free(da_t *tests) {
@@ -858,11 +1477,15 @@ void ltf_state_free(ltf_state_t *state) {
     da_free(state->test_teardown_finished_cbs);
     da_free(state->test_defer_failed_cbs);
     da_free(state->test_log_cbs);
+    da_free(state->test_completed_cbs);
 
     da_free_vars(state->vars);
     da_free_strings(state->tags);
 
     ltf_state_tests_free(state->tests);
 
+    if (state->spill_file)
+        fclose(state->spill_file);
+
     free(state);
 }
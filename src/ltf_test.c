@@ -5,15 +5,22 @@
 #include "internal_logging.h"
 #include "keyword_status.h"
 #include "ltf_hooks.h"
+#include "ltf_profiler.h"
 #include "ltf_secrets.h"
+#include "ltf_shard.h"
+#include "ltf_test_index.h"
+#include "ltf_timings.h"
 #include "ltf_tui.h"
 #include "ltf_vars.h"
+#include "ltf_watchdog.h"
+#include "ltf_workers.h"
 #include "project_parser.h"
 #include "test_case.h"
 #include "test_logs.h"
 #include "version.h"
 
 #include "modules/hooks/ltf-hooks.h"
+#include "modules/http/ltf-http-pool.h"
 #include "modules/http/ltf-http.h"
 #include "modules/json/ltf-json.h"
 #include "modules/ltf/ltf.h"
@@ -22,7 +29,9 @@
 #include "modules/ssh/ltf-ssh-lib.h"
 #include "modules/util/util.h"
 
+#include "util/bytecode_cache.h"
 #include "util/files.h"
+#include "util/kv.h"
 #include "util/line_cache.h"
 #include "util/lua_hooks.h"
 #include "util/string.h"
@@ -32,10 +41,12 @@
 #include <lua.h>
 #include <lualib.h>
 
+#include <dirent.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 static int g_first = 0;
 static int g_last = 0;
 
@@ -45,6 +56,14 @@ static char *project_test_dir_path = NULL;
 static char *project_common_test_dir_path = NULL;
 static char *project_lib_dir_path = NULL;
 
+// Durations of previous runs, see load_run_timings()
+static ltf_timings_t run_timings = {0};
+
+// Tests of --rerun-failed and their files, see select_failed_tests()
+static da_t *rerun_names = NULL;
+static str_array_t rerun_files = {NULL, 0};
+static bool rerun_files_known = false;
+
 static bool test_marked_failed = false;
 static size_t current_test_index = 0;
 
@@ -53,11 +72,9 @@ void ltf_mark_test_failed() { test_marked_failed = true; }
 keyword_status_t *kw_root = NULL;
 
 static void line_hook(lua_State *, lua_Debug *ar, const char *src) {
-
-    const char *text = get_line_text(src, ar->currentline);
-
-    ltf_tui_set_current_line(src, ar->currentline,
-                             text ? text : "(source unavailable)");
+    // Called for every executed Lua line, only do any work once per frame
+    if (!ltf_tui_line_wanted())
+        return;
 
     if (string_has_prefix(src, project_test_dir_path) ||
         string_has_prefix(src, project_common_test_dir_path)) {
@@ -66,6 +83,15 @@ static void line_hook(lua_State *, lua_Debug *ar, const char *src) {
         progress = div == 0 ? 0 : (double)(ar->currentline - g_first) / div;
         ltf_tui_set_test_progress(progress);
     }
+
+    size_t len = 0;
+    const char *text = get_line_text(src, ar->currentline, &len);
+    if (!text) {
+        text = "(source unavailable)";
+        len = strlen(text);
+    }
+
+    ltf_tui_set_current_line(src, ar->currentline, text, len);
 }
 
 static int ltf_errhandler(lua_State *L) {
@@ -158,10 +184,134 @@ static void on_sigint(int sig) {
     sigint = true;
 }
 
-static int run_all_tests(lua_State *L, ltf_state_t *state) {
-    LOG("Running tests...");
+static void run_test(lua_State *L, ltf_state_t *state, test_case_t *tc) {
+    test_marked_failed = false;
+
+    ltf_state_test_started(state, tc);
+    ltf_hooks_run(L, LTF_HOOK_FN_TEST_STARTED);
+    LOG("Setting up error handler...");
+    lua_pushcfunction(L, ltf_errhandler);
+    int erridx = lua_gettop(L);
+    LOG("Error handler index: %d", erridx);
+
+    LOG("Pushing test body with index %d...", tc->ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, tc->ref);
+    lua_pushvalue(L, -1);
+    lua_Debug ar;
+    if (lua_getinfo(L, ">S", &ar)) {
+        g_first = ar.linedefined;
+        g_last = ar.lastlinedefined;
+    }
+
+    LOG("Resetting ltf.millis...");
+    reset_millis();
+
+    // The defer queue and the hooks run without deadline
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    ltf_watchdog_arm(tc->timeout >= 0 ? (uint64_t)tc->timeout
+                                      : opts->timeout_ms);
+
+    LOG("Executing test '%s'...", tc->name);
+    int rc = lua_pcall(L, 0, 0, erridx);
+    LOG("Finished executing test '%s', status: %d", tc->name, rc);
+
+    ltf_watchdog_disarm();
+
+    char *file = NULL;
+    int line = 0;
+    char *trace = NULL;
+
+    if (rc != LUA_OK) {
+        trace = strdup(lua_tostring(L, -1));
+        LOG("Test '%s' traceback: %s", tc->name, trace);
+
+        if (trace) {
+            const char *colon1 = strchr(trace, ':');
+            if (colon1) {
+                const char *colon2 = strchr(colon1 + 1, ':');
+                if (colon2) {
+                    file = strndup(trace, colon1 - trace);
+                    line = atoi(colon1 + 1);
+                }
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    LOG("Popping error handler...");
+    lua_remove(L, erridx);
 
-    size_t passed = 0;
+    if (rc == LUA_OK) {
+        if (test_marked_failed) {
+            ltf_state_test_failed(state, NULL, 0, NULL);
+        } else {
+            ltf_state_test_passed(state);
+        }
+    } else {
+        ltf_state_test_failed(state, file ? file : "unknown", line,
+                              trace ? trace : "unknown");
+        free(file);
+        free(trace);
+    }
+
+    run_deferred(L, state, rc == LUA_OK ? "passed" : "failed");
+
+    ltf_hooks_run(L, LTF_HOOK_FN_TEST_FINISHED);
+
+    ltf_state_test_completed(state);
+}
+
+static da_t *lua_hooks_whitelist = NULL;
+
+static void init_test_tracing(lua_State *L, ltf_state_t *state) {
+    lua_hooks_init(L, lua_hooks_whitelist);
+    keyword_status_init(state, ltf_lib_dir_path);
+    ltf_profiler_attach(state);
+}
+
+// Tests run in this process: trace them, and show the current line and
+// progress in the TUI
+static void init_serial_tracing(lua_State *L, ltf_state_t *state,
+                                cmd_test_options *opts) {
+    lua_hooks_init(L, lua_hooks_whitelist);
+
+    if (!opts->headless) {
+        LOG("Enabling line hook...");
+        lua_hooks_add(LUA_HOOKLINE, line_hook);
+    }
+
+    keyword_status_init(state, ltf_lib_dir_path);
+    ltf_profiler_attach(state);
+}
+
+static void init_profiler(cmd_test_options *opts) {
+    const char *logs_dir = ltf_log_get_logs_dir();
+    if (!logs_dir) {
+        fprintf(stderr, "Profiling needs log files, ignoring --profile.\n");
+        return;
+    }
+
+    char time[TS_LEN];
+    get_date_time_now(time);
+
+    char *dir = NULL;
+    asprintf(&dir, "%s/profile_%s", logs_dir, time);
+    for (size_t i = 2; dir && directory_exists(dir); i++) {
+        free(dir);
+        dir = NULL;
+        asprintf(&dir, "%s/profile_%s(%zu)", logs_dir, time, i);
+    }
+
+    if (!dir || ltf_profiler_init(dir, opts->profile_hz)) {
+        fprintf(stderr, "Unable to set up profiling, ignoring --profile.\n");
+    }
+    free(dir);
+}
+
+static int run_all_tests(lua_State *L, ltf_state_t *state,
+                         cmd_test_options *opts) {
+    size_t jobs = opts->jobs;
+    LOG("Running tests...");
 
     da_t *tests = test_case_get_all();
     size_t amount = da_size(tests);
@@ -173,88 +323,391 @@ static int run_all_tests(lua_State *L, ltf_state_t *state) {
 
     reset_ltf_start_millis();
 
-    for (size_t i = 0; i < amount; ++i) {
+    // Longest tests first, so that none of them is left for the end while
+    // the other workers are idle. Without durations the order is kept.
+    size_t *order = NULL;
+    if (jobs > 1 && run_timings.count) {
+        order = calloc(amount, sizeof *order);
+        if (order) {
+            ltf_timings_longest_first(&run_timings, tests, order);
+        }
+    }
 
-        test_case_t *tc = da_get(tests, i);
+    // Workers are forked only after the test run started hooks, so that
+    // whatever those prepared in the Lua state is visible to all of them.
+    bool parallel = jobs > 1;
+    if (parallel && ltf_workers_run(L, state, jobs, order, init_test_tracing,
+                                    run_test, &sigint)) {
+        LOG("Unable to start worker processes, running tests serially...");
+        init_serial_tracing(L, state, opts);
+        parallel = false;
+    }
 
-        test_marked_failed = false;
-        current_test_index = i;
+    if (parallel) {
+        if (sigint) {
+            ltf_tui_deinit();
+            exit(130);
+        }
+    } else {
+        for (size_t i = 0; i < amount; ++i) {
 
-        ltf_state_test_started(state, tc);
-        ltf_hooks_run(L, LTF_HOOK_FN_TEST_STARTED);
-        LOG("Setting up error handler...");
-        lua_pushcfunction(L, ltf_errhandler);
-        int erridx = lua_gettop(L);
-        LOG("Error handler index: %d", erridx);
+            test_case_t *tc = da_get(tests, i);
+
+            current_test_index = i;
 
-        LOG("Pushing test body with index %d...", tc->ref);
-        lua_rawgeti(L, LUA_REGISTRYINDEX, tc->ref);
-        lua_pushvalue(L, -1);
-        lua_Debug ar;
-        if (lua_getinfo(L, ">S", &ar)) {
-            g_first = ar.linedefined;
-            g_last = ar.lastlinedefined;
+            run_test(L, state, tc);
+
+            if (sigint) {
+                ltf_tui_deinit();
+                exit(130);
+            }
         }
+    }
 
-        LOG("Resetting ltf.millis...");
-        reset_millis();
+    free(order);
 
-        LOG("Executing test '%s'...", tc->name);
-        int rc = lua_pcall(L, 0, 0, erridx);
-        LOG("Finished executing test '%s', status: %d", tc->name, rc);
+    ltf_state_test_run_finished(state);
+    ltf_hooks_run(L, LTF_HOOK_FN_TEST_RUN_FINISHED);
 
-        char *file = NULL;
-        int line = 0;
-        char *trace = NULL;
+    return state->passed_amount == amount ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-        if (rc != LUA_OK) {
-            trace = strdup(lua_tostring(L, -1));
-            LOG("Test '%s' traceback: %s", tc->name, trace);
+// Compiled chunks are kept in the project, see util/bytecode_cache.h
+static void init_bytecode_cache(lua_State *L, project_parsed_t *proj) {
+    char *dir = NULL;
+    if (asprintf(&dir, "%s/.ltf/cache/bytecode", proj->project_path) < 0) {
+        return;
+    }
 
-            if (trace) {
-                const char *colon1 = strchr(trace, ':');
-                if (colon1) {
-                    const char *colon2 = strchr(colon1 + 1, ':');
-                    if (colon2) {
-                        file = strndup(trace, colon1 - trace);
-                        line = atoi(colon1 + 1);
-                    }
-                }
-            }
-            lua_pop(L, 1);
+    if (bytecode_cache_init(dir)) {
+        LOG("Running without bytecode cache.");
+    } else {
+        bytecode_cache_install_searcher(L);
+    }
+    free(dir);
+}
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#define FNV1A_INIT 1469598103934665603ULL
+
+// Variables can change which tests a file registers, an index only serves
+// runs with the same ones
+static uint64_t vars_context(cmd_test_options *opts) {
+    uint64_t context = 0;
+    da_foreach(opts->vars, kv_pair_t, var) {
+        uint64_t h = FNV1A_INIT;
+        if (var->key)
+            h = fnv1a(h, var->key, strlen(var->key));
+        h = fnv1a(h, "=", 1);
+        if (var->value)
+            h = fnv1a(h, var->value, strlen(var->value));
+        context += h; // the order of the variables does not matter
+    }
+    return context;
+}
+
+// So do the helpers a test file requires from the project 'lib/'. Every file
+// below 'dir' counts with its path, size and modification time, so that any
+// change there drops the whole index.
+static uint64_t lib_tree_context(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return 0;
+
+    uint64_t context = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        char *full = NULL;
+        if (asprintf(&full, "%s/%s", dir, ent->d_name) < 0)
+            continue;
+
+        struct stat st;
+        if (stat(full, &st) == 0) {
+            uint64_t h = fnv1a(FNV1A_INIT, full, strlen(full));
+            h = fnv1a(h, &st.st_size, sizeof st.st_size);
+            h = fnv1a(h, &st.st_mtim.tv_sec, sizeof st.st_mtim.tv_sec);
+            h = fnv1a(h, &st.st_mtim.tv_nsec, sizeof st.st_mtim.tv_nsec);
+            context += h; // the order of the entries does not matter
+            if (S_ISDIR(st.st_mode))
+                context += lib_tree_context(full);
         }
+        free(full);
+    }
+    closedir(d);
+    return context;
+}
 
-        LOG("Popping error handler...");
-        lua_remove(L, erridx);
+// The tests of every test file are indexed in the project (per target), see
+// ltf_test_index.h
+static void init_test_index(project_parsed_t *proj, cmd_test_options *opts) {
+    char *path = NULL;
+    int rc = opts->target ? asprintf(&path, "%s/.ltf/cache/test_index_%s.json",
+                                     proj->project_path, opts->target)
+                          : asprintf(&path, "%s/.ltf/cache/test_index.json",
+                                     proj->project_path);
+    if (rc < 0) {
+        return;
+    }
 
-        if (rc == LUA_OK) {
-            if (test_marked_failed) {
-                ltf_state_test_failed(state, NULL, 0, NULL);
-            } else {
-                ltf_state_test_passed(state);
-                passed++;
-            }
-        } else {
-            ltf_state_test_failed(state, file ? file : "unknown", line,
-                                  trace ? trace : "unknown");
-            free(file);
-            free(trace);
+    uint64_t context =
+        vars_context(opts) + lib_tree_context(project_lib_dir_path);
+    ltf_test_index_init(path, proj->project_path, context);
+    free(path);
+}
+
+// Whether this run only wants some of the tests, so that test files without
+// any of them can be skipped
+static bool selects_tests(cmd_test_options *opts) {
+    return da_size(opts->tags) != 0 || rerun_names ||
+           (opts->scenario_parsed && da_size(opts->scenario.order) != 0);
+}
+
+// Timings of the tests of the project (or target), kept next to its logs
+static char *get_timings_path(project_parsed_t *proj, cmd_test_options *opts) {
+    char *path = NULL;
+    if (proj->multitarget) {
+        asprintf(&path, "%s/logs/%s/test_timings.json", proj->project_path,
+                 opts->target);
+    } else {
+        asprintf(&path, "%s/logs/test_timings.json", proj->project_path);
+    }
+    return path;
+}
+
+static char *get_latest_raw_log_path(project_parsed_t *proj,
+                                     cmd_test_options *opts) {
+    char *path = NULL;
+    if (proj->multitarget) {
+        asprintf(&path, "%s/logs/%s/test_run_latest_raw.json",
+                 proj->project_path, opts->target);
+    } else {
+        asprintf(&path, "%s/logs/test_run_latest_raw.json",
+                 proj->project_path);
+    }
+    return path;
+}
+
+// Durations of previous runs from the timings file, or from the latest raw
+// log before there is one
+static void load_run_timings(project_parsed_t *proj, cmd_test_options *opts) {
+    char *path = get_timings_path(proj, opts);
+    if (path && file_exists(path)) {
+        ltf_timings_load(&run_timings, path);
+        free(path);
+        return;
+    }
+    free(path);
+
+    path = get_latest_raw_log_path(proj, opts);
+    if (path && file_exists(path)) {
+        ltf_timings_load(&run_timings, path);
+    }
+    free(path);
+}
+
+static void save_run_timings(project_parsed_t *proj, cmd_test_options *opts,
+                             ltf_state_t *state) {
+    char *path = get_timings_path(proj, opts);
+    if (!path) {
+        return;
+    }
+    ltf_timings_update(&run_timings, state);
+    ltf_timings_save(&run_timings, path);
+    free(path);
+}
+
+// Estimated duration of every test for the ETA of the TUI
+static void set_tui_estimates(cmd_test_options *opts) {
+    da_t *tests = test_case_get_all();
+    size_t tests_count = da_size(tests);
+    uint64_t *estimates =
+        calloc(tests_count ? tests_count : 1, sizeof(uint64_t));
+    if (!estimates) {
+        return;
+    }
+    for (size_t i = 0; i < tests_count; ++i) {
+        test_case_t *tc = da_get(tests, i);
+        estimates[i] = ltf_timings_estimate(&run_timings, tc->name);
+    }
+    ltf_tui_set_estimates(estimates, tests_count,
+                          opts->jobs < tests_count ? opts->jobs : tests_count);
+    free(estimates);
+}
+
+static bool is_in_dir(const char *file, const char *dir) {
+    size_t len = dir ? strlen(dir) : 0;
+    return len && !strncmp(file, dir, len) && file[len] == '/';
+}
+
+static bool is_test_file(const char *path) {
+    return is_in_dir(path, project_test_dir_path) ||
+           is_in_dir(path, project_common_test_dir_path);
+}
+
+static bool str_array_contains(str_array_t *a, const char *str) {
+    for (size_t i = 0; i < a->count; ++i) {
+        if (!strcmp(a->items[i], str)) {
+            return true;
         }
+    }
+    return false;
+}
 
-        run_deferred(L, state, rc == LUA_OK ? "passed" : "failed");
+// Remember which files registered the failed tests. They are loaded alone
+// if every one of them is a test file that still exists.
+static void add_rerun_file(project_parsed_t *proj, const char *file) {
+    char *path = NULL;
+    if (!file || asprintf(&path, "%s/%s", proj->project_path, file) < 0) {
+        rerun_files_known = false;
+        return;
+    }
 
-        if (sigint) {
-            ltf_tui_deinit();
-            exit(130);
+    if (!is_test_file(path) || !file_exists(path)) {
+        LOG("Test file %s is unknown, loading all test files", path);
+        rerun_files_known = false;
+        free(path);
+        return;
+    }
+
+    if (str_array_contains(&rerun_files, path)) {
+        free(path);
+        return;
+    }
+    char **items =
+        realloc(rerun_files.items, (rerun_files.count + 1) * sizeof(char *));
+    if (!items) {
+        rerun_files_known = false;
+        free(path);
+        return;
+    }
+    rerun_files.items = items;
+    rerun_files.items[rerun_files.count++] = path;
+}
+
+// Only enqueue the tests that failed in the log of --rerun-failed. Returns 0
+// on success, 1 if no test failed, -1 on errors.
+static int select_failed_tests(project_parsed_t *proj,
+                               cmd_test_options *opts) {
+    char *path = opts->rerun_log ? strdup(opts->rerun_log)
+                                 : get_latest_raw_log_path(proj, opts);
+    ltf_state_t *log = NULL;
+    if (path && file_exists(path)) {
+        log = ltf_state_from_file(path);
+    }
+    if (!log || !log->os) {
+        LOG("Unable to load log of failed tests %s", path ? path : "");
+        fprintf(stderr,
+                "Log file %s is either missing, incorrect or corrupt.\n",
+                path ? path : "");
+        ltf_state_free(log);
+        free(path);
+        return -1;
+    }
+
+    rerun_names = da_init(1, sizeof(char *));
+    rerun_files_known = true;
+    da_foreach(log->tests, ltf_state_test_t, test) {
+        if (!test->name || !test->status_str ||
+            strcmp(test->status_str, "FAILED")) {
+            continue;
         }
+        char *name = strdup(test->name);
+        da_append(rerun_names, &name);
+        add_rerun_file(proj, test->file);
+    }
+    ltf_state_free(log);
 
-        ltf_hooks_run(L, LTF_HOOK_FN_TEST_FINISHED);
+    size_t failed = da_size(rerun_names);
+    if (failed == 0) {
+        printf("No failed tests in %s.\n", path);
+        free(path);
+        return 1;
     }
 
-    ltf_state_test_run_finished(state);
-    ltf_hooks_run(L, LTF_HOOK_FN_TEST_RUN_FINISHED);
+    LOG("Re-running %zu failed tests of %s", failed, path);
+    printf("Re-running %zu failed tests of %s.\n", failed, path);
+    test_case_set_only(rerun_names);
+    free(path);
+    return 0;
+}
+
+// Failed tests that are gone since (renamed or removed)
+static void warn_missing_failed_tests(cmd_test_options *opts) {
+    if (da_size(opts->tags)) {
+        return; // may have been left out on purpose
+    }
 
-    return passed == amount ? EXIT_SUCCESS : EXIT_FAILURE;
+    da_t *tests = test_case_get_all();
+    size_t tests_count = da_size(tests);
+    da_foreach(rerun_names, char *, name) {
+        bool found = false;
+        for (size_t i = 0; i < tests_count && !found; ++i) {
+            test_case_t *tc = da_get(tests, i);
+            found = !strcmp(tc->name, *name);
+        }
+        if (!found) {
+            printf("\x1b[33mWARNING:\x1b[0m Failed test '%s' no longer "
+                   "exists.\n",
+                   *name);
+        }
+    }
+}
+
+static void free_rerun_selection() {
+    da_foreach(rerun_names, char *, name) { free(*name); }
+    da_free(rerun_names);
+    rerun_names = NULL;
+    free_str_array(&rerun_files);
+}
+
+// Keep only the tests of this shard. Must run after test_case_order_tests(),
+// all shards have to see the same tests in the same order.
+static int shard_tests(lua_State *L, cmd_test_options *opts) {
+    da_t *tests = test_case_get_all();
+    size_t tests_count = da_size(tests);
+    if (tests_count == 0) {
+        return 0;
+    }
+
+    // Only the given timings file, never 'run_timings': every shard has to
+    // balance with the same durations, whatever machine it runs on
+    ltf_timings_t timings = {0};
+    if (opts->shard_by == LTF_SHARD_BY_DURATION &&
+        ltf_timings_load(&timings, opts->shard_timings)) {
+        printf("\x1b[33mWARNING:\x1b[0m No test durations in '%s', "
+               "every test counts the same.\n",
+               opts->shard_timings);
+    }
+
+    bool *keep = calloc(tests_count, sizeof(bool));
+    if (!keep) {
+        ltf_timings_free(&timings);
+        return -1;
+    }
+    ltf_shard_partition(tests, opts->shard_index, opts->shard_count,
+                        opts->shard_by, &timings, keep);
+    test_case_retain(L, keep);
+
+    LOG("Shard %zu/%zu: %zu of %zu tests", opts->shard_index + 1,
+        opts->shard_count, da_size(tests), tests_count);
+    printf("Shard %zu/%zu: running %zu of %zu tests.\n",
+           opts->shard_index + 1, opts->shard_count, da_size(tests),
+           tests_count);
+
+    free(keep);
+    ltf_timings_free(&timings);
+    return 0;
 }
 
 static char *get_ltf_lib_dir() {
@@ -391,9 +844,12 @@ static void inject_cmodules_dir(lua_State *L) {
         ltf_lib_dir_path);
 }
 
+// C modules are only opened by their first require()
 static void register_clua_module(lua_State *L, const char *name,
                                  lua_CFunction openf) {
-    luaL_requiref(L, name, openf, 1);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    lua_pushcfunction(L, openf);
+    lua_setfield(L, -2, name);
     lua_pop(L, 1);
 }
 
@@ -422,19 +878,34 @@ void register_ltf_libs(lua_State *L) {
 }
 
 static int load_lua_files(lua_State *L, str_array_t *files) {
+    project_parsed_t *proj = get_parsed_project();
+    const char *project_path = proj ? proj->project_path : NULL;
 
     for (size_t i = 0; i < files->count; i++) {
         char *file = files->items[i];
         LOG("Loading Lua file %s...", file);
-        if (luaL_dofile(L, file)) {
+        // Tests remember their file relative to the project, for
+        // --rerun-failed
+        const char *rel = is_in_dir(file, project_path)
+                              ? file + strlen(project_path) + 1
+                              : file;
+        test_case_set_loading_file(rel);
+        ltf_test_index_set_loading_file(is_test_file(file) ? rel : NULL);
+        line_cache_invalidate(file);
+        if (bytecode_cache_loadfile(L, file) ||
+            lua_pcall(L, 0, LUA_MULTRET, 0)) {
             const char *err = lua_tostring(L, -1);
             LOG("Failed loading: %s", err);
             fprintf(stderr, "Lua error loading %s: %s\n", file, err);
             lua_pop(L, 1);
+            test_case_set_loading_file(NULL);
+            ltf_test_index_set_loading_file(NULL);
             return -1;
         }
         LOG("File %s loaded successfully.", file);
     }
+    test_case_set_loading_file(NULL);
+    ltf_test_index_set_loading_file(NULL);
 
     return 0;
 }
@@ -463,6 +934,46 @@ int load_lua_dir(const char *dir_path, lua_State *L) {
     }
 }
 
+// Drop the files of 'files' that the test index knows to have none of the
+// tests of this run
+static void skip_unwanted_files(str_array_t *files) {
+    project_parsed_t *proj = get_parsed_project();
+    size_t kept = 0;
+    for (size_t i = 0; i < files->count; i++) {
+        char *file = files->items[i];
+        const char *rel = is_in_dir(file, proj->project_path)
+                              ? file + strlen(proj->project_path) + 1
+                              : file;
+        if (!ltf_test_index_needs_file(rel, test_case_is_wanted)) {
+            free(file);
+            continue;
+        }
+        files->items[kept++] = file;
+    }
+    files->count = kept;
+}
+
+// Same as load_lua_dir(), for a directory of test files
+static int load_test_dir(const char *dir_path, lua_State *L,
+                         cmd_test_options *opts) {
+    if (!directory_exists(dir_path)) {
+        LOG("Directory %s doesn't exist.", dir_path);
+        return -1;
+    }
+
+    str_array_t lua_files = list_lua_recursive(dir_path);
+    size_t found = lua_files.count;
+    if (selects_tests(opts)) {
+        skip_unwanted_files(&lua_files);
+    }
+    LOG("Loading %zu of %zu lua files in '%s'...", lua_files.count, found,
+        dir_path);
+
+    int rc = load_lua_files(L, &lua_files) ? -2 : 0;
+    free_str_array(&lua_files);
+    return rc;
+}
+
 int ltf_test() {
 
     cmd_test_options *opts = cmd_parser_get_test_options();
@@ -539,6 +1050,11 @@ int ltf_test() {
     }
 
     register_ltf_libs(L);
+    if (!opts->no_cache) {
+        init_bytecode_cache(L, proj);
+        if (!opts->no_index)
+            init_test_index(proj, opts);
+    }
     // Change default lua 'print' to our implementation:
     lua_pushcfunction(L, l_module_ltf_print);
     lua_setglobal(L, "print");
@@ -546,7 +1062,6 @@ int ltf_test() {
     int exitcode = EXIT_FAILURE;
 
     ltf_state_t *state = NULL;
-    da_t *lua_hooks_whitelist = NULL;
 
     state = ltf_state_new();
 
@@ -566,13 +1081,31 @@ int ltf_test() {
         goto deinit;
     }
 
-    if (proj->multitarget) {
-        if (load_lua_dir(project_common_test_dir_path, L) == -2) {
+    if (opts->rerun_failed) {
+        int res = select_failed_tests(proj, opts);
+        if (res) {
+            exitcode = res > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
             goto deinit;
         }
     }
-    if (load_lua_dir(project_test_dir_path, L) == -2) {
-        goto deinit;
+
+    if (rerun_files_known) {
+        LOG("Loading only the files of the failed tests...");
+        if (load_lua_files(L, &rerun_files)) {
+            goto deinit;
+        }
+    } else {
+        if (proj->multitarget) {
+            if (load_test_dir(project_common_test_dir_path, L, opts) == -2) {
+                goto deinit;
+            }
+        }
+        if (load_test_dir(project_test_dir_path, L, opts) == -2) {
+            goto deinit;
+        }
+    }
+    if (!opts->no_cache && !opts->no_index) {
+        ltf_test_index_save();
     }
 
     ltf_hooks_init(state);
@@ -584,11 +1117,28 @@ int ltf_test() {
     if (!opts->no_logs) {
         ltf_log_init(state);
     }
+    if (opts->profile) {
+        init_profiler(opts);
+    }
     test_case_order_tests();
+    if (opts->rerun_failed) {
+        warn_missing_failed_tests(opts);
+    }
+    load_run_timings(proj, opts);
+    size_t unsharded_amount = da_size(test_case_get_all());
+    if (opts->shard_count && shard_tests(L, opts)) {
+        goto deinit;
+    }
 
     size_t amount = da_size(test_case_get_all());
 
-    if (amount == 0) {
+    if (amount == 0 && unsharded_amount != 0) {
+        // More shards than tests, nothing left for this one
+        LOG("No tests in shard.");
+        printf("No tests in this shard.\n");
+        exitcode = EXIT_SUCCESS;
+        goto deinit;
+    } else if (amount == 0) {
         LOG("No tests found.");
         fprintf(stderr, "No tests to execute.\n");
         goto deinit;
@@ -600,6 +1150,9 @@ int ltf_test() {
         if (ltf_tui_init(state)) {
             goto deinit;
         }
+        if (run_timings.count) {
+            set_tui_estimates(opts);
+        }
         struct sigaction sa = {0};
         sa.sa_handler = on_sigint;
         sigemptyset(&sa.sa_mask);
@@ -613,20 +1166,22 @@ int ltf_test() {
     da_append(lua_hooks_whitelist, &project_test_dir_path);
     da_append(lua_hooks_whitelist, &project_lib_dir_path);
     da_append(lua_hooks_whitelist, &ltf_lib_dir_path);
-    lua_hooks_init(L, lua_hooks_whitelist);
 
-    if (!opts->headless) {
-        LOG("Enabling line hook...");
-        lua_hooks_add(LUA_HOOKLINE, line_hook);
+    // With several jobs tests are traced inside of the workers instead,
+    // see init_test_tracing()
+    if (opts->jobs <= 1) {
+        init_serial_tracing(L, state, opts);
     }
 
-    keyword_status_init(state, ltf_lib_dir_path);
-
-    exitcode = run_all_tests(L, state);
+    exitcode = run_all_tests(L, state, opts);
+    if (!opts->no_logs) {
+        save_run_timings(proj, opts, state);
+    }
 
     if (!opts->headless) {
         tui_render_result(NULL);
     }
+    ltf_profiler_finish(state);
 
 deinit:
 
@@ -634,9 +1189,17 @@ deinit:
 
     ltf_log_free();
     test_case_free_all(L);
+    free_rerun_selection();
     ltf_hooks_deinit(L);
+    ltf_watchdog_free();
     lua_hooks_deinit();
+    line_cache_free();
+    ltf_profiler_free();
     lua_close(L);
+    bytecode_cache_free();
+    ltf_test_index_free();
+    ltf_timings_free(&run_timings);
+    http_pool_clear();
     project_parser_free();
     internal_logging_deinit();
     ltf_free_vars();
@@ -644,6 +1207,7 @@ deinit:
     ltf_state_free(state);
     cmd_parser_free_test_options();
     da_free(lua_hooks_whitelist);
+    lua_hooks_whitelist = NULL;
     free(project_hooks_dir_path);
     free(ltf_lib_dir_path);
     free(project_common_test_dir_path);
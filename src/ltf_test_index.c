@@ -0,0 +1,447 @@
+#include "ltf_test_index.h"
+
+#include "internal_logging.h"
+
+#include "util/files.h"
+
+#include <json.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif // __APPLE__
+
+#define INDEX_VERSION 1
+
+typedef struct {
+    char *name;
+    da_t *tags; // char *
+} index_test_t;
+
+typedef struct {
+    char *file; // relative to the project
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    da_t *tests; // index_test_t
+    bool seen;   // looked up or loaded by this run
+} index_file_t;
+
+static char *index_path = NULL;
+static char *index_root = NULL;
+static uint64_t index_context = 0;
+static bool index_changed = false;
+
+static index_file_t *files = NULL; // sorted by file unless !files_sorted
+static size_t files_count = 0;
+static size_t files_capacity = 0;
+static bool files_sorted = true;
+
+// Entry of the file being loaded and the tests it had before
+static bool loading = false;
+static size_t loading_index = 0;
+static da_t *loading_previous = NULL;
+
+static void free_tests(da_t *tests) {
+    da_foreach(tests, index_test_t, test) {
+        free(test->name);
+        da_foreach(test->tags, char *, tag) { free(*tag); }
+        da_free(test->tags);
+    }
+    da_free(tests);
+}
+
+static void free_files(void) {
+    for (size_t i = 0; i < files_count; ++i) {
+        free(files[i].file);
+        free_tests(files[i].tests);
+    }
+    free(files);
+    files = NULL;
+    files_count = 0;
+    files_capacity = 0;
+    files_sorted = true;
+}
+
+static da_t *copy_tags(da_t *tags) {
+    da_t *copy = da_init(1, sizeof(char *));
+    da_foreach(tags, char *, tag) {
+        char *dup = strdup(*tag);
+        da_append(copy, &dup);
+    }
+    return copy;
+}
+
+static bool tests_equal(da_t *a, da_t *b) {
+    size_t count = da_size(a);
+    if (count != da_size(b))
+        return false;
+
+    for (size_t i = 0; i < count; ++i) {
+        index_test_t *ta = da_get(a, i);
+        index_test_t *tb = da_get(b, i);
+        size_t tags_count = da_size(ta->tags);
+        if (strcmp(ta->name, tb->name) || tags_count != da_size(tb->tags))
+            return false;
+        for (size_t j = 0; j < tags_count; ++j) {
+            if (strcmp(*(char **)da_get(ta->tags, j),
+                       *(char **)da_get(tb->tags, j)))
+                return false;
+        }
+    }
+    return true;
+}
+
+static int file_cmp(const void *a, const void *b) {
+    const index_file_t *fa = a;
+    const index_file_t *fb = b;
+    return strcmp(fa->file, fb->file);
+}
+
+static index_file_t *find_file(const char *file) {
+    if (!files_count)
+        return NULL;
+    if (!files_sorted) {
+        qsort(files, files_count, sizeof(index_file_t), file_cmp);
+        files_sorted = true;
+    }
+
+    index_file_t key = {.file = (char *)file};
+    return bsearch(&key, files, files_count, sizeof(index_file_t), file_cmp);
+}
+
+static index_file_t *add_file(const char *file) {
+    if (files_count == files_capacity) {
+        size_t capacity = files_capacity ? files_capacity * 2 : 64;
+        index_file_t *grown = realloc(files, capacity * sizeof(index_file_t));
+        if (!grown)
+            return NULL;
+        files = grown;
+        files_capacity = capacity;
+    }
+
+    char *dup = strdup(file);
+    if (!dup)
+        return NULL;
+    files[files_count] = (index_file_t){
+        .file = dup,
+        .tests = da_init(1, sizeof(index_test_t)),
+    };
+    files_sorted = false;
+    return &files[files_count++];
+}
+
+static bool stat_file(const char *file, struct stat *st) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", index_root, file) < 0)
+        return false;
+    bool ok = stat(path, st) == 0 && S_ISREG(st->st_mode);
+    free(path);
+    return ok;
+}
+
+static bool is_fresh(const index_file_t *entry, const struct stat *st) {
+    return entry->mtime_sec == (int64_t)st->st_mtime &&
+           entry->mtime_nsec == (int64_t)STAT_MTIME_NSEC(*st) &&
+           entry->size == (int64_t)st->st_size;
+}
+
+static void context_str(uint64_t context, char *buf, size_t len) {
+    snprintf(buf, len, "%016llx", (unsigned long long)context);
+}
+
+static da_t *tests_from_json(json_object *arr) {
+    da_t *tests = da_init(1, sizeof(index_test_t));
+    size_t len = json_object_array_length(arr);
+    for (size_t i = 0; i < len; ++i) {
+        json_object *obj = json_object_array_get_idx(arr, i);
+        json_object *name;
+        json_object *tags;
+        if (!json_object_object_get_ex(obj, "name", &name) ||
+            !json_object_is_type(name, json_type_string))
+            continue;
+
+        index_test_t test = {
+            .name = strdup(json_object_get_string(name)),
+            .tags = da_init(1, sizeof(char *)),
+        };
+        if (json_object_object_get_ex(obj, "tags", &tags) &&
+            json_object_is_type(tags, json_type_array)) {
+            size_t tags_len = json_object_array_length(tags);
+            for (size_t j = 0; j < tags_len; ++j) {
+                json_object *tag = json_object_array_get_idx(tags, j);
+                if (!json_object_is_type(tag, json_type_string))
+                    continue;
+                char *dup = strdup(json_object_get_string(tag));
+                da_append(test.tags, &dup);
+            }
+        }
+        da_append(tests, &test);
+    }
+    return tests;
+}
+
+static int files_from_json(json_object *root) {
+    json_object *version;
+    json_object *context;
+    json_object *obj;
+    if (!json_object_object_get_ex(root, "version", &version) ||
+        json_object_get_int(version) != INDEX_VERSION ||
+        !json_object_object_get_ex(root, "files", &obj) ||
+        !json_object_is_type(obj, json_type_object)) {
+        LOG("Test index has an unknown format");
+        return -1;
+    }
+
+    char expected[32];
+    context_str(index_context, expected, sizeof expected);
+    if (!json_object_object_get_ex(root, "context", &context) ||
+        strcmp(json_object_get_string(context), expected)) {
+        LOG("Test index was made for another context, rebuilding it");
+        return -1;
+    }
+
+    json_object_object_foreach(obj, file, val) {
+        json_object *mtime_sec;
+        json_object *mtime_nsec;
+        json_object *size;
+        json_object *tests;
+        if (!json_object_object_get_ex(val, "mtime_sec", &mtime_sec) ||
+            !json_object_object_get_ex(val, "mtime_nsec", &mtime_nsec) ||
+            !json_object_object_get_ex(val, "size", &size) ||
+            !json_object_object_get_ex(val, "tests", &tests) ||
+            !json_object_is_type(tests, json_type_array))
+            continue;
+
+        index_file_t *entry = add_file(file);
+        if (!entry)
+            return -1;
+        entry->mtime_sec = json_object_get_int64(mtime_sec);
+        entry->mtime_nsec = json_object_get_int64(mtime_nsec);
+        entry->size = json_object_get_int64(size);
+        free_tests(entry->tests);
+        entry->tests = tests_from_json(tests);
+    }
+    return 0;
+}
+
+int ltf_test_index_init(const char *path, const char *project_path,
+                        uint64_t context) {
+    ltf_test_index_free();
+
+    index_path = strdup(path);
+    index_root = strdup(project_path);
+    index_context = context;
+    if (!index_path || !index_root) {
+        ltf_test_index_free();
+        return -1;
+    }
+
+    json_object *root = json_object_from_file(path);
+    int rc = root ? files_from_json(root) : -1;
+    json_object_put(root);
+
+    if (rc) {
+        LOG("No usable test index in %s", path);
+        free_files();
+        index_changed = true;
+        return -1;
+    }
+    LOG("Loaded test index of %zu files from %s", files_count, path);
+    return 0;
+}
+
+bool ltf_test_index_needs_file(const char *file,
+                               ltf_test_index_filter_t wanted) {
+    if (!index_root)
+        return true;
+
+    struct stat st;
+    index_file_t *entry = find_file(file);
+    if (!entry || !stat_file(file, &st) || !is_fresh(entry, &st)) {
+        LOG("Test file %s is not indexed", file);
+        return true;
+    }
+
+    entry->seen = true;
+    da_foreach(entry->tests, index_test_t, test) {
+        if (wanted(test->name, test->tags))
+            return true;
+    }
+    LOG("Skipping test file %s, none of its tests are selected", file);
+    return false;
+}
+
+static void finish_loading(void) {
+    if (!loading)
+        return;
+
+    index_file_t *entry = &files[loading_index];
+    if (!tests_equal(entry->tests, loading_previous)) {
+        LOG("Indexed %zu tests of %s", da_size(entry->tests), entry->file);
+        index_changed = true;
+    }
+    free_tests(loading_previous);
+    loading_previous = NULL;
+    loading = false;
+}
+
+void ltf_test_index_set_loading_file(const char *file) {
+    finish_loading();
+
+    struct stat st;
+    if (!index_root || !file || !stat_file(file, &st))
+        return;
+
+    index_file_t *entry = find_file(file);
+    if (!entry)
+        entry = add_file(file);
+    if (!entry)
+        return;
+
+    if (!is_fresh(entry, &st))
+        index_changed = true;
+    entry->mtime_sec = (int64_t)st.st_mtime;
+    entry->mtime_nsec = (int64_t)STAT_MTIME_NSEC(st);
+    entry->size = (int64_t)st.st_size;
+    entry->seen = true;
+
+    loading_previous = entry->tests;
+    entry->tests = da_init(1, sizeof(index_test_t));
+    loading_index = (size_t)(entry - files);
+    loading = true;
+}
+
+void ltf_test_index_record(const char *name, da_t *tags) {
+    if (!loading || !name)
+        return;
+
+    index_test_t test = {.name = strdup(name), .tags = copy_tags(tags)};
+    da_append(files[loading_index].tests, &test);
+}
+
+// Drop the entries of deleted files, the ones of this run were already seen
+static void prune_files(void) {
+    size_t kept = 0;
+    for (size_t i = 0; i < files_count; ++i) {
+        struct stat st;
+        if (!files[i].seen && !stat_file(files[i].file, &st)) {
+            LOG("Dropping test file %s from the index", files[i].file);
+            free(files[i].file);
+            free_tests(files[i].tests);
+            index_changed = true;
+            continue;
+        }
+        files[kept++] = files[i];
+    }
+    files_count = kept;
+}
+
+static json_object *files_to_json(void) {
+    json_object *obj = json_object_new_object();
+    for (size_t i = 0; i < files_count; ++i) {
+        index_file_t *entry = &files[i];
+        json_object *val = json_object_new_object();
+        json_object *tests = json_object_new_array();
+        json_object_object_add(val, "mtime_sec",
+                               json_object_new_int64(entry->mtime_sec));
+        json_object_object_add(val, "mtime_nsec",
+                               json_object_new_int64(entry->mtime_nsec));
+        json_object_object_add(val, "size", json_object_new_int64(entry->size));
+
+        da_foreach(entry->tests, index_test_t, test) {
+            json_object *t = json_object_new_object();
+            json_object *tags = json_object_new_array();
+            json_object_object_add(t, "name",
+                                   json_object_new_string(test->name));
+            da_foreach(test->tags, char *, tag) {
+                json_object_array_add(tags, json_object_new_string(*tag));
+            }
+            json_object_object_add(t, "tags", tags);
+            json_object_array_add(tests, t);
+        }
+        json_object_object_add(val, "tests", tests);
+        json_object_object_add(obj, entry->file, val);
+    }
+    return obj;
+}
+
+static int ensure_parent_dir(const char *path) {
+    char *dir = strdup(path);
+    if (!dir)
+        return -1;
+
+    int rc = 0;
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        if (!directory_exists(dir))
+            rc = create_directory(dir, MKDIR_MODE);
+    }
+    free(dir);
+    return rc;
+}
+
+int ltf_test_index_save(void) {
+    finish_loading();
+    if (!index_path)
+        return -1;
+
+    prune_files();
+    if (!index_changed) {
+        LOG("Test index is up to date");
+        return 0;
+    }
+
+    char context[32];
+    context_str(index_context, context, sizeof context);
+    json_object *root = json_object_new_object();
+    json_object_object_add(root, "version", json_object_new_int(INDEX_VERSION));
+    json_object_object_add(root, "context", json_object_new_string(context));
+    json_object_object_add(root, "files", files_to_json());
+
+    // Written aside and renamed, runs of the same project may finish at the
+    // same time
+    char *tmp = NULL;
+    int rc = -1;
+    if (ensure_parent_dir(index_path) == 0 &&
+        asprintf(&tmp, "%s.%ld.tmp", index_path, (long)getpid()) >= 0) {
+        rc = json_object_to_file_ext(tmp, root,
+                                     JSON_C_TO_STRING_PLAIN |
+                                         JSON_C_TO_STRING_NOSLASHESCAPE);
+        if (rc == 0 && rename(tmp, index_path) != 0)
+            rc = -1;
+        if (rc)
+            unlink(tmp);
+    }
+
+    if (rc) {
+        LOG("Unable to save test index to %s", index_path);
+    } else {
+        LOG("Saved test index of %zu files to %s", files_count, index_path);
+        index_changed = false;
+    }
+    free(tmp);
+    json_object_put(root);
+    return rc;
+}
+
+void ltf_test_index_free(void) {
+    free_tests(loading_previous);
+    loading_previous = NULL;
+    loading = false;
+    free_files();
+    free(index_path);
+    index_path = NULL;
+    free(index_root);
+    index_root = NULL;
+    index_context = 0;
+    index_changed = false;
+}
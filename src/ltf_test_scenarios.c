@@ -230,7 +230,7 @@ static int ltf_test_scenario_from_json(const char *file_path,
             out->cmd.skip_hooks = json_object_get_boolean(cmd_v);
         }
         if (json_object_object_get_ex(v, "log_level", &cmd_v)) {
-            char *log_level_str;
+            char *log_level_str = NULL;
             ERR_CHECK(json_string_to_string(file_path, "cmd.log_level", cmd_v,
                                             &log_level_str));
             int level = ltf_log_level_from_str(log_level_str);
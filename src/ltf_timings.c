@@ -0,0 +1,298 @@
+#include "ltf_timings.h"
+
+#include "internal_logging.h"
+#include "test_case.h"
+
+#include <json.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TIMINGS_VERSION 1
+
+static int timing_cmp(const void *a, const void *b) {
+    const ltf_timing_t *ta = a;
+    const ltf_timing_t *tb = b;
+    return strcmp(ta->name, tb->name);
+}
+
+// Duration waiting to be added, 'order' tells which one of several
+// durations of the same test is the latest
+typedef struct {
+    ltf_timing_t timing; // name is not owned
+    size_t order;
+} timing_entry_t;
+
+static int timing_entry_cmp(const void *a, const void *b) {
+    const timing_entry_t *ea = a;
+    const timing_entry_t *eb = b;
+    int cmp = strcmp(ea->timing.name, eb->timing.name);
+    if (cmp)
+        return cmp;
+    return ea->order < eb->order ? -1 : 1;
+}
+
+// Replace the durations of 'timings' with the latest one of every test of
+// 'entries'
+static int timings_set(ltf_timings_t *timings, timing_entry_t *entries,
+                       size_t entries_count) {
+    qsort(entries, entries_count, sizeof(timing_entry_t), timing_entry_cmp);
+
+    ltf_timing_t *items =
+        calloc(entries_count ? entries_count : 1, sizeof(ltf_timing_t));
+    if (!items)
+        return -1;
+
+    size_t count = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < entries_count; ++i) {
+        ltf_timing_t *t = &entries[i].timing;
+        if (i + 1 < entries_count &&
+            !strcmp(t->name, entries[i + 1].timing.name))
+            continue;
+        items[count++] = (ltf_timing_t){
+            .name = strdup(t->name),
+            .duration_ns = t->duration_ns,
+        };
+        total += t->duration_ns;
+    }
+
+    ltf_timings_free(timings);
+    timings->items = items;
+    timings->count = count;
+    timings->mean_ns = count ? total / count : 0;
+    return 0;
+}
+
+static int timings_from_state(ltf_timings_t *timings, ltf_state_t *state) {
+    size_t tests_count = da_size(state->tests);
+    timing_entry_t *entries =
+        calloc(tests_count ? tests_count : 1, sizeof(timing_entry_t));
+    if (!entries)
+        return -1;
+
+    size_t entries_count = 0;
+    for (size_t i = 0; i < tests_count; ++i) {
+        ltf_state_test_t *test = da_get(state->tests, i);
+        if (!test->name || !test->duration_ns)
+            continue;
+        entries[entries_count] = (timing_entry_t){
+            .timing = {.name = test->name, .duration_ns = test->duration_ns},
+            .order = entries_count,
+        };
+        entries_count++;
+    }
+
+    int rc = timings_set(timings, entries, entries_count);
+    free(entries);
+    return rc;
+}
+
+static int timings_from_json(ltf_timings_t *timings, json_object *durations) {
+    size_t len = (size_t)json_object_object_length(durations);
+    timing_entry_t *entries = calloc(len ? len : 1, sizeof(timing_entry_t));
+    if (!entries)
+        return -1;
+
+    size_t entries_count = 0;
+    json_object_object_foreach(durations, name, val) {
+        int64_t duration_ns = json_object_get_int64(val);
+        if (duration_ns <= 0)
+            continue;
+        entries[entries_count] = (timing_entry_t){
+            .timing = {.name = name, .duration_ns = (uint64_t)duration_ns},
+            .order = entries_count,
+        };
+        entries_count++;
+    }
+
+    int rc = timings_set(timings, entries, entries_count);
+    free(entries);
+    return rc;
+}
+
+int ltf_timings_load(ltf_timings_t *timings, const char *path) {
+    memset(timings, 0, sizeof *timings);
+
+    int rc = -1;
+    json_object *root = json_object_from_file(path);
+    json_object *durations;
+    if (root && json_object_object_get_ex(root, "durations", &durations) &&
+        json_object_is_type(durations, json_type_object)) {
+        rc = timings_from_json(timings, durations);
+    } else {
+        // Raw log, possibly of an interrupted run that needs recovering
+        ltf_state_t *state =
+            root ? ltf_state_from_json(root) : ltf_state_from_file(path);
+        if (state)
+            rc = timings_from_state(timings, state);
+        ltf_state_free(state);
+    }
+    json_object_put(root);
+
+    if (rc) {
+        LOG("Unable to load timings from %s", path);
+        return -1;
+    }
+    LOG("Loaded %zu test durations from %s", timings->count, path);
+    return 0;
+}
+
+int ltf_timings_save(const ltf_timings_t *timings, const char *path) {
+    json_object *root = json_object_new_object();
+    json_object *durations = json_object_new_object();
+    json_object_object_add(root, "version",
+                           json_object_new_int(TIMINGS_VERSION));
+    for (size_t i = 0; i < timings->count; ++i) {
+        json_object_object_add(
+            durations, timings->items[i].name,
+            json_object_new_int64((int64_t)timings->items[i].duration_ns));
+    }
+    json_object_object_add(root, "durations", durations);
+
+    // Written aside and renamed, runs of the same project may finish at the
+    // same time
+    char *tmp = NULL;
+    int rc = -1;
+    if (asprintf(&tmp, "%s.%ld.tmp", path, (long)getpid()) >= 0) {
+        rc = json_object_to_file_ext(tmp, root,
+                                     JSON_C_TO_STRING_PLAIN |
+                                         JSON_C_TO_STRING_NOSLASHESCAPE);
+        if (rc == 0 && rename(tmp, path) != 0)
+            rc = -1;
+        if (rc)
+            unlink(tmp);
+    }
+
+    if (rc) {
+        LOG("Unable to save timings to %s", path);
+    } else {
+        LOG("Saved %zu test durations to %s", timings->count, path);
+    }
+    free(tmp);
+    json_object_put(root);
+    return rc;
+}
+
+void ltf_timings_update(ltf_timings_t *timings, ltf_state_t *state) {
+    size_t tests_count = da_size(state->tests);
+    timing_entry_t *entries =
+        calloc(timings->count + tests_count + 1, sizeof(timing_entry_t));
+    if (!entries)
+        return;
+
+    size_t entries_count = 0;
+    for (size_t i = 0; i < timings->count; ++i) {
+        entries[entries_count] = (timing_entry_t){
+            .timing = timings->items[i],
+            .order = entries_count,
+        };
+        entries_count++;
+    }
+
+    for (size_t i = 0; i < tests_count; ++i) {
+        ltf_state_test_t *test = da_get(state->tests, i);
+        if (!test->name || !test->duration_ns || !test->status_str)
+            continue;
+
+        bool passed = !strcmp(test->status_str, "PASSED");
+        if (!passed && strcmp(test->status_str, "FAILED"))
+            continue;
+
+        uint64_t known_ns;
+        if (!passed && ltf_timings_find(timings, test->name, &known_ns) &&
+            known_ns >= test->duration_ns)
+            continue;
+
+        entries[entries_count] = (timing_entry_t){
+            .timing = {.name = test->name, .duration_ns = test->duration_ns},
+            .order = entries_count,
+        };
+        entries_count++;
+    }
+
+    // The names of the current items are copied before they are freed
+    ltf_timings_t updated = {0};
+    if (timings_set(&updated, entries, entries_count) == 0) {
+        ltf_timings_free(timings);
+        *timings = updated;
+    }
+    free(entries);
+}
+
+bool ltf_timings_find(const ltf_timings_t *timings, const char *name,
+                      uint64_t *duration_ns) {
+    if (!timings || !timings->count || !name)
+        return false;
+
+    ltf_timing_t key = {.name = (char *)name};
+    const ltf_timing_t *found = bsearch(&key, timings->items, timings->count,
+                                        sizeof(ltf_timing_t), timing_cmp);
+    if (!found)
+        return false;
+    *duration_ns = found->duration_ns;
+    return true;
+}
+
+uint64_t ltf_timings_estimate(const ltf_timings_t *timings, const char *name) {
+    uint64_t duration_ns;
+    if (ltf_timings_find(timings, name, &duration_ns))
+        return duration_ns;
+    return timings && timings->mean_ns ? timings->mean_ns : 1;
+}
+
+typedef struct {
+    size_t index;
+    const char *name;
+    uint64_t duration_ns;
+} timing_job_t;
+
+// Longest first, then by name and position, so equal durations keep the same
+// order whatever the run order of the tests
+static int job_cmp(const void *a, const void *b) {
+    const timing_job_t *ja = a;
+    const timing_job_t *jb = b;
+    if (ja->duration_ns != jb->duration_ns)
+        return ja->duration_ns > jb->duration_ns ? -1 : 1;
+    int cmp = strcmp(ja->name, jb->name);
+    if (cmp != 0)
+        return cmp;
+    return (ja->index > jb->index) - (ja->index < jb->index);
+}
+
+void ltf_timings_longest_first(const ltf_timings_t *timings, da_t *tests,
+                               size_t *order) {
+    size_t tests_count = da_size(tests);
+    timing_job_t *jobs =
+        calloc(tests_count ? tests_count : 1, sizeof(timing_job_t));
+    if (!jobs) {
+        for (size_t i = 0; i < tests_count; ++i)
+            order[i] = i;
+        return;
+    }
+
+    for (size_t i = 0; i < tests_count; ++i) {
+        test_case_t *tc = da_get(tests, i);
+        jobs[i] = (timing_job_t){
+            .index = i,
+            .name = tc->name,
+            .duration_ns = ltf_timings_estimate(timings, tc->name),
+        };
+    }
+    qsort(jobs, tests_count, sizeof(timing_job_t), job_cmp);
+
+    for (size_t i = 0; i < tests_count; ++i)
+        order[i] = jobs[i].index;
+    free(jobs);
+}
+
+void ltf_timings_free(ltf_timings_t *timings) {
+    if (!timings)
+        return;
+    for (size_t i = 0; i < timings->count; ++i)
+        free(timings->items[i].name);
+    free(timings->items);
+    memset(timings, 0, sizeof *timings);
+}
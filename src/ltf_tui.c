@@ -13,6 +13,9 @@
 
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,11 +36,20 @@ typedef struct {
     bool is_teardown;
     bool is_hooking;
 
-    double current_test_progress;
     char *current_file;
     int current_line;
     char *current_line_str;
 
+    // Copied from the last started test by the state callbacks, the
+    // ticker thread must not read 'ltf_state->tests' while it grows
+    char *test_name; // NULL before the first test
+    uint64_t test_started_ns;
+    bool test_running; // test body, not the defer queue
+    bool test_done;
+    size_t tests_started;
+    size_t passed_amount;
+    size_t failed_amount;
+
 } ui_state_t;
 
 static ui_state_t ui_state = {0};
@@ -52,8 +64,69 @@ static int log_level_to_palindex_map[] = {
 
 static bool result_render = false;
 
+// Panel redraws are coalesced to at most one per frame interval
+static uint64_t frame_interval_ns = 0;
+static uint64_t next_frame_ns = 0;
+
+// The panel is redrawn by a ticker thread once per frame interval, so that
+// the elapsed time and ETA keep moving while a test blocks in C. 'ui' and
+// 'ui_state' are only used with 'tui_mutex' held.
+static pthread_mutex_t tui_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t ticker_thread;
+static bool ticker_started = false;
+static atomic_bool ticker_stopping = false;
+
+// Set by the ticker once it drew the current line, see
+// ltf_tui_set_current_line()
+static atomic_bool line_wanted = true;
+static _Atomic double test_progress = 0;
+
+// remaining_ns[i] is the estimated duration of tests i.. together, NULL
+// without estimates
+static uint64_t *remaining_ns = NULL;
+static size_t estimates_count = 0;
+static size_t estimates_jobs = 1;
+
+static void tui_frame(bool force);
+
 void ltf_tui_set_test_progress(double progress) {
-    ui_state.current_test_progress = progress;
+    atomic_store_explicit(&test_progress, progress, memory_order_relaxed);
+}
+
+void ltf_tui_set_estimates(const uint64_t *estimates_ns, size_t count,
+                           size_t jobs) {
+    pthread_mutex_lock(&tui_mutex);
+    free(remaining_ns);
+    remaining_ns = calloc(count + 1, sizeof(uint64_t));
+    if (remaining_ns) {
+        for (size_t i = count; i > 0; --i)
+            remaining_ns[i - 1] = remaining_ns[i] + estimates_ns[i - 1];
+        estimates_count = count;
+        estimates_jobs = jobs ? jobs : 1;
+    }
+    pthread_mutex_unlock(&tui_mutex);
+}
+
+// Estimated time left, false if unknown. Tests count as started once in
+// 'ltf_state' (or merged back from a worker), the last one may still run.
+static bool ltf_tui_eta(uint64_t *eta_ms) {
+    if (!remaining_ns)
+        return false;
+
+    size_t started = ui_state.tests_started;
+    if (started > estimates_count)
+        return false;
+
+    uint64_t left_ns = remaining_ns[started];
+    if (started > 0 && !ui_state.test_done) {
+        uint64_t estimate_ns =
+            remaining_ns[started - 1] - remaining_ns[started];
+        uint64_t elapsed_ns = monotonic_nanos() - ui_state.test_started_ns;
+        left_ns += elapsed_ns < estimate_ns ? estimate_ns - elapsed_ns : 0;
+    }
+
+    *eta_ms = left_ns / estimates_jobs / 1000000;
+    return true;
 }
 
 static size_t sanitize_inplace(char *buf, size_t len) {
@@ -101,6 +174,8 @@ void ltf_tui_log(ltf_state_test_t *, ltf_state_test_output_t *output) {
     tmp[output->msg_len] = '\0';
     sanitize_inplace(tmp, output->msg_len);
 
+    pthread_mutex_lock(&tui_mutex);
+
     // Wrie Log Level information for current run
     pico_set_colors(ui, log_level_to_palindex_map[output->level], -1);
     pico_printf(ui, "[%s]", ll_to_str[output->level]);
@@ -115,6 +190,9 @@ void ltf_tui_log(ltf_state_test_t *, ltf_state_test_output_t *output) {
     pico_reset_colors(ui);
     pico_print_block(ui, tmp);
     free(tmp);
+
+    tui_frame(false);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void ltf_tui_hook_log(ltf_state_test_output_t *output) {
@@ -130,6 +208,8 @@ void ltf_tui_hook_log(ltf_state_test_output_t *output) {
     tmp[output->msg_len] = '\0';
     sanitize_inplace(tmp, output->msg_len);
 
+    pthread_mutex_lock(&tui_mutex);
+
     // Wrie Log Level information for current run
     pico_set_colors(ui, log_level_to_palindex_map[output->level], -1);
     pico_printf(ui, "[%s]", ll_to_str[output->level]);
@@ -144,6 +224,9 @@ void ltf_tui_hook_log(ltf_state_test_output_t *output) {
     pico_reset_colors(ui);
     pico_print_block(ui, tmp);
     free(tmp);
+
+    tui_frame(false);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 /*------------------- LTF UI functions -------------------*/
@@ -255,12 +338,10 @@ static void ltf_tui_test_progress_render(pico_t *ui) {
     pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
     pico_ui_puts_yx(ui, 8, 3, "Test Progress:");
 
-    size_t tests_count = da_size(ltf_state->tests);
-    if (tests_count == 0)
+    const char *name = ui_state.test_name;
+    if (!name)
         return;
 
-    ltf_state_test_t *test = da_get(ltf_state->tests, tests_count - 1);
-
     /* Line 9: Test Name and millis from the start*/
     pico_ui_clear_line(ui, 9);
     pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
@@ -268,7 +349,7 @@ static void ltf_tui_test_progress_render(pico_t *ui) {
     pico_set_colors(ui, PICO_COLOR_BRIGHT_WHITE, -1);
     pico_ui_puts_yx(ui, 9, 6, "Name: ");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_YELLOW, -1);
-    pico_ui_printf_yx(ui, 9, 12, "%s", test->name);
+    pico_ui_printf_yx(ui, 9, 12, "%s", name);
 
     /* Line 10: Test Progress */
     pico_ui_clear_line(ui, 10);
@@ -277,15 +358,18 @@ static void ltf_tui_test_progress_render(pico_t *ui) {
     pico_set_colors(ui, PICO_COLOR_BRIGHT_WHITE, -1);
     pico_ui_puts_yx(ui, 10, 6, "Progress: ");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_CYAN, -1);
-    pico_ui_printf_yx(ui, 10, 16, "%d%%",
-                      (unsigned int)(ui_state.current_test_progress * 100));
+    double progress =
+        atomic_load_explicit(&test_progress, memory_order_relaxed);
+    pico_ui_printf_yx(ui, 10, 16, "%d%%", (unsigned int)(progress * 100));
 
     pico_set_colors(ui, PICO_COLOR_BRIGHT_YELLOW, -1);
-    pico_ui_printf_yx(ui, 10, strlen(test->name) + 13, "[ %lums ]",
-                      millis_since_start());
+    pico_ui_printf_yx(
+        ui, 10, strlen(name) + 13, "[ %lums ]",
+        (unsigned long)((monotonic_nanos() - ui_state.test_started_ns) /
+                        1000000));
 
     /* Line 11: Current Line in Test */
-    if (test->status == TEST_STATUS_RUNNING) {
+    if (ui_state.test_running) {
         char *file_str = ui_state.current_file;
         if (file_str) {
             size_t len = strlen(ui_state.current_file);
@@ -336,11 +420,11 @@ static void ltf_tui_summary_render(pico_t *ui, size_t size) {
     pico_ui_puts_yx(ui, size + 1, 36, "           |");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_GREEN, -1);
     pico_ui_puts_yx(ui, size + 1, 36, "Passed:    ");
-    pico_ui_printf_yx(ui, size + 1, 44, "%zu", ltf_state->passed_amount);
+    pico_ui_printf_yx(ui, size + 1, 44, "%zu", ui_state.passed_amount);
     pico_set_colors(ui, PICO_COLOR_BRIGHT_RED, -1);
     pico_ui_puts_yx(ui, size + 1, 49, "Failed:     ");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_RED, -1);
-    pico_ui_printf_yx(ui, size + 1, 57, "%zu", ltf_state->failed_amount);
+    pico_ui_printf_yx(ui, size + 1, 57, "%zu", ui_state.failed_amount);
     pico_reset_colors(ui);
     /* Line 14: Test Elapsed Time */
     uint64_t ms;
@@ -361,6 +445,16 @@ static void ltf_tui_summary_render(pico_t *ui, size_t size) {
     pico_set_colors(ui, PICO_COLOR_BRIGHT_YELLOW, -1);
     pico_ui_printf_yx(ui, size + 2, 20, "%lum %lu.%03lus ", minutes, seconds,
                       millis);
+
+    uint64_t eta_ms;
+    if (!result_render && ltf_tui_eta(&eta_ms)) {
+        pico_set_colors(ui, PICO_COLOR_BRIGHT_WHITE, -1);
+        pico_ui_puts_yx(ui, size + 2, 36, "ETA: ");
+        pico_set_colors(ui, PICO_COLOR_BRIGHT_CYAN, -1);
+        pico_ui_printf_yx(ui, size + 2, 41, "~%lum %lus ",
+                          (unsigned long)(eta_ms / 60000),
+                          (unsigned long)(eta_ms / 1000) % 60);
+    }
     pico_reset_colors(ui);
 }
 
@@ -384,12 +478,18 @@ static void render_ui(pico_t *ui, void *ud) {
     ltf_tui_summary_render(ui, 12);
 }
 
-static void render_progress(pico_t *ui, void *ud) {
-    (void)ud;
-
-    ltf_tui_test_progress_render(ui);
+// Redraw the panel if forced or the frame interval has passed, otherwise
+// only push out the pending log output. Needs 'tui_mutex'.
+static void tui_frame(bool force) {
+    uint64_t now = monotonic_nanos();
+    if (!force && now < next_frame_ns) {
+        pico_flush(ui);
+        return;
+    }
 
-    ltf_tui_summary_render(ui, 12);
+    render_ui(ui, NULL);
+    pico_present(ui);
+    next_frame_ns = now + frame_interval_ns;
 }
 
 #define ANSI_ESC "\x1b["
@@ -437,8 +537,9 @@ static inline const char *pico_fg_color(int color) {
 void tui_render_result(void *ud) {
     (void)ud;
 
+    pthread_mutex_lock(&tui_mutex);
     result_render = true;
-    render_ui(ui, NULL);
+    tui_frame(true);
 
     pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
     term_size_t terminal_size = get_term_size();
@@ -448,6 +549,7 @@ void tui_render_result(void *ud) {
     }
     pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
     pico_println(ui, "-");
+    pthread_mutex_unlock(&tui_mutex);
 
     ltf_tui_deinit();
 
@@ -524,6 +626,16 @@ void tui_render_result(void *ud) {
     printf("%s %s%s\n", pico_fg_color(PICO_COLOR_BRIGHT_CYAN), test->finished,
            ANSI_RESET);
 
+    // Output memory
+    char peak[32];
+    char spilled[32];
+    string_format_bytes(ltf_state->outputs_mem_peak, peak, sizeof peak);
+    string_format_bytes(ltf_state->outputs_spilled, spilled, sizeof spilled);
+    printf("\n%sOutput memory: %s", pico_fg_color(PICO_COLOR_BRIGHT_WHITE),
+           ANSI_RESET);
+    printf("%speak %s, %s spilled to disk%s\n",
+           pico_fg_color(PICO_COLOR_BRIGHT_CYAN), peak, spilled, ANSI_RESET);
+
     // Part of deinit
     cmd_test_options *opts = cmd_parser_get_test_options();
     if (!opts->no_logs) {
@@ -534,8 +646,16 @@ void tui_render_result(void *ud) {
 }
 
 void ltf_tui_test_started(ltf_state_test_t *test) {
+    pthread_mutex_lock(&tui_mutex);
 
-    render_ui(ui, NULL);
+    free(ui_state.test_name);
+    ui_state.test_name = strdup(test->name);
+    // Tests merged back from workers have no monotonic start
+    ui_state.test_started_ns =
+        test->started_ns ? test->started_ns : monotonic_nanos();
+    ui_state.test_running = true;
+    ui_state.test_done = false;
+    ui_state.tests_started++;
 
     //  "-" Gap  between logs
     pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
@@ -552,13 +672,26 @@ void ltf_tui_test_started(ltf_state_test_t *test) {
     pico_print(ui, "[LTF]");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_WHITE, -1);
     pico_printf(ui, " Test '%s' \n", test->name);
+
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void ltf_tui_defer_queue_started(ltf_state_test_t *) { render_ui(ui, NULL); }
+void ltf_tui_defer_queue_started(ltf_state_test_t *) {
+    pthread_mutex_lock(&tui_mutex);
+    ui_state.test_running = false;
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
+}
 
-void ltf_tui_defer_queue_finished(ltf_state_test_t *) { render_ui(ui, NULL); }
+void ltf_tui_defer_queue_finished(ltf_state_test_t *) {
+    pthread_mutex_lock(&tui_mutex);
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
+}
 
 void ltf_tui_defer_failed(ltf_state_test_t *, ltf_state_test_output_t *output) {
+    pthread_mutex_lock(&tui_mutex);
 
     pico_set_colors(ui, PICO_COLOR_BRIGHT_GREEN, -1);
     pico_print(ui, "[LTF]");
@@ -566,11 +699,19 @@ void ltf_tui_defer_failed(ltf_state_test_t *, ltf_state_test_output_t *output) {
     pico_print(ui, " Defer failed with message: \n");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_RED, -1);
     pico_print_block(ui, output->msg);
+
+    tui_frame(false);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void ltf_tui_test_finished(ltf_state_test_t *test) {
+    pthread_mutex_lock(&tui_mutex);
+
+    ui_state.test_running = false;
+    ui_state.test_done = true;
+    ui_state.passed_amount = ltf_state->passed_amount;
+    ui_state.failed_amount = ltf_state->failed_amount;
 
-    render_ui(ui, NULL);
     size_t errors_count = da_size(test->failure_reasons);
 
     // Check if there any failed reasons
@@ -596,13 +737,20 @@ void ltf_tui_test_finished(ltf_state_test_t *test) {
         pico_print_block(ui, error->msg);
     } else {
     }
+
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void ltf_tui_tests_set_finished() { render_ui(ui, NULL); }
+void ltf_tui_tests_set_finished() {
+    pthread_mutex_lock(&tui_mutex);
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
+}
 
 void ltf_tui_hook_started(ltf_hook_fn fn) {
+    pthread_mutex_lock(&tui_mutex);
 
-    render_ui(ui, NULL);
     // If Test Run Finished
     if (fn == 3) {
         //  "-" Gap  between logs
@@ -615,15 +763,19 @@ void ltf_tui_hook_started(ltf_hook_fn fn) {
         pico_set_colors(ui, PICO_COLOR_BRIGHT_MAGENTA, -1);
         pico_println(ui, "-");
     }
+
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void ltf_tui_hook_finished(ltf_hook_fn) { render_ui(ui, NULL); }
+void ltf_tui_hook_finished(ltf_hook_fn) {
+    pthread_mutex_lock(&tui_mutex);
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
+}
 
 void ltf_tui_hook_failed(ltf_hook_fn fn, const char *msg) {
 
-    // Update UI
-    render_ui(ui, NULL);
-
     // Update log
     char *str = "";
     switch (fn) {
@@ -641,6 +793,8 @@ void ltf_tui_hook_failed(ltf_hook_fn fn, const char *msg) {
         break;
     }
 
+    pthread_mutex_lock(&tui_mutex);
+
     // Test Finished message
     pico_set_colors(ui, PICO_COLOR_BRIGHT_GREEN, -1);
     pico_print(ui, "[LTF]");
@@ -652,6 +806,65 @@ void ltf_tui_hook_failed(ltf_hook_fn fn, const char *msg) {
     pico_print(ui, "Failure Reason:\n");
     pico_set_colors(ui, PICO_COLOR_BRIGHT_RED, -1);
     pico_print_block(ui, msg);
+
+    // Update UI
+    tui_frame(true);
+    pthread_mutex_unlock(&tui_mutex);
+}
+
+// Sleeps in slices so that ltf_tui_deinit() does not wait a whole frame
+// interval of a low --tui-fps
+#define TICKER_MAX_SLEEP_NS 50000000ULL
+
+static void *ticker_main(void *) {
+    uint64_t next_ns = monotonic_nanos();
+    while (!atomic_load(&ticker_stopping)) {
+        uint64_t now = monotonic_nanos();
+        if (now < next_ns) {
+            uint64_t sleep_ns = next_ns - now;
+            if (sleep_ns > TICKER_MAX_SLEEP_NS)
+                sleep_ns = TICKER_MAX_SLEEP_NS;
+            struct timespec ts = {
+                .tv_sec = (time_t)(sleep_ns / 1000000000ULL),
+                .tv_nsec = (long)(sleep_ns % 1000000000ULL),
+            };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        pthread_mutex_lock(&tui_mutex);
+        tui_frame(false);
+        pthread_mutex_unlock(&tui_mutex);
+        atomic_store(&line_wanted, true);
+        next_ns = now + frame_interval_ns;
+    }
+    return NULL;
+}
+
+static int ticker_start(void) {
+    // Signals are left to the main thread, e.g. SIGINT has to interrupt its
+    // blocking calls
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    atomic_store(&ticker_stopping, false);
+    int rc = pthread_create(&ticker_thread, NULL, ticker_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc) {
+        LOG("Unable to start the TUI ticker thread");
+        return -1;
+    }
+    ticker_started = true;
+    return 0;
+}
+
+static void ticker_stop(void) {
+    if (!ticker_started)
+        return;
+    atomic_store(&ticker_stopping, true);
+    pthread_join(ticker_thread, NULL);
+    ticker_started = false;
 }
 
 int ltf_tui_init(ltf_state_t *state) {
@@ -679,6 +892,8 @@ int ltf_tui_init(ltf_state_t *state) {
     // Get project information
     cmd_test_options *opts = cmd_parser_get_test_options();
     ui_state.log_level = opts->log_level;
+    frame_interval_ns = 1000000000ULL / (opts->tui_fps ? opts->tui_fps : 30);
+    next_frame_ns = 0;
 
     // To  write Unicode
     setlocale(LC_ALL, "");
@@ -691,6 +906,9 @@ int ltf_tui_init(ltf_state_t *state) {
 
     pico_remove_cursor();
 
+    // Without the ticker the panel is still redrawn on test events
+    ticker_start();
+
     return 0;
 }
 
@@ -698,6 +916,8 @@ void ltf_tui_deinit() {
 
     LOG("Start TUI deinit");
 
+    ticker_stop();
+
     // Turn off UI and free resources
     pico_shutdown(ui);
 
@@ -709,20 +929,46 @@ void ltf_tui_deinit() {
 
     // Freing resources
     pico_free(ui);
+    ui = NULL;
+
+    free(ui_state.current_file);
+    free(ui_state.current_line_str);
+    free(ui_state.test_name);
+    ui_state.current_file = NULL;
+    ui_state.current_line_str = NULL;
+    ui_state.test_name = NULL;
+
+    free(remaining_ns);
+    remaining_ns = NULL;
 }
 
 void ltf_tui_update() {
 
     // UI panel update
+    pthread_mutex_lock(&tui_mutex);
     pico_redraw_ui(ui);
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void ltf_tui_set_current_line(const char *file, int line,
-                              const char *line_str) {
-    free(ui_state.current_file);
+bool ltf_tui_line_wanted(void) {
+    return atomic_load_explicit(&line_wanted, memory_order_relaxed);
+}
+
+void ltf_tui_set_current_line(const char *file, int line, const char *line_str,
+                              size_t line_len) {
+    // Only take a snapshot once the ticker drew the previous one, the
+    // arguments are not guaranteed to outlive this call
+    if (!atomic_load_explicit(&line_wanted, memory_order_relaxed))
+        return;
+    atomic_store_explicit(&line_wanted, false, memory_order_relaxed);
+
+    pthread_mutex_lock(&tui_mutex);
+    if (!ui_state.current_file || strcmp(ui_state.current_file, file)) {
+        free(ui_state.current_file);
+        ui_state.current_file = strdup(file);
+    }
     free(ui_state.current_line_str);
-    ui_state.current_file = strdup(file);
     ui_state.current_line = line;
-    ui_state.current_line_str = string_strip(line_str);
-    render_progress(ui, NULL);
+    ui_state.current_line_str = string_strip_len(line_str, line_len);
+    pthread_mutex_unlock(&tui_mutex);
 }
@@ -0,0 +1,167 @@
+#include "ltf_watchdog.h"
+
+#include "internal_logging.h"
+
+#include "util/lua_hooks.h"
+#include "util/time.h"
+
+#include <lauxlib.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+// The thread never sleeps longer at once, so that changes of the wall clock
+// used by pthread_cond_timedwait() delay it that much at most
+#define WATCHDOG_MAX_SLEEP_NS 100000000ULL
+
+static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t watchdog_thread;
+static pid_t watchdog_pid = 0; // forked workers start without the thread
+static bool watchdog_stopping = false;
+
+static _Atomic uint64_t deadline_ns = 0; // 0: no deadline
+static atomic_bool expired = false;
+static uint64_t armed_timeout_ms = 0;
+static bool hooked = false;
+
+static void *watchdog_main(void *) {
+    pthread_mutex_lock(&watchdog_mutex);
+    while (!watchdog_stopping) {
+        uint64_t deadline = atomic_load(&deadline_ns);
+        if (!deadline || atomic_load(&expired)) {
+            pthread_cond_wait(&watchdog_cond, &watchdog_mutex);
+            continue;
+        }
+
+        uint64_t now = monotonic_nanos();
+        if (now >= deadline) {
+            atomic_store(&expired, true);
+            continue;
+        }
+
+        uint64_t sleep_ns = deadline - now;
+        if (sleep_ns > WATCHDOG_MAX_SLEEP_NS)
+            sleep_ns = WATCHDOG_MAX_SLEEP_NS;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t nsec = (uint64_t)ts.tv_nsec + sleep_ns;
+        ts.tv_sec += (time_t)(nsec / 1000000000ULL);
+        ts.tv_nsec = (long)(nsec % 1000000000ULL);
+        pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex, &ts);
+    }
+    pthread_mutex_unlock(&watchdog_mutex);
+    return NULL;
+}
+
+static int watchdog_start(void) {
+    pid_t pid = getpid();
+    if (watchdog_pid == pid)
+        return 0;
+
+    if (watchdog_pid) {
+        // Forked from a process that had the thread, only its state is left
+        pthread_mutex_init(&watchdog_mutex, NULL);
+        pthread_cond_init(&watchdog_cond, NULL);
+    }
+    watchdog_stopping = false;
+    if (pthread_create(&watchdog_thread, NULL, watchdog_main, NULL)) {
+        LOG("Unable to start the watchdog thread");
+        return -1;
+    }
+    watchdog_pid = pid;
+    LOG("Watchdog thread started.");
+    return 0;
+}
+
+// 'level' 0 blames the running Lua function, 1 the caller of a C function
+static int raise_timeout(lua_State *L, int level) {
+    luaL_where(L, level);
+    lua_pushfstring(L, "Test timed out after %I ms",
+                    (lua_Integer)armed_timeout_ms);
+    lua_concat(L, 2);
+    return lua_error(L);
+}
+
+// Keeps raising until the test body is left, even if the error is caught
+static void timeout_hook(lua_State *L, lua_Debug *, const char *) {
+    if (atomic_load(&expired))
+        raise_timeout(L, 0);
+}
+
+int ltf_watchdog_arm(uint64_t timeout_ms) {
+    ltf_watchdog_disarm();
+    if (!timeout_ms)
+        return 0;
+    if (watchdog_start())
+        return -1;
+
+    pthread_mutex_lock(&watchdog_mutex);
+    armed_timeout_ms = timeout_ms;
+    atomic_store(&expired, false);
+    atomic_store(&deadline_ns, monotonic_nanos() + timeout_ms * 1000000);
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+
+    lua_hooks_add_unfiltered(LUA_HOOKCOUNT, timeout_hook);
+    hooked = true;
+    LOG("Watchdog armed for %llu ms", (unsigned long long)timeout_ms);
+    return 0;
+}
+
+void ltf_watchdog_disarm(void) {
+    if (hooked) {
+        lua_hooks_remove_unfiltered(LUA_HOOKCOUNT, timeout_hook);
+        hooked = false;
+    }
+    if (!atomic_load(&deadline_ns))
+        return;
+
+    pthread_mutex_lock(&watchdog_mutex);
+    atomic_store(&deadline_ns, 0);
+    atomic_store(&expired, false);
+    pthread_mutex_unlock(&watchdog_mutex);
+    LOG("Watchdog disarmed.");
+}
+
+bool ltf_watchdog_expired(void) {
+    if (atomic_load(&expired))
+        return true;
+    // The thread may not have woken up yet
+    uint64_t deadline = atomic_load(&deadline_ns);
+    return deadline && monotonic_nanos() >= deadline;
+}
+
+int ltf_watchdog_clamp_ms(int timeout_ms) {
+    uint64_t deadline = atomic_load(&deadline_ns);
+    if (!deadline || timeout_ms == 0)
+        return timeout_ms;
+
+    unsigned int left = millis_until(deadline);
+    if (left == 0)
+        left = 1;
+    if (timeout_ms < 0 || (unsigned int)timeout_ms > left)
+        return (int)left;
+    return timeout_ms;
+}
+
+void ltf_watchdog_check(lua_State *L) {
+    if (ltf_watchdog_expired())
+        raise_timeout(L, 1);
+}
+
+void ltf_watchdog_free(void) {
+    ltf_watchdog_disarm();
+    if (watchdog_pid != getpid())
+        return;
+
+    pthread_mutex_lock(&watchdog_mutex);
+    watchdog_stopping = true;
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+    pthread_join(watchdog_thread, NULL);
+    watchdog_pid = 0;
+    LOG("Watchdog thread stopped.");
+}
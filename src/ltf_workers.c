@@ -0,0 +1,380 @@
+#include "ltf_workers.h"
+
+#include "internal_logging.h"
+
+#include "util/da.h"
+
+#include <json.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define WORKER_STOP SIZE_MAX
+#define WORKER_IDLE SIZE_MAX
+
+typedef struct {
+    size_t index;
+    size_t len;
+} worker_msg_header_t;
+
+typedef struct {
+    pid_t pid;
+    int task_fd;   // parent -> worker, test indexes
+    int result_fd; // worker -> parent, serialized test results
+    size_t current;
+} worker_t;
+
+typedef struct {
+    bool done;
+    char *json;        // serialized ltf_state_test_t, NULL if not available
+    const char *error; // reason the test has no result
+} worker_result_t;
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Returns 0 on success, 1 on EOF before any byte was read, -1 on error
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, p + got, len - got);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            return got == 0 ? 1 : -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+/*----------------------------- worker side -----------------------------*/
+
+static void worker_loop(lua_State *L, ltf_state_t *state, int task_fd,
+                        int result_fd, ltf_worker_test_fn run_test) {
+    da_t *tests = test_case_get_all();
+    size_t index;
+
+    while (read_full(task_fd, &index, sizeof index) == 0) {
+        if (index == WORKER_STOP || index >= da_size(tests))
+            break;
+
+        test_case_t *tc = da_get(tests, index);
+        run_test(L, state, tc);
+
+        json_object *obj = ltf_state_current_test_to_json(state);
+        size_t len = 0;
+        const char *str = json_object_to_json_string_length(
+            obj, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &len);
+
+        worker_msg_header_t hdr = {.index = index, .len = len};
+        int rc = write_full(result_fd, &hdr, sizeof hdr);
+        if (!rc)
+            rc = write_full(result_fd, str, len);
+        json_object_put(obj);
+
+        // The parent has the result now. The callbacks that free it in a
+        // serial run were dropped in worker_spawn().
+        size_t started = da_size(state->tests);
+        if (started)
+            ltf_state_test_release(state, da_get(state->tests, started - 1));
+
+        if (rc) {
+            LOG("Worker %d: unable to send result: %s", getpid(),
+                strerror(errno));
+            break;
+        }
+    }
+}
+
+static pid_t worker_spawn(lua_State *L, ltf_state_t *state, worker_t *workers,
+                          size_t spawned, ltf_worker_init_fn init,
+                          ltf_worker_test_fn run_test) {
+    int task_pipe[2];
+    int result_pipe[2];
+
+    if (pipe(task_pipe)) {
+        return -1;
+    }
+    if (pipe(result_pipe)) {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        return -1;
+    }
+
+    // Do not let buffered output get duplicated by the child
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Ctrl-C is handled by the parent, which stops handing out tests
+        // and lets the workers finish the ones in progress.
+        signal(SIGINT, SIG_IGN);
+        signal(SIGPIPE, SIG_DFL);
+
+        for (size_t i = 0; i < spawned; ++i) {
+            close(workers[i].task_fd);
+            close(workers[i].result_fd);
+        }
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+
+        ltf_state_clear_cbs(state);
+        if (init) {
+            init(L, state);
+        }
+
+        worker_loop(L, state, task_pipe[0], result_pipe[1], run_test);
+
+        close(task_pipe[0]);
+        close(result_pipe[1]);
+
+        // Lua state is intentionally not closed: finalizers of objects
+        // inherited from the parent (sessions, ports, ...) would tear down
+        // resources that are still shared with it.
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+
+    workers[spawned] = (worker_t){
+        .pid = pid,
+        .task_fd = task_pipe[1],
+        .result_fd = result_pipe[0],
+        .current = WORKER_IDLE,
+    };
+
+    return pid;
+}
+
+/*----------------------------- parent side -----------------------------*/
+
+static void worker_stop(worker_t *w) {
+    if (w->task_fd < 0)
+        return;
+    size_t stop = WORKER_STOP;
+    write_full(w->task_fd, &stop, sizeof stop);
+    close(w->task_fd);
+    w->task_fd = -1;
+}
+
+static void worker_dispatch(worker_t *w, const size_t *order,
+                            size_t *next_task, size_t amount,
+                            bool interrupted) {
+    if (interrupted || *next_task >= amount) {
+        worker_stop(w);
+        return;
+    }
+
+    size_t index = order ? order[*next_task] : *next_task;
+    if (write_full(w->task_fd, &index, sizeof index)) {
+        LOG("Unable to send test %zu to worker %d: %s", index, w->pid,
+            strerror(errno));
+        worker_stop(w);
+        return;
+    }
+
+    w->current = index;
+    (*next_task)++;
+}
+
+static void merge_in_order(ltf_state_t *state, worker_result_t *results,
+                           size_t amount, size_t *next_merge) {
+    da_t *tests = test_case_get_all();
+
+    while (*next_merge < amount && results[*next_merge].done) {
+        worker_result_t *r = &results[*next_merge];
+
+        json_object *obj = r->json ? json_tokener_parse(r->json) : NULL;
+        if (obj) {
+            ltf_state_test_merge(state, obj);
+            json_object_put(obj);
+        } else {
+            test_case_t *tc = da_get(tests, *next_merge);
+            ltf_state_test_started(state, tc);
+            ltf_state_test_failed(state, NULL, 0,
+                                  r->error ? r->error
+                                           : "Unable to parse worker result");
+            ltf_state_test_completed(state);
+        }
+
+        free(r->json);
+        r->json = NULL;
+        (*next_merge)++;
+    }
+}
+
+// Returns false once the worker closed its result pipe
+static bool worker_receive(worker_t *w, worker_result_t *results,
+                           size_t amount) {
+    worker_msg_header_t hdr;
+
+    int rc = read_full(w->result_fd, &hdr, sizeof hdr);
+    if (rc == 0 && hdr.index < amount) {
+        char *json = malloc(hdr.len + 1);
+        if (json && read_full(w->result_fd, json, hdr.len) == 0) {
+            json[hdr.len] = '\0';
+            results[hdr.index].json = json;
+            results[hdr.index].done = true;
+            w->current = WORKER_IDLE;
+            return true;
+        }
+        free(json);
+        rc = -1;
+    }
+
+    if (w->current != WORKER_IDLE) {
+        LOG("Worker %d exited while running test %zu", w->pid, w->current);
+        results[w->current].done = true;
+        results[w->current].error = "Worker process terminated unexpectedly";
+        w->current = WORKER_IDLE;
+    }
+
+    close(w->result_fd);
+    w->result_fd = -1;
+    worker_stop(w);
+    return false;
+}
+
+int ltf_workers_run(lua_State *L, ltf_state_t *state, size_t jobs,
+                    const size_t *order, ltf_worker_init_fn init,
+                    ltf_worker_test_fn run_test, volatile bool *interrupted) {
+    size_t amount = da_size(test_case_get_all());
+    if (jobs > amount)
+        jobs = amount;
+    if (jobs == 0)
+        return 0;
+
+    LOG("Starting %zu workers for %zu tests...", jobs, amount);
+
+    worker_t *workers = calloc(jobs, sizeof *workers);
+    worker_result_t *results = calloc(amount, sizeof *results);
+    struct pollfd *fds = calloc(jobs, sizeof *fds);
+    if (!workers || !results || !fds) {
+        free(workers);
+        free(results);
+        free(fds);
+        return -1;
+    }
+
+    // A dead worker must not kill us when we write to its task pipe
+    struct sigaction sa = {0};
+    struct sigaction old_sa;
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, &old_sa);
+
+    size_t spawned = 0;
+    for (; spawned < jobs; ++spawned) {
+        if (worker_spawn(L, state, workers, spawned, init, run_test) < 0) {
+            LOG("Unable to spawn worker: %s", strerror(errno));
+            break;
+        }
+    }
+
+    if (spawned == 0) {
+        sigaction(SIGPIPE, &old_sa, NULL);
+        free(workers);
+        free(results);
+        free(fds);
+        return -1;
+    }
+
+    size_t next_task = 0;
+    size_t next_merge = 0;
+    size_t alive = spawned;
+
+    for (size_t i = 0; i < spawned; ++i) {
+        worker_dispatch(&workers[i], order, &next_task, amount,
+                        *interrupted);
+    }
+
+    while (alive > 0) {
+        for (size_t i = 0; i < spawned; ++i) {
+            fds[i].fd = workers[i].result_fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds, spawned, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG("poll() failed: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t i = 0; i < spawned; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            worker_t *w = &workers[i];
+            if (worker_receive(w, results, amount)) {
+                worker_dispatch(w, order, &next_task, amount, *interrupted);
+            } else {
+                alive--;
+            }
+        }
+
+        merge_in_order(state, results, amount, &next_merge);
+    }
+
+    // Tests left without a worker to run them (every worker died)
+    if (!*interrupted) {
+        for (size_t i = next_task; i < amount; ++i) {
+            size_t index = order ? order[i] : i;
+            results[index].done = true;
+            results[index].error = "No worker process left to run the test";
+        }
+    }
+    merge_in_order(state, results, amount, &next_merge);
+
+    for (size_t i = 0; i < spawned; ++i) {
+        worker_stop(&workers[i]);
+        if (workers[i].result_fd >= 0)
+            close(workers[i].result_fd);
+        waitpid(workers[i].pid, NULL, 0);
+    }
+
+    sigaction(SIGPIPE, &old_sa, NULL);
+
+    for (size_t i = 0; i < amount; ++i) {
+        free(results[i].json);
+    }
+    free(results);
+    free(workers);
+    free(fds);
+
+    LOG("All workers finished.");
+    return 0;
+}
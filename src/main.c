@@ -22,6 +22,8 @@ int main(int argc, char **argv) {
         return ltf_eval();
     case CMD_LOGS_INFO:
         return ltf_logs_info();
+    case CMD_LOGS_MERGE:
+        return ltf_logs_merge();
     case CMD_TARGET_ADD:
         return ltf_target_add();
     case CMD_TARGET_REMOVE:
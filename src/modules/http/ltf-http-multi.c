@@ -0,0 +1,345 @@
+#include "modules/http/ltf-http-multi.h"
+
+#include "internal_logging.h"
+
+#include "util/time.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Upper bound of a single curl_multi_poll(), so a transfer whose socket
+// curl does not expose (e.g. during DNS resolution) is still driven
+#define MULTI_MAX_POLL_MS 1000
+
+static l_module_http_multi_t *check_multi(lua_State *L, int idx) {
+    l_module_http_multi_t *mu = luaL_checkudata(L, idx, HTTP_MULTI_MT);
+    if (!mu->m) {
+        luaL_error(L, "http multi handle is closed");
+        return NULL;
+    }
+    return mu;
+}
+
+static void handles_remove(l_module_http_multi_t *mu, l_module_http_t *ud) {
+    for (size_t i = 0; i < mu->handles_count; ++i) {
+        if (mu->handles[i] == ud) {
+            mu->handles[i] = mu->handles[--mu->handles_count];
+            return;
+        }
+    }
+}
+
+void http_multi_detach(l_module_http_t *ud) {
+    l_module_http_multi_t *mu = ud->multi;
+    if (!mu)
+        return;
+
+    if (mu->m && ud->h)
+        curl_multi_remove_handle(mu->m, ud->h);
+    http_collect_abort(ud);
+    handles_remove(mu, ud);
+    ud->multi = NULL;
+}
+
+int l_module_http_multi_new(lua_State *L) {
+    LOG("Invoked ltf-http multi new...");
+
+    long max_connections = 0;
+    if (lua_istable(L, 1)) {
+        lua_getfield(L, 1, "max_connections");
+        max_connections = (long)luaL_optinteger(L, -1, 0);
+        lua_pop(L, 1);
+    }
+
+    // The uservalue maps every attached easy handle to its userdata, which
+    // keeps it alive while curl works on it
+    l_module_http_multi_t *mu = lua_newuserdatauv(L, sizeof *mu, 1);
+    memset(mu, 0, sizeof *mu);
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, 1);
+
+    mu->m = curl_multi_init();
+    if (!mu->m) {
+        LOG("curl_multi_init() failed");
+        return luaL_error(L, "curl_multi_init() failed");
+    }
+
+    luaL_getmetatable(L, HTTP_MULTI_MT);
+    lua_setmetatable(L, -2);
+
+    curl_multi_setopt(mu->m, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    if (max_connections > 0)
+        curl_multi_setopt(mu->m, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                          max_connections);
+
+    LOG("Successfully finished ltf-http multi new.");
+    return 1;
+}
+
+int l_module_http_multi_add(lua_State *L) {
+    LOG("Invoked ltf-http multi add...");
+    l_module_http_multi_t *mu = check_multi(L, 1);
+    l_module_http_t *ud = luaL_checkudata(L, 2, HTTP_HANDLE_MT);
+
+    if (!ud->h)
+        return luaL_error(L, "http handle is cleaned up");
+    if (ud->multi)
+        return luaL_error(L, "http handle is already part of a batch");
+
+    if (mu->handles_count == mu->handles_cap) {
+        size_t cap = mu->handles_cap ? mu->handles_cap * 2 : 16;
+        l_module_http_t **grown = realloc(mu->handles, cap * sizeof *grown);
+        if (!grown)
+            return luaL_error(L, "out of memory");
+        mu->handles = grown;
+        mu->handles_cap = cap;
+    }
+
+    if (!lua_isnoneornil(L, 3))
+        http_collect_begin(L, ud, 3);
+    curl_easy_setopt(ud->h, CURLOPT_PRIVATE, ud);
+
+    CURLMcode rc = curl_multi_add_handle(mu->m, ud->h);
+    if (rc != CURLM_OK) {
+        http_collect_abort(ud);
+        const char *err = curl_multi_strerror(rc);
+        LOG("curl_multi_add_handle: %s", err);
+        return luaL_error(L, "curl_multi_add_handle: %s", err);
+    }
+
+    mu->handles[mu->handles_count++] = ud;
+    ud->multi = mu;
+    ud->multi_index = ++mu->added;
+
+    lua_getiuservalue(L, 1, 1);
+    lua_pushlightuserdata(L, ud);
+    lua_pushvalue(L, 2);
+    lua_rawset(L, -3);
+
+    lua_settop(L, 1); // method-chain
+    LOG("Successfully finished ltf-http multi add.");
+    return 1;
+}
+
+// Pop one finished transfer from curl and push its result table.
+// Returns false if none finished.
+static bool multi_push_done(lua_State *L, int self,
+                            l_module_http_multi_t *mu) {
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(mu->m, &queued))) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        CURL *h = msg->easy_handle;
+        CURLcode result = msg->data.result;
+
+        l_module_http_t *ud = NULL;
+        curl_easy_getinfo(h, CURLINFO_PRIVATE, (char **)&ud);
+        if (!ud) {
+            curl_multi_remove_handle(mu->m, h);
+            continue;
+        }
+
+        long status = 0;
+        curl_easy_getinfo(h, CURLINFO_RESPONSE_CODE, &status);
+
+        lua_createtable(L, 0, 5);
+
+        lua_getiuservalue(L, self, 1);
+        lua_pushlightuserdata(L, ud);
+        lua_rawget(L, -2);
+        lua_setfield(L, -3, "handle");
+        lua_pushlightuserdata(L, ud);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+
+        lua_pushinteger(L, (lua_Integer)ud->multi_index);
+        lua_setfield(L, -2, "index");
+        lua_pushboolean(L, result == CURLE_OK);
+        lua_setfield(L, -2, "ok");
+        if (result != CURLE_OK) {
+            lua_pushstring(L, curl_easy_strerror(result));
+            lua_setfield(L, -2, "error");
+        }
+        lua_pushinteger(L, status);
+        lua_setfield(L, -2, "status");
+
+        if (ud->collect.active && !http_collect_finish(L, ud, -1) &&
+            result == CURLE_OK) {
+            lua_pushboolean(L, false);
+            lua_setfield(L, -2, "ok");
+            lua_pushstring(L, "Unable to write the response body");
+            lua_setfield(L, -2, "error");
+        }
+
+        http_multi_detach(ud);
+        return true;
+    }
+    return false;
+}
+
+// Callbacks run on the stack of whichever state waits on the batch
+static void multi_bind_state(lua_State *L, l_module_http_multi_t *mu) {
+    for (size_t i = 0; i < mu->handles_count; ++i)
+        mu->handles[i]->mainL = L;
+}
+
+// Drive the transfers until one finishes or 'deadline_ns' (0 = none)
+// passes. Returns false on timeout or when nothing is left.
+static bool multi_wait_done(lua_State *L, int self,
+                            l_module_http_multi_t *mu, uint64_t deadline_ns) {
+    for (;;) {
+        if (multi_push_done(L, self, mu))
+            return true;
+        if (mu->handles_count == 0)
+            return false;
+
+        CURLMcode rc = curl_multi_perform(mu->m, &mu->running);
+        if (rc != CURLM_OK) {
+            luaL_error(L, "curl_multi_perform: %s", curl_multi_strerror(rc));
+            return false;
+        }
+        if (multi_push_done(L, self, mu))
+            return true;
+
+        int wait_ms = MULTI_MAX_POLL_MS;
+        if (deadline_ns) {
+            unsigned int left = millis_until(deadline_ns);
+            if (left == 0)
+                return false;
+            if (left < (unsigned int)wait_ms)
+                wait_ms = (int)left;
+        }
+
+        rc = curl_multi_poll(mu->m, NULL, 0, wait_ms, NULL);
+        if (rc != CURLM_OK) {
+            luaL_error(L, "curl_multi_poll: %s", curl_multi_strerror(rc));
+            return false;
+        }
+    }
+}
+
+int l_module_http_multi_next(lua_State *L) {
+    LOG("Invoked ltf-http multi next...");
+    l_module_http_multi_t *mu = check_multi(L, 1);
+    lua_Integer timeout = luaL_optinteger(L, 2, -1);
+
+    multi_bind_state(L, mu);
+
+    uint64_t deadline_ns = 0;
+    if (timeout >= 0)
+        deadline_ns = monotonic_nanos() + (uint64_t)timeout * 1000000ULL;
+
+    if (!multi_wait_done(L, 1, mu, deadline_ns))
+        lua_pushnil(L);
+
+    LOG("Successfully finished ltf-http multi next.");
+    return 1;
+}
+
+int l_module_http_multi_perform(lua_State *L) {
+    LOG("Invoked ltf-http multi perform...");
+    l_module_http_multi_t *mu = check_multi(L, 1);
+    lua_settop(L, 1);
+    multi_bind_state(L, mu);
+
+    // Results keyed by submission index, then packed in that order
+    size_t first = mu->added + 1;
+    size_t last = 0;
+    lua_newtable(L);
+    while (multi_wait_done(L, 1, mu, 0)) {
+        lua_getfield(L, -1, "index");
+        size_t index = (size_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+
+        if (index < first)
+            first = index;
+        if (index > last)
+            last = index;
+        lua_rawseti(L, 2, (lua_Integer)index);
+    }
+
+    lua_newtable(L);
+    lua_Integer n = 0;
+    for (size_t i = first; i <= last; ++i) {
+        if (lua_rawgeti(L, 2, (lua_Integer)i) == LUA_TNIL) {
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_rawseti(L, 3, ++n);
+    }
+
+    LOG("Successfully finished ltf-http multi perform, %lld results.",
+        (long long)n);
+    return 1;
+}
+
+int l_module_http_multi_pending(lua_State *L) {
+    l_module_http_multi_t *mu = luaL_checkudata(L, 1, HTTP_MULTI_MT);
+    lua_pushinteger(L, (lua_Integer)mu->handles_count);
+    return 1;
+}
+
+static void multi_close(l_module_http_multi_t *mu) {
+    while (mu->handles_count > 0)
+        http_multi_detach(mu->handles[mu->handles_count - 1]);
+    free(mu->handles);
+    mu->handles = NULL;
+    mu->handles_cap = 0;
+
+    if (mu->m) {
+        curl_multi_cleanup(mu->m);
+        mu->m = NULL;
+    }
+}
+
+int l_module_http_multi_close(lua_State *L) {
+    LOG("Invoked ltf-http multi close...");
+    l_module_http_multi_t *mu = luaL_checkudata(L, 1, HTTP_MULTI_MT);
+    multi_close(mu);
+
+    lua_newtable(L);
+    lua_setiuservalue(L, 1, 1);
+
+    LOG("Successfully finished ltf-http multi close.");
+    return 0;
+}
+
+static int l_module_http_multi_gc(lua_State *L) {
+    LOG("Invoked ltf-http multi GC...");
+    l_module_http_multi_t *mu = luaL_checkudata(L, 1, HTTP_MULTI_MT);
+    multi_close(mu);
+    LOG("Successfully finished ltf-http multi GC.");
+    return 0;
+}
+
+/*----------- registration ------------------------------------------*/
+static const luaL_Reg multi_fns[] = {
+    {"add", l_module_http_multi_add},         //
+    {"next", l_module_http_multi_next},       //
+    {"perform", l_module_http_multi_perform}, //
+    {"pending", l_module_http_multi_pending}, //
+    {"close", l_module_http_multi_close},     //
+    {NULL, NULL},                             //
+};
+
+int l_module_register_http_multi(lua_State *L) {
+    LOG("Registering ltf-http-multi...");
+
+    if (luaL_newmetatable(L, HTTP_MULTI_MT)) {
+        lua_pushcfunction(L, l_module_http_multi_gc);
+        lua_setfield(L, -2, "__gc");
+
+        lua_newtable(L);
+        luaL_setfuncs(L, multi_fns, 0);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+
+    LOG("Successfully registered ltf-http-multi.");
+    return 0;
+}
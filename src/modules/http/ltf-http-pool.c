@@ -0,0 +1,95 @@
+#include "modules/http/ltf-http-pool.h"
+
+#include "internal_logging.h"
+
+#include <stddef.h>
+#include <unistd.h>
+
+#define HTTP_POOL_MAX_IDLE 16
+
+static CURLSH *share = NULL;
+static CURL *idle[HTTP_POOL_MAX_IDLE];
+static size_t idle_count = 0;
+static pid_t pool_owner = 0;
+
+static void pool_check_owner(void) {
+    if (!pool_owner || pool_owner == getpid())
+        return;
+
+    // Cleaning up would shut down TLS sessions and connections the parent
+    // is still using, so only forget about them
+    LOG("Abandoning HTTP pool inherited from process %d", pool_owner);
+    share = NULL;
+    idle_count = 0;
+    pool_owner = 0;
+}
+
+static CURLSH *share_get(void) {
+    pool_check_owner();
+    if (share)
+        return share;
+
+    share = curl_share_init();
+    if (!share) {
+        LOG("curl_share_init() failed");
+        return NULL;
+    }
+
+    // Everything runs on the Lua thread, no lock callbacks are needed
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    pool_owner = getpid();
+
+    LOG("Created HTTP share object.");
+    return share;
+}
+
+CURL *http_pool_checkout(void) {
+    CURLSH *sh = share_get();
+
+    CURL *h = idle_count > 0 ? idle[--idle_count] : curl_easy_init();
+    if (!h)
+        return NULL;
+
+    if (sh)
+        curl_easy_setopt(h, CURLOPT_SHARE, sh);
+    return h;
+}
+
+void http_pool_checkin(CURL *h) {
+    if (!h)
+        return;
+
+    pool_check_owner();
+    if (!share || idle_count == HTTP_POOL_MAX_IDLE) {
+        curl_easy_cleanup(h);
+        return;
+    }
+
+    // Resets the options only: the share handle, the cookies and the
+    // connection cache stay with the handle. Cookies are not shared between
+    // handles, so they are dropped here rather than leaking into the next
+    // test that checks the handle out.
+    curl_easy_setopt(h, CURLOPT_COOKIELIST, "ALL");
+    curl_easy_reset(h);
+    idle[idle_count++] = h;
+}
+
+void http_pool_clear(void) {
+    pool_check_owner();
+
+    while (idle_count > 0)
+        curl_easy_cleanup(idle[--idle_count]);
+
+    if (share) {
+        CURLSHcode rc = curl_share_cleanup(share);
+        if (rc != CURLSHE_OK) {
+            // Still in use by a handle that was not cleaned up
+            LOG("curl_share_cleanup: %s", curl_share_strerror(rc));
+            return;
+        }
+        share = NULL;
+    }
+    pool_owner = 0;
+}
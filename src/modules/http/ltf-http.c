@@ -1,9 +1,13 @@
 #include "modules/http/ltf-http.h"
+#include "modules/http/ltf-http-multi.h"
+#include "modules/http/ltf-http-pool.h"
 
 #include "internal_logging.h"
 
 #include "util/lua.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <string.h>
 
 static void ud_clear_slist(l_module_http_t *handle) {
@@ -19,7 +23,7 @@ static struct curl_slist *lua_to_slist(lua_State *L, int idx) {
     LOG("Converting Lua string array into curl_slist...");
     struct curl_slist *head = NULL;
     size_t n = lua_rawlen(L, idx);
-    for (size_t i = 1; i < n; i++) {
+    for (size_t i = 1; i <= n; i++) {
         lua_geti(L, idx, i);
         const char *line = luaL_checkstring(L, -1);
         head = curl_slist_append(head, line);
@@ -34,14 +38,14 @@ int l_module_http_new(lua_State *L) {
     LOG("Invoked ltf-http new...");
     l_module_http_t *ud = lua_newuserdata(L, sizeof *ud);
     memset(ud, 0, sizeof *ud);
-    ud->h = curl_easy_init();
+    ud->h = http_pool_checkout();
     ud->mainL = L;
-    if (!ud) {
+    if (!ud->h) {
         LOG("curl_easy_init() failed");
         return luaL_error(L, "curl_easy_init() failed");
     }
 
-    luaL_getmetatable(L, "ltf-http");
+    luaL_getmetatable(L, HTTP_HANDLE_MT);
     lua_setmetatable(L, -2);
     LOG("Successfully finished ltf-http new.");
     return 1;
@@ -120,7 +124,7 @@ static size_t c_read_cb(char *dest, size_t size, size_t nmemb, void *ud_) {
 
 int l_module_http_setopt(lua_State *L) {
     LOG("Invoked ltf-http setopt...");
-    l_module_http_t *ud = luaL_checkudata(L, 1, "ltf-http");
+    l_module_http_t *ud = luaL_checkudata(L, 1, HTTP_HANDLE_MT);
     long option = luaL_checkinteger(L, 2);
     int vtype = lua_type(L, 3);
     LOG("Option: %lu, vtype: %d", option, vtype);
@@ -201,8 +205,13 @@ int l_module_http_setopt(lua_State *L) {
 int l_module_http_perform(lua_State *L) {
     LOG("Invoked ltf-http perform...");
     int s = selfshift(L);
-    CURL **ud = luaL_checkudata(L, s, "ltf-http");
-    CURLcode rc = curl_easy_perform(*ud);
+    l_module_http_t *ud = luaL_checkudata(L, s, HTTP_HANDLE_MT);
+    if (!ud->h)
+        return luaL_error(L, "http handle is cleaned up");
+    if (ud->multi)
+        return luaL_error(L, "http handle is part of a batch");
+    ud->mainL = L;
+    CURLcode rc = curl_easy_perform(ud->h);
     if (rc != CURLE_OK) {
         const char *err = curl_easy_strerror(rc);
         LOG("curl_easy_perform: %s", err);
@@ -213,31 +222,239 @@ int l_module_http_perform(lua_State *L) {
     return 1;
 }
 
+/*----------- collected responses ----------------------------------*/
+
+static size_t collect_body_cb(char *ptr, size_t size, size_t nmemb,
+                              void *ud_) {
+    size_t nbytes = size * nmemb;
+    http_collect_t *c = &((l_module_http_t *)ud_)->collect;
+
+    if (c->file) {
+        if (fwrite(ptr, 1, nbytes, c->file) != nbytes) {
+            c->write_failed = true;
+            return 0;
+        }
+        return nbytes;
+    }
+    return byte_buf_append(&c->body, ptr, nbytes) ? nbytes : 0;
+}
+
+static size_t collect_header_cb(char *ptr, size_t size, size_t nmemb,
+                                void *ud_) {
+    size_t nbytes = size * nmemb;
+    http_collect_t *c = &((l_module_http_t *)ud_)->collect;
+    return byte_buf_append(&c->headers, ptr, nbytes) ? nbytes : 0;
+}
+
+// Give the Lua write callback, if any, its place back
+static void collect_restore_opts(l_module_http_t *ud) {
+    if (!ud->h)
+        return;
+
+    if (ud->write_ref) {
+        curl_easy_setopt(ud->h, CURLOPT_WRITEDATA, ud);
+        curl_easy_setopt(ud->h, CURLOPT_WRITEFUNCTION, c_write_cb);
+    } else {
+        curl_easy_setopt(ud->h, CURLOPT_WRITEDATA, stdout);
+        curl_easy_setopt(ud->h, CURLOPT_WRITEFUNCTION, NULL);
+    }
+    curl_easy_setopt(ud->h, CURLOPT_HEADERDATA, NULL);
+    curl_easy_setopt(ud->h, CURLOPT_HEADERFUNCTION, NULL);
+}
+
+void http_collect_abort(l_module_http_t *ud) {
+    http_collect_t *c = &ud->collect;
+    if (!c->active)
+        return;
+
+    collect_restore_opts(ud);
+    if (c->file)
+        fclose(c->file);
+    byte_buf_free(&c->body);
+    byte_buf_free(&c->headers);
+    *c = (http_collect_t){0};
+}
+
+void http_collect_begin(lua_State *L, l_module_http_t *ud, int opts_idx) {
+    http_collect_abort(ud);
+
+    const char *path = NULL;
+    if (!lua_isnoneornil(L, opts_idx)) {
+        luaL_checktype(L, opts_idx, LUA_TTABLE);
+        lua_getfield(L, opts_idx, "file");
+        path = luaL_optstring(L, -1, NULL);
+        lua_pop(L, 1);
+    }
+
+    http_collect_t *c = &ud->collect;
+    if (path) {
+        c->file = fopen(path, "wbe");
+        if (!c->file) {
+            luaL_error(L, "Unable to open '%s': %s", path, strerror(errno));
+            return;
+        }
+    }
+    c->active = true;
+
+    curl_easy_setopt(ud->h, CURLOPT_WRITEDATA, ud);
+    curl_easy_setopt(ud->h, CURLOPT_WRITEFUNCTION, collect_body_cb);
+    curl_easy_setopt(ud->h, CURLOPT_HEADERDATA, ud);
+    curl_easy_setopt(ud->h, CURLOPT_HEADERFUNCTION, collect_header_cb);
+}
+
+static void trim(const char **s, const char **e) {
+    while (*s < *e && isspace((unsigned char)**s))
+        (*s)++;
+    while (*e > *s && isspace((unsigned char)(*e)[-1]))
+        (*e)--;
+}
+
+// Push the headers of the last response (after redirects and interim
+// responses) as {[lowercase name] = value}, repeated headers joined by ", "
+static void push_headers(lua_State *L, const char *p, size_t len) {
+    const char *end = p + len;
+    char name[256];
+
+    lua_newtable(L);
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = nl ? nl : end;
+        const char *next = nl ? nl + 1 : end;
+
+        if (line_end - p >= 5 && memcmp(p, "HTTP/", 5) == 0) {
+            // Status line of a new response, forget the previous one
+            lua_pop(L, 1);
+            lua_newtable(L);
+            p = next;
+            continue;
+        }
+
+        const char *colon = memchr(p, ':', (size_t)(line_end - p));
+        if (!colon) {
+            p = next;
+            continue;
+        }
+
+        const char *ns = p, *ne = colon;
+        const char *vs = colon + 1, *ve = line_end;
+        trim(&ns, &ne);
+        trim(&vs, &ve);
+
+        size_t name_len = (size_t)(ne - ns);
+        if (name_len == 0 || name_len >= sizeof name) {
+            p = next;
+            continue;
+        }
+        for (size_t i = 0; i < name_len; ++i)
+            name[i] = (char)tolower((unsigned char)ns[i]);
+
+        lua_pushlstring(L, name, name_len);
+        lua_pushvalue(L, -1);
+        if (lua_rawget(L, -3) == LUA_TSTRING) {
+            lua_pushliteral(L, ", ");
+            lua_pushlstring(L, vs, (size_t)(ve - vs));
+            lua_concat(L, 3);
+        } else {
+            lua_pop(L, 1);
+            lua_pushlstring(L, vs, (size_t)(ve - vs));
+        }
+        lua_rawset(L, -3);
+
+        p = next;
+    }
+}
+
+bool http_collect_finish(lua_State *L, l_module_http_t *ud, int idx) {
+    http_collect_t *c = &ud->collect;
+    idx = lua_absindex(L, idx);
+
+    long status = 0;
+    if (ud->h)
+        curl_easy_getinfo(ud->h, CURLINFO_RESPONSE_CODE, &status);
+    lua_pushinteger(L, status);
+    lua_setfield(L, idx, "status");
+
+    push_headers(L, byte_buf_data(&c->headers), byte_buf_size(&c->headers));
+    lua_setfield(L, idx, "headers");
+
+    bool ok = !c->write_failed;
+    if (c->file) {
+        if (fclose(c->file))
+            ok = false;
+        c->file = NULL;
+    } else {
+        lua_pushlstring(L, byte_buf_data(&c->body), byte_buf_size(&c->body));
+        lua_setfield(L, idx, "body");
+    }
+
+    http_collect_abort(ud);
+    return ok;
+}
+
+int l_module_http_fetch(lua_State *L) {
+    LOG("Invoked ltf-http fetch...");
+    l_module_http_t *ud = luaL_checkudata(L, 1, HTTP_HANDLE_MT);
+    if (!ud->h)
+        return luaL_error(L, "http handle is cleaned up");
+    if (ud->multi)
+        return luaL_error(L, "http handle is part of a batch");
+
+    http_collect_begin(L, ud, 2);
+    ud->mainL = L;
+    CURLcode rc = curl_easy_perform(ud->h);
+    if (rc != CURLE_OK) {
+        bool write_failed = ud->collect.write_failed;
+        http_collect_abort(ud);
+        const char *err = write_failed ? strerror(errno)
+                                       : curl_easy_strerror(rc);
+        LOG("curl_easy_perform: %s", err);
+        return luaL_error(L, "curl_easy_perform: %s", err);
+    }
+
+    lua_createtable(L, 0, 3);
+    if (!http_collect_finish(L, ud, -1))
+        return luaL_error(L, "Unable to write the response body: %s",
+                          strerror(errno));
+
+    LOG("Successfully finished ltf-http fetch.");
+    return 1;
+}
+
+// Give the CURL handle back to the pool along with everything the options
+// kept alive. The handle is unusable afterwards.
+static void ud_release(lua_State *L, l_module_http_t *ud) {
+    http_multi_detach(ud);
+
+    if (ud->h) {
+        http_pool_checkin(ud->h);
+        ud->h = NULL;
+    }
+
+    http_collect_abort(ud);
+    ud_clear_slist(ud);
+    if (ud->write_ref) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->write_ref);
+        ud->write_ref = 0;
+    }
+    if (ud->read_ref) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->read_ref);
+        ud->read_ref = 0;
+    }
+}
+
 int l_module_http_cleanup(lua_State *L) {
     LOG("Invoked ltf-http cleanup...");
     int s = selfshift(L);
-    CURL **ud = luaL_checkudata(L, s, "ltf-http");
-    if (*ud)
-        curl_easy_cleanup(*ud);
+    l_module_http_t *ud = luaL_checkudata(L, s, HTTP_HANDLE_MT);
+    ud_release(L, ud);
     LOG("Successfully finished ltf-http cleanup.");
     return 0;
 }
 
 static int l_module_http_gc(lua_State *L) {
     LOG("Invoked ltf-http GC...");
-    l_module_http_t *ud = luaL_checkudata(L, 1, "ltf.curl.easy");
-    if (!ud)
-        return 0;
-
-    ud_clear_slist(ud);
-    if (ud->write_ref)
-        luaL_unref(L, LUA_REGISTRYINDEX, ud->write_ref);
-    if (ud->read_ref)
-        luaL_unref(L, LUA_REGISTRYINDEX, ud->read_ref);
-
-    if (ud->h)
-        curl_easy_cleanup(ud->h);
-
+    l_module_http_t *ud = luaL_checkudata(L, 1, HTTP_HANDLE_MT);
+    ud_release(L, ud);
     LOG("Successfully finished ltf-http GC.");
     return 0;
 }
@@ -246,19 +463,21 @@ static int l_module_http_gc(lua_State *L) {
 static const luaL_Reg handle_fns[] = {
     {"setopt", l_module_http_setopt},   //
     {"perform", l_module_http_perform}, //
+    {"fetch", l_module_http_fetch},     //
     {"cleanup", l_module_http_cleanup}, //
     {NULL, NULL},                       //
 };
 
 static const luaL_Reg module_fns[] = {
-    {"new", l_module_http_new}, //
-    {NULL, NULL},               //
+    {"new", l_module_http_new},         //
+    {"multi", l_module_http_multi_new}, //
+    {NULL, NULL},                       //
 };
 
 int l_module_http_register_module(lua_State *L) {
     LOG("Registering ltf-http module...");
 
-    luaL_newmetatable(L, "ltf-http");
+    luaL_newmetatable(L, HTTP_HANDLE_MT);
 
     LOG("Registering GC functions...");
     lua_pushcfunction(L, l_module_http_gc);
@@ -272,6 +491,8 @@ int l_module_http_register_module(lua_State *L) {
     lua_pop(L, 1);
     LOG("Handle functions registered.");
 
+    l_module_register_http_multi(L);
+
     LOG("Registering module functions...");
     lua_newtable(L);
     luaL_setfuncs(L, module_fns, 0);
@@ -0,0 +1,864 @@
+#include "modules/json/ltf-json-codec.h"
+
+#include "internal_logging.h"
+
+#include "util/byte_buf.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*----------- string scanning ---------------------------------------*/
+
+static inline bool is_special(unsigned char c, unsigned char extra) {
+    return c == '"' || c == '\\' || c < 0x20 || c == extra;
+}
+
+// First byte of [p, end) that is a quote, a backslash, a control character
+// or 'extra', 'end' if none. Strings are mostly plain text, so this is where
+// both directions spend their time: 16 bytes are checked at once.
+static const char *scan_special(const char *p, const char *end,
+                                unsigned char extra) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ex = _mm_set1_epi8((char)extra);
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, ex),
+                         _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz((unsigned int)mask);
+        p += 16;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t bslash = vdupq_n_u8('\\');
+    const uint8x16_t ex = vdupq_n_u8(extra);
+    const uint8x16_t ctl = vdupq_n_u8(0x1f);
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint8x16_t m =
+            vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)),
+                     vorrq_u8(vceqq_u8(v, ex), vcleq_u8(v, ctl)));
+        if (vmaxvq_u8(m))
+            break; // found in this block, located below
+        p += 16;
+    }
+#endif
+    while (p < end && !is_special((unsigned char)*p, extra))
+        p++;
+    return p;
+}
+
+/*----------- encoder -----------------------------------------------*/
+
+// The output is a byte_buf owned by a userdata, so that it is freed if a
+// Lua error interrupts the encoding. luaL_Buffer cannot be used: it needs
+// the top of the stack, which the table traversal keeps using.
+typedef struct {
+    lua_State *L;
+    byte_buf_t *out;
+    unsigned char slash; // '/' if escaped, '"' (special anyway) otherwise
+    int depth;
+} json_enc_t;
+
+static void enc_oom(json_enc_t *e) {
+    luaL_error(e->L, "json-serialize: out of memory");
+}
+
+static void enc_put(json_enc_t *e, const char *s, size_t n) {
+    if (!byte_buf_append(e->out, s, n))
+        enc_oom(e);
+}
+
+#define enc_lit(e, s) enc_put((e), (s), sizeof(s) - 1)
+
+static void enc_string(json_enc_t *e, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    const char *end = s + len;
+
+    enc_lit(e, "\"");
+    while (s < end) {
+        const char *special = scan_special(s, end, e->slash);
+        if (special > s)
+            enc_put(e, s, (size_t)(special - s));
+        if (special == end)
+            break;
+
+        unsigned char c = (unsigned char)*special;
+        switch (c) {
+        case '"':
+            enc_lit(e, "\\\"");
+            break;
+        case '\\':
+            enc_lit(e, "\\\\");
+            break;
+        case '/':
+            enc_lit(e, "\\/");
+            break;
+        case '\b':
+            enc_lit(e, "\\b");
+            break;
+        case '\f':
+            enc_lit(e, "\\f");
+            break;
+        case '\n':
+            enc_lit(e, "\\n");
+            break;
+        case '\r':
+            enc_lit(e, "\\r");
+            break;
+        case '\t':
+            enc_lit(e, "\\t");
+            break;
+        default: {
+            char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            enc_put(e, u, sizeof u);
+            break;
+        }
+        }
+        s = special + 1;
+    }
+    enc_lit(e, "\"");
+}
+
+static void enc_number(json_enc_t *e, int idx) {
+    char buf[64];
+    int n;
+
+    if (lua_isinteger(e->L, idx)) {
+        n = snprintf(buf, sizeof buf, "%lld",
+                     (long long)lua_tointeger(e->L, idx));
+        enc_put(e, buf, (size_t)n);
+        return;
+    }
+
+    double d = (double)lua_tonumber(e->L, idx);
+    if (isnan(d)) {
+        enc_lit(e, "NaN");
+        return;
+    }
+    if (isinf(d)) {
+        if (d > 0)
+            enc_lit(e, "Infinity");
+        else
+            enc_lit(e, "-Infinity");
+        return;
+    }
+
+    // Same as json-c: shortest exact form, always recognizable as a double
+    n = snprintf(buf, sizeof buf, "%.17g", d);
+    if (n > 0 && !memchr(buf, '.', (size_t)n) && !memchr(buf, 'e', (size_t)n) &&
+        n + 2 < (int)sizeof buf) {
+        buf[n++] = '.';
+        buf[n++] = '0';
+    }
+    enc_put(e, buf, (size_t)n);
+}
+
+static void enc_value(json_enc_t *e, int idx);
+
+static bool table_forced_array(lua_State *L, int idx) {
+    if (!lua_getmetatable(L, idx))
+        return false;
+
+    bool is_array = false;
+    if (lua_getfield(L, -1, "__json_type") == LUA_TSTRING)
+        is_array = strcmp(lua_tostring(L, -1), "array") == 0;
+    lua_pop(L, 2);
+    return is_array;
+}
+
+// Largest positive integer key, -1 if there is any other key
+static lua_Integer table_array_size(lua_State *L, int idx, bool forced) {
+    lua_Integer max = 0;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pop(L, 1);
+        if (lua_isinteger(L, -1) && lua_tointeger(L, -1) > 0) {
+            lua_Integer k = lua_tointeger(L, -1);
+            if (k > max)
+                max = k;
+        } else if (!forced) {
+            lua_pop(L, 1);
+            return -1;
+        }
+    }
+    return max;
+}
+
+static void enc_array_indexed(json_enc_t *e, int idx, lua_Integer n) {
+    enc_lit(e, "[");
+    for (lua_Integer i = 1; i <= n; ++i) {
+        if (i > 1)
+            enc_lit(e, ",");
+        lua_rawgeti(e->L, idx, i);
+        enc_value(e, lua_gettop(e->L));
+        lua_pop(e->L, 1);
+    }
+    enc_lit(e, "]");
+}
+
+static void enc_key(json_enc_t *e, int key_idx) {
+    lua_State *L = e->L;
+    size_t len;
+
+    if (lua_type(L, key_idx) == LUA_TSTRING) {
+        const char *s = lua_tolstring(L, key_idx, &len);
+        enc_string(e, s, len);
+        return;
+    }
+
+    // Converting the key in place would confuse lua_next()
+    const char *s = luaL_tolstring(L, key_idx, &len);
+    enc_string(e, s, len);
+    lua_pop(L, 1);
+}
+
+// Object members from the current lua_next() position, key and value are
+// on the stack
+static void enc_object_members(json_enc_t *e, int idx, bool first) {
+    lua_State *L = e->L;
+    do {
+        if (!first)
+            enc_lit(e, ",");
+        first = false;
+
+        int top = lua_gettop(L);
+        enc_key(e, top - 1);
+        enc_lit(e, ":");
+        enc_value(e, top);
+        lua_pop(L, 1);
+    } while (lua_next(L, idx));
+}
+
+static void enc_table(json_enc_t *e, int idx) {
+    lua_State *L = e->L;
+
+    if (++e->depth > JSON_MAX_DEPTH) {
+        luaL_error(L, "json-serialize: nesting deeper than %d, cyclic table?",
+                   JSON_MAX_DEPTH);
+        return;
+    }
+    luaL_checkstack(L, 4, "json-serialize: nesting too deep");
+
+    if (table_forced_array(L, idx)) {
+        enc_array_indexed(e, idx, table_array_size(L, idx, true));
+        e->depth--;
+        return;
+    }
+
+    lua_pushnil(L);
+    if (!lua_next(L, idx)) {
+        enc_lit(e, "{}");
+        e->depth--;
+        return;
+    }
+
+    if (!lua_isinteger(L, -2)) {
+        // Any non integer key makes an object, encoded while traversing
+        enc_lit(e, "{");
+        enc_object_members(e, idx, true);
+        enc_lit(e, "}");
+        e->depth--;
+        return;
+    }
+
+    // Sequences come out of lua_next() as 1..n from the array part and are
+    // encoded on the fly. Anything else (holes, keys out of order, mixed
+    // keys) is rewound and encoded the way lua_to_json() does.
+    size_t mark = byte_buf_size(e->out);
+    lua_Integer expected = 1;
+    enc_lit(e, "[");
+    do {
+        if (!lua_isinteger(L, -2) || lua_tointeger(L, -2) != expected) {
+            lua_pop(L, 2);
+            byte_buf_truncate(e->out, mark);
+            goto generic;
+        }
+        if (expected > 1)
+            enc_lit(e, ",");
+        enc_value(e, lua_gettop(L));
+        lua_pop(L, 1);
+        expected++;
+    } while (lua_next(L, idx));
+    enc_lit(e, "]");
+    e->depth--;
+    return;
+
+generic: {
+    lua_Integer n = table_array_size(L, idx, false);
+    if (n > 0) {
+        enc_array_indexed(e, idx, n);
+    } else {
+        enc_lit(e, "{");
+        lua_pushnil(L);
+        if (lua_next(L, idx))
+            enc_object_members(e, idx, true);
+        enc_lit(e, "}");
+    }
+    e->depth--;
+}
+}
+
+static void enc_value(json_enc_t *e, int idx) {
+    lua_State *L = e->L;
+
+    switch (lua_type(L, idx)) {
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(L, idx))
+            enc_lit(e, "true");
+        else
+            enc_lit(e, "false");
+        break;
+
+    case LUA_TNUMBER:
+        enc_number(e, idx);
+        break;
+
+    case LUA_TSTRING: {
+        size_t len;
+        const char *s = lua_tolstring(L, idx, &len);
+        enc_string(e, s, len);
+        break;
+    }
+
+    case LUA_TTABLE:
+        enc_table(e, idx);
+        break;
+
+    default: // nil and unsupported types
+        enc_lit(e, "null");
+        break;
+    }
+}
+
+static int codec_buffer_gc(lua_State *L) {
+    byte_buf_t *b = luaL_checkudata(L, 1, JSON_CODEC_MT);
+    byte_buf_free(b);
+    return 0;
+}
+
+void json_codec_encode(lua_State *L, int idx, bool escape_slash) {
+    idx = lua_absindex(L, idx);
+
+    byte_buf_t *out = lua_newuserdatauv(L, sizeof *out, 0);
+    *out = (byte_buf_t)BYTE_BUF_INIT;
+    luaL_setmetatable(L, JSON_CODEC_MT);
+
+    json_enc_t e = {
+        .L = L,
+        .out = out,
+        .slash = escape_slash ? '/' : '"',
+    };
+    enc_value(&e, idx);
+
+    lua_pushlstring(L, byte_buf_data(out), byte_buf_size(out));
+    byte_buf_free(out);
+    lua_remove(L, -2);
+}
+
+/*----------- decoder -----------------------------------------------*/
+
+void json_dec_error(json_dec_t *d, const char *what) {
+    luaL_error(d->L, "json-deserialize: %s at offset %d", what,
+               (int)(d->p - d->start));
+}
+
+void json_dec_skip_ws(json_dec_t *d) {
+    while (d->p < d->end) {
+        char c = *d->p;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            d->p++;
+        } else if (c == '/' && d->p + 1 < d->end && d->p[1] == '/') {
+            const char *nl = memchr(d->p, '\n', (size_t)(d->end - d->p));
+            d->p = nl ? nl + 1 : d->end;
+        } else if (c == '/' && d->p + 1 < d->end && d->p[1] == '*') {
+            const char *q = d->p + 2;
+            while (q + 1 < d->end && !(q[0] == '*' && q[1] == '/'))
+                q++;
+            if (q + 1 >= d->end)
+                json_dec_error(d, "unterminated comment");
+            d->p = q + 2;
+        } else {
+            break;
+        }
+    }
+}
+
+static bool dec_word(json_dec_t *d, const char *word) {
+    size_t n = strlen(word);
+    if ((size_t)(d->end - d->p) < n || strncasecmp(d->p, word, n) != 0)
+        return false;
+    d->p += n;
+    return true;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static long dec_hex4(json_dec_t *d) {
+    if (d->end - d->p < 4)
+        json_dec_error(d, "truncated \\u escape");
+    long v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int h = hex_value(d->p[i]);
+        if (h < 0)
+            json_dec_error(d, "invalid \\u escape");
+        v = (v << 4) | h;
+    }
+    d->p += 4;
+    return v;
+}
+
+static size_t utf8_encode(unsigned long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Escape after the backslash, appended to 'b'
+static void dec_escape(json_dec_t *d, luaL_Buffer *b) {
+    if (d->p >= d->end)
+        json_dec_error(d, "unterminated string");
+
+    char c = *d->p++;
+    switch (c) {
+    case '"':
+    case '\'':
+    case '\\':
+    case '/':
+        luaL_addchar(b, c);
+        return;
+    case 'b':
+        luaL_addchar(b, '\b');
+        return;
+    case 'f':
+        luaL_addchar(b, '\f');
+        return;
+    case 'n':
+        luaL_addchar(b, '\n');
+        return;
+    case 'r':
+        luaL_addchar(b, '\r');
+        return;
+    case 't':
+        luaL_addchar(b, '\t');
+        return;
+    case 'u': {
+        unsigned long cp = (unsigned long)dec_hex4(d);
+        if (cp >= 0xd800 && cp <= 0xdbff && d->end - d->p >= 6 &&
+            d->p[0] == '\\' && d->p[1] == 'u') {
+            const char *save = d->p;
+            d->p += 2;
+            unsigned long lo = (unsigned long)dec_hex4(d);
+            if (lo >= 0xdc00 && lo <= 0xdfff)
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            else
+                d->p = save; // lone high surrogate, kept as is
+        }
+        char utf8[4];
+        luaL_addlstring(b, utf8, utf8_encode(cp, utf8));
+        return;
+    }
+    default:
+        d->p--;
+        json_dec_error(d, "invalid escape");
+    }
+}
+
+// String after its opening quote, pushed onto the stack
+void json_dec_string(json_dec_t *d, char quote) {
+    const char *s = d->p;
+
+    // Fast path: no escape, the string is pushed straight from the input
+    for (;;) {
+        const char *q = scan_special(d->p, d->end, (unsigned char)quote);
+        if (q == d->end) {
+            d->p = q;
+            json_dec_error(d, "unterminated string");
+        }
+        if (*q == quote) {
+            lua_pushlstring(d->L, s, (size_t)(q - s));
+            d->p = q + 1;
+            return;
+        }
+        d->p = q + 1;
+        if (*q == '\\')
+            break;
+        // Control characters and the other quote are taken as they are
+    }
+
+    luaL_Buffer b;
+    luaL_buffinit(d->L, &b);
+    luaL_addlstring(&b, s, (size_t)(d->p - 1 - s));
+    dec_escape(d, &b);
+
+    for (;;) {
+        const char *q = scan_special(d->p, d->end, (unsigned char)quote);
+        if (q == d->end) {
+            d->p = q;
+            json_dec_error(d, "unterminated string");
+        }
+        luaL_addlstring(&b, d->p, (size_t)(q - d->p));
+        d->p = q + 1;
+        if (*q == quote)
+            break;
+        if (*q == '\\')
+            dec_escape(d, &b);
+        else
+            luaL_addchar(&b, *q);
+    }
+    luaL_pushresult(&b);
+}
+
+static void dec_number(json_dec_t *d) {
+    const char *s = d->p;
+    const char *p = s;
+    bool negative = false;
+
+    if (p < d->end && *p == '-') {
+        negative = true;
+        p++;
+        d->p = p;
+        if (dec_word(d, "Infinity")) {
+            lua_pushnumber(d->L, -HUGE_VAL);
+            return;
+        }
+    }
+
+    if (p >= d->end || *p < '0' || *p > '9') {
+        d->p = p;
+        json_dec_error(d, "invalid number");
+    }
+
+    // Integers are accumulated directly, json_to_lua() pushed them as
+    // floats and so does this
+    uint64_t mantissa = 0;
+    bool exact = true;
+    while (p < d->end && *p >= '0' && *p <= '9') {
+        unsigned int digit = (unsigned int)(*p - '0');
+        if (mantissa > (UINT64_MAX - digit) / 10)
+            exact = false;
+        else
+            mantissa = mantissa * 10 + digit;
+        p++;
+    }
+
+    bool is_int = true;
+    if (p < d->end && *p == '.') {
+        is_int = false;
+        p++;
+        if (p >= d->end || *p < '0' || *p > '9') {
+            d->p = p;
+            json_dec_error(d, "invalid number");
+        }
+        while (p < d->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < d->end && (*p == 'e' || *p == 'E')) {
+        is_int = false;
+        p++;
+        if (p < d->end && (*p == '+' || *p == '-'))
+            p++;
+        if (p >= d->end || *p < '0' || *p > '9') {
+            d->p = p;
+            json_dec_error(d, "invalid number");
+        }
+        while (p < d->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    d->p = p;
+
+    if (is_int && exact && mantissa <= (uint64_t)INT64_MAX) {
+        int64_t v = negative ? -(int64_t)mantissa : (int64_t)mantissa;
+        lua_pushnumber(d->L, (lua_Number)v);
+        return;
+    }
+
+    // The input is NUL terminated (Lua string), strtod() stops at the same
+    // place as the grammar above
+    lua_pushnumber(d->L, (lua_Number)strtod(s, NULL));
+}
+
+static void dec_enter(json_dec_t *d) {
+    if (++d->depth > JSON_MAX_DEPTH)
+        json_dec_error(d, "nesting too deep");
+    luaL_checkstack(d->L, 3, "json-deserialize: nesting too deep");
+}
+
+static void dec_array(json_dec_t *d) {
+    dec_enter(d);
+    lua_newtable(d->L);
+
+    lua_Integer n = 0;
+    for (;;) {
+        json_dec_skip_ws(d);
+        if (d->p < d->end && *d->p == ']') {
+            d->p++;
+            break;
+        }
+        if (n > 0) {
+            if (d->p >= d->end || *d->p != ',')
+                json_dec_error(d, "expected ',' or ']'");
+            d->p++;
+            json_dec_skip_ws(d);
+            if (d->p < d->end && *d->p == ']') { // trailing comma
+                d->p++;
+                break;
+            }
+        }
+
+        json_dec_value(d);
+        lua_rawseti(d->L, -2, ++n);
+    }
+    d->depth--;
+}
+
+static void dec_object(json_dec_t *d) {
+    dec_enter(d);
+    lua_newtable(d->L);
+
+    bool first = true;
+    for (;;) {
+        json_dec_skip_ws(d);
+        if (d->p < d->end && *d->p == '}') {
+            d->p++;
+            break;
+        }
+        if (!first) {
+            if (d->p >= d->end || *d->p != ',')
+                json_dec_error(d, "expected ',' or '}'");
+            d->p++;
+            json_dec_skip_ws(d);
+            if (d->p < d->end && *d->p == '}') { // trailing comma
+                d->p++;
+                break;
+            }
+        }
+        first = false;
+
+        if (d->p >= d->end || (*d->p != '"' && *d->p != '\''))
+            json_dec_error(d, "expected a string key");
+        char quote = *d->p++;
+        json_dec_string(d, quote);
+
+        json_dec_skip_ws(d);
+        if (d->p >= d->end || *d->p != ':')
+            json_dec_error(d, "expected ':'");
+        d->p++;
+
+        json_dec_value(d);
+        lua_rawset(d->L, -3);
+    }
+    d->depth--;
+}
+
+void json_dec_value(json_dec_t *d) {
+    json_dec_skip_ws(d);
+    if (d->p >= d->end)
+        json_dec_error(d, "unexpected end of input");
+
+    char c = *d->p;
+    switch (c) {
+    case '{':
+        d->p++;
+        dec_object(d);
+        return;
+    case '[':
+        d->p++;
+        dec_array(d);
+        return;
+    case '"':
+    case '\'':
+        d->p++;
+        json_dec_string(d, c);
+        return;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        dec_number(d);
+        return;
+    default:
+        break;
+    }
+
+    if (dec_word(d, "true")) {
+        lua_pushboolean(d->L, 1);
+    } else if (dec_word(d, "false")) {
+        lua_pushboolean(d->L, 0);
+    } else if (dec_word(d, "null")) {
+        lua_pushnil(d->L);
+    } else if (dec_word(d, "NaN")) {
+        lua_pushnumber(d->L, (lua_Number)NAN);
+    } else if (dec_word(d, "Infinity")) {
+        lua_pushnumber(d->L, (lua_Number)HUGE_VAL);
+    } else {
+        json_dec_error(d, "unexpected character");
+    }
+}
+
+void json_dec_skip_string(json_dec_t *d, char quote) {
+    for (;;) {
+        const char *q = scan_special(d->p, d->end, (unsigned char)quote);
+        if (q == d->end) {
+            d->p = q;
+            json_dec_error(d, "unterminated string");
+        }
+        d->p = q + 1;
+        if (*q == quote)
+            return;
+        if (*q == '\\') {
+            if (d->p >= d->end)
+                json_dec_error(d, "unterminated string");
+            d->p++;
+        }
+    }
+}
+
+bool json_dec_key_equals(json_dec_t *d, char quote, const char *name,
+                         size_t len) {
+    const char *s = d->p;
+    for (;;) {
+        const char *q = scan_special(d->p, d->end, (unsigned char)quote);
+        if (q == d->end) {
+            d->p = q;
+            json_dec_error(d, "unterminated string");
+        }
+        d->p = q + 1;
+        if (*q == quote)
+            return (size_t)(q - s) == len && memcmp(s, name, len) == 0;
+        if (*q == '\\')
+            break;
+    }
+
+    // Escaped keys are rare, they are decoded to be compared
+    d->p = s;
+    json_dec_string(d, quote);
+    size_t key_len;
+    const char *key = lua_tolstring(d->L, -1, &key_len);
+    bool equal = key_len == len && memcmp(key, name, len) == 0;
+    lua_pop(d->L, 1);
+    return equal;
+}
+
+static bool is_scalar_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+void json_dec_skip_value(json_dec_t *d) {
+    char close[JSON_MAX_DEPTH];
+    int depth = 0;
+
+    do {
+        json_dec_skip_ws(d);
+        if (d->p >= d->end)
+            json_dec_error(d, "unexpected end of input");
+
+        char c = *d->p;
+        switch (c) {
+        case '{':
+        case '[':
+            if (d->depth + depth >= JSON_MAX_DEPTH)
+                json_dec_error(d, "nesting too deep");
+            close[depth++] = c == '{' ? '}' : ']';
+            d->p++;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0 || close[depth - 1] != c)
+                json_dec_error(d, "unexpected character");
+            depth--;
+            d->p++;
+            break;
+        case ',':
+        case ':':
+            if (depth == 0)
+                json_dec_error(d, "unexpected character");
+            d->p++;
+            break;
+        case '"':
+        case '\'':
+            d->p++;
+            json_dec_skip_string(d, c);
+            break;
+        default: {
+            const char *s = d->p;
+            while (d->p < d->end && is_scalar_char(*d->p))
+                d->p++;
+            if (d->p == s)
+                json_dec_error(d, "unexpected character");
+            break;
+        }
+        }
+    } while (depth > 0);
+}
+
+void json_codec_decode(lua_State *L, const char *s, size_t len) {
+    json_dec_t d = {.L = L, .start = s, .p = s, .end = s + len};
+
+    // Like json_tokener_parse(), anything after the first value is ignored
+    json_dec_value(&d);
+}
+
+/*----------- registration ------------------------------------------*/
+
+int l_module_register_json_codec(lua_State *L) {
+    LOG("Registering ltf-json-codec...");
+
+    if (luaL_newmetatable(L, JSON_CODEC_MT)) {
+        lua_pushcfunction(L, codec_buffer_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+
+    LOG("Successfully registered ltf-json-codec.");
+    return 0;
+}
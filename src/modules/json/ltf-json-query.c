@@ -0,0 +1,374 @@
+#include "modules/json/ltf-json-query.h"
+#include "modules/json/ltf-json-codec.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    STEP_MEMBER,   // object member 'name' and/or array element 'index'
+    STEP_WILDCARD, // every member or element
+    STEP_SLICE,    // array elements 'index' to 'to' (exclusive)
+} query_step_kind_t;
+
+typedef struct {
+    query_step_kind_t kind;
+    bool descend;      // '..': applied to the node and all its descendants
+    const char *name;  // NULL if no object member is selected
+    size_t name_len;   //
+    lua_Integer index; // -1 if no array element is selected
+    lua_Integer to;    // -1 if the slice is open
+} query_step_t;
+
+typedef struct {
+    json_dec_t d;
+    const query_step_t *steps;
+    size_t steps_count;
+    bool first_only; // the path selects at most one value
+    bool done;
+    int results; // stack index of the array of matches
+    lua_Integer found;
+} json_query_t;
+
+/*----------- path parsing ------------------------------------------*/
+
+static void path_error(lua_State *L, const char *path, const char *p,
+                       const char *what) {
+    luaL_error(L, "json-query: %s at offset %d of '%s'", what,
+               (int)(p - path), path);
+}
+
+// Decimal array index, -1 if 's' is not one
+static lua_Integer parse_index(const char *s, size_t len) {
+    if (len == 0 || len > 18 || (len > 1 && s[0] == '0'))
+        return -1;
+
+    lua_Integer v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] < '0' || s[i] > '9')
+            return -1;
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+
+// Reference tokens of a JSON pointer, unescaped into 'names'
+static size_t parse_pointer(lua_State *L, const char *ptr, size_t len,
+                            query_step_t *steps, char *names) {
+    if (len == 0)
+        return 0; // the whole document
+    if (ptr[0] != '/')
+        path_error(L, ptr, ptr, "a JSON pointer must start with '/'");
+
+    const char *p = ptr + 1;
+    const char *end = ptr + len;
+    size_t n = 0;
+    for (;;) {
+        query_step_t *st = &steps[n++];
+        size_t k = 0;
+        while (p < end && *p != '/') {
+            if (*p == '~') {
+                if (p + 1 >= end || (p[1] != '0' && p[1] != '1'))
+                    path_error(L, ptr, p, "invalid '~' escape");
+                names[k++] = p[1] == '0' ? '~' : '/';
+                p += 2;
+                continue;
+            }
+            names[k++] = *p++;
+        }
+
+        *st = (query_step_t){
+            .kind = STEP_MEMBER,
+            .name = names,
+            .name_len = k,
+            .index = parse_index(names, k),
+            .to = -1,
+        };
+        names += k;
+
+        if (p == end)
+            return n;
+        p++;
+    }
+}
+
+static bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '$' ||
+           (unsigned char)c >= 0x80;
+}
+
+static lua_Integer parse_path_index(lua_State *L, const char *path,
+                                    const char **p, const char *end) {
+    const char *s = *p;
+    if (s < end && *s == '-')
+        path_error(L, path, s, "negative indices are not supported");
+    while (*p < end && **p >= '0' && **p <= '9')
+        (*p)++;
+    if (*p == s)
+        return -1;
+
+    lua_Integer v = parse_index(s, (size_t)(*p - s));
+    if (v < 0)
+        path_error(L, path, s, "invalid index");
+    return v;
+}
+
+// Content of a bracket after '['
+static void parse_bracket(lua_State *L, const char *path, const char **pp,
+                          const char *end, query_step_t *st, char **names) {
+    const char *p = *pp;
+
+    if (p < end && *p == '*') {
+        st->kind = STEP_WILDCARD;
+        p++;
+    } else if (p < end && (*p == '\'' || *p == '"')) {
+        char quote = *p++;
+        st->name = *names;
+        while (p < end && *p != quote) {
+            if (*p == '\\' && p + 1 < end)
+                p++;
+            *(*names)++ = *p++;
+        }
+        if (p >= end)
+            path_error(L, path, p, "unterminated name");
+        st->name_len = (size_t)(*names - st->name);
+        p++;
+    } else {
+        st->index = parse_path_index(L, path, &p, end);
+        if (p < end && *p == ':') {
+            p++;
+            st->kind = STEP_SLICE;
+            if (st->index < 0)
+                st->index = 0;
+            st->to = parse_path_index(L, path, &p, end);
+        } else if (st->index < 0) {
+            path_error(L, path, p, "expected an index, a name or '*'");
+        }
+    }
+
+    if (p >= end || *p != ']')
+        path_error(L, path, p, "expected ']'");
+    *pp = p + 1;
+}
+
+static size_t parse_path(lua_State *L, const char *path, size_t len,
+                         query_step_t *steps, char *names) {
+    if (len == 0 || path[0] != '$')
+        path_error(L, path, path, "a JSONPath must start with '$'");
+
+    const char *p = path + 1;
+    const char *end = path + len;
+    size_t n = 0;
+    while (p < end) {
+        query_step_t st = {
+            .kind = STEP_MEMBER,
+            .index = -1,
+            .to = -1,
+        };
+
+        if (*p == '[') {
+            p++;
+            parse_bracket(L, path, &p, end, &st, &names);
+        } else if (*p == '.') {
+            p++;
+            if (p < end && *p == '.') {
+                st.descend = true;
+                p++;
+            }
+
+            if (st.descend && p < end && *p == '[') {
+                p++;
+                parse_bracket(L, path, &p, end, &st, &names);
+            } else if (p < end && *p == '*') {
+                st.kind = STEP_WILDCARD;
+                p++;
+            } else {
+                const char *s = p;
+                while (p < end && is_name_char(*p))
+                    p++;
+                if (p == s)
+                    path_error(L, path, p, "expected a name");
+                memcpy(names, s, (size_t)(p - s));
+                st.name = names;
+                st.name_len = (size_t)(p - s);
+                names += st.name_len;
+            }
+        } else {
+            path_error(L, path, p, "expected '.' or '['");
+        }
+
+        steps[n++] = st;
+    }
+    return n;
+}
+
+/*----------- matching ----------------------------------------------*/
+
+static bool step_selects_index(const query_step_t *st, lua_Integer i) {
+    switch (st->kind) {
+    case STEP_WILDCARD:
+        return true;
+    case STEP_SLICE:
+        return i >= st->index && (st->to < 0 || i < st->to);
+    default:
+        return i == st->index;
+    }
+}
+
+// Move to the next member or element of the container being walked. False
+// once its closing bracket is consumed.
+static bool query_next(json_dec_t *d, char close, bool *first) {
+    json_dec_skip_ws(d);
+    if (d->p < d->end && *d->p == close) {
+        d->p++;
+        return false;
+    }
+    if (!*first) {
+        if (d->p >= d->end || *d->p != ',')
+            json_dec_error(d, close == '}' ? "expected ',' or '}'"
+                                           : "expected ',' or ']'");
+        d->p++;
+        json_dec_skip_ws(d);
+        if (d->p < d->end && *d->p == close) { // trailing comma
+            d->p++;
+            return false;
+        }
+    }
+    *first = false;
+    return true;
+}
+
+// Apply steps 'i'.. to the value at the current position and move past it
+static void query_match(json_query_t *q, size_t i) {
+    json_dec_t *d = &q->d;
+
+    if (i == q->steps_count) {
+        json_dec_value(d);
+        lua_rawseti(d->L, q->results, ++q->found);
+        q->done = q->first_only;
+        return;
+    }
+
+    json_dec_skip_ws(d);
+    if (d->p >= d->end)
+        json_dec_error(d, "unexpected end of input");
+
+    char open = *d->p;
+    if (open != '{' && open != '[') {
+        json_dec_skip_value(d);
+        return;
+    }
+    if (++d->depth > JSON_MAX_DEPTH)
+        json_dec_error(d, "nesting too deep");
+    d->p++;
+
+    const query_step_t *st = &q->steps[i];
+    bool first = true;
+    lua_Integer index = 0;
+    while (query_next(d, open == '{' ? '}' : ']', &first)) {
+        bool selected;
+        if (open == '{') {
+            if (d->p >= d->end || (*d->p != '"' && *d->p != '\''))
+                json_dec_error(d, "expected a string key");
+            char quote = *d->p++;
+            if (st->kind == STEP_WILDCARD) {
+                selected = true;
+                json_dec_skip_string(d, quote);
+            } else if (st->kind == STEP_MEMBER && st->name) {
+                selected =
+                    json_dec_key_equals(d, quote, st->name, st->name_len);
+            } else {
+                selected = false;
+                json_dec_skip_string(d, quote);
+            }
+
+            json_dec_skip_ws(d);
+            if (d->p >= d->end || *d->p != ':')
+                json_dec_error(d, "expected ':'");
+            d->p++;
+        } else {
+            selected = step_selects_index(st, index++);
+        }
+
+        // The text stays in memory: a selected child is walked again for
+        // the recursive descent
+        const char *child = d->p;
+        if (selected) {
+            query_match(q, i + 1);
+            if (q->done)
+                return;
+        }
+        if (st->descend) {
+            d->p = child;
+            query_match(q, i);
+            if (q->done)
+                return;
+        } else if (!selected) {
+            json_dec_skip_value(d);
+        }
+    }
+    d->depth--;
+}
+
+// Scratch space for the steps and their unescaped names, which are never
+// longer than the path itself
+static query_step_t *query_prepare(lua_State *L, size_t path_len,
+                                   char **names) {
+    size_t steps_size = (path_len + 1) * sizeof(query_step_t);
+    query_step_t *steps = lua_newuserdatauv(L, steps_size + path_len + 1, 0);
+    *names = (char *)steps + steps_size;
+    return steps;
+}
+
+static void query_run(lua_State *L, json_query_t *q, const char *s,
+                      size_t len) {
+    q->d = (json_dec_t){.L = L, .start = s, .p = s, .end = s + len};
+    luaL_checkstack(L, 3, "json-query");
+    query_match(q, 0);
+}
+
+void json_query_pointer(lua_State *L, const char *s, size_t len,
+                        const char *ptr, size_t ptr_len) {
+    lua_newtable(L);
+    int results = lua_gettop(L);
+
+    char *names;
+    query_step_t *steps = query_prepare(L, ptr_len, &names);
+    json_query_t q = {
+        .steps = steps,
+        .steps_count = parse_pointer(L, ptr, ptr_len, steps, names),
+        .first_only = true,
+        .results = results,
+    };
+    query_run(L, &q, s, len);
+
+    lua_settop(L, results);
+    lua_rawgeti(L, results, 1);
+    lua_pushboolean(L, q.found > 0);
+    lua_remove(L, results);
+}
+
+void json_query_path(lua_State *L, const char *s, size_t len,
+                     const char *path, size_t path_len) {
+    lua_newtable(L);
+    int results = lua_gettop(L);
+
+    char *names;
+    query_step_t *steps = query_prepare(L, path_len, &names);
+    json_query_t q = {
+        .steps = steps,
+        .steps_count = parse_path(L, path, path_len, steps, names),
+        .first_only = true,
+        .results = results,
+    };
+    for (size_t i = 0; i < q.steps_count; ++i) {
+        if (steps[i].kind != STEP_MEMBER || steps[i].descend)
+            q.first_only = false;
+    }
+    query_run(L, &q, s, len);
+
+    // matched 'null's are nil, so the array may have holes: pass the count
+    lua_settop(L, results);
+    lua_pushinteger(L, q.found);
+}
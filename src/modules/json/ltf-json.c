@@ -1,4 +1,6 @@
 #include "modules/json/ltf-json.h"
+#include "modules/json/ltf-json-codec.h"
+#include "modules/json/ltf-json-query.h"
 
 #include "internal_logging.h"
 
@@ -9,6 +11,12 @@ int l_module_json_serialize(lua_State *L) {
     luaL_checktype(L, s, LUA_TTABLE);
     int flags = luaL_checkinteger(L, s + 1);
 
+    // Compact output is encoded directly, json-c only formats the rest
+    if ((flags & ~JSON_C_TO_STRING_NOSLASHESCAPE) == 0) {
+        json_codec_encode(L, s, !(flags & JSON_C_TO_STRING_NOSLASHESCAPE));
+        return 1;
+    }
+
     json_object *obj = lua_to_json(L, s);
     if (!obj) {
         LOG("Unable to create json object from Lua table.");
@@ -30,32 +38,50 @@ int l_module_json_serialize(lua_State *L) {
 
 int l_module_json_deserialize(lua_State *L) {
     int s = selfshift(L);
-    const char *str = luaL_checkstring(L, s);
+    size_t len;
+    const char *str = luaL_checklstring(L, s, &len);
 
-    json_object *obj = json_tokener_parse(str);
-    if (!obj) {
-        const char *err = json_util_get_last_err();
-        LOG("json-deserialize: %s", err);
-        return luaL_error(L, "json-deserialize: %s", err);
-    }
+    json_codec_decode(L, str, len);
 
-    json_to_lua(L, obj);
+    return 1;
+}
 
-    json_object_put(obj);
+int l_module_json_query(lua_State *L) {
+    int s = selfshift(L);
+    size_t len, ptr_len;
+    const char *str = luaL_checklstring(L, s, &len);
+    const char *ptr = luaL_checklstring(L, s + 1, &ptr_len);
 
-    return 1;
+    json_query_pointer(L, str, len, ptr, ptr_len);
+
+    return 2;
+}
+
+int l_module_json_query_path(lua_State *L) {
+    int s = selfshift(L);
+    size_t len, path_len;
+    const char *str = luaL_checklstring(L, s, &len);
+    const char *path = luaL_checklstring(L, s + 1, &path_len);
+
+    json_query_path(L, str, len, path, path_len);
+
+    return 2;
 }
 
 /*----------- registration ------------------------------------------*/
 static const luaL_Reg module_fns[] = {
     {"serialize", l_module_json_serialize},     //
     {"deserialize", l_module_json_deserialize}, //
+    {"query", l_module_json_query},             //
+    {"query_path", l_module_json_query_path},   //
     {NULL, NULL},                               //
 };
 
 int l_module_json_register_module(lua_State *L) {
     LOG("Registering ltf-json module...");
 
+    l_module_register_json_codec(L);
+
     LOG("Registering module functions...");
     lua_newtable(L);
     luaL_setfuncs(L, module_fns, 0);
@@ -4,6 +4,7 @@
 #include "internal_logging.h"
 #include "ltf_secrets.h"
 #include "ltf_vars.h"
+#include "ltf_watchdog.h"
 #include "test_case.h"
 
 #include "util/da.h"
@@ -29,13 +30,29 @@ int l_module_ltf_sleep(lua_State *L) {
         return 0;
     }
     LOG("Sleeping for %d ms...", ms);
-    usleep(ms * 1000);
+    // Cut short at the deadline of the running test
+    usleep(ltf_watchdog_clamp_ms(ms) * 1000);
+    ltf_watchdog_check(L);
 
     LOG("Successfully finished ltf-main sleep");
 
     return 0; /* no Lua return values */
 }
 
+static bool is_string_array(lua_State *L, int idx) {
+    if (!lua_istable(L, idx))
+        return false;
+    lua_Integer n = luaL_len(L, idx);
+    for (lua_Integer i = 1; i <= n; ++i) {
+        lua_rawgeti(L, idx, i);
+        bool is_string = lua_isstring(L, -1);
+        lua_pop(L, 1);
+        if (!is_string)
+            return false;
+    }
+    return true;
+}
+
 static void read_string_array(lua_State *L, int idx, da_t **out) {
     luaL_checktype(L, idx, LUA_TTABLE);
     lua_Integer n = luaL_len(L, idx);
@@ -58,35 +75,43 @@ int l_module_ltf_register_test(lua_State *L) {
 
     luaL_checktype(L, 1, LUA_TTABLE);
 
+    // Every field is checked before anything is allocated, an error raised
+    // afterwards would leak the test case
     lua_getfield(L, 1, "name");
     const char *name = luaL_checkstring(L, -1);
-    char *name_copy = strdup(name);
-    lua_pop(L, 1);
 
     lua_getfield(L, 1, "body");
     luaL_argcheck(L, lua_isfunction(L, -1), 1, "`body` must be a function");
-    int body_ref = luaL_ref(L, LUA_REGISTRYINDEX);
-
-    test_case_t *tc = malloc(sizeof(test_case_t));
-    memset(tc, 0, sizeof(*tc));
-    tc->ref = body_ref;
-    tc->name = name_copy;
+    int body = lua_gettop(L);
 
     lua_getfield(L, 1, "description");
-    if (!lua_isnil(L, -1)) {
-        luaL_argcheck(L, lua_isstring(L, -1), 1,
-                      "`description` must be string");
-        tc->desc = strdup(lua_tostring(L, -1));
-    }
-    lua_pop(L, 1);
+    int desc = lua_isnil(L, -1) ? 0 : lua_gettop(L);
+    luaL_argcheck(L, !desc || lua_isstring(L, desc), 1,
+                  "`description` must be string");
 
     lua_getfield(L, 1, "tags");
+    int tags = lua_isnil(L, -1) ? 0 : lua_gettop(L);
+    luaL_argcheck(L, !tags || is_string_array(L, tags), 1,
+                  "`tags` must be array of strings");
+
+    int64_t timeout = -1;
+    lua_getfield(L, 1, "timeout");
     if (!lua_isnil(L, -1)) {
-        luaL_argcheck(L, lua_istable(L, -1), 1,
-                      "`tags` must be array of strings");
-        read_string_array(L, lua_gettop(L), &tc->tags);
+        luaL_argcheck(L, lua_isinteger(L, -1) && lua_tointeger(L, -1) >= 0, 1,
+                      "`timeout` must be a non-negative integer");
+        timeout = (int64_t)lua_tointeger(L, -1);
     }
-    lua_pop(L, 1);
+
+    test_case_t *tc = malloc(sizeof(test_case_t));
+    memset(tc, 0, sizeof(*tc));
+    tc->name = strdup(name);
+    tc->timeout = timeout;
+    if (desc)
+        tc->desc = strdup(lua_tostring(L, desc));
+    if (tags)
+        read_string_array(L, tags, &tc->tags);
+    lua_pushvalue(L, body);
+    tc->ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
     int res = test_case_enqueue(L, tc);
     if (res == 0) {
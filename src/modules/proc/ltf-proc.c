@@ -1,23 +1,186 @@
 #include "modules/proc/ltf-proc.h"
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
 
 #include "util/lua.h"
+#include "util/time.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef __linux__
+#include <sys/syscall.h>
 #include <wait.h>
+#else
+#include <sys/wait.h>
 #endif // __linux__
 
 extern char **environ;
 
-static void close_fd(int fd) {
-    if (fd >= 0)
-        close(fd);
+#define PROC_READ_CHUNK 65536
+
+// Without a pidfd the exit of the child is noticed by waitpid() at this rate
+#define PROC_REAP_INTERVAL_MS 10
+
+// How long kill() gives the child to exit after SIGTERM before SIGKILL
+#define PROC_KILL_GRACE_MS 1000
+
+// How long read() waits for EOF once the child exited. Its own output is in
+// the pipe already, only a grandchild that inherited the pipe can hold it
+// open beyond that.
+#define PROC_EXIT_DRAIN_MS 100
+
+static void close_fd(int *fd) {
+    if (*fd >= 0)
+        close(*fd);
+    *fd = -1;
+}
+
+static int set_fd_flags(int fd, bool nonblock) {
+    // dup2() in the child clears close-on-exec on stdin/stdout/stderr
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC))
+        return -1;
+    if (!nonblock)
+        return 0;
+    int fl = fcntl(fd, F_GETFL);
+    return fl < 0 ? -1 : fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+static int open_pidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    // Close-on-exec by default
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0)
+        LOG("pidfd_open: %s, falling back to waitpid() polling",
+            strerror(errno));
+    return fd;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/*----------- reactor -----------------------------------------------*/
+
+// Read everything currently available on a non-blocking pipe. The pipe is
+// closed on EOF.
+static void proc_drain(int *fd, byte_buf_t *b) {
+    while (*fd >= 0) {
+        if (!byte_buf_reserve(b, PROC_READ_CHUNK)) {
+            LOG("Out of memory, leaving output in the pipe.");
+            return;
+        }
+
+        ssize_t n = read(*fd, byte_buf_tail(b), PROC_READ_CHUNK);
+        if (n > 0) {
+            byte_buf_commit(b, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (n < 0)
+            LOG("read: %s", strerror(errno));
+        close_fd(fd);
+    }
+}
+
+// Returns 1 if the child has exited, 0 if it is running, -1 on error. With
+// 'block' waits until it exits.
+static int proc_reap(l_module_proc_t *p, bool block) {
+    if (p->exited)
+        return 1;
+    if (p->pid <= 0)
+        return 0;
+
+    int st;
+    pid_t r;
+    do {
+        r = waitpid(p->pid, &st, block ? 0 : WNOHANG);
+    } while (block && r < 0 && errno == EINTR);
+    if (r == 0 || (r < 0 && errno == EINTR))
+        return 0;
+    if (r < 0) {
+        LOG("waitpid: %s", strerror(errno));
+        return -1;
+    }
+
+    p->pid = 0;
+    p->exited = true;
+    close_fd(&p->pidfd);
+
+    if (WIFEXITED(st)) {
+        p->exitcode = WEXITSTATUS(st);
+        LOG("Exited with status %d", p->exitcode);
+    } else if (WIFSIGNALED(st)) {
+        p->exitcode = WTERMSIG(st);
+        LOG("Exited with signal %d (%d)", 128 + p->exitcode, p->exitcode);
+    } else {
+        LOG("Unknown termination status.");
+        p->exitcode = -1;
+    }
+    return 1;
+}
+
+// Wait up to 'timeout_ms' (-1: no limit) until output is available, the
+// child exits or, with 'want_in', stdin becomes writable. Whatever is
+// available is drained into the output buffers, so that the child never
+// blocks on a full pipe. Returns -1 on error.
+static int proc_poll(l_module_proc_t *p, int timeout_ms, bool want_in) {
+    struct pollfd fds[4];
+    nfds_t n = 0;
+    int out_i = -1, err_i = -1, pid_i = -1;
+
+    if (p->pout[0] >= 0) {
+        out_i = (int)n;
+        fds[n++] = (struct pollfd){.fd = p->pout[0], .events = POLLIN};
+    }
+    if (p->perr[0] >= 0) {
+        err_i = (int)n;
+        fds[n++] = (struct pollfd){.fd = p->perr[0], .events = POLLIN};
+    }
+    if (!p->exited && p->pidfd >= 0) {
+        pid_i = (int)n;
+        fds[n++] = (struct pollfd){.fd = p->pidfd, .events = POLLIN};
+    }
+    if (want_in && p->pin[1] >= 0) {
+        fds[n++] = (struct pollfd){.fd = p->pin[1], .events = POLLOUT};
+    }
+
+    if (!p->exited && p->pidfd < 0 &&
+        (timeout_ms < 0 || timeout_ms > PROC_REAP_INTERVAL_MS))
+        timeout_ms = PROC_REAP_INTERVAL_MS;
+
+    if (n == 0 && timeout_ms < 0)
+        return 0; // nothing left to wait for
+
+    int rc = poll(fds, n, ltf_watchdog_clamp_ms(timeout_ms));
+    if (rc < 0) {
+        if (errno == EINTR)
+            return 0;
+        LOG("poll: %s", strerror(errno));
+        return -1;
+    }
+
+    if (out_i >= 0 && fds[out_i].revents)
+        proc_drain(&p->pout[0], &p->out);
+    if (err_i >= 0 && fds[err_i].revents)
+        proc_drain(&p->perr[0], &p->err);
+    if (pid_i < 0 || fds[pid_i].revents) {
+        if (proc_reap(p, false) < 0)
+            return -1;
+    }
+
+    return rc;
 }
 
 static void proc_close_streams(l_module_proc_t *p) {
@@ -26,28 +189,15 @@ static void proc_close_streams(l_module_proc_t *p) {
         LOG("Proc is NULL");
         return;
     }
-    if (p->in) {
-        fclose(p->in);
-        p->in = NULL;
-        LOG("Closed stdin file");
-    }
-    if (p->out) {
-        fclose(p->out);
-        p->out = NULL;
-        LOG("Closed stdout file");
-    }
-    if (p->err) {
-        fclose(p->err);
-        p->err = NULL;
-        LOG("Closed stderr file");
-    }
 
     LOG("Closing file descriptors...");
     for (size_t i = 0; i < 2; i++) {
-        close_fd(p->pin[i]);
-        close_fd(p->pout[i]);
-        close_fd(p->perr[i]);
+        close_fd(&p->pin[i]);
+        close_fd(&p->pout[i]);
+        close_fd(&p->perr[i]);
     }
+    byte_buf_free(&p->out);
+    byte_buf_free(&p->err);
     LOG("Successfully closed streams...");
 }
 
@@ -88,6 +238,10 @@ int l_module_proc_spawn(lua_State *L) {
 
     l_module_proc_t *proc = lua_newuserdata(L, sizeof *proc);
     memset(proc, 0, sizeof *proc);
+    proc->pidfd = -1;
+    for (size_t i = 0; i < 2; i++) {
+        proc->pin[i] = proc->pout[i] = proc->perr[i] = -1;
+    }
 
     LOG("Piping...");
 
@@ -102,6 +256,22 @@ int l_module_proc_spawn(lua_State *L) {
         return luaL_error(L, "pipe(): %s", err);
     }
 
+    // No pipe end may leak into other children: a leaked stdin would never
+    // report EOF to this one
+    if (set_fd_flags(proc->pin[0], false) || set_fd_flags(proc->pin[1], true) ||
+        set_fd_flags(proc->pout[0], true) ||
+        set_fd_flags(proc->pout[1], false) ||
+        set_fd_flags(proc->perr[0], true) ||
+        set_fd_flags(proc->perr[1], false)) {
+        const char *err = strerror(errno);
+        LOG("Unable to set pipe flags: %s", err);
+        proc_close_streams(proc);
+        for (size_t i = 0; i < len; i++)
+            free(argv[i]);
+        free(argv);
+        return luaL_error(L, "fcntl(): %s", err);
+    }
+
     LOG("Spawning file actions...");
     posix_spawn_file_actions_t fa;
     posix_spawn_file_actions_init(&fa);
@@ -109,9 +279,6 @@ int l_module_proc_spawn(lua_State *L) {
     posix_spawn_file_actions_adddup2(&fa, proc->pin[0], STDIN_FILENO);
     posix_spawn_file_actions_adddup2(&fa, proc->pout[1], STDOUT_FILENO);
     posix_spawn_file_actions_adddup2(&fa, proc->perr[1], STDERR_FILENO);
-    posix_spawn_file_actions_addclose(&fa, proc->pin[1]);
-    posix_spawn_file_actions_addclose(&fa, proc->pout[0]);
-    posix_spawn_file_actions_addclose(&fa, proc->perr[0]);
 
     LOG("Spawning...");
     int rc = posix_spawnp(&proc->pid, argv[0], &fa, NULL, argv, environ);
@@ -130,21 +297,11 @@ int l_module_proc_spawn(lua_State *L) {
     }
 
     LOG("Closing child side ends...");
-    close_fd(proc->pin[0]);
-    close_fd(proc->pout[1]);
-    close_fd(proc->perr[1]);
-
-    LOG("Opening file descriptors...");
-    proc->in = fdopen(proc->pin[1], "w");
-    proc->out = fdopen(proc->pout[0], "r");
-    proc->err = fdopen(proc->perr[0], "r");
-
-    if (!proc->in || !proc->out || !proc->err) {
-        LOG("fdopen failed");
-        proc_kill(proc, SIGKILL);
-        proc_close_streams(proc);
-        return luaL_error(L, "fdopen() failed");
-    }
+    close_fd(&proc->pin[0]);
+    close_fd(&proc->pout[1]);
+    close_fd(&proc->perr[1]);
+
+    proc->pidfd = open_pidfd(proc->pid);
 
     luaL_getmetatable(L, "ltf-proc");
     lua_setmetatable(L, -2);
@@ -162,12 +319,31 @@ int l_module_proc_write(lua_State *L) {
     const char *buf = luaL_checklstring(L, s + 1, &len);
     LOG("Buffer to write: %.*s", (int)len, buf);
 
-    if (!proc->in) {
+    if (proc->pin[1] < 0) {
         LOG("stdin closed");
         return luaL_error(L, "stdin closed");
     }
-    size_t wr = fwrite(buf, 1, len, proc->in);
-    fflush(proc->in);
+
+    size_t wr = 0;
+    while (wr < len) {
+        ssize_t n = write(proc->pin[1], buf + wr, len - wr);
+        if (n > 0) {
+            wr += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The child may be blocked writing its own output: keep
+            // draining it while waiting for room in the stdin pipe
+            ltf_watchdog_check(L);
+            if (proc_poll(proc, -1, true) < 0)
+                break;
+            continue;
+        }
+        LOG("write: %s", strerror(errno));
+        break;
+    }
 
     LOG("Wrote %zu bytes", wr);
     lua_pushinteger(L, (lua_Integer)wr);
@@ -190,41 +366,54 @@ int l_module_proc_read(lua_State *L) {
 
     LOG("Stream = %s , want = %lld", which, want);
 
-    FILE **Fptr = NULL;
-    if (strcasecmp(which, "stdout") == 0)
-        Fptr = &proc->out;
-    else if (strcasecmp(which, "stderr") == 0)
-        Fptr = &proc->err;
-    else
+    int *fd = NULL;
+    byte_buf_t *b = NULL;
+    if (strcasecmp(which, "stdout") == 0) {
+        fd = &proc->pout[0];
+        b = &proc->out;
+    } else if (strcasecmp(which, "stderr") == 0) {
+        fd = &proc->perr[0];
+        b = &proc->err;
+    } else {
         return luaL_error(L, "unknown stream '%s'", which);
-
-    if (!*Fptr) { // already closed / EOF
-        LOG("%s already closed", which);
-        lua_pushliteral(L, "");
-        return 1;
     }
 
-    if (proc->pid == 0) {
-        LOG("Process exited, draining %s to EOF …", which);
-        luaL_Buffer lb;
-        luaL_buffinit(L, &lb);
+    if (proc_poll(proc, 0, false) < 0)
+        return luaL_error(L, "poll(): %s", strerror(errno));
 
-        char tmp[4096];
-        size_t got;
-        while ((got = fread(tmp, 1, sizeof tmp, *Fptr)) > 0)
-            luaL_addlstring(&lb, tmp, got);
+    // Block until some output, EOF or the exit of the child
+    while (byte_buf_size(b) == 0 && *fd >= 0 && !proc->exited) {
+        ltf_watchdog_check(L);
+        if (proc_poll(proc, -1, false) < 0)
+            return luaL_error(L, "poll(): %s", strerror(errno));
+    }
 
-        fclose(*Fptr);
-        *Fptr = NULL;
-        luaL_pushresult(&lb);
+    if (proc->exited) {
+        LOG("Process exited, draining %s to EOF …", which);
+        uint64_t deadline =
+            monotonic_nanos() + (uint64_t)PROC_EXIT_DRAIN_MS * 1000000;
+        while (*fd >= 0) {
+            int left = (int)millis_until(deadline);
+            if (left == 0) {
+                LOG("%s still open, held by another process.", which);
+                break;
+            }
+            ltf_watchdog_check(L);
+            if (proc_poll(proc, left, false) < 0)
+                return luaL_error(L, "poll(): %s", strerror(errno));
+        }
+        lua_pushlstring(L, byte_buf_data(b), byte_buf_size(b));
+        byte_buf_free(b);
         LOG("Drain complete (%llu bytes)", lua_rawlen(L, -1));
         return 1;
     }
 
-    char *tmp = lua_newuserdatauv(L, want, 0);
-    size_t got = fread(tmp, 1, want, *Fptr);
+    size_t got = byte_buf_size(b);
+    if (got > (size_t)want)
+        got = (size_t)want;
     LOG("Got %zu bytes", got);
-    lua_pushlstring(L, tmp, got);
+    lua_pushlstring(L, byte_buf_data(b), got);
+    byte_buf_consume(b, got);
 
     LOG("Successfully finished ltf-proc read.");
     return 1;
@@ -235,40 +424,37 @@ int l_module_proc_wait(lua_State *L) {
     int s = selfshift(L);
     l_module_proc_t *proc = luaL_checkudata(L, s, "ltf-proc");
     LOG("Proc pointer: %p", (void *)proc);
-    if (proc->pid <= 0) {
-        LOG("Proc pid is %d <= 0", proc->pid);
-        lua_pushnil(L);
-        LOG("Successfully finished ltf-proc wait.");
-        return 1;
-    }
 
-    int st;
-    pid_t r = waitpid(proc->pid, &st, WNOHANG);
-    if (r == 0) {
-        LOG("Proc is running.");
-        lua_pushnil(L);
-        LOG("Successfully finished ltf-proc wait.");
-        return 1;
+    lua_Integer timeout = luaL_optinteger(L, s + 1, 0);
+    uint64_t deadline = 0;
+    if (timeout > 0)
+        deadline = monotonic_nanos() + (uint64_t)timeout * 1000000;
+
+    // Output is drained even by a non-blocking wait, so that callers
+    // polling it in a loop cannot deadlock on a full pipe
+    int rc = proc_poll(proc, 0, false);
+    while (rc >= 0 && !proc->exited) {
+        rc = proc_reap(proc, false);
+        if (rc != 0 || timeout == 0)
+            break;
+
+        int left = timeout < 0 ? -1 : (int)millis_until(deadline);
+        if (left == 0)
+            break;
+        ltf_watchdog_check(L);
+        rc = proc_poll(proc, left, false);
     }
-    if (r == -1) {
+
+    if (rc < 0) {
         const char *err = strerror(errno);
-        LOG("waitpid: %s", err);
-        return luaL_error(L, "waitpid: %s", err);
+        return luaL_error(L, "wait: %s", err);
     }
 
-    proc->pid = 0;
-
-    if (WIFEXITED(st)) {
-        int status = WEXITSTATUS(st);
-        LOG("Exited with status %d", status);
-        lua_pushinteger(L, status);
-    } else if (WIFSIGNALED(st)) {
-        int signal = WTERMSIG(st);
-        LOG("Exited with signal %d (%d)", 128 + signal, signal);
-        lua_pushinteger(L, signal);
+    if (!proc->exited) {
+        LOG("Proc is running.");
+        lua_pushnil(L);
     } else {
-        LOG("Unknown termination status.");
-        lua_pushinteger(L, -1);
+        lua_pushinteger(L, proc->exitcode);
     }
 
     LOG("Successfully finished ltf-proc wait.");
@@ -284,8 +470,22 @@ int l_module_proc_kill(lua_State *L) {
 
     if (proc) {
         proc_close_streams(proc);
-        proc_kill(proc, SIGTERM);
-        l_module_proc_wait(L);
+        if (!proc->exited && proc_kill(proc, SIGTERM) == 0) {
+            // Reaped in any case, a child left behind becomes a zombie and
+            // its exit status is lost
+            uint64_t deadline =
+                monotonic_nanos() + (uint64_t)PROC_KILL_GRACE_MS * 1000000;
+            int left;
+            while (!proc->exited && (left = (int)millis_until(deadline)) &&
+                   proc_poll(proc, left, false) >= 0)
+                ;
+            if (!proc->exited) {
+                LOG("Still running after SIGTERM, sending SIGKILL...");
+                proc_kill(proc, SIGKILL);
+                proc_reap(proc, true);
+            }
+        }
+        close_fd(&proc->pidfd);
     }
 
     LOG("Successfully finished ltf-proc kill.");
@@ -1,11 +1,15 @@
 #include "modules/serial/ltf-serial.h"
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
 #include "util/lua.h"
+#include "util/time.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#define RX_CHUNK 4096
+
 static inline l_module_serial_t *check_port(lua_State *L, int idx) {
     return luaL_checkudata(L, idx, "ltf-serial");
 }
@@ -16,7 +20,7 @@ int l_module_serial_get_port_by_name(lua_State *L) {
     const char *p = luaL_checkstring(L, s);
 
     l_module_serial_t *u = lua_newuserdata(L, sizeof *u);
-    u->port = NULL;
+    memset(u, 0, sizeof *u);
 
     enum sp_return r = sp_get_port_by_name(p, &u->port);
 
@@ -560,14 +564,37 @@ static inline int read_helper(lua_State *L, int blocking) {
 
     luaL_Buffer b;
     char *buf = luaL_buffinitsize(L, &b, n);
-    int got = blocking ? sp_blocking_read(u->port, buf, n, to_ms)
-                       : sp_nonblocking_read(u->port, buf, n);
+
+    // Input left over by read_until() comes first
+    int buffered = 0;
+    size_t rx_size = byte_buf_size(&u->rx);
+    if (n > 0 && rx_size > 0) {
+        buffered = rx_size < (size_t)n ? (int)rx_size : n;
+        memcpy(buf, byte_buf_data(&u->rx), buffered);
+        byte_buf_consume(&u->rx, buffered);
+        LOG("Took %d buffered bytes", buffered);
+    }
+
+    int got = 0;
+    if (buffered < n && blocking) {
+        // libserialport waits without limit for 0, unlike the watchdog
+        ltf_watchdog_check(L);
+        int wait_ms = ltf_watchdog_clamp_ms(to_ms > 0 ? to_ms : -1);
+        got = sp_blocking_read(u->port, buf + buffered, n - buffered,
+                               wait_ms > 0 ? (unsigned int)wait_ms : 0);
+    } else if (buffered < n) {
+        got = sp_nonblocking_read(u->port, buf + buffered, n - buffered);
+    }
 
     if (got < 0) {
         const char *err = sp_last_error_message();
         LOG("Unable to read: %s", err);
         return luaL_error(L, err);
     }
+    if (blocking && got < n - buffered) {
+        ltf_watchdog_check(L);
+    }
+    got += buffered;
 
     LOG("Read %d bytes: %.*s", got, got, buf);
     luaL_addsize(&b, got);
@@ -581,6 +608,82 @@ int l_module_serial_read_blocking(lua_State *L) { return read_helper(L, 1); }
 
 int l_module_serial_read_nonblocking(lua_State *L) { return read_helper(L, 0); }
 
+// The scan resumes where the previous one stopped, so every received byte is
+// looked at about once however long the wait, and the thread sleeps in
+// sp_blocking_read_next() until input arrives or the deadline passes.
+int l_module_serial_read_until(lua_State *L) {
+    LOG("Invoked ltf-serial read_until...");
+    int s = selfshift(L);
+    l_module_serial_t *u = check_port(L, s);
+
+    size_t plen = 1;
+    const char *pattern = "\n";
+    lua_Integer timeout = 200;
+    lua_Integer chunk = RX_CHUNK;
+
+    if (!lua_isnoneornil(L, s + 1)) {
+        luaL_checktype(L, s + 1, LUA_TTABLE);
+
+        lua_getfield(L, s + 1, "pattern");
+        if (!lua_isnil(L, -1))
+            pattern = luaL_checklstring(L, -1, &plen);
+        lua_getfield(L, s + 1, "timeout");
+        timeout = luaL_optinteger(L, -1, timeout);
+        lua_getfield(L, s + 1, "chunk_size");
+        chunk = luaL_optinteger(L, -1, chunk);
+        // Pattern stays referenced by the options table
+        lua_pop(L, 3);
+    }
+    if (chunk <= 0)
+        chunk = RX_CHUNK;
+    if (plen == 0)
+        return luaL_error(L, "read_until: pattern must not be empty");
+
+    LOG("Pattern: '%.*s', timeout: %lld, chunk: %lld", (int)plen, pattern,
+        timeout, chunk);
+
+    uint64_t deadline =
+        monotonic_nanos() + (uint64_t)(timeout > 0 ? timeout : 0) * 1000000;
+    size_t scanned = 0;
+
+    for (;;) {
+        size_t end = byte_buf_find(&u->rx, pattern, plen, &scanned);
+        if (end) {
+            LOG("Pattern found after %zu bytes", end);
+            lua_pushboolean(L, 1);
+            lua_pushlstring(L, byte_buf_data(&u->rx), end);
+            byte_buf_consume(&u->rx, end);
+            return 2;
+        }
+
+        unsigned int left = millis_until(deadline);
+        if (left == 0)
+            break;
+        ltf_watchdog_check(L);
+
+        if (!byte_buf_reserve(&u->rx, (size_t)chunk)) {
+            LOG("Out of memory.");
+            return luaL_error(L, "ltf-serial:read_until: Out of memory");
+        }
+
+        int got = sp_blocking_read_next(u->port, byte_buf_tail(&u->rx),
+                                        (size_t)chunk,
+                                        ltf_watchdog_clamp_ms((int)left));
+        if (got < 0) {
+            const char *err = sp_last_error_message();
+            LOG("Unable to read: %s", err);
+            return luaL_error(L, err);
+        }
+        byte_buf_commit(&u->rx, (size_t)got);
+    }
+
+    LOG("Timed out with %zu bytes read", byte_buf_size(&u->rx));
+    lua_pushboolean(L, 0);
+    lua_pushlstring(L, byte_buf_data(&u->rx), byte_buf_size(&u->rx));
+    byte_buf_consume(&u->rx, byte_buf_size(&u->rx));
+    return 2;
+}
+
 /*----------- writing ------------------------------------------------*/
 static inline int write_helper(lua_State *L, int blocking) {
     LOG("Invoked ltf-serial write. Blocking: %d", blocking);
@@ -592,14 +695,25 @@ static inline int write_helper(lua_State *L, int blocking) {
     int to_ms = luaL_optinteger(L, s + 2, 0);
     LOG("Length: %zu, Buffer: '%.*s', timeout: %d", len, (int)len, buf, to_ms);
 
-    int wrote = blocking ? sp_blocking_write(u->port, buf, len, to_ms)
-                         : sp_nonblocking_write(u->port, buf, len);
+    int wrote;
+    if (blocking) {
+        // libserialport waits without limit for 0, unlike the watchdog
+        ltf_watchdog_check(L);
+        int wait_ms = ltf_watchdog_clamp_ms(to_ms > 0 ? to_ms : -1);
+        wrote = sp_blocking_write(u->port, buf, len,
+                                  wait_ms > 0 ? (unsigned int)wait_ms : 0);
+    } else {
+        wrote = sp_nonblocking_write(u->port, buf, len);
+    }
 
     if (wrote < 0) {
         const char *err = sp_last_error_message();
         LOG("Unable to write: %s", err);
         return luaL_error(L, err);
     }
+    if (blocking && (size_t)wrote < len) {
+        ltf_watchdog_check(L);
+    }
     LOG("Wrote %d bytes.", wrote);
 
     lua_pushinteger(L, wrote);
@@ -626,6 +740,8 @@ static inline int status_helper(lua_State *L, int direction) {
         LOG("Unable to get_waiting: %s", err);
         return luaL_error(L, err);
     }
+    if (direction)
+        r += (int)byte_buf_size(&u->rx);
     LOG("Waiting: %d", r);
     lua_pushinteger(L, r);
 
@@ -665,6 +781,9 @@ int l_module_serial_flush(lua_State *L) {
         return luaL_error(L, "invalid direction, use 'i', 'o' or 'io'");
     }
 
+    if (dir == SP_BUF_INPUT || dir == SP_BUF_BOTH)
+        byte_buf_consume(&u->rx, byte_buf_size(&u->rx));
+
     enum sp_return r = sp_flush(u->port, dir);
     if (r != SP_OK) {
         const char *err = sp_last_error_message();
@@ -706,6 +825,7 @@ int l_module_serial_close(lua_State *L) {
         LOG("Freeing port...");
         sp_free_port(u->port);
         u->port = NULL;
+        byte_buf_free(&u->rx);
     } else {
         LOG("Port is NULL.");
     }
@@ -730,6 +850,7 @@ static const luaL_Reg port_mt[] = {
     {"read_blocking", l_module_serial_read_blocking},
     {"read_nonblocking", l_module_serial_read_nonblocking},
     {"read", l_module_serial_read_nonblocking},
+    {"read_until", l_module_serial_read_until},
     {"set_baudrate", l_module_serial_set_baudrate},
     {"set_bits", l_module_serial_set_bits},
     {"set_cts", l_module_serial_set_cts},
@@ -4,15 +4,19 @@
 #include "modules/ssh/ltf-ssh-session.h"
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
 #include "util/da.h"
+#include "util/time.h"
 
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #define DEFAULT_CHUNK_SIZE 4096
+#define READ_UNTIL_CHUNK (32 * 1024) // max SSH packet payload
 
 l_ssh_channel_t *check_channel_udata(lua_State *L) {
     l_ssh_channel_t *u = luaL_checkudata(L, 1, SSH_CHANNEL_MT);
@@ -38,11 +42,16 @@ int l_module_ssh_channel_open_session(lua_State *L) {
     }
 
     l_ssh_channel_t *u = lua_newuserdata(L, sizeof *u);
+    u->out = (byte_buf_t)BYTE_BUF_INIT;
+    u->err = (byte_buf_t)BYTE_BUF_INIT;
+    ssh_session_begin_call(s->session);
     u->channel = libssh2_channel_open_session(s->session);
+    ssh_session_end_call(s->session);
     u->session = s;
     if (u->channel == NULL) {
         int rc = libssh2_session_last_error(u->session->session, NULL, NULL, 0);
         u->session = NULL;
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_session_last_error failed with code: %s",
                    ssh_err_to_str(rc));
 
@@ -137,9 +146,12 @@ int l_module_ssh_channel_exec(lua_State *L) {
     }
     const char *s = luaL_checkstring(L, 2);
 
+    ssh_session_begin_call(u->session->session);
     int rc = libssh2_channel_exec(u->channel, s);
+    ssh_session_end_call(u->session->session);
 
     if (rc) {
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_channel_exec() failed with code: %s",
                    ssh_err_to_str(rc));
         return 0;
@@ -153,9 +165,12 @@ int l_module_ssh_channel_shell(lua_State *L) {
     if (!u) {
         return 0;
     }
+    ssh_session_begin_call(u->session->session);
     int rc = libssh2_channel_shell(u->channel);
+    ssh_session_end_call(u->session->session);
 
     if (rc) {
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_channel_shell() failed with code: %s",
                    ssh_err_to_str(rc));
         return 0;
@@ -172,8 +187,13 @@ int l_module_ssh_channel_write(lua_State *L) {
     size_t len;
     const char *s = luaL_checklstring(L, 2, &len);
 
+    ssh_session_begin_call(u->session->session);
     int rc = libssh2_channel_write(u->channel, s, len);
+    ssh_session_end_call(u->session->session);
 
+    if (rc != (int)len) {
+        ltf_watchdog_check(L);
+    }
     if (rc < 0) {
         luaL_error(L, "libssh2_channel_write() failed with code: %s",
                    ssh_err_to_str(rc));
@@ -211,14 +231,25 @@ int l_module_ssh_channel_read_helper(lua_State *L, bool read_stderr) {
     if (len > MAX_CHUNK)
         len = MAX_CHUNK;
 
+    // Data left over by read_until() comes first
+    byte_buf_t *pending = read_stderr ? &u->err : &u->out;
+    if (byte_buf_size(pending) > 0) {
+        size_t n = byte_buf_size(pending) < len ? byte_buf_size(pending) : len;
+        lua_pushlstring(L, byte_buf_data(pending), n);
+        byte_buf_consume(pending, n);
+        return 1;
+    }
+
     char *buf = (char *)malloc(len);
     if (!buf) {
         luaL_error(L, "l_module_ssh_channel_read() failed: out of memory");
         return 0;
     }
 
+    ssh_session_begin_call(u->session->session);
     ssize_t rc = read_stderr ? libssh2_channel_read_stderr(u->channel, buf, len)
                              : libssh2_channel_read(u->channel, buf, len);
+    ssh_session_end_call(u->session->session);
 
     if (rc > 0) {
         lua_pushlstring(L, buf, (size_t)rc);
@@ -235,6 +266,7 @@ int l_module_ssh_channel_read_helper(lua_State *L, bool read_stderr) {
 
     /* rc < 0 : error code */
     free(buf);
+    ltf_watchdog_check(L);
 
     /* special case EAGAIN */
     if (rc == LIBSSH2_ERROR_EAGAIN) {
@@ -262,6 +294,89 @@ int l_module_ssh_channel_read_stderr(lua_State *L) {
     return l_module_ssh_channel_read_helper(L, true);
 }
 
+int l_module_ssh_channel_read_until(lua_State *L) {
+    l_ssh_channel_t *u = check_channel_udata(L);
+    if (!u) {
+        return 0;
+    }
+
+    size_t plen;
+    const char *pattern = luaL_optlstring(L, 2, "\n", &plen);
+    lua_Integer timeout = luaL_optinteger(L, 3, 200);
+    const char *stream = luaL_optstring(L, 4, "stdout");
+
+    bool read_stderr = strcmp(stream, "stderr") == 0;
+    if (!read_stderr && strcmp(stream, "stdout") != 0) {
+        luaL_error(L, "unknown stream '%s'", stream);
+        return 0;
+    }
+    if (plen == 0) {
+        luaL_error(L, "read_until() failed: pattern is empty");
+        return 0;
+    }
+
+    byte_buf_t *b = read_stderr ? &u->err : &u->out;
+    LIBSSH2_SESSION *session = u->session->session;
+    uint64_t deadline =
+        monotonic_nanos() + (uint64_t)(timeout > 0 ? timeout : 0) * 1000000;
+
+    // Non-blocking only for the duration of the call: the rest of the module
+    // relies on blocking libssh2 calls
+    int was_blocking = libssh2_session_get_blocking(session);
+    libssh2_session_set_blocking(session, 0);
+
+    size_t scanned = 0;
+    size_t end = 0;
+    ssize_t rc = 0;
+    for (;;) {
+        end = byte_buf_find(b, pattern, plen, &scanned);
+        if (end)
+            break;
+
+        if (!byte_buf_reserve(b, READ_UNTIL_CHUNK)) {
+            rc = LIBSSH2_ERROR_ALLOC;
+            break;
+        }
+        rc = read_stderr ? libssh2_channel_read_stderr(
+                               u->channel, byte_buf_tail(b), READ_UNTIL_CHUNK)
+                         : libssh2_channel_read(u->channel, byte_buf_tail(b),
+                                                READ_UNTIL_CHUNK);
+        if (rc > 0) {
+            byte_buf_commit(b, (size_t)rc);
+            continue;
+        }
+        if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN)
+            break;
+        if (rc == 0 && libssh2_channel_eof(u->channel) == 1)
+            break;
+
+        unsigned int left = millis_until(deadline);
+        if (left == 0 || ltf_watchdog_expired())
+            break;
+        if (ssh_wait_socket(session, u->session->sock_fd, (int)left)) {
+            rc = LIBSSH2_ERROR_SOCKET_RECV;
+            break;
+        }
+    }
+
+    libssh2_session_set_blocking(session, was_blocking);
+    if (!end) {
+        ltf_watchdog_check(L);
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        luaL_error(L, "read_until() failed with code: %s",
+                   ssh_err_to_str((int)rc));
+        return 0;
+    }
+
+    size_t len = end ? end : byte_buf_size(b);
+    lua_pushboolean(L, end != 0);
+    lua_pushlstring(L, byte_buf_data(b), len);
+    byte_buf_consume(b, len);
+    return 2;
+}
+
 int l_module_ssh_channel_close(lua_State *L) {
     l_ssh_channel_t *u = check_channel_udata(L);
     if (!u) {
@@ -276,6 +391,8 @@ int l_module_ssh_channel_close(lua_State *L) {
     }
 
     libssh2_channel_free(u->channel);
+    byte_buf_free(&u->out);
+    byte_buf_free(&u->err);
     int cleanup = 0;
     size_t size = da_size(u->session->active_channels);
     for (size_t i = 0; i < size; ++i) {
@@ -350,8 +467,11 @@ int l_module_ssh_channel_wait_eof(lua_State *L) {
         return 0;
     }
 
+    ssh_session_begin_call(u->session->session);
     int rc = libssh2_channel_wait_eof(u->channel);
+    ssh_session_end_call(u->session->session);
     if (rc) {
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_channel_send_eof failed with code: %s",
                    ssh_err_to_str(rc));
     }
@@ -373,6 +493,8 @@ int l_channel_ssh_gc(lua_State *L) {
     libssh2_channel_close(u->channel);
 
     libssh2_channel_free(u->channel);
+    byte_buf_free(&u->out);
+    byte_buf_free(&u->err);
 
     size_t size = da_size(u->session->active_channels);
     for (size_t i = 0; i < size; ++i) {
@@ -397,6 +519,7 @@ static const luaL_Reg channel_methods[] = {
     {"write", l_module_ssh_channel_write},
     {"read", l_module_ssh_channel_read},
     {"read_stderr", l_module_ssh_channel_read_stderr},
+    {"read_until", l_module_ssh_channel_read_until},
     {"request_pty", l_module_ssh_channel_request_pty},
     {"request_pty_size", l_module_ssh_channel_request_pty_size},
     {"setenv", l_module_ssh_channel_setenv},
@@ -1,13 +1,17 @@
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdatomic.h>
 #include <sys/socket.h>
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
 
 #include "modules/ssh/ltf-ssh-channel.h"
 #include "modules/ssh/ltf-ssh-lib.h"
+#include "modules/ssh/ltf-ssh-pool.h"
 #include "modules/ssh/ltf-ssh-session.h"
 #include "modules/ssh/ltf-ssh-sftp.h"
 
@@ -23,6 +27,33 @@ const char *ssh_err_to_str(int code) {
     return unknown_err_output;
 }
 
+int ssh_wait_socket(LIBSSH2_SESSION *session, libssh2_socket_t sock,
+                    int timeout_ms) {
+    int dir = libssh2_session_block_directions(session);
+
+    struct pollfd pfd = {.fd = sock};
+    if (dir & LIBSSH2_SESSION_BLOCK_INBOUND)
+        pfd.events |= POLLIN;
+    if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+        pfd.events |= POLLOUT;
+    if (!pfd.events)
+        pfd.events = POLLIN;
+
+    int rc = poll(&pfd, 1, ltf_watchdog_clamp_ms(timeout_ms));
+    if (rc < 0 && errno == EINTR)
+        return 0;
+    return rc < 0 ? -1 : 0;
+}
+
+void ssh_session_begin_call(LIBSSH2_SESSION *session) {
+    libssh2_session_set_timeout(session,
+                                ltf_watchdog_clamp_ms(SSH_SESSION_TIMEOUT_MS));
+}
+
+void ssh_session_end_call(LIBSSH2_SESSION *session) {
+    libssh2_session_set_timeout(session, SSH_SESSION_TIMEOUT_MS);
+}
+
 /******************* API ***********************/
 
 int l_module_ssh_lib_init(lua_State *L) {
@@ -45,6 +76,7 @@ int l_module_ssh_lib_exit(lua_State *) {
         return 0;
     }
 
+    ssh_pool_clear();
     libssh2_exit();
     lib_ssh_inited = false;
     return 0;
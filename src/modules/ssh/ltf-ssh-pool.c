@@ -0,0 +1,169 @@
+#include "modules/ssh/ltf-ssh-pool.h"
+
+#include "internal_logging.h"
+#include "util/da.h"
+#include "util/time.h"
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SSH_POOL_MAX_PER_KEY 4
+#define SSH_POOL_MAX_IDLE_NS (300ULL * 1000000000ULL) // 5 minutes
+
+typedef struct {
+    char *ip;
+    int port;
+    char *user;
+    char *password;
+
+    LIBSSH2_SESSION *session;
+    libssh2_socket_t sock;
+    uint64_t idle_since_ns;
+} ssh_pool_entry_t;
+
+static da_t *pool = NULL; // ssh_pool_entry_t
+static pid_t pool_owner = 0;
+
+static void entry_free(ssh_pool_entry_t *e, bool disconnect) {
+    if (disconnect) {
+        libssh2_session_disconnect(e->session, "Session pool cleared.");
+        shutdown(e->sock, SHUT_RDWR);
+    }
+    // Without a disconnect the socket is closed before the session is freed,
+    // so that nothing reaches the server
+    close(e->sock);
+    libssh2_session_free(e->session);
+    free(e->ip);
+    free(e->user);
+    free(e->password);
+}
+
+static void pool_drop_all(bool disconnect) {
+    da_foreach(pool, ssh_pool_entry_t, e) { entry_free(e, disconnect); }
+    da_clear(pool);
+}
+
+static bool pool_ready(void) {
+    if (!pool) {
+        pool = da_init(4, sizeof(ssh_pool_entry_t));
+        pool_owner = getpid();
+        return pool != NULL;
+    }
+
+    if (pool_owner != getpid()) {
+        LOG("Dropping %zu SSH sessions inherited from process %d",
+            da_size(pool), pool_owner);
+        pool_drop_all(false);
+        pool_owner = getpid();
+    }
+    return true;
+}
+
+static bool entry_matches(const ssh_pool_entry_t *e, const char *ip, int port,
+                          const char *user, const char *password) {
+    return e->port == port && strcmp(e->ip, ip) == 0 &&
+           strcmp(e->user, user) == 0 && strcmp(e->password, password) == 0;
+}
+
+static bool session_alive(LIBSSH2_SESSION *session, libssh2_socket_t sock) {
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    if (poll(&pfd, 1, 0) < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        return false;
+
+    if (pfd.revents & POLLIN) {
+        // EOF means the server closed the connection, anything else is
+        // protocol traffic (e.g. its own keepalive) left for libssh2
+        char c;
+        if (recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            return false;
+    }
+
+    int next;
+    return libssh2_keepalive_send(session, &next) == 0;
+}
+
+bool ssh_pool_checkout(const char *ip, int port, const char *user,
+                       const char *password, LIBSSH2_SESSION **session,
+                       libssh2_socket_t *sock) {
+    if (!pool_ready())
+        return false;
+
+    uint64_t now = monotonic_nanos();
+
+    // Most recently returned first: the least likely to have timed out
+    for (size_t i = da_size(pool); i-- > 0;) {
+        ssh_pool_entry_t *e = da_get(pool, i);
+        if (!entry_matches(e, ip, port, user, password))
+            continue;
+
+        ssh_pool_entry_t entry = *e;
+        da_remove(pool, i);
+
+        if (now - entry.idle_since_ns > SSH_POOL_MAX_IDLE_NS ||
+            !session_alive(entry.session, entry.sock)) {
+            LOG("Discarding stale pooled SSH session to %s:%d", ip, port);
+            entry_free(&entry, true);
+            continue;
+        }
+
+        LOG("Reusing pooled SSH session to %s@%s:%d", user, ip, port);
+        *session = entry.session;
+        *sock = entry.sock;
+        free(entry.ip);
+        free(entry.user);
+        free(entry.password);
+        return true;
+    }
+
+    return false;
+}
+
+bool ssh_pool_checkin(const char *ip, int port, const char *user,
+                      const char *password, LIBSSH2_SESSION *session,
+                      libssh2_socket_t sock) {
+    if (!pool_ready())
+        return false;
+
+    size_t same_key = 0;
+    da_foreach(pool, ssh_pool_entry_t, e) {
+        if (entry_matches(e, ip, port, user, password))
+            same_key++;
+    }
+    if (same_key >= SSH_POOL_MAX_PER_KEY)
+        return false;
+
+    if (!session_alive(session, sock))
+        return false;
+
+    ssh_pool_entry_t entry = {
+        .ip = strdup(ip),
+        .port = port,
+        .user = strdup(user),
+        .password = strdup(password),
+        .session = session,
+        .sock = sock,
+        .idle_since_ns = monotonic_nanos(),
+    };
+    if (!entry.ip || !entry.user || !entry.password ||
+        !da_append(pool, &entry)) {
+        free(entry.ip);
+        free(entry.user);
+        free(entry.password);
+        return false;
+    }
+
+    LOG("Pooled SSH session to %s@%s:%d", user, ip, port);
+    return true;
+}
+
+void ssh_pool_clear(void) {
+    if (!pool)
+        return;
+    pool_drop_all(pool_owner == getpid());
+    da_free(pool);
+    pool = NULL;
+}
@@ -3,8 +3,11 @@
 
 #include "modules/ssh/ltf-ssh-channel.h"
 #include "modules/ssh/ltf-ssh-lib.h"
+#include "modules/ssh/ltf-ssh-pool.h"
+#include "modules/ssh/ltf-ssh-sftp.h"
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
 #include "util/da.h"
 
 #include <lauxlib.h>
@@ -13,7 +16,9 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -37,7 +42,28 @@ static int ssh_socket_connect_ipv4(const char *ip_str, int port) {
         return -1;
     }
 
-    if (connect(sock, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+    // Connected without blocking, so that an unreachable host cannot hold
+    // the running test past its deadline
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(sock, (struct sockaddr *)&sin, sizeof(sin));
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+        do {
+            rc = poll(&pfd, 1, ltf_watchdog_clamp_ms(-1));
+        } while ((rc == 0 && !ltf_watchdog_expired()) ||
+                 (rc < 0 && errno == EINTR));
+
+        int err = rc < 0 ? errno : ETIMEDOUT;
+        socklen_t len = sizeof err;
+        if (rc > 0 && getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len))
+            err = errno;
+        rc = err ? -1 : 0;
+        errno = err;
+    }
+    fcntl(sock, F_SETFL, flags);
+
+    if (rc != 0) {
         int saved_errno = errno;
         close(sock);
         errno = saved_errno;
@@ -53,6 +79,7 @@ int l_module_ssh_session_init_userpass(lua_State *L) {
     int port = (int)luaL_checkinteger(L, 2);
     const char *user = luaL_checkstring(L, 3);
     const char *password = luaL_checkstring(L, 4);
+    bool pooled = lua_toboolean(L, 5);
 
     LIBSSH2_SESSION *session = NULL;
 
@@ -62,7 +89,7 @@ int l_module_ssh_session_init_userpass(lua_State *L) {
         return 0;
     }
 
-    libssh2_session_set_timeout(session, 60000);
+    libssh2_session_set_timeout(session, SSH_SESSION_TIMEOUT_MS);
 
     l_ssh_session_t *u = lua_newuserdata(L, sizeof *u);
     u->session = session;
@@ -72,8 +99,10 @@ int l_module_ssh_session_init_userpass(lua_State *L) {
     u->method = SSH_AUTH_USERPASS;
     u->userpass.user = strdup(user);
     u->userpass.password = strdup(password);
+    u->pooled = pooled;
 
     u->active_channels = da_init(1, sizeof(l_ssh_channel_t *));
+    u->active_sftp = da_init(1, sizeof(l_sftp_session_t *));
     luaL_getmetatable(L, SSH_SESSION_MT);
     lua_setmetatable(L, -2);
 
@@ -97,15 +126,32 @@ int l_module_ssh_session_connect(lua_State *L) {
         return 0;
     }
 
+    if (u->pooled && u->method == SSH_AUTH_USERPASS) {
+        LIBSSH2_SESSION *pooled_session;
+        libssh2_socket_t pooled_sock;
+        if (ssh_pool_checkout(u->ip, u->port, u->userpass.user,
+                              u->userpass.password, &pooled_session,
+                              &pooled_sock)) {
+            libssh2_session_free(u->session);
+            u->session = pooled_session;
+            u->sock_fd = pooled_sock;
+            return 0;
+        }
+    }
+
     int sock_fd = ssh_socket_connect_ipv4(u->ip, u->port);
     if (sock_fd < 0) {
+        ltf_watchdog_check(L);
         luaL_error(L, "ssh_socket_connect_ipv4 failed: %d", sock_fd);
         return 0;
     }
     u->sock_fd = sock_fd;
 
+    ssh_session_begin_call(u->session);
     int rc = libssh2_session_handshake(u->session, u->sock_fd);
     if (rc) {
+        ssh_session_end_call(u->session);
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_session_handshake failed with code: %s",
                    ssh_err_to_str(rc));
         return 0;
@@ -117,16 +163,23 @@ int l_module_ssh_session_connect(lua_State *L) {
                                        u->userpass.password);
         break;
     default:
+        ssh_session_end_call(u->session);
         luaL_error(L, "Unknown SSH auth method %d", u->method);
         return 0;
     }
+    ssh_session_end_call(u->session);
 
     if (rc) {
+        ltf_watchdog_check(L);
         luaL_error(L, "libssh2_userauth failed with code: %s",
                    ssh_err_to_str(rc));
         return 0;
     }
 
+    if (u->pooled) {
+        libssh2_keepalive_config(u->session, 1, SSH_POOL_KEEPALIVE_INTERVAL);
+    }
+
     return 0;
 }
 
@@ -195,6 +248,23 @@ int l_module_ssh_session_close(lua_State *L) {
     }
 
     da_free(u->active_channels);
+    u->active_channels = NULL;
+
+    // A pooled session must not be handed out with an SFTP subsystem of this
+    // one still open on it
+    if (u->active_sftp) {
+        ssh_sftp_shutdown_all(u);
+        da_free(u->active_sftp);
+        u->active_sftp = NULL;
+    }
+
+    if (u->pooled && u->sock_fd != -1 && u->method == SSH_AUTH_USERPASS &&
+        ssh_pool_checkin(u->ip, u->port, u->userpass.user,
+                         u->userpass.password, u->session, u->sock_fd)) {
+        // Owned by the pool now
+        u->session = NULL;
+        u->sock_fd = -1;
+    }
 
     if (u->sock_fd != -1) {
         int res = l_module_ssh_session_disconnect(L);
@@ -203,7 +273,7 @@ int l_module_ssh_session_close(lua_State *L) {
         }
     }
 
-    int rc = libssh2_session_free(u->session);
+    int rc = u->session ? libssh2_session_free(u->session) : 0;
     if (rc) {
         lua_pushfstring(L, "libssh2_session_free failed with code: %s",
                         ssh_err_to_str(rc));
@@ -4,15 +4,60 @@
 #include "modules/ssh/ltf-ssh-session.h"
 
 #include "internal_logging.h"
+#include "ltf_watchdog.h"
+#include "util/da.h"
+#include "util/time.h"
 
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define DEFAULT_CHUNK_SIZE 4096
 
+#define TRANSFER_DEFAULT_WINDOW (1024 * 1024)
+#define TRANSFER_MIN_WINDOW (32 * 1024)
+#define TRANSFER_MAX_WINDOW (64 * 1024 * 1024)
+#define TRANSFER_PROGRESS_INTERVAL_NS (100 * 1000000ULL) // 10 Hz
+
+static void sftp_untrack(l_sftp_session_t *u) {
+    if (!u->owner)
+        return;
+
+    size_t size = da_size(u->owner->active_sftp);
+    for (size_t i = 0; i < size; ++i) {
+        l_sftp_session_t **val = da_get(u->owner->active_sftp, i);
+        if (*val == u) {
+            da_remove(u->owner->active_sftp, i);
+            break;
+        }
+    }
+    u->owner = NULL;
+}
+
+void ssh_sftp_shutdown_all(l_ssh_session_t *s) {
+    size_t size = da_size(s->active_sftp);
+    for (size_t i = 0; i < size; ++i) {
+        l_sftp_session_t **val = da_get(s->active_sftp, i);
+        l_sftp_session_t *u = *val;
+        if (u->sftp_handle)
+            libssh2_sftp_close(u->sftp_handle);
+        libssh2_sftp_shutdown(u->sftp_session);
+        u->sftp_handle = NULL;
+        u->sftp_session = NULL;
+        u->session = NULL;
+        u->owner = NULL;
+    }
+    da_clear(s->active_sftp);
+}
+
 int l_module_ssh_sftp_init(lua_State *L) {
     l_ssh_session_t *s = luaL_checkudata(L, 1, SSH_SESSION_MT);
     if (!s->session) {
@@ -25,11 +70,21 @@ int l_module_ssh_sftp_init(lua_State *L) {
     u->sftp_session = libssh2_sftp_init(s->session);
     u->sftp_handle = NULL;
     u->session = s->session;
+    u->sock_fd = s->sock_fd;
+    u->owner = NULL;
     if (u->sftp_session == NULL) {
         u->session = NULL;
         luaL_error(L, "libssh2_sftp_init failed");
         return 0;
     }
+    if (!da_append(s->active_sftp, &u)) {
+        libssh2_sftp_shutdown(u->sftp_session);
+        u->sftp_session = NULL;
+        u->session = NULL;
+        luaL_error(L, "Out of memory");
+        return 0;
+    }
+    u->owner = s;
     luaL_getmetatable(L, SFTP_SESSION_MT);
     lua_setmetatable(L, -2);
     return 1;
@@ -218,6 +273,7 @@ int l_module_ssh_sftp_shutdown(lua_State *L) {
         return 0;
     }
     libssh2_sftp_shutdown(u->sftp_session);
+    sftp_untrack(u);
 
     u->sftp_session = NULL;
     u->session = NULL;
@@ -225,6 +281,340 @@ int l_module_ssh_sftp_shutdown(lua_State *L) {
     return 0;
 }
 
+/*----------- pipelined transfers -------------------------------------*/
+
+// libssh2 splits a large sftp read/write into many SFTP requests and keeps
+// them all in flight, so the size of the buffer handed to it is the request
+// window. Non-blocking mode lets an upload read the next window from disk
+// while the server acknowledges the current one.
+
+typedef struct {
+    lua_State *L;
+    l_sftp_session_t *u;
+
+    unsigned long flags;
+    long permissions;
+    size_t window;
+    int progress_idx; // 0 if no callback
+
+    uint64_t total;
+    uint64_t done;
+    uint64_t next_progress_ns;
+
+    int stall_ms; // session timeout, -1 if none
+    uint64_t last_activity_ns;
+
+    char error[256];
+    bool lua_error; // error object raised by the callback is on the stack
+} sftp_transfer_t;
+
+static void transfer_opts(sftp_transfer_t *t, int idx) {
+    lua_State *L = t->L;
+
+    t->flags = LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC;
+    t->permissions = 0644;
+    t->window = TRANSFER_DEFAULT_WINDOW;
+
+    if (lua_isnoneornil(L, idx))
+        return;
+    luaL_checktype(L, idx, LUA_TTABLE);
+
+    lua_getfield(L, idx, "flags");
+    t->flags = (unsigned long)luaL_optinteger(L, -1, (lua_Integer)t->flags);
+    lua_getfield(L, idx, "permissions");
+    t->permissions = (long)luaL_optinteger(L, -1, t->permissions);
+    lua_getfield(L, idx, "window");
+    lua_Integer window = luaL_optinteger(L, -1, (lua_Integer)t->window);
+    lua_pop(L, 3);
+
+    if (window < TRANSFER_MIN_WINDOW)
+        window = TRANSFER_MIN_WINDOW;
+    if (window > TRANSFER_MAX_WINDOW)
+        window = TRANSFER_MAX_WINDOW;
+    t->window = (size_t)window;
+
+    lua_getfield(L, idx, "progress");
+    if (lua_isfunction(L, -1)) {
+        t->progress_idx = lua_gettop(L);
+    } else {
+        lua_pop(L, 1);
+    }
+}
+
+// Call the progress callback at most every TRANSFER_PROGRESS_INTERVAL_NS,
+// unless 'force'. Returns false if the callback raised an error.
+static bool transfer_progress(sftp_transfer_t *t, bool force) {
+    if (!t->progress_idx)
+        return true;
+
+    uint64_t now = monotonic_nanos();
+    if (!force && now < t->next_progress_ns)
+        return true;
+    t->next_progress_ns = now + TRANSFER_PROGRESS_INTERVAL_NS;
+
+    lua_pushvalue(t->L, t->progress_idx);
+    lua_pushinteger(t->L, (lua_Integer)t->done);
+    lua_pushinteger(t->L, (lua_Integer)t->total);
+    if (lua_pcall(t->L, 2, 0, 0) != LUA_OK) {
+        t->lua_error = true;
+        return false;
+    }
+    return true;
+}
+
+static void transfer_advance(sftp_transfer_t *t, size_t n) {
+    t->done += n;
+    t->last_activity_ns = monotonic_nanos();
+}
+
+// Wait for the server, failing when nothing moved for the session timeout
+static bool transfer_wait(sftp_transfer_t *t) {
+    if (ltf_watchdog_expired()) {
+        snprintf(t->error, sizeof t->error, "test timed out");
+        return false;
+    }
+
+    int left = -1;
+    if (t->stall_ms >= 0) {
+        left = (int)millis_until(t->last_activity_ns +
+                                 (uint64_t)t->stall_ms * 1000000);
+        if (left == 0) {
+            snprintf(t->error, sizeof t->error,
+                     "transfer stalled for %d ms", t->stall_ms);
+            return false;
+        }
+    }
+
+    if (ssh_wait_socket(t->u->session, t->u->sock_fd, left)) {
+        snprintf(t->error, sizeof t->error, "poll() failed: %s",
+                 strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void transfer_sftp_error(sftp_transfer_t *t, const char *what,
+                                ssize_t rc) {
+    if (rc == LIBSSH2_ERROR_SFTP_PROTOCOL) {
+        snprintf(t->error, sizeof t->error, "%s failed with SFTP status %lu",
+                 what, libssh2_sftp_last_error(t->u->sftp_session));
+    } else {
+        snprintf(t->error, sizeof t->error, "%s failed with code: %s", what,
+                 ssh_err_to_str((int)rc));
+    }
+}
+
+// Returns the amount read, less than 'len' only at EOF, -1 on error
+static ssize_t read_file(int fd, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
+
+static int write_file(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static bool transfer_upload(sftp_transfer_t *t, int fd,
+                            LIBSSH2_SFTP_HANDLE *handle) {
+    char *cur = malloc(t->window);
+    char *next = malloc(t->window);
+    bool ok = cur && next;
+    if (!ok)
+        snprintf(t->error, sizeof t->error, "out of memory");
+
+    ssize_t cur_len = ok ? read_file(fd, cur, t->window) : 0;
+    while (ok && cur_len > 0) {
+        ssize_t next_len = 0;
+        bool next_ready = false;
+
+        size_t off = 0;
+        while (ok && off < (size_t)cur_len) {
+            ssize_t rc = libssh2_sftp_write(handle, cur + off,
+                                            (size_t)cur_len - off);
+            if (rc > 0) {
+                off += (size_t)rc;
+                transfer_advance(t, (size_t)rc);
+                ok = transfer_progress(t, false);
+            } else if (rc != LIBSSH2_ERROR_EAGAIN) {
+                transfer_sftp_error(t, "libssh2_sftp_write()", rc);
+                ok = false;
+            } else if (!next_ready) {
+                // Server is busy with this window: fetch the next one
+                next_len = read_file(fd, next, t->window);
+                next_ready = true;
+            } else {
+                ok = transfer_wait(t);
+            }
+        }
+
+        if (!next_ready)
+            next_len = read_file(fd, next, t->window);
+
+        char *tmp = cur;
+        cur = next;
+        next = tmp;
+        cur_len = next_len;
+    }
+
+    if (ok && cur_len < 0) {
+        snprintf(t->error, sizeof t->error, "read() failed: %s",
+                 strerror(errno));
+        ok = false;
+    }
+
+    free(cur);
+    free(next);
+    return ok;
+}
+
+static bool transfer_download(sftp_transfer_t *t, int fd,
+                              LIBSSH2_SFTP_HANDLE *handle) {
+    char *buf = malloc(t->window);
+    if (!buf) {
+        snprintf(t->error, sizeof t->error, "out of memory");
+        return false;
+    }
+
+    bool ok = true;
+    for (;;) {
+        ssize_t rc = libssh2_sftp_read(handle, buf, t->window);
+        if (rc == 0)
+            break;
+        if (rc > 0) {
+            if (write_file(fd, buf, (size_t)rc)) {
+                snprintf(t->error, sizeof t->error, "write() failed: %s",
+                         strerror(errno));
+                ok = false;
+                break;
+            }
+            transfer_advance(t, (size_t)rc);
+            if (!(ok = transfer_progress(t, false)))
+                break;
+        } else if (rc != LIBSSH2_ERROR_EAGAIN) {
+            transfer_sftp_error(t, "libssh2_sftp_read()", rc);
+            ok = false;
+            break;
+        } else if (!(ok = transfer_wait(t))) {
+            break;
+        }
+    }
+
+    free(buf);
+    return ok;
+}
+
+static int transfer(lua_State *L, bool upload) {
+    l_sftp_session_t *u = luaL_checkudata(L, 1, SFTP_SESSION_MT);
+    if (!u->sftp_session || !u->session) {
+        luaL_error(L, "sftp_session not initialized");
+        return 0;
+    }
+
+    const char *remote = luaL_checkstring(L, upload ? 3 : 2);
+    const char *local = luaL_checkstring(L, upload ? 2 : 3);
+
+    sftp_transfer_t t = {.L = L, .u = u};
+    transfer_opts(&t, 4);
+
+    int fd = upload ? open(local, O_RDONLY | O_CLOEXEC)
+                    : open(local, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                           (mode_t)t.permissions);
+    if (fd < 0) {
+        luaL_error(L, "Unable to open '%s': %s", local, strerror(errno));
+        return 0;
+    }
+
+    LIBSSH2_SFTP_HANDLE *handle = libssh2_sftp_open_ex(
+        u->sftp_session, remote, (unsigned int)strlen(remote),
+        upload ? t.flags : LIBSSH2_FXF_READ, upload ? t.permissions : 0,
+        LIBSSH2_SFTP_OPENFILE);
+    if (!handle) {
+        close(fd);
+        unsigned long fx = libssh2_sftp_last_error(u->sftp_session);
+        luaL_error(L, "Unable to open remote '%s': SFTP status %lu", remote,
+                   fx);
+        return 0;
+    }
+
+    if (upload) {
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+            t.total = (uint64_t)st.st_size;
+    } else {
+        LIBSSH2_SFTP_ATTRIBUTES a = {0};
+        if (libssh2_sftp_fstat(handle, &a) == 0 &&
+            (a.flags & LIBSSH2_SFTP_ATTR_SIZE))
+            t.total = a.filesize;
+    }
+
+    long timeout = libssh2_session_get_timeout(u->session);
+    t.stall_ms = timeout > 0 ? (int)timeout : -1;
+    t.last_activity_ns = monotonic_nanos();
+
+    LOG("SFTP %s '%s' -> '%s', %llu bytes, window %zu",
+        upload ? "upload" : "download", upload ? local : remote,
+        upload ? remote : local, (unsigned long long)t.total, t.window);
+
+    int was_blocking = libssh2_session_get_blocking(u->session);
+    libssh2_session_set_blocking(u->session, 0);
+
+    bool ok = upload ? transfer_upload(&t, fd, handle)
+                     : transfer_download(&t, fd, handle);
+
+    libssh2_session_set_blocking(u->session, was_blocking);
+
+    int rc = libssh2_sftp_close(handle);
+    if (ok && rc) {
+        transfer_sftp_error(&t, "libssh2_sftp_close()", rc);
+        ok = false;
+    }
+    if (close(fd) && ok) {
+        snprintf(t.error, sizeof t.error, "close() failed: %s",
+                 strerror(errno));
+        ok = false;
+    }
+
+    if (ok)
+        ok = transfer_progress(&t, true);
+
+    if (!ok) {
+        if (t.lua_error)
+            return lua_error(L);
+        ltf_watchdog_check(L);
+        luaL_error(L, "SFTP %s of '%s' failed: %s",
+                   upload ? "upload" : "download", upload ? local : remote,
+                   t.error);
+        return 0;
+    }
+
+    LOG("SFTP transfer done, %llu bytes", (unsigned long long)t.done);
+    lua_pushinteger(L, (lua_Integer)t.done);
+    return 1;
+}
+
+int l_module_ssh_sftp_upload(lua_State *L) { return transfer(L, true); }
+
+int l_module_ssh_sftp_download(lua_State *L) { return transfer(L, false); }
+
 static void normalize_abs_path_inplace(char *s) {
     if (!s || s[0] != '/')
         return;
@@ -536,8 +926,10 @@ int l_module_ssh_sftp_resolve_symlink(lua_State *L) {
 int l_sftp_session_gc(lua_State *L) {
     l_sftp_session_t *u = luaL_checkudata(L, 1, SFTP_SESSION_MT);
     if (u && u->sftp_session) {
-        libssh2_sftp_close(u->sftp_handle);
+        if (u->sftp_handle)
+            libssh2_sftp_close(u->sftp_handle);
         libssh2_sftp_shutdown(u->sftp_session);
+        sftp_untrack(u);
         u->sftp_session = NULL;
         u->sftp_handle = NULL;
         u->session = NULL;
@@ -549,6 +941,8 @@ static const luaL_Reg sftp_methods[] = {
     {"open", l_module_ssh_sftp_open},
     {"write", l_module_ssh_sftp_write},
     {"read", l_module_ssh_sftp_read},
+    {"upload", l_module_ssh_sftp_upload},
+    {"download", l_module_ssh_sftp_download},
     {"file_info", l_module_ssh_sftp_file_info},
     {"resolve_symlink", l_module_ssh_sftp_resolve_symlink},
     {"close", l_module_ssh_sftp_close},
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,22 @@
 #include <unibilium.h>
 #include <unistd.h>
 
+/* Attributes of a UI cell; fg/bg -1 means terminal default */
+typedef struct {
+    signed char fg;
+    signed char bg;
+    unsigned char ul;
+} pico_attr_t;
+
+/* One UI cell: a single UTF-8 glyph (no wide glyph handling) */
+typedef struct {
+    char glyph[4];
+    unsigned char glyph_len;
+    pico_attr_t attr;
+} pico_cell_t;
+
+static const pico_attr_t default_attr = {.fg = -1, .bg = -1, .ul = 0};
+
 struct pico_t {
     int ui_rows;
     term_size_t sz;
@@ -42,6 +59,19 @@ struct pico_t {
     const char *cap_smul; /* enter_underline_mode */
     const char *cap_rmul; /* exit_underline_mode */
 
+    /* UI region back-buffer (drawn into by pico_ui_*) and front-buffer (what
+       the terminal currently shows). pico_present() emits only the cells that
+       differ between the two. */
+    pico_cell_t *back;
+    pico_cell_t *front;
+    int buf_rows;
+    int buf_cols;
+    int front_valid; /* 0: terminal content unknown, repaint everything */
+
+    pico_attr_t pen;  /* attributes for subsequent prints */
+    pico_attr_t term; /* attributes currently active in the terminal */
+    int term_known;   /* 0/1 */
+
     volatile sig_atomic_t resized;
 };
 
@@ -56,8 +86,18 @@ static void handle_resize_if_needed(pico_t *ui) {
 
 static pico_t *g_ui_singleton = NULL;
 
-/* ---------- low-level write ---------- */
-static void write_str(const char *s, size_t n) {
+/* ---------- low-level write ----------
+   Everything is accumulated in a single output buffer and handed to the
+   terminal with one write() per frame (pico_flush/pico_present). */
+#define OUT_FLUSH_THRESHOLD (64 * 1024)
+
+static struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} g_out = {0};
+
+static void write_fd(const char *s, size_t n) {
     while (n) {
         ssize_t w = write(STDOUT_FILENO, s, n);
         if (w > 0) {
@@ -69,6 +109,35 @@ static void write_str(const char *s, size_t n) {
             break;
     }
 }
+
+static void out_flush(void) {
+    if (g_out.len == 0)
+        return;
+    write_fd(g_out.data, g_out.len);
+    g_out.len = 0;
+}
+
+static void write_str(const char *s, size_t n) {
+    if (g_out.len + n > g_out.cap) {
+        size_t cap = g_out.cap ? g_out.cap : 4096;
+        while (cap < g_out.len + n)
+            cap *= 2;
+        char *data = realloc(g_out.data, cap);
+        if (!data) {
+            /* Out of memory: keep the ordering and write through */
+            out_flush();
+            write_fd(s, n);
+            return;
+        }
+        g_out.data = data;
+        g_out.cap = cap;
+    }
+    memcpy(g_out.data + g_out.len, s, n);
+    g_out.len += n;
+
+    if (g_out.len >= OUT_FLUSH_THRESHOLD)
+        out_flush();
+}
 static void write_cstr(const char *s) { write_str(s, strlen(s)); }
 
 /* FIX: Never reuse a va_list after it was consumed. Take a copy for sizing,
@@ -202,43 +271,80 @@ static void emit_el(pico_t *ui) {
 /* ---------- colors (16-color fg/bg) ---------- */
 static int clamp16(int v) { return v < 0 ? -1 : (v > 15 ? 15 : v); }
 
-int pico_set_colors(pico_t *ui, int fg16, int bg16) {
-    fg16 = clamp16(fg16);
-    bg16 = clamp16(bg16);
-
-    /* Try terminfo seltf/setab (expects color index) */
-    if (fg16 >= 0) {
-        if (ui->cap_seltf)
-            emit_unibi_fmt1(ui->cap_seltf, fg16);
-        else {
-            /* ANSI fallback: map 0..7 -> 30..37, 8..15 -> 90..97 */
-            int code = (fg16 < 8 ? 30 + fg16 : 90 + (fg16 - 8));
-            char b[16];
-            int n = snprintf(b, sizeof(b), "\x1b[%dm", code);
-            write_str(b, (size_t)n);
-        }
+static void emit_fg(pico_t *ui, int fg16) {
+    /* Try terminfo seltf (expects color index) */
+    if (ui->cap_seltf) {
+        emit_unibi_fmt1(ui->cap_seltf, fg16);
+        return;
     }
-    if (bg16 >= 0) {
-        if (ui->cap_setab)
-            emit_unibi_fmt1(ui->cap_setab, bg16);
-        else {
-            /* ANSI fallback: map 0..7 -> 40..47, 8..15 -> 100..107 */
-            int code = (bg16 < 8 ? 40 + bg16 : 100 + (bg16 - 8));
-            char b[16];
-            int n = snprintf(b, sizeof(b), "\x1b[%dm", code);
-            write_str(b, (size_t)n);
-        }
+    /* ANSI fallback: map 0..7 -> 30..37, 8..15 -> 90..97 */
+    int code = (fg16 < 8 ? 30 + fg16 : 90 + (fg16 - 8));
+    char b[16];
+    int n = snprintf(b, sizeof(b), "\x1b[%dm", code);
+    write_str(b, (size_t)n);
+}
+
+static void emit_bg(pico_t *ui, int bg16) {
+    /* Try terminfo setab (expects color index) */
+    if (ui->cap_setab) {
+        emit_unibi_fmt1(ui->cap_setab, bg16);
+        return;
     }
-    return 0;
+    /* ANSI fallback: map 0..7 -> 40..47, 8..15 -> 100..107 */
+    int code = (bg16 < 8 ? 40 + bg16 : 100 + (bg16 - 8));
+    char b[16];
+    int n = snprintf(b, sizeof(b), "\x1b[%dm", code);
+    write_str(b, (size_t)n);
 }
 
-void pico_reset_colors(pico_t *ui) {
+static void emit_sgr0(pico_t *ui) {
     if (ui->cap_sgr0)
         write_cstr(ui->cap_sgr0);
     else
         write_cstr("\x1b[0m");
 }
 
+static bool attr_eq(pico_attr_t a, pico_attr_t b) {
+    return a.fg == b.fg && a.bg == b.bg && a.ul == b.ul;
+}
+
+/* Bring the terminal to 'attr', emitting nothing if it is already there */
+static void emit_attrs(pico_t *ui, pico_attr_t attr) {
+    if (ui->term_known && attr_eq(ui->term, attr))
+        return;
+
+    emit_sgr0(ui);
+    if (attr.fg >= 0)
+        emit_fg(ui, attr.fg);
+    if (attr.bg >= 0)
+        emit_bg(ui, attr.bg);
+    if (attr.ul) {
+        /* Prefer terminfo; fallback to SGR 4 */
+        if (ui->cap_smul)
+            write_cstr(ui->cap_smul);
+        else
+            write_cstr("\x1b[4m");
+    }
+
+    ui->term = attr;
+    ui->term_known = 1;
+}
+
+/* Colors only change the pen; they reach the terminal together with the
+   text that uses them, so redundant color changes cost nothing. */
+int pico_set_colors(pico_t *ui, int fg16, int bg16) {
+    fg16 = clamp16(fg16);
+    bg16 = clamp16(bg16);
+
+    if (fg16 >= 0)
+        ui->pen.fg = (signed char)fg16;
+    if (bg16 >= 0)
+        ui->pen.bg = (signed char)bg16;
+    return 0;
+}
+
+void pico_reset_colors(pico_t *ui) { ui->pen = default_attr; }
+
 /* ---------- core ops ---------- */
 static void set_scroll_region(pico_t *ui, int top0, int bot0) {
     emit_csr(ui, top0, bot0);
@@ -255,16 +361,6 @@ static void move_to_bottom_scroll_line(pico_t *ui) {
     emit_cup(ui, row, 0);
 }
 
-static void clear_ui_region(pico_t *ui) {
-    int start = ui->sz.rows - ui->ui_rows;
-    if (start < 0)
-        start = 0;
-    for (int i = 0; i < ui->ui_rows; ++i) {
-        emit_cup(ui, start + i, 0);
-        emit_el(ui);
-    }
-}
-
 /* ------------ UI cursor math (track our own Y/X; don't use save/restore) ---
  */
 
@@ -295,82 +391,153 @@ static int advance_col_text(int start_col, const char *s, int term_cols) {
     return col;
 }
 
-static void ui_move_abs(pico_t *ui, int rel_row, int col) {
-    int base = ui->sz.rows - ui->ui_rows;
-    if (base < 0)
-        base = 0;
-    int r = base + rel_row;
-    if (r < 0)
-        r = 0;
-    if (r >= ui->sz.rows)
-        r = ui->sz.rows - 1;
-    if (col < 0)
-        col = 0;
-    emit_cup(ui, r, col);
+/* ------------ UI back-buffer ----------------------------------------------
+ */
+
+static pico_cell_t blank_cell(pico_attr_t attr) {
+    return (pico_cell_t){.glyph = {' '}, .glyph_len = 1, .attr = attr};
 }
 
-/* ------------ Public UI API (YX and append variants) -----------------------
- */
+static bool cell_eq(const pico_cell_t *a, const pico_cell_t *b) {
+    return a->glyph_len == b->glyph_len &&
+           memcmp(a->glyph, b->glyph, a->glyph_len) == 0 &&
+           attr_eq(a->attr, b->attr);
+}
 
-void pico_ui_puts_yx(pico_t *ui, int rel_row, int col, const char *s) {
-    handle_resize_if_needed(ui); /* FIX: handle resize here too */
-    if (!s)
+static bool cell_is_blank(const pico_cell_t *c) {
+    return c->glyph_len == 1 && c->glyph[0] == ' ' &&
+           attr_eq(c->attr, default_attr);
+}
+
+static void clear_cells(pico_cell_t *cells, size_t n) {
+    pico_cell_t blank = blank_cell(default_attr);
+    for (size_t i = 0; i < n; ++i)
+        cells[i] = blank;
+}
+
+/* (Re)allocate buffers for the current UI size. A new size means we no
+   longer know what the terminal shows, so the next present repaints all. */
+static void ensure_buffers(pico_t *ui) {
+    int rows = ui->ui_rows;
+    int cols = ui->sz.cols;
+    if (ui->back && rows == ui->buf_rows && cols == ui->buf_cols)
         return;
+
+    size_t n = (size_t)rows * (size_t)cols;
+    pico_cell_t *back = malloc(n * sizeof(*back));
+    pico_cell_t *front = malloc(n * sizeof(*front));
+    if (!back || !front) {
+        free(back);
+        free(front);
+        return;
+    }
+
+    free(ui->back);
+    free(ui->front);
+    ui->back = back;
+    ui->front = front;
+    ui->buf_rows = rows;
+    ui->buf_cols = cols;
+    clear_cells(ui->back, n);
+    ui->front_valid = 0;
+}
+
+/* Draw text into the back-buffer with the current pen. Continuation bytes of
+   UTF-8 sequences are attached to the preceding glyph, control characters
+   are dropped and text past the right edge is clipped.
+   Returns the column following the text. */
+static int ui_put_text(pico_t *ui, int rel_row, int col, const char *s) {
     if (rel_row < 0)
         rel_row = 0;
     if (col < 0)
         col = 0;
+    if (!ui->back || rel_row >= ui->buf_rows)
+        return col;
 
-    ui_move_abs(ui, rel_row, col);
-    write_cstr(s);
+    int cols = ui->buf_cols;
+    pico_cell_t *line = ui->back + (size_t)rel_row * (size_t)cols;
+    pico_cell_t *last = NULL;
 
-    /* Update our tracked UI cursor */
-    ui->ui_anchor_set = 1;
-    ui->ui_cur_row = rel_row;
-    ui->ui_cur_col = advance_col_text(col, s, ui->sz.cols);
-}
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        unsigned char ch = *p;
+        if ((ch & 0xC0) == 0x80) {
+            if (last && last->glyph_len < sizeof(last->glyph))
+                last->glyph[last->glyph_len++] = (char)ch;
+            continue;
+        }
+        last = NULL;
+        if (ch == '\t') {
+            int next = ((col / 8) + 1) * 8;
+            while (col < next && col < cols)
+                line[col++] = blank_cell(ui->pen);
+            continue;
+        }
+        if (ch < 0x20 || ch == 0x7f || col >= cols)
+            continue;
 
-void pico_ui_printf_yx(pico_t *ui, int rel_row, int col, const char *fmt, ...) {
-    handle_resize_if_needed(ui);
-    if (rel_row < 0)
-        rel_row = 0;
-    if (col < 0)
-        col = 0;
+        last = &line[col++];
+        last->glyph[0] = (char)ch;
+        last->glyph_len = 1;
+        last->attr = ui->pen;
+    }
 
-    /* Format to stack or heap to compute new col */
+    return col < cols ? col : cols - 1;
+}
+
+/* printf into the back-buffer at (rel_row, col); returns the next column */
+static int ui_vprintf(pico_t *ui, int rel_row, int col, const char *fmt,
+                      va_list ap) {
     char stack[1024];
     va_list ap1;
-    va_start(ap1, fmt);
+    va_copy(ap1, ap);
     int n = vsnprintf(stack, sizeof(stack), fmt, ap1);
     va_end(ap1);
 
-    if (n >= 0 && (size_t)n < sizeof(stack)) {
-        ui_move_abs(ui, rel_row, col);
-        write_str(stack, (size_t)n);
-        ui->ui_anchor_set = 1;
-        ui->ui_cur_row = rel_row;
-        ui->ui_cur_col = advance_col_text(col, stack, ui->sz.cols);
-        return;
-    }
+    if (n >= 0 && (size_t)n < sizeof(stack))
+        return ui_put_text(ui, rel_row, col, stack);
 
     size_t need = (n > 0 ? (size_t)n + 1 : 4096);
     char *buf = malloc(need);
     if (!buf)
-        return;
+        return col;
 
     va_list ap2;
-    va_start(ap2, fmt);
+    va_copy(ap2, ap);
     vsnprintf(buf, need, fmt, ap2);
     va_end(ap2);
 
-    ui_move_abs(ui, rel_row, col);
-    write_cstr(buf);
+    col = ui_put_text(ui, rel_row, col, buf);
+    free(buf);
+    return col;
+}
+
+/* ------------ Public UI API (YX and append variants) -----------------------
+ */
+
+void pico_ui_puts_yx(pico_t *ui, int rel_row, int col, const char *s) {
+    handle_resize_if_needed(ui);
+    if (!s)
+        return;
+    if (rel_row < 0)
+        rel_row = 0;
 
+    /* Update our tracked UI cursor */
     ui->ui_anchor_set = 1;
     ui->ui_cur_row = rel_row;
-    ui->ui_cur_col = advance_col_text(col, buf, ui->sz.cols);
+    ui->ui_cur_col = ui_put_text(ui, rel_row, col, s);
+}
 
-    free(buf);
+void pico_ui_printf_yx(pico_t *ui, int rel_row, int col, const char *fmt, ...) {
+    handle_resize_if_needed(ui);
+    if (rel_row < 0)
+        rel_row = 0;
+
+    va_list ap;
+    va_start(ap, fmt);
+    ui->ui_anchor_set = 1;
+    ui->ui_cur_row = rel_row;
+    ui->ui_cur_col = ui_vprintf(ui, rel_row, col, fmt, ap);
+    va_end(ap);
 }
 
 /* Ensure we have a starting UI anchor; default to (0,0) in the UI region. */
@@ -387,67 +554,100 @@ void pico_ui_puts(pico_t *ui, const char *s) {
     if (!s || !*s)
         return;
     ensure_ui_anchor(ui);
-    ui_move_abs(ui, ui->ui_cur_row, ui->ui_cur_col);
-    write_cstr(s);
-    ui->ui_cur_col = advance_col_text(ui->ui_cur_col, s, ui->sz.cols);
+    ui->ui_cur_col = ui_put_text(ui, ui->ui_cur_row, ui->ui_cur_col, s);
 }
 
 void pico_ui_printf(pico_t *ui, const char *fmt, ...) {
     handle_resize_if_needed(ui);
     ensure_ui_anchor(ui);
 
-    char stack[1024];
-    va_list ap1;
-    va_start(ap1, fmt);
-    int n = vsnprintf(stack, sizeof(stack), fmt, ap1);
-    va_end(ap1);
-
-    if (n >= 0 && (size_t)n < sizeof(stack)) {
-        ui_move_abs(ui, ui->ui_cur_row, ui->ui_cur_col);
-        write_str(stack, (size_t)n);
-        ui->ui_cur_col = advance_col_text(ui->ui_cur_col, stack, ui->sz.cols);
-        return;
-    }
-
-    size_t need = (n > 0 ? (size_t)n + 1 : 4096);
-    char *buf = malloc(need);
-    if (!buf)
-        return;
-
-    va_list ap2;
-    va_start(ap2, fmt);
-    vsnprintf(buf, need, fmt, ap2);
-    va_end(ap2);
-
-    ui_move_abs(ui, ui->ui_cur_row, ui->ui_cur_col);
-    write_cstr(buf);
-    ui->ui_cur_col = advance_col_text(ui->ui_cur_col, buf, ui->sz.cols);
-
-    free(buf);
+    va_list ap;
+    va_start(ap, fmt);
+    ui->ui_cur_col = ui_vprintf(ui, ui->ui_cur_row, ui->ui_cur_col, fmt, ap);
+    va_end(ap);
 }
 
 void pico_ui_clear_line(pico_t *ui, int rel_row) {
     handle_resize_if_needed(ui);
-    int base = ui->sz.rows - ui->ui_rows;
-    if (base < 0)
-        base = 0;
-    int r = base + (rel_row < 0 ? 0 : rel_row);
-    if (r >= ui->sz.rows)
+    if (rel_row < 0)
+        rel_row = 0;
+    if (!ui->back || rel_row >= ui->buf_rows)
         return;
-    emit_cup(ui, r, 0);
-    emit_el(ui);
+    clear_cells(ui->back + (size_t)rel_row * (size_t)ui->buf_cols,
+                (size_t)ui->buf_cols);
     /* Reset UI cursor to start of that line */
     ui->ui_anchor_set = 1;
-    ui->ui_cur_row = (rel_row < 0 ? 0 : rel_row);
+    ui->ui_cur_row = rel_row;
     ui->ui_cur_col = 0;
 }
 
+void pico_flush(pico_t *ui) {
+    (void)ui;
+    out_flush();
+}
+
+void pico_present(pico_t *ui) {
+    handle_resize_if_needed(ui);
+
+    if (ui->back) {
+        int base = ui->sz.rows - ui->ui_rows;
+        if (base < 0)
+            base = 0;
+        int cols = ui->buf_cols;
+        int cur_row = -1; /* where the terminal cursor is, -1 if unknown */
+        int cur_col = -1;
+
+        for (int r = 0; r < ui->buf_rows; ++r) {
+            const pico_cell_t *b = ui->back + (size_t)r * (size_t)cols;
+            const pico_cell_t *f = ui->front + (size_t)r * (size_t)cols;
+
+            /* Trailing blanks are cleared with a single EL */
+            int end = cols;
+            while (end > 0 && cell_is_blank(&b[end - 1]))
+                --end;
+
+            for (int c = 0; c < end; ++c) {
+                if (ui->front_valid && cell_eq(&b[c], &f[c]))
+                    continue;
+                if (cur_row != r || cur_col != c)
+                    emit_cup(ui, base + r, c);
+                emit_attrs(ui, b[c].attr);
+                write_str(b[c].glyph, b[c].glyph_len);
+                cur_row = r;
+                /* Writing the last column leaves a pending wrap */
+                cur_col = (c + 1 < cols) ? c + 1 : -1;
+            }
+
+            bool tail_dirty = !ui->front_valid;
+            for (int c = end; !tail_dirty && c < cols; ++c)
+                tail_dirty = !cell_eq(&b[c], &f[c]);
+
+            if (tail_dirty && end < cols) {
+                if (cur_row != r || cur_col != end)
+                    emit_cup(ui, base + r, end);
+                emit_attrs(ui, default_attr);
+                emit_el(ui);
+                cur_row = r;
+                cur_col = end;
+            }
+        }
+
+        memcpy(ui->front, ui->back,
+               (size_t)ui->buf_rows * (size_t)cols * sizeof(*ui->front));
+        ui->front_valid = 1;
+    }
+
+    out_flush();
+}
+
 void pico_redraw_ui(pico_t *ui) {
-    clear_ui_region(ui);
+    if (ui->back)
+        clear_cells(ui->back, (size_t)ui->buf_rows * (size_t)ui->buf_cols);
     if (ui->render)
         ui->render(ui, ui->render_ud);
     /* We don't know where you want to continue -> reset UI anchor */
     ui->ui_anchor_set = 0;
+    pico_present(ui);
 }
 
 /* Re-query size, clamp ui_rows, re-apply region, redraw. */
@@ -462,8 +662,14 @@ static void reprogram_region_and_redraw(pico_t *ui) {
     if (bot < 0)
         bot = 0;
     set_scroll_region(ui, 0, bot);
+
+    /* The terminal may have reflowed the UI region: repaint every cell */
+    ensure_buffers(ui);
+    ui->front_valid = 0;
+    ui->term_known = 0;
     pico_redraw_ui(ui);
     move_to_bottom_scroll_line(ui);
+    out_flush();
 
     ui->stream_anchor_set = 0;
     ui->ui_anchor_set = 0;
@@ -494,6 +700,8 @@ pico_t *pico_init(int ui_rows, pico_render_fn render, void *userdata) {
         ui->cap_rmul = unibi_get_str(ui->ut, unibi_exit_underline_mode);
     }
     ui->sz = get_term_size();
+    ui->pen = default_attr;
+    ensure_buffers(ui);
 
     g_ui_singleton = ui;
     struct sigaction sa = {0};
@@ -517,6 +725,7 @@ void pico_attach(pico_t *ui) {
         bot = 0;
     set_scroll_region(ui, 0, bot);
     move_to_bottom_scroll_line(ui);
+    out_flush();
 
     ui->stream_anchor_set = 0;
     ui->ui_anchor_set = 0;
@@ -564,21 +773,24 @@ static void ensure_stream_anchor(pico_t *ui) {
         ui->stream_cur_col = 0;
     }
 }
+/* Position the cursor in the stream area and apply the pen. Stream output
+   stays buffered until the next pico_flush()/pico_present(). */
+static void stream_move(pico_t *ui, int col) {
+    emit_cup(ui, stream_bottom_row(ui), col);
+    emit_attrs(ui, ui->pen);
+}
+
 void pico_print(pico_t *ui, const char *text) {
     handle_resize_if_needed(ui);
     ensure_stream_anchor(ui);
 
-    int row = stream_bottom_row(ui);
-    emit_cup(ui, row, ui->stream_cur_col);
+    stream_move(ui, ui->stream_cur_col);
 
     if (text && *text) {
         write_cstr(text);
         ui->stream_cur_col =
             advance_col_text(ui->stream_cur_col, text, ui->sz.cols);
     }
-
-    if (ui->render)
-        ui->render(ui, ui->render_ud);
 }
 void pico_printf(pico_t *ui, const char *fmt, ...) {
     handle_resize_if_needed(ui);
@@ -590,25 +802,19 @@ void pico_printf(pico_t *ui, const char *fmt, ...) {
     int n = vsnprintf(stack, sizeof(stack), fmt, ap1);
     va_end(ap1);
 
-    int row = stream_bottom_row(ui);
-    emit_cup(ui, row, ui->stream_cur_col);
+    stream_move(ui, ui->stream_cur_col);
 
     if (n >= 0 && (size_t)n < sizeof(stack)) {
         write_str(stack, (size_t)n);
         ui->stream_cur_col =
             advance_col_text(ui->stream_cur_col, stack, ui->sz.cols);
-        if (ui->render)
-            ui->render(ui, ui->render_ud);
         return;
     }
 
     size_t need = (n > 0 ? (size_t)n + 1 : 4096);
     char *buf = malloc(need);
-    if (!buf) {
-        if (ui->render)
-            ui->render(ui, ui->render_ud);
+    if (!buf)
         return;
-    }
 
     va_list ap2;
     va_start(ap2, fmt);
@@ -618,32 +824,24 @@ void pico_printf(pico_t *ui, const char *fmt, ...) {
     write_cstr(buf);
     ui->stream_cur_col = advance_col_text(ui->stream_cur_col, buf, ui->sz.cols);
     free(buf);
-
-    if (ui->render)
-        ui->render(ui, ui->render_ud);
 }
 
 void pico_println(pico_t *ui, const char *line) {
     handle_resize_if_needed(ui);
 
-    int row = stream_bottom_row(ui);
-    emit_cup(ui, row, 0);
+    stream_move(ui, 0);
     if (line && *line)
         write_cstr(line);
     write_cstr("\r\n");
 
     /* newline scrolls; next print should re-anchor at column 0 */
     ui->stream_anchor_set = 0;
-
-    if (ui->render)
-        ui->render(ui, ui->render_ud);
 }
 
 void pico_printfln(pico_t *ui, const char *fmt, ...) {
     handle_resize_if_needed(ui);
 
-    int row = stream_bottom_row(ui);
-    emit_cup(ui, row, 0);
+    stream_move(ui, 0);
 
     va_list ap;
     va_start(ap, fmt);
@@ -652,9 +850,6 @@ void pico_printfln(pico_t *ui, const char *fmt, ...) {
     write_cstr("\r\n");
 
     ui->stream_anchor_set = 0;
-
-    if (ui->render)
-        ui->render(ui, ui->render_ud);
 }
 void pico_print_block(pico_t *ui, const char *block) {
     if (!block)
@@ -663,8 +858,7 @@ void pico_print_block(pico_t *ui, const char *block) {
     handle_resize_if_needed(ui);
     ensure_stream_anchor(ui);
 
-    int row = stream_bottom_row(ui);
-    emit_cup(ui, row, ui->stream_cur_col);
+    stream_move(ui, ui->stream_cur_col);
 
     /* Write whole block as-is */
     write_cstr(block);
@@ -683,34 +877,16 @@ void pico_print_block(pico_t *ui, const char *block) {
         ui->stream_anchor_set = 1;
     }
 
-    if (ui->render)
-        ui->render(ui, ui->render_ud);
-
     pico_println(ui, "");
 }
 
-void pico_underline_on(pico_t *ui) {
-    (void)ui;
-    /* Prefer terminfo; fallback to SGR 4 */
-    if (ui && ui->cap_smul) {
-        write_cstr(ui->cap_smul);
-    } else {
-        write_cstr("\x1b[4m"); /* underline on */
-    }
-}
+void pico_underline_on(pico_t *ui) { ui->pen.ul = 1; }
 
-void pico_underline_off(pico_t *ui) {
-    (void)ui;
-    /* Prefer terminfo; fallback to SGR 24 (underline off) */
-    if (ui && ui->cap_rmul) {
-        write_cstr(ui->cap_rmul);
-    } else {
-        write_cstr("\x1b[24m"); /* underline off */
-    }
-}
+void pico_underline_off(pico_t *ui) { ui->pen.ul = 0; }
 
 void pico_remove_cursor() {
     write_cstr("\033[?25l"); // Turn off cursor
+    out_flush();
 }
 
 void pico_restore_cursor() {
@@ -722,8 +898,11 @@ void pico_restore_cursor() {
 void pico_shutdown(pico_t *ui) {
     if (!ui)
         return;
+    emit_sgr0(ui);
+    ui->term_known = 0;
     reset_scroll_region(ui);
     emit_cup(ui, ui->sz.rows - 1, 0);
+    out_flush();
 }
 
 void pico_free(pico_t *ui) {
@@ -733,7 +912,14 @@ void pico_free(pico_t *ui) {
         g_ui_singleton = NULL;
     if (ui->ut)
         unibi_destroy(ui->ut);
+    free(ui->back);
+    free(ui->front);
     free(ui);
+
+    free(g_out.data);
+    g_out.data = NULL;
+    g_out.len = 0;
+    g_out.cap = 0;
 }
 
 /* getters */
@@ -745,11 +931,9 @@ int pico_cols(const pico_t *ui) { return ui->sz.cols; }
    self-pipe/flag and exit from your main loop instead. */
 static void on_sigint(int sig) {
     (void)sig;
-    if (g_ui_singleton) {
+    if (g_ui_singleton)
         pico_shutdown(g_ui_singleton);
-        pico_reset_colors(g_ui_singleton);
-    }
-    write_cstr("\n");
+    write_fd("\n", 1);
     _exit(130); /* conventional Ctrl-C exit code */
 }
 
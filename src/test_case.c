@@ -2,15 +2,20 @@
 
 #include "cmd_parser.h"
 #include "internal_logging.h"
+#include "ltf_test_index.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 static da_t *tests = NULL;
 
+static char *loading_file = NULL;
+static da_t *only_names = NULL;
+
 static void test_case_free(lua_State *L, test_case_t *tc) {
     free((char *)tc->name);
     free((char *)tc->desc);
+    free((char *)tc->file);
     size_t tags_amount = da_size(tc->tags);
     for (size_t i = 0; i < tags_amount; i++) {
         char **tag = da_get(tc->tags, i);
@@ -20,34 +25,80 @@ static void test_case_free(lua_State *L, test_case_t *tc) {
     luaL_unref(L, LUA_REGISTRYINDEX, tc->ref);
 }
 
+void test_case_set_loading_file(const char *file) {
+    free(loading_file);
+    loading_file = file ? strdup(file) : NULL;
+}
+
+void test_case_set_only(da_t *names) { only_names = names; }
+
+static bool test_case_is_selected(const char *name) {
+    if (!only_names)
+        return true;
+
+    size_t names_count = da_size(only_names);
+    for (size_t i = 0; i < names_count; i++) {
+        char **selected = da_get(only_names, i);
+        if (!strcmp(*selected, name))
+            return true;
+    }
+    return false;
+}
+
+static bool test_case_has_wanted_tag(da_t *tags) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    size_t opts_tags_amount = da_size(opts->tags);
+    size_t test_tags_amount = da_size(tags);
+    if (opts_tags_amount == 0)
+        return true;
+
+    for (size_t i = 0; i < opts_tags_amount; i++) {
+        for (size_t j = 0; j < test_tags_amount; j++) {
+            char **opts_tag = da_get(opts->tags, i);
+            char **test_tag = da_get(tags, j);
+            if (strcmp(*opts_tag, *test_tag) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool test_case_is_wanted(const char *name, da_t *tags) {
+    if (!test_case_is_selected(name) || !test_case_has_wanted_tag(tags))
+        return false;
+
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    if (!opts->scenario_parsed || da_size(opts->scenario.order) == 0)
+        return true;
+
+    da_foreach(opts->scenario.order, char *, ordered) {
+        if (!strcmp(*ordered, name))
+            return true;
+    }
+    return false;
+}
+
 int test_case_enqueue(lua_State *L, test_case_t *tc) {
     if (!tc) {
         LOG("Test case is NULL");
         return -1;
     }
-    cmd_test_options *opts = cmd_parser_get_test_options();
-    size_t opts_tags_amount = da_size(opts->tags);
-    size_t test_tags_amount = da_size(tc->tags);
-    if (opts_tags_amount > 0) {
-        bool has_tag = false;
-        for (size_t i = 0; i < opts_tags_amount; i++) {
-            for (size_t j = 0; j < test_tags_amount; j++) {
-                char **opts_tag = da_get(opts->tags, i);
-                char **test_tag = da_get(tc->tags, j);
-                if (strcmp(*opts_tag, *test_tag) == 0) {
-                    has_tag = true;
-                    break;
-                }
-            }
-            if (has_tag)
-                break;
-        }
-        if (!has_tag) {
-            LOG("Skipping test '%s' registration, no tag found.", tc->name);
-            test_case_free(L, tc);
-            free(tc);
-            return 1;
-        }
+    // Every registration is indexed, whether this run wants it or not
+    ltf_test_index_record(tc->name, tc->tags);
+    if (!test_case_is_selected(tc->name)) {
+        LOG("Skipping test '%s' registration, not selected.", tc->name);
+        test_case_free(L, tc);
+        free(tc);
+        return 1;
+    }
+    if (!tc->file && loading_file) {
+        tc->file = strdup(loading_file);
+    }
+    if (!test_case_has_wanted_tag(tc->tags)) {
+        LOG("Skipping test '%s' registration, no tag found.", tc->name);
+        test_case_free(L, tc);
+        free(tc);
+        return 1;
     }
     if (!tests) {
         tests = da_init(3, sizeof(test_case_t));
@@ -62,6 +113,8 @@ int test_case_enqueue(lua_State *L, test_case_t *tc) {
             registered->desc = tc->desc;
             registered->ref = tc->ref;
             registered->tags = tc->tags;
+            registered->file = tc->file;
+            registered->timeout = tc->timeout;
             free(tc);
             return 0;
         }
@@ -101,8 +154,30 @@ void test_case_order_tests() {
 
 da_t *test_case_get_all() { return tests; }
 
+void test_case_retain(lua_State *L, const bool *keep) {
+    if (!tests)
+        return;
+
+    size_t kept = 0;
+    size_t tests_count = da_size(tests);
+    for (size_t i = 0; i < tests_count; i++) {
+        test_case_t *tc = da_get(tests, i);
+        if (!keep[i]) {
+            test_case_free(L, tc);
+            continue;
+        }
+        if (kept != i)
+            da_set(tests, kept, tc);
+        kept++;
+    }
+    if (kept < tests_count)
+        da_remove_range(tests, kept, tests_count - kept);
+}
+
 void test_case_free_all(lua_State *L) {
     LOG("Freeing test cases...");
+    test_case_set_loading_file(NULL);
+    only_names = NULL;
     if (!tests) {
         LOG("Tests are null.");
         return;
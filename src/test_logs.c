@@ -2,6 +2,7 @@
 
 #include "cmd_parser.h"
 #include "internal_logging.h"
+#include "ltf_hooks.h"
 #include "ltf_state.h"
 #include "project_parser.h"
 
@@ -10,12 +11,19 @@
 
 #include <json.h>
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 static ltf_log_level log_level;
 
 static FILE *output_log_file;
+static FILE *raw_log_file;
+static size_t raw_log_tests_written = 0;
+// Index of the latest test written to the raw log, SIZE_MAX if none, see
+// ltf_log_test_completed()
+static size_t unreleased_test = SIZE_MAX;
 
 static char *logs_dir;
 static char *output_log_file_path;
@@ -103,19 +111,95 @@ void ltf_log_defer_failed(ltf_state_test_t *test,
     LOG("Wrote to output log file");
 }
 
-void ltf_log_test_run_finished() {
+/*
+ * The raw log is streamed while the tests run instead of being serialized
+ * from the whole state at the end:
+ *
+ *   {"project_name":...,"tags":[...],"tests":[
+ *   {...first test...}
+ *   ,{...second test...}
+ *   ],"finished":...,"total_amount":...}
+ *
+ * Every test is written (and its outputs released) as soon as it completes,
+ * so a finished run gives the usual single JSON object and an interrupted
+ * one can still be read by ltf_state_from_file().
+ */
+static void raw_log_write_object(json_object *obj, size_t skip_head,
+                                 const char *head, size_t skip_tail,
+                                 const char *tail) {
+    size_t len = 0;
+    const char *str = json_object_to_json_string_length(
+        obj, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &len);
+
+    if (len < skip_head + skip_tail) {
+        skip_head = 0;
+        skip_tail = 0;
+    }
+
+    fputs(head, raw_log_file);
+    fwrite(str + skip_head, 1, len - skip_head - skip_tail, raw_log_file);
+    fputs(tail, raw_log_file);
+    fflush(raw_log_file);
+}
 
-    json_object *ltf_state_root = ltf_state_to_json(ltf_state);
+void ltf_log_test_run_started() {
+
+    raw_log_file = fopen(raw_log_file_path, "w");
+    if (!raw_log_file) {
+        LOG("Unable to create raw log file.");
+        return;
+    }
+    raw_log_tests_written = 0;
+    unreleased_test = SIZE_MAX;
+
+    json_object *header = ltf_state_header_to_json(ltf_state);
+    bool empty = json_object_object_length(header) == 0;
+    // Keep the object open: '{...}' -> '{...,"tests":['
+    raw_log_write_object(header, 0, "", 1, empty ? "\"tests\":[\n"
+                                                 : ",\"tests\":[\n");
+    json_object_put(header);
+    LOG("Wrote raw log header.");
+}
+
+void ltf_log_test_completed(ltf_state_test_t *test) {
+
+    if (raw_log_file) {
+        // Streamed so that outputs spilled to disk are never all paged back
+        // into memory at once
+        if (raw_log_tests_written)
+            fputc(',', raw_log_file);
+        ltf_state_test_write_json(test, raw_log_file);
+        fputc('\n', raw_log_file);
+        fflush(raw_log_file);
+        raw_log_tests_written++;
+        LOG("Wrote test '%s' to raw log file.", test->name);
+    }
+
+    // Everything the raw log needs is on disk now. The outputs of the latest
+    // test are only released once the next one completed, so that the test
+    // run finished hooks still get them in their context.test.
+    size_t tests_count = da_size(ltf_state->tests);
+    if (unreleased_test < tests_count)
+        ltf_state_test_release_outputs(ltf_state,
+                                       da_get(ltf_state->tests, unreleased_test));
+    unreleased_test = SIZE_MAX;
+    if (tests_count && da_get(ltf_state->tests, tests_count - 1) == test)
+        unreleased_test = tests_count - 1;
+    else
+        ltf_state_test_release_outputs(ltf_state, test);
+}
+
+void ltf_log_test_run_finished() {
 
-    LOG("Saving raw log file...");
-    if (json_object_to_file_ext(raw_log_file_path, ltf_state_root,
-                                JSON_C_TO_STRING_SPACED |
-                                    JSON_C_TO_STRING_PRETTY |
-                                    JSON_C_TO_STRING_NOSLASHESCAPE) == -1) {
-        LOG("Unable to save raw log file: %s", json_util_get_last_err());
+    if (raw_log_file) {
+        LOG("Finalizing raw log file...");
+        json_object *footer = ltf_state_footer_to_json(ltf_state);
+        // Close the tests array and the root object: '{...}' -> '],...}'
+        raw_log_write_object(footer, 1, "],", 0, "\n");
+        json_object_put(footer);
+        fclose(raw_log_file);
+        raw_log_file = NULL;
     }
-    LOG("Freeing JSON object...");
-    json_object_put(ltf_state_root);
 
     char *latest_log = NULL;
     char *latest_raw = NULL;
@@ -219,6 +303,8 @@ void ltf_log_init(ltf_state_t *state) {
     ltf_state_register_test_teardown_finished_cb(state,
                                                  ltf_log_defer_queue_finished);
     ltf_state_register_test_defer_failed_cb(state, ltf_log_defer_failed);
+    ltf_state_register_test_completed_cb(state, ltf_log_test_completed);
+    ltf_state_register_test_run_started_cb(state, ltf_log_test_run_started);
     ltf_state_register_test_run_finished_cb(state, ltf_log_test_run_finished);
     ltf_hooks_register_hook_log_cb(ltf_log_hook);
 
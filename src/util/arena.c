@@ -0,0 +1,95 @@
+#include "util/arena.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (16 * 1024)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+} arena_block_t;
+
+struct arena_t {
+    arena_block_t *blocks; // current block first
+    size_t block_size;
+    size_t used;
+};
+
+static arena_block_t *arena_block_new(size_t size) {
+    arena_block_t *block = malloc(sizeof *block + size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+arena_t *arena_init(size_t block_size) {
+    arena_t *arena = calloc(1, sizeof *arena);
+    if (!arena)
+        return NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    return arena;
+}
+
+void arena_free(arena_t *arena) {
+    if (!arena)
+        return;
+    arena_block_t *block = arena->blocks;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    const size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    if (size == 0)
+        size = align;
+
+    arena_block_t *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        // Oversized requests get a block of their own, behind the current
+        // one so that its free space is not wasted
+        bool oversized = size > arena->block_size;
+        arena_block_t *fresh =
+            arena_block_new(oversized ? size : arena->block_size);
+        if (!fresh)
+            return NULL;
+        if (oversized && block) {
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next = block;
+            arena->blocks = fresh;
+        }
+        block = fresh;
+    }
+
+    void *p = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len) {
+    char *out = arena_alloc(arena, len + 1);
+    if (!out)
+        return NULL;
+    memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
+
+size_t arena_used(const arena_t *arena) { return arena ? arena->used : 0; }
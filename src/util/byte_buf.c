@@ -0,0 +1,81 @@
+#include "util/byte_buf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTE_BUF_MIN_CAP 4096
+
+size_t byte_buf_size(const byte_buf_t *b) { return b->len - b->start; }
+
+const char *byte_buf_data(const byte_buf_t *b) {
+    return b->data ? b->data + b->start : "";
+}
+
+bool byte_buf_reserve(byte_buf_t *b, size_t extra) {
+    if (b->len + extra <= b->cap)
+        return true;
+
+    if (b->start > 0) {
+        memmove(b->data, b->data + b->start, b->len - b->start);
+        b->len -= b->start;
+        b->start = 0;
+        if (b->len + extra <= b->cap)
+            return true;
+    }
+
+    size_t cap = b->cap ? b->cap : BYTE_BUF_MIN_CAP;
+    while (cap < b->len + extra)
+        cap *= 2;
+    char *data = realloc(b->data, cap);
+    if (!data)
+        return false;
+    b->data = data;
+    b->cap = cap;
+    return true;
+}
+
+char *byte_buf_tail(byte_buf_t *b) { return b->data + b->len; }
+
+void byte_buf_commit(byte_buf_t *b, size_t n) { b->len += n; }
+
+bool byte_buf_append(byte_buf_t *b, const void *data, size_t n) {
+    if (!byte_buf_reserve(b, n))
+        return false;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    return true;
+}
+
+void byte_buf_consume(byte_buf_t *b, size_t n) {
+    size_t size = byte_buf_size(b);
+    b->start += n < size ? n : size;
+    if (b->start == b->len)
+        b->start = b->len = 0;
+}
+
+void byte_buf_truncate(byte_buf_t *b, size_t n) {
+    if (n < byte_buf_size(b))
+        b->len = b->start + n;
+}
+
+void byte_buf_free(byte_buf_t *b) {
+    free(b->data);
+    *b = (byte_buf_t)BYTE_BUF_INIT;
+}
+
+size_t byte_buf_find(const byte_buf_t *b, const char *pat, size_t pat_len,
+                     size_t *scanned) {
+    size_t size = byte_buf_size(b);
+    if (size < pat_len)
+        return 0;
+    if (pat_len == 0)
+        return 0;
+
+    const char *base = byte_buf_data(b);
+    const char *hit = memmem(base + *scanned, size - *scanned, pat, pat_len);
+    if (hit)
+        return (size_t)(hit - base) + pat_len;
+
+    *scanned = size - pat_len + 1;
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include "util/bytecode_cache.h"
+
+#include "internal_logging.h"
+
+#include "util/byte_buf.h"
+#include "util/files.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif // __APPLE__
+
+#define CACHE_MAGIC "LTFB"
+#define CACHE_VERSION 1
+
+// Entry file: header, source path, bytecode
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint32_t path_len;
+    uint32_t reserved;
+} cache_header_t;
+
+static char *cache_dir = NULL;
+static size_t cache_hits = 0;
+static size_t cache_misses = 0;
+
+int bytecode_cache_init(const char *dir) {
+    bytecode_cache_free();
+
+    if (!directory_exists(dir) && create_directory(dir, MKDIR_MODE)) {
+        LOG("Unable to create bytecode cache directory %s", dir);
+        return -1;
+    }
+    cache_dir = strdup(dir);
+    if (!cache_dir)
+        return -1;
+
+    LOG("Bytecode cache directory: %s", cache_dir);
+    return 0;
+}
+
+void bytecode_cache_free(void) {
+    if (cache_dir) {
+        LOG("Bytecode cache: %zu hits, %zu misses", cache_hits, cache_misses);
+    }
+    free(cache_dir);
+    cache_dir = NULL;
+    cache_hits = 0;
+    cache_misses = 0;
+}
+
+// Entries are named after a hash of the source path, the path itself is
+// stored in the entry to tell collisions apart
+static char *entry_path(const char *path) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (const char *p = path; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+
+    char *entry = NULL;
+    if (asprintf(&entry, "%s/%016llx.luac", cache_dir, (unsigned long long)h) <
+        0)
+        return NULL;
+    return entry;
+}
+
+static void header_init(cache_header_t *hdr, const char *path,
+                        const struct stat *st) {
+    memset(hdr, 0, sizeof *hdr);
+    memcpy(hdr->magic, CACHE_MAGIC, sizeof hdr->magic);
+    hdr->version = CACHE_VERSION;
+    hdr->mtime_sec = (int64_t)st->st_mtime;
+    hdr->mtime_nsec = (int64_t)STAT_MTIME_NSEC(*st);
+    hdr->size = (int64_t)st->st_size;
+    hdr->path_len = (uint32_t)strlen(path);
+}
+
+static char *read_entry(const char *entry, size_t *len) {
+    int fd = open(entry, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = malloc((size_t)st.st_size);
+
+    size_t got = 0;
+    while (data && got < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + got, (size_t)st.st_size - got);
+        if (n <= 0) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+
+    *len = got;
+    return data;
+}
+
+// Push the chunk of a valid entry. Returns LUA_OK, anything else means the
+// entry cannot be used and nothing was pushed.
+static int load_entry(lua_State *L, const char *entry, const char *path,
+                      const struct stat *st) {
+    size_t len;
+    char *data = read_entry(entry, &len);
+    if (!data)
+        return LUA_ERRFILE;
+
+    cache_header_t expected;
+    header_init(&expected, path, st);
+
+    int rc = LUA_ERRFILE;
+    size_t off = sizeof expected + expected.path_len;
+    if (len > off && memcmp(data, &expected, sizeof expected) == 0 &&
+        memcmp(data + sizeof expected, path, expected.path_len) == 0) {
+        // The chunk name is only used by errors of lua_load() itself, the
+        // dump keeps "@path" as the source for debug info
+        lua_pushfstring(L, "@%s", path);
+        rc = luaL_loadbufferx(L, data + off, len - off, lua_tostring(L, -1),
+                              "b");
+        lua_remove(L, -2);
+        if (rc != LUA_OK) {
+            LOG("Unable to load cached bytecode of %s: %s", path,
+                lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+
+    free(data);
+    return rc;
+}
+
+static int dump_writer(lua_State *, const void *p, size_t sz, void *ud) {
+    return byte_buf_append(ud, p, sz) ? 0 : 1;
+}
+
+// Store the chunk on the top of the stack. Written to a temporary file and
+// renamed, so concurrent runs never see a partial entry.
+static void store_entry(lua_State *L, const char *entry, const char *path,
+                        const struct stat *st) {
+    cache_header_t hdr;
+    header_init(&hdr, path, st);
+
+    byte_buf_t out = BYTE_BUF_INIT;
+    if (!byte_buf_append(&out, &hdr, sizeof hdr) ||
+        !byte_buf_append(&out, path, hdr.path_len) ||
+        lua_dump(L, dump_writer, &out, 0) != 0) {
+        LOG("Unable to dump bytecode of %s", path);
+        byte_buf_free(&out);
+        return;
+    }
+
+    char *tmp = NULL;
+    if (asprintf(&tmp, "%s.%ld.tmp", entry, (long)getpid()) < 0) {
+        byte_buf_free(&out);
+        return;
+    }
+
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f && fwrite(byte_buf_data(&out), 1, byte_buf_size(&out), f) ==
+                       byte_buf_size(&out);
+    if (f && fclose(f) != 0)
+        ok = false;
+
+    if (ok && rename(tmp, entry) == 0) {
+        LOG("Cached bytecode of %s", path);
+    } else {
+        LOG("Unable to write bytecode cache entry %s", entry);
+        unlink(tmp);
+    }
+
+    free(tmp);
+    byte_buf_free(&out);
+}
+
+int bytecode_cache_loadfile(lua_State *L, const char *path) {
+    struct stat st;
+    if (!cache_dir || stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        return luaL_loadfile(L, path);
+
+    char *entry = entry_path(path);
+    if (!entry)
+        return luaL_loadfile(L, path);
+
+    if (load_entry(L, entry, path, &st) == LUA_OK) {
+        cache_hits++;
+        free(entry);
+        return LUA_OK;
+    }
+
+    cache_misses++;
+    int rc = luaL_loadfile(L, path);
+    if (rc == LUA_OK)
+        store_entry(L, entry, path, &st);
+
+    free(entry);
+    return rc;
+}
+
+// Runs before the Lua file searcher of package.searchers and finds the same
+// files. Modules it does not find are left to the remaining searchers.
+static int cache_searcher(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getfield(L, lua_upvalueindex(1), "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, lua_upvalueindex(1), "path");
+    if (!lua_isstring(L, -1))
+        return 0;
+    lua_call(L, 2, 1);
+    if (!lua_isstring(L, -1))
+        return 0;
+    const char *filename = lua_tostring(L, -1);
+
+    if (bytecode_cache_loadfile(L, filename) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                          name, filename, lua_tostring(L, -1));
+    }
+    lua_insert(L, -2); // loader, filename
+    return 2;
+}
+
+void bytecode_cache_install_searcher(lua_State *L) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 2);
+        return;
+    }
+
+    // package.searchers[2] is the Lua file searcher, shift it and the rest
+    lua_Integer n = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = n; i >= 2; --i) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, cache_searcher, 1);
+    lua_rawseti(L, -2, 2);
+
+    lua_pop(L, 2);
+}
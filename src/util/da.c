@@ -148,6 +148,19 @@ bool da_remove(da_t *da, size_t index) {
     return true;
 }
 
+bool da_remove_range(da_t *da, size_t index, size_t count) {
+    if (!da || index > da->size || count > da->size - index)
+        return false;
+    size_t tail = da->size - index - count;
+    if (tail) {
+        memmove((char *)da->data + index * da->elem_size,
+                (char *)da->data + (index + count) * da->elem_size,
+                tail * da->elem_size);
+    }
+    da->size -= count;
+    return true;
+}
+
 size_t da_capacity(const da_t *da) {
     //
     return da ? da->capacity : 0;
@@ -1,42 +1,303 @@
 #include "util/line_cache.h"
 
-#include <stdio.h>
+#include "internal_logging.h"
+#include "util/time.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif // __APPLE__
+
+#define LINE_CACHE_MIN_BUCKETS 64
+
+// How often a cached file is compared with the one on disk. A stat() for
+// every executed line would cost more than the lookup it saves.
+#define LINE_CACHE_CHECK_NS 100000000ULL
+
+typedef struct line_cache_entry {
+    char *path;
+    uint64_t hash;
+
+    char *data; // copy of the file, NULL if empty or unreadable
+    size_t size;
+
+    size_t *offsets; // start of every line, plus 'size' as a sentinel
+    size_t lines_count;
+
+    // The file as it was read, all 0 if it was not
+    dev_t dev;
+    ino_t ino;
+    off_t st_size;
+    int64_t mtime_sec;
+    long mtime_nsec;
+    uint64_t checked_ns;
+
+    struct line_cache_entry *next; // bucket chain
+} line_cache_entry_t;
+
+static line_cache_entry_t **buckets = NULL;
+static size_t buckets_count = 0; // power of two
+static size_t entries_count = 0;
+
+// Last hit: the line hook asks for the same file many times in a row
+static line_cache_entry_t *last_entry = NULL;
+
+static uint64_t path_hash(const char *path) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; ++p) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// The file is copied rather than mmap'd: reading a mapping of a file that
+// was truncated since raises SIGBUS, and test files may well be edited
+// while a run is going on
+static void entry_read(line_cache_entry_t *e) {
+    int fd = open(e->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return;
+    }
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->st_size = st.st_size;
+    e->mtime_sec = (int64_t)st.st_mtime;
+    e->mtime_nsec = (long)STAT_MTIME_NSEC(st);
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    // Shorter than stat() said if it was truncated in between
+    char *data = malloc((size_t)st.st_size);
+    size_t size = 0;
+    while (data && size < (size_t)st.st_size) {
+        ssize_t n = pread(fd, data + size, (size_t)st.st_size - size,
+                          (off_t)size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        size += (size_t)n;
+    }
+    close(fd);
+    if (!data || size == 0) {
+        LOG("Unable to read '%s' for the line cache.", e->path);
+        free(data);
+        return;
+    }
+
+    e->data = data;
+    e->size = size;
+
+    size_t cap = 128;
+    e->offsets = malloc(sizeof(size_t) * cap);
+    if (!e->offsets) {
+        free(data);
+        e->data = NULL;
+        e->size = 0;
+        return;
+    }
+
+    size_t pos = 0;
+    while (pos < e->size) {
+        if (e->lines_count + 1 >= cap) {
+            cap *= 2;
+            size_t *grown = realloc(e->offsets, sizeof(size_t) * cap);
+            if (!grown)
+                break;
+            e->offsets = grown;
+        }
+        e->offsets[e->lines_count++] = pos;
+
+        const char *nl = memchr(e->data + pos, '\n', e->size - pos);
+        pos = nl ? (size_t)(nl - e->data) + 1 : e->size;
+    }
+    e->offsets[e->lines_count] = pos;
+}
+
+static void entry_release(line_cache_entry_t *e) {
+    free(e->data);
+    free(e->offsets);
+    e->data = NULL;
+    e->size = 0;
+    e->offsets = NULL;
+    e->lines_count = 0;
+}
 
-static line_cache_t *cache_head = NULL;
+// Whether the file changed on disk since it was read
+static bool entry_stale(line_cache_entry_t *e) {
+    uint64_t now = monotonic_nanos();
+    if (now - e->checked_ns < LINE_CACHE_CHECK_NS)
+        return false;
+    e->checked_ns = now;
 
-char *get_line_text(const char *path, int lineno) {
+    struct stat st;
+    if (stat(e->path, &st))
+        return e->ino != 0; // removed since
+    return st.st_dev != e->dev || st.st_ino != e->ino ||
+           st.st_size != e->st_size || (int64_t)st.st_mtime != e->mtime_sec ||
+           (long)STAT_MTIME_NSEC(st) != e->mtime_nsec;
+}
+
+static void entry_free(line_cache_entry_t *e) {
+    entry_release(e);
+    free(e->path);
+    free(e);
+}
+
+static void buckets_grow(void) {
+    size_t new_count =
+        buckets_count ? buckets_count * 2 : LINE_CACHE_MIN_BUCKETS;
+    line_cache_entry_t **grown = calloc(new_count, sizeof *grown);
+    if (!grown)
+        return;
 
-    for (line_cache_t *c = cache_head; c; c = c->next) {
-        if (strcmp(c->path, path) == 0) {
-            return c->lines[lineno - 1]; // lineno is 1-based
+    for (size_t i = 0; i < buckets_count; ++i) {
+        line_cache_entry_t *e = buckets[i];
+        while (e) {
+            line_cache_entry_t *next = e->next;
+            size_t b = e->hash & (new_count - 1);
+            e->next = grown[b];
+            grown[b] = e;
+            e = next;
         }
     }
 
-    FILE *fp = fopen(path, "r");
-    if (!fp)
+    free(buckets);
+    buckets = grown;
+    buckets_count = new_count;
+}
+
+static line_cache_entry_t *entry_find(const char *path, uint64_t hash) {
+    if (!buckets_count)
         return NULL;
+    for (line_cache_entry_t *e = buckets[hash & (buckets_count - 1)]; e;
+         e = e->next) {
+        if (e->hash == hash && strcmp(e->path, path) == 0)
+            return e;
+    }
+    return NULL;
+}
 
-    line_cache_t *c = malloc(sizeof *c);
-    c->path = strdup(path);
-    c->lines = NULL;
-    c->next = cache_head;
-    cache_head = c;
+void line_cache_invalidate(const char *path) {
+    if (!buckets_count)
+        return;
 
-    size_t cap = 0, n = 0;
-    char *line = NULL;
-    size_t len = 0;
+    uint64_t hash = path_hash(path);
+    line_cache_entry_t **link = &buckets[hash & (buckets_count - 1)];
+    while (*link) {
+        line_cache_entry_t *e = *link;
+        if (e->hash == hash && strcmp(e->path, path) == 0) {
+            *link = e->next;
+            if (last_entry == e)
+                last_entry = NULL;
+            entry_free(e);
+            entries_count--;
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+static line_cache_entry_t *entry_get(const char *path) {
+    line_cache_entry_t *e = NULL;
+    uint64_t hash = 0;
+    if (last_entry && strcmp(last_entry->path, path) == 0) {
+        e = last_entry;
+    } else {
+        hash = path_hash(path);
+        e = entry_find(path, hash);
+    }
+
+    if (e && entry_stale(e)) {
+        LOG("'%s' changed on disk, reading it again.", path);
+        line_cache_invalidate(path);
+        e = NULL;
+    }
+    if (e) {
+        last_entry = e;
+        return e;
+    }
+    if (!hash)
+        hash = path_hash(path);
+
+    if (entries_count >= buckets_count)
+        buckets_grow();
+    if (!buckets_count)
+        return NULL;
+
+    e = calloc(1, sizeof *e);
+    if (!e)
+        return NULL;
+    e->path = strdup(path);
+    if (!e->path) {
+        free(e);
+        return NULL;
+    }
+    e->hash = hash;
+    e->checked_ns = monotonic_nanos();
+
+    // Unreadable files are remembered too, so that they are not reopened
+    // for every executed line
+    entry_read(e);
+
+    size_t b = hash & (buckets_count - 1);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entries_count++;
+
+    last_entry = e;
+    return e;
+}
+
+const char *get_line_text(const char *path, int lineno, size_t *len) {
+    line_cache_entry_t *e = entry_get(path);
+    if (!e || lineno <= 0 || (size_t)lineno > e->lines_count)
+        return NULL;
+
+    size_t start = e->offsets[lineno - 1];
+    size_t end = e->offsets[lineno];
+    while (end > start &&
+           (e->data[end - 1] == '\n' || e->data[end - 1] == '\r'))
+        end--;
+
+    if (len)
+        *len = end - start;
+    return e->data + start;
+}
 
-    while (getline(&line, &len, fp) > 0) {
-        if (n == cap) {
-            cap = cap ? cap * 2 : 128;
-            c->lines = realloc(c->lines, sizeof(char *) * (cap + 1));
+void line_cache_free(void) {
+    for (size_t i = 0; i < buckets_count; ++i) {
+        line_cache_entry_t *e = buckets[i];
+        while (e) {
+            line_cache_entry_t *next = e->next;
+            entry_free(e);
+            e = next;
         }
-        c->lines[n++] = strdup(line);
+        buckets[i] = NULL;
     }
-    free(line);
-    c->lines[n] = NULL;
-    fclose(fp);
+    entries_count = 0;
+    last_entry = NULL;
 
-    return (lineno > 0 && lineno <= (int)n) ? c->lines[lineno - 1] : NULL;
+    free(buckets);
+    buckets = NULL;
+    buckets_count = 0;
 }
@@ -5,14 +5,99 @@
 #include "util/da.h"
 #include "util/string.h"
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Direct-mapped cache of whitelist decisions, indexed by the address of the
+// source string of the running chunk. Every entry keeps the function it was
+// filled for referenced, and with it the source string: no other source can
+// show up at that address while the entry exists, so a hit only compares the
+// pointer and the length.
+#define SOURCE_CACHE_SIZE 256
+
+typedef struct {
+    const char *source;
+    size_t srclen;
+    int ref; // of the function that keeps 'source' alive, LUA_NOREF if none
+    bool allowed;
+} source_cache_entry_t;
+
+static source_cache_entry_t source_cache[SOURCE_CACHE_SIZE];
+
 static da_t *lua_call_hooks = NULL;
 static da_t *lua_ret_hooks = NULL;
 static da_t *lua_line_hooks = NULL;
 static da_t *lua_tail_hooks = NULL;
 static da_t *_file_whitelist = NULL;
+static lua_State *hooked_L = NULL;
+
+// Indexed by LUA_HOOK* event, see lua_hooks_add_unfiltered()
+static da_t *lua_unfiltered_hooks[LUA_HOOKTAILCALL + 1];
+static int hook_count = 1000;
+
+static bool source_allowed(const char *src) {
+    size_t whitelist_count = da_size(_file_whitelist);
+    for (size_t i = 0; i < whitelist_count; ++i) {
+        char **file = da_get(_file_whitelist, i);
+        if (file && *file && string_has_prefix(src, *file)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool source_allowed_cached(lua_State *L, lua_Debug *ar,
+                                  const char *src) {
+    size_t slot = ((uintptr_t)ar->source >> 4) & (SOURCE_CACHE_SIZE - 1);
+    source_cache_entry_t *entry = &source_cache[slot];
+
+    if (entry->ref != LUA_NOREF && entry->source == ar->source &&
+        entry->srclen == ar->srclen)
+        return entry->allowed;
+
+    bool allowed = source_allowed(src);
+
+    // "f" pushes the running function, whose prototype holds the source
+    if (!lua_getinfo(L, "f", ar))
+        return allowed;
+    luaL_unref(L, LUA_REGISTRYINDEX, entry->ref);
+    entry->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    entry->source = ar->source;
+    entry->srclen = ar->srclen;
+    entry->allowed = allowed;
+    return allowed;
+}
+
+// 'L' is NULL if the entries belong to a state that is gone
+static void source_cache_clear(lua_State *L) {
+    for (size_t i = 0; i < SOURCE_CACHE_SIZE; ++i) {
+        if (L)
+            luaL_unref(L, LUA_REGISTRYINDEX, source_cache[i].ref);
+        source_cache[i] = (source_cache_entry_t){.ref = LUA_NOREF};
+    }
+}
+
+static void run_hooks(da_t *hooks, lua_State *L, lua_Debug *ar,
+                      const char *src) {
+    size_t size = da_size(hooks);
+    for (size_t i = 0; i < size; ++i) {
+        lua_hook_fn *fn = da_get(hooks, i);
+        if (fn && *fn) {
+            (*fn)(L, ar, src);
+        }
+    }
+}
 
 static void master_hook(lua_State *L, lua_Debug *ar) {
-    if (!lua_getinfo(L, "Sl", ar)) {
+    // Count events only exist for unfiltered hooks and need no source
+    if (ar->event == LUA_HOOKCOUNT) {
+        run_hooks(lua_unfiltered_hooks[LUA_HOOKCOUNT], L, ar, NULL);
+        return;
+    }
+
+    // Line events already carry 'currentline', "l" is not needed here
+    if (!lua_getinfo(L, "S", ar)) {
         return;
     }
 
@@ -20,16 +105,10 @@ static void master_hook(lua_State *L, lua_Debug *ar) {
     if (src[0] == '@')
         src++;
 
-    size_t whitelist_count = da_size(_file_whitelist);
-    bool found = false;
-    for (size_t i = 0; i < whitelist_count; ++i) {
-        char **file = da_get(_file_whitelist, i);
-        if (file && *file && string_has_prefix(src, *file)) {
-            found = true;
-            break;
-        }
-    }
-    if (!found)
+    if (ar->event >= 0 && ar->event <= LUA_HOOKTAILCALL)
+        run_hooks(lua_unfiltered_hooks[ar->event], L, ar, src);
+
+    if (!source_allowed_cached(L, ar, src))
         return;
 
     da_t *hooks;
@@ -52,38 +131,94 @@ static void master_hook(lua_State *L, lua_Debug *ar) {
     default:
         return;
     }
+    run_hooks(hooks, L, ar, src);
+}
+
+// Only ask Lua for the events somebody listens to: without a line hook the
+// interpreter does not stop on every executed line at all
+static void update_hook_mask(void) {
+    if (!hooked_L)
+        return;
+
+    da_t **unfiltered = lua_unfiltered_hooks;
+
+    int mask = 0;
+    // Tail calls are reported with call events
+    if (da_size(lua_call_hooks) || da_size(lua_tail_hooks) ||
+        da_size(unfiltered[LUA_HOOKCALL]) ||
+        da_size(unfiltered[LUA_HOOKTAILCALL]))
+        mask |= LUA_MASKCALL;
+    if (da_size(lua_ret_hooks) || da_size(unfiltered[LUA_HOOKRET]))
+        mask |= LUA_MASKRET;
+    if (da_size(lua_line_hooks) || da_size(unfiltered[LUA_HOOKLINE]))
+        mask |= LUA_MASKLINE;
+    if (da_size(unfiltered[LUA_HOOKCOUNT]))
+        mask |= LUA_MASKCOUNT;
+
+    lua_sethook(hooked_L, mask ? master_hook : NULL, mask,
+                (mask & LUA_MASKCOUNT) ? hook_count : 0);
+}
+
+static da_t *hooks_for_type(int type) {
+    switch (type) {
+    case LUA_HOOKCALL:
+        return lua_call_hooks;
+    case LUA_HOOKRET:
+        return lua_ret_hooks;
+    case LUA_HOOKTAILCALL:
+        return lua_tail_hooks;
+    case LUA_HOOKLINE:
+        return lua_line_hooks;
+    default:
+        return NULL;
+    }
+}
+
+static void hooks_remove(da_t *hooks, lua_hook_fn fn) {
     size_t size = da_size(hooks);
     for (size_t i = 0; i < size; ++i) {
-        lua_hook_fn *fn = da_get(hooks, i);
-        if (fn && *fn) {
-            (*fn)(L, ar, src);
+        lua_hook_fn *registered = da_get(hooks, i);
+        if (registered && *registered == fn) {
+            da_remove(hooks, i);
+            break;
         }
     }
 }
 
-void lua_hooks_add(int type, lua_hook_fn fn) {
-    switch (type) {
-    case LUA_HOOKCALL: {
-        da_append(lua_call_hooks, &fn);
-        break;
-    }
-    case LUA_HOOKRET: {
-        da_append(lua_ret_hooks, &fn);
-        break;
-    }
-    case LUA_HOOKTAILCALL: {
-        da_append(lua_tail_hooks, &fn);
-        break;
-    }
-    case LUA_HOOKLINE: {
-        da_append(lua_line_hooks, &fn);
-        break;
-    }
-    default: {
+void lua_hooks_remove(int type, lua_hook_fn fn) {
+    hooks_remove(hooks_for_type(type), fn);
+    update_hook_mask();
+}
+
+void lua_hooks_add_unfiltered(int type, lua_hook_fn fn) {
+    if (type < 0 || type > LUA_HOOKTAILCALL) {
         LOG("Unknown hook type %d, cannot register.", type);
         return;
     }
+    da_append(lua_unfiltered_hooks[type], &fn);
+    update_hook_mask();
+}
+
+void lua_hooks_remove_unfiltered(int type, lua_hook_fn fn) {
+    if (type < 0 || type > LUA_HOOKTAILCALL)
+        return;
+    hooks_remove(lua_unfiltered_hooks[type], fn);
+    update_hook_mask();
+}
+
+void lua_hooks_set_count(int count) {
+    hook_count = count > 0 ? count : 1;
+    update_hook_mask();
+}
+
+void lua_hooks_add(int type, lua_hook_fn fn) {
+    da_t *hooks = hooks_for_type(type);
+    if (!hooks) {
+        LOG("Unknown hook type %d, cannot register.", type);
+        return;
     }
+    da_append(hooks, &fn);
+    update_hook_mask();
 }
 
 void lua_hooks_init(lua_State *L, da_t *file_whitelist) {
@@ -92,15 +227,34 @@ void lua_hooks_init(lua_State *L, da_t *file_whitelist) {
     lua_ret_hooks = da_init(1, sizeof(lua_hook_fn));
     lua_tail_hooks = da_init(1, sizeof(lua_hook_fn));
     lua_line_hooks = da_init(1, sizeof(lua_hook_fn));
+    for (int i = 0; i <= LUA_HOOKTAILCALL; ++i) {
+        lua_unfiltered_hooks[i] = da_init(1, sizeof(lua_hook_fn));
+    }
 
     _file_whitelist = file_whitelist;
+    source_cache_clear(NULL);
 
-    lua_sethook(L, master_hook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
+    // Nothing is hooked until the first lua_hooks_add()
+    hooked_L = L;
+    update_hook_mask();
 }
 
 void lua_hooks_deinit() {
+    if (hooked_L) {
+        lua_sethook(hooked_L, NULL, 0, 0);
+        source_cache_clear(hooked_L);
+        hooked_L = NULL;
+    }
     da_free(lua_call_hooks);
     da_free(lua_ret_hooks);
     da_free(lua_tail_hooks);
     da_free(lua_line_hooks);
+    lua_call_hooks = NULL;
+    lua_ret_hooks = NULL;
+    lua_tail_hooks = NULL;
+    lua_line_hooks = NULL;
+    for (int i = 0; i <= LUA_HOOKTAILCALL; ++i) {
+        da_free(lua_unfiltered_hooks[i]);
+        lua_unfiltered_hooks[i] = NULL;
+    }
 }
@@ -1,6 +1,7 @@
 #include "util/string.h"
 
 #include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -97,25 +98,23 @@ size_t *string_wrapped_lines(const char *text, size_t max_len, size_t *count) {
 }
 
 char *string_strip(const char *s) {
+    if (!s)
+        return NULL;
+    return string_strip_len(s, strlen(s));
+}
+
+char *string_strip_len(const char *s, size_t s_len) {
     if (!s)
         return NULL;
 
     const char *start = s;
-    while (*start && isspace((unsigned char)*start))
+    const char *end = s + s_len;
+    while (start < end && isspace((unsigned char)*start))
         ++start;
-
-    if (*start == '\0') {
-        char *out = malloc(1);
-        if (out)
-            *out = '\0';
-        return out;
-    }
-
-    const char *end = start + strlen(start) - 1;
-    while (end > start && isspace((unsigned char)*end))
+    while (end > start && isspace((unsigned char)end[-1]))
         --end;
 
-    size_t len = (size_t)(end - start + 1);
+    size_t len = (size_t)(end - start);
     char *out = malloc(len + 1);
     if (!out)
         return NULL;
@@ -161,3 +160,20 @@ bool string_has_prefix(const char *str, const char *prefix) {
     }
     return strncasecmp(prefix, str, strlen(prefix)) == 0;
 }
+
+void string_format_bytes(size_t bytes, char *buf, size_t buf_len) {
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+
+    if (bytes < 1024) {
+        snprintf(buf, buf_len, "%zu B", bytes);
+        return;
+    }
+
+    double value = (double)bytes;
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        unit++;
+    }
+    snprintf(buf, buf_len, "%.1f %s", value, units[unit]);
+}
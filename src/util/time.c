@@ -1,6 +1,10 @@
 #include "util/time.h"
 
+#include <limits.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
 
 // WINDOWS
 #if defined(_WIN32) || defined(_WIN64)
@@ -24,6 +28,13 @@ uint64_t millis_since_start(void) {
                       freq.QuadPart);
 }
 
+uint64_t monotonic_nanos(void) {
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
 #else // POSIX
 
 #include <time.h>
@@ -78,10 +89,74 @@ unsigned long millis_since_ltf_start(void) {
     /* convert to milliseconds */
     return (unsigned long)ds * 1000ULL + (unsigned long)(dns / 1000000L);
 }
+
+uint64_t monotonic_nanos(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
 #endif
 
+unsigned int millis_until(uint64_t deadline_ns) {
+    uint64_t now = monotonic_nanos();
+    if (now >= deadline_ns)
+        return 0;
+    uint64_t ms = (deadline_ns - now + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : (unsigned int)ms;
+}
+
 void get_date_time_now(char buf[TS_LEN]) {
     time_t raw = time(NULL);
     struct tm *tmnow = localtime(&raw);
     strftime(buf, TS_LEN, "%m.%d.%y-%H:%M:%S", tmnow);
 }
+
+// Wall clock minus monotonic clock, in nanoseconds
+static int64_t monotonic_to_wall_offset(void) {
+    static bool known = false;
+    static int64_t offset = 0;
+
+    if (!known) {
+        struct timespec wall;
+        timespec_get(&wall, TIME_UTC);
+        uint64_t mono = monotonic_nanos();
+        offset = (int64_t)wall.tv_sec * 1000000000LL + (int64_t)wall.tv_nsec -
+                 (int64_t)mono;
+        known = true;
+    }
+    return offset;
+}
+
+void monotonic_to_date_time(uint64_t ns, char buf[TS_LEN]) {
+    int64_t wall_ns = monotonic_to_epoch_nanos(ns);
+    time_t raw = (time_t)(wall_ns / 1000000000LL);
+    struct tm *tm = localtime(&raw);
+    if (!tm || !strftime(buf, TS_LEN, "%m.%d.%y-%H:%M:%S", tm))
+        buf[0] = '\0';
+}
+
+int64_t monotonic_to_epoch_nanos(uint64_t ns) {
+    return (int64_t)(ns + (uint64_t)monotonic_to_wall_offset());
+}
+
+uint64_t epoch_nanos_to_monotonic(int64_t epoch_ns) {
+    uint64_t ns = (uint64_t)epoch_ns - (uint64_t)monotonic_to_wall_offset();
+    return ns ? ns : 1;
+}
+
+uint64_t date_time_to_monotonic(const char *str) {
+    struct tm tm = {0};
+    if (!str || sscanf(str, "%d.%d.%d-%d:%d:%d", &tm.tm_mon, &tm.tm_mday,
+                       &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return 0;
+
+    tm.tm_mon -= 1;
+    tm.tm_year += 100; // two digit year, since 2000
+    tm.tm_isdst = -1;
+    time_t raw = mktime(&tm);
+    if (raw == (time_t)-1)
+        return 0;
+
+    return epoch_nanos_to_monotonic((int64_t)raw * 1000000000LL);
+}